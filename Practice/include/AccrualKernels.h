@@ -0,0 +1,15 @@
+#pragma once
+#include "FixedPoint.h"
+#include <cstddef>
+#include <cstdint>
+
+// Rates of the accrual kernel are billionths per period (1000000000 = 100%)
+static constexpr uint32_t accrualRateScale = 1000000000;
+
+// accruals[i] = floor(balances[i] * rate / accrualRateScale) for count balances, exact for every balance in
+// [0, 2^63) and rate <= accrualRateScale; the remainders of the divisions (the fractions rounded off, in billionths
+// of a unit) are added to remainderSum. Uses AVX2 when allowed and the CPU has AVX2, a scalar loop otherwise.
+void accrueInterest(const Amount* balances, uint32_t rate, Amount* accruals, size_t count, uint64_t& remainderSum, bool allowSimd = true);
+
+// Name of the kernel accrueInterest uses ("AVX2" or "scalar")
+const char* accrueInterestKernel(bool allowSimd = true);
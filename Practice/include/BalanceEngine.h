@@ -0,0 +1,330 @@
+#pragma once
+#include "SQLData.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Interns names (accounts, assets) to small dense integer IDs. Thread-safe: lookups take a shared lock
+// on one of 64 shards, so sessions resolving different names do not contend.
+class IdRegistry
+{
+private:
+    static constexpr size_t shardCount = 64;
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;                // Guards ids
+        std::unordered_map<std::string, uint32_t> ids;  // name -> ID
+    };
+
+    Shard shards[shardCount];         // name -> ID, sharded by name hash
+    mutable std::mutex namesMutex;    // Guards names
+    std::deque<std::string> names;    // ID -> name
+
+    // Method to pick the shard of a name
+    Shard& shardOf(const std::string& name) { return shards[std::hash<std::string>()(name) & (shardCount - 1)]; }
+    const Shard& shardOf(const std::string& name) const { return shards[std::hash<std::string>()(name) & (shardCount - 1)]; }
+
+public:
+    static constexpr uint32_t invalidId = 0xFFFFFFFFu;
+
+    // Method to get the ID of a name, registering it if needed
+    uint32_t intern(const std::string& name);
+
+    // Method to get the ID of a name without registering it (returns invalidId if unknown)
+    uint32_t find(const std::string& name) const;
+
+    // Method to get the name of an ID
+    std::string name(uint32_t id) const;
+
+    // Method to get the number of registered names
+    size_t size() const;
+};
+
+// Open-addressing (linear probing) hash table from a packed (account, asset) key to a fixed-point amount.
+// Slots are 16 bytes in one contiguous array, so a lookup is usually a single cache line.
+class BalanceTable
+{
+public:
+    struct Slot
+    {
+        uint64_t key;   // (account << 32) | asset, emptyKey when unused
+        Amount amount;  // Current balance
+    };
+
+    static constexpr uint64_t emptyKey = ~0ull;
+
+    // Constructor that allocates a power-of-two number of slots
+    explicit BalanceTable(size_t initialCapacity = 1024);
+
+    // Method to pack an account and an asset into a key
+    static uint64_t makeKey(uint32_t account, uint32_t asset) { return (static_cast<uint64_t>(account) << 32) | asset; }
+
+    // Method to find a balance (returns nullptr if the key was never written)
+    const Amount* find(uint64_t key) const
+    {
+        size_t index = hash(key) & mask;
+        for (;;)
+        {
+            const Slot& slot = slots[index];
+            if (slot.key == key)
+                return &slot.amount;
+            if (slot.key == emptyKey)
+                return nullptr;
+            index = (index + 1) & mask;
+        }
+    }
+
+    // Method to find a balance for writing (returns nullptr if the key was never written)
+    Amount* find(uint64_t key)
+    {
+        return const_cast<Amount*>(static_cast<const BalanceTable*>(this)->find(key));
+    }
+
+    // Method to find a balance, inserting a zero balance if the key is new.
+    // The pointer stays valid until the table grows, call reserve first when holding several pointers.
+    Amount* findOrInsert(uint64_t key)
+    {
+        size_t index = hash(key) & mask;
+        for (;;)
+        {
+            Slot& slot = slots[index];
+            if (slot.key == key)
+                return &slot.amount;
+            if (slot.key == emptyKey)
+            {
+                slot.key = key;
+                slot.amount = 0;
+                ++count;
+                return &slot.amount;
+            }
+            index = (index + 1) & mask;
+        }
+    }
+
+    // Method to make room for extra new keys without exceeding a 50% load factor
+    void reserve(size_t extra);
+
+    // Method to get the number of stored balances
+    size_t size() const { return count; }
+
+    // Method to get the memory used by the slot array in bytes
+    size_t memoryBytes() const { return slots.size() * sizeof(Slot); }
+
+    // Method to visit every stored balance
+    template <typename Visitor>
+    void forEach(Visitor&& visit) const
+    {
+        for (const auto& slot : slots)
+        {
+            if (slot.key != emptyKey)
+                visit(slot.key, slot.amount);
+        }
+    }
+
+    // Method to visit every stored balance with write access to its amount
+    template <typename Visitor>
+    void forEachAmount(Visitor&& visit)
+    {
+        for (auto& slot : slots)
+        {
+            if (slot.key != emptyKey)
+                visit(slot.key, slot.amount);
+        }
+    }
+
+private:
+    std::vector<Slot> slots;  // Slot array (size is a power of two)
+    size_t mask;              // slots.size() - 1
+    size_t count;             // Number of used slots
+
+public:
+    // Finalizer of MurmurHash3, spreads sequential IDs over the table
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+// One leg of a transaction in interned form
+struct EnginePosting
+{
+    uint32_t account;  // Interned account ID
+    uint32_t asset;    // Interned asset ID
+    Amount amount;     // Signed fixed-point change
+};
+
+// Authoritative in-memory balances of every account. Mutations are applied here first (all-or-nothing,
+// no user balance may go negative) and persisted afterwards by the JournalPersister.
+// Thread-safe through lock striping: every account belongs to one of stripeCount stripes, each with its own
+// mutex and table. A transaction locks the stripes of its accounts in ascending order (no deadlocks),
+// so transfers between unrelated accounts run in parallel.
+// Hot accounts (omnibus and fee accounts credited by almost every trade) can be split: their credits, and every
+// posting of a hot system account, go to one of hotShardCount sub-balances picked by the calling thread, each with
+// its own lock, so threads paying into the same account do not wait for each other. A user debit of a hot account
+// locks its stripe and every sub-balance and folds them in first, so it is checked against the whole balance.
+// Reads sum the parts; the aggregator thread folds the sub-balances into the stripes periodically. Sub-balance
+// locks come after every stripe in the lock order.
+class BalanceEngine
+{
+public:
+    static constexpr uint32_t systemBit = 0x80000000u; // Set in the IDs of '@' accounts, which may go negative
+    static constexpr size_t stripeCount = 1024;        // Number of lock stripes (power of two)
+    static constexpr size_t hotShardCount = 32;        // Sub-balances of a hot account
+    static constexpr size_t maxHotAccounts = 64;       // Accounts that can be split
+
+private:
+    // One lock stripe: the balances of all accounts hashed to it
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;    // Guards table
+        BalanceTable table;  // (account, asset) -> amount
+
+        Stripe() : table(16) {}
+    };
+
+    IdRegistry accounts;      // Account names (user IDs and '@' system accounts)
+    IdRegistry assets;        // Asset keys (name and book: a name held in COINS and in BALANCE is two assets)
+    std::unique_ptr<Stripe[]> stripes; // Lock stripes
+    mutable std::mutex booksMutex;     // Guards assetBook and assetNames
+    std::vector<SQLData::DataBaseState> assetBook; // Per asset ID: the balance table it lives in
+    std::vector<std::string> assetNames;           // Per asset ID: the coin or currency name
+
+    // Method to build the registry key of an asset in a book
+    static std::string assetKey(const std::string& asset, SQLData::DataBaseState book)
+    {
+        return asset + '\x1f' + static_cast<char>('0' + static_cast<int>(book));
+    }
+
+    std::unique_ptr<Stripe[]> hotShards;     // Sub-balances, hotShardCount per hot account (same layout as a stripe)
+    uint32_t hotIds[maxHotAccounts];         // Hot account IDs (an entry is written before hotCount covers it)
+    std::atomic<size_t> hotCount;            // Number of hot accounts (they are never unsplit)
+    std::mutex hotMutex;                     // Serializes markHot
+
+    std::thread aggregator;                  // Periodic folding of the sub-balances
+    std::mutex aggregatorMutex;              // Guards aggregating
+    std::condition_variable wakeAggregator;  // Signalled on stop
+    bool aggregating;                        // Flag to check if the aggregator should keep running
+
+    // Method to get the stripe of an account
+    size_t stripeOf(uint32_t account) const { return BalanceTable::hash(account) & (stripeCount - 1); }
+
+    // Method to get the lock of a stripe (index < stripeCount) or of a sub-balance (the ones after)
+    Stripe& lockTarget(size_t index) const { return index < stripeCount ? stripes[index] : hotShards[index - stripeCount]; }
+
+    // Method to get the lock index of a sub-balance of the hot-th hot account
+    static size_t hotLock(size_t hot, size_t shard) { return stripeCount + hot * hotShardCount + shard; }
+
+    // Method to get the sub-balance of the calling thread (threads are spread over the sub-balances in turn)
+    static size_t threadShard();
+
+    // Method to sum the balances of a hot account per asset, with its stripe and every sub-balance locked
+    void hotBalances(size_t hot, std::vector<std::pair<uint32_t, Amount>>& perAsset) const;
+
+public:
+    // Constructor that sizes the stripes for the expected number of balances
+    explicit BalanceEngine(size_t expectedBalances = 1024);
+
+    // Destructor that stops the aggregator
+    ~BalanceEngine();
+
+    // Method to rebuild all balances from COINS, BALANCE and the journal (used at startup)
+    bool load(SQLData& sqlData);
+
+    // Methods to intern names
+    uint32_t accountId(const std::string& userID);
+    uint32_t assetId(const std::string& asset, SQLData::DataBaseState book);
+
+    // Methods to get names back from IDs
+    std::string accountName(uint32_t account) const { return accounts.name(account & ~systemBit); }
+    std::string assetName(uint32_t asset) const;
+    SQLData::DataBaseState bookOf(uint32_t asset) const;
+
+    // Method to check if an account ID belongs to a system account
+    static bool isSystem(uint32_t account) { return (account & systemBit) != 0; }
+
+    // Method to apply interned postings atomically (returns false and changes nothing on insufficient funds).
+    // whileLocked runs after a successful apply, before the stripes are released (used to queue the journal
+    // entry in the same order the transactions were applied to each account).
+    bool apply(const EnginePosting* postings, size_t count, const std::function<void()>& whileLocked = nullptr);
+
+    // Method to apply ledger postings (interns the names first)
+    bool apply(const std::vector<SQLData::Posting>& postings, const std::function<void()>& whileLocked = nullptr);
+
+    // Method to split an account into sub-balances (false once maxHotAccounts are split)
+    bool markHot(const std::string& userID);
+
+    // Method to get the position of a split account (-1 if it is not split)
+    int hotIndexOf(uint32_t account) const
+    {
+        size_t hots = hotCount.load(std::memory_order_acquire);
+        for (size_t i = 0; i < hots; ++i)
+        {
+            if (hotIds[i] == account)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Method to fold every sub-balance into its account's stripe; returns the number of amounts moved
+    size_t aggregateHot();
+
+    // Methods to fold the sub-balances every intervalMillis on a background thread, and to stop it
+    void startAggregation(int64_t intervalMillis = 1000);
+    void stopAggregation();
+
+    // Method to get a balance (0 if the account never held the asset)
+    Amount balance(uint32_t account, uint32_t asset) const;
+    Amount balance(const std::string& userID, const std::string& asset, SQLData::DataBaseState book) const;
+
+    // Method to get the number of stored balances
+    size_t size() const;
+
+    // Method to get the memory used by the balance tables in bytes
+    size_t memoryBytes() const;
+
+    // Method to visit every balance as (account ID, asset ID, amount), one stripe at a time (a split account
+    // once, with its sub-balances summed, after the stripes)
+    template <typename Visitor>
+    void forEach(Visitor&& visit) const
+    {
+        size_t hots = hotCount.load(std::memory_order_acquire);
+        for (size_t i = 0; i < stripeCount; ++i)
+        {
+            std::lock_guard<std::mutex> lock(stripes[i].mutex);
+            stripes[i].table.forEach([&](uint64_t key, Amount amount)
+                {
+                    uint32_t account = static_cast<uint32_t>(key >> 32);
+                    int hot = hots == 0 ? -1 : hotIndexOf(account);
+                    if (hot < 0 || static_cast<size_t>(hot) >= hots)
+                    {
+                        visit(account, static_cast<uint32_t>(key & 0xFFFFFFFFu), amount);
+                    }
+                });
+        }
+
+        std::vector<std::pair<uint32_t, Amount>> perAsset;
+        for (size_t hot = 0; hot < hots; ++hot)
+        {
+            hotBalances(hot, perAsset);
+            for (const auto& balance : perAsset)
+            {
+                visit(hotIds[hot], balance.first, balance.second);
+            }
+        }
+    }
+};
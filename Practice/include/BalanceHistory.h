@@ -0,0 +1,77 @@
+#pragma once
+#include "SQLData.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One balance of an account at a point in time
+struct AsOfBalance
+{
+    std::string asset;            // Coin or currency
+    SQLData::DataBaseState book;  // COINS or BALANCE
+    Amount amount;                // Fixed-point balance
+};
+
+// How an as-of query was answered
+struct AsOfInfo
+{
+    sqlite3_int64 throughTxID = 0;     // Newest transaction included (the journal as it stood at the time asked)
+    sqlite3_int64 checkpointTxID = 0;  // Checkpoint the query started from (0 = the empty ledger)
+    uint64_t deltaPostings = 0;        // Postings of the account applied on top of the checkpoint
+    int timeLookups = 0;               // Transactions read to find throughTxID
+};
+
+// Point-in-time balances (what did an account hold at time T). Every intervalPostings postings of the journal a
+// checkpoint stores the new amount of each balance those postings changed (BALANCE_CHECKPOINTS), so a checkpoint
+// costs its interval, not the whole ledger. A query finds the newest checkpoint taken by T, binary-searches the
+// transaction recorded last by T between that checkpoint and the next one, reads the account's balances at the
+// checkpoint (one index seek per asset) and adds its postings between the two. Everything it reads is bounded by
+// one checkpoint interval, so the query costs the same for last year as for a minute ago.
+// The journal is appended in time order (writer threads can swap transactions a few milliseconds apart), so the
+// state at T is the journal through the last transaction recorded at or before T.
+// Thread-safe. The worker writes the checkpoints in the background; checkpoint() can also be called directly.
+class BalanceHistory
+{
+public:
+    static constexpr uint64_t defaultInterval = 100000; // Postings between two checkpoints
+
+private:
+    std::string dbName;                 // Database of the ledger
+    const char* vfsName;                // VFS of that database
+    uint64_t intervalPostings;          // Postings between two checkpoints
+    SQLData storage;                    // History's connection (CHECKPOINTS, BALANCE_CHECKPOINTS)
+    std::mutex mutex;                   // Guards storage, running and stopping
+
+    std::thread worker;                 // Background checkpoint writer
+    std::condition_variable wakeWorker; // Signalled on stop
+    bool running;                       // Flag to check if the worker should keep running
+    bool stopping;                      // Set by stop(): a catch-up in progress ends after its current checkpoint
+
+    // Method to open the connection and create the tables (mutex held)
+    bool openLocked();
+
+    // Worker loop
+    void run(int64_t pollMillis);
+
+public:
+    // Constructor that attaches the history to the ledger's database
+    BalanceHistory(SQLData& sqlData, uint64_t intervalPostings = defaultInterval);
+
+    // Destructor that stops the worker and closes the connection
+    ~BalanceHistory();
+
+    // Method to write a checkpoint for every full interval of the journal not covered yet; returns how many were written
+    size_t checkpoint();
+
+    // Method to get every balance of an account at timeMillis (Unix milliseconds); zero balances are left out
+    bool balancesAt(const std::string& userID, int64_t timeMillis, std::vector<AsOfBalance>& balances, AsOfInfo* info = nullptr);
+
+    // Method to get one balance of an account at timeMillis
+    bool balanceAt(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, int64_t timeMillis, Amount& amount);
+
+    // Methods to write the checkpoints in the background every pollMillis, and to stop it
+    bool start(int64_t pollMillis = 60000);
+    void stop();
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+
+// Runs the benchmark with the given name and prints the results to the console.
+// Started from the command line with: Practice.exe --bench <name>
+// Returns the process exit code (0 on success, 1 if the benchmark is unknown or failed).
+int runBenchmark(const std::string& name);
@@ -0,0 +1,99 @@
+#pragma once
+#include "Ledger.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// Which accounts a bulk credit goes to
+enum class CreditTargets : uint8_t
+{
+    BT_AllAccounts,   // Every registered user
+    BT_Holders,       // Every account holding at least filterMinimum of filterAsset (base = the amount held)
+    BT_File           // One account per line of filePath: "userID" or "userID,amount" (base = the amount)
+};
+
+// A credit of one asset to many accounts: every target gets amount + base * rate, paid by the funding account
+struct BulkCreditJob
+{
+    std::string name;                        // Unique name; running a job again with the same name resumes it
+    CreditTargets targets = CreditTargets::BT_AllAccounts;
+    std::string asset;                       // Asset credited
+    SQLData::DataBaseState book = SQLData::DataBaseState::DBS_COINS; // Book of the asset
+    Amount amount = 0;                       // Fixed credit per account
+    Amount rate = 0;                         // Credit per unit of the base (fixed point: SCALE = 1.0, rounded down)
+    std::string funding = Ledger::externalAccount; // Account debited with each bucket's total
+    std::string filterAsset;                 // BT_Holders: asset held
+    SQLData::DataBaseState filterBook = SQLData::DataBaseState::DBS_COINS;
+    Amount filterMinimum = 1;                // BT_Holders: smallest holding that qualifies
+    std::string filePath;                    // BT_File: list of accounts
+    std::function<bool(const std::string& userID)> filter; // Optional extra filter (called from the workers, must be thread-safe)
+};
+
+// Progress of a bulk credit (counts include the runs before a resume)
+struct BulkCreditProgress
+{
+    size_t buckets = 0;         // Buckets of the job (one ledger transaction each)
+    size_t bucketsDone = 0;     // Buckets credited and recorded
+    uint64_t credited = 0;      // Accounts credited
+    Amount total = 0;           // Amount credited
+    uint64_t duplicates = 0;    // Buckets whose command ID the ledger had already applied, skipped
+    double elapsedMillis = 0.0; // Time of this run
+    bool finished = false;      // Every bucket is done
+};
+
+// Engine that credits an asset to millions of accounts (airdrops, interest, rebates).
+// The targets are hashed into buckets of about accountsPerBucket accounts; the number of buckets is fixed when
+// the job is created, so an account always lands in the same bucket. Worker threads build the buckets' postings
+// in parallel and apply each bucket as one transaction through the ledger (the persister writes a wave of
+// buckets in one database transaction). A bucket's BULK_CREDIT_BUCKETS row is written in the same database
+// transaction as its credits, so a job that was stopped or crashed, however long ago, resumes with exactly the
+// buckets not paid yet. Each bucket is also applied with a command ID derived from the job and the bucket.
+class BulkCredit
+{
+public:
+    using ProgressCallback = std::function<void(const BulkCreditProgress&)>;
+
+    static constexpr size_t accountsPerBucket = 2048;  // Target size of a bucket
+    static constexpr size_t sliceCount = 65536;        // Hash slices the targets are collected in (a bucket is a set of slices)
+
+private:
+    // Targets of one hash slice: names packed back to back ('\0'-terminated) and their base amounts
+    struct Slice
+    {
+        std::vector<char> names;
+        std::vector<Amount> bases;
+    };
+
+    Ledger& ledger;                      // Ledger the credits are applied to
+    std::string dbName;                  // Database of the ledger
+    const char* vfsName;                 // VFS of that database
+    SQLData storage;                     // Connection for the targets and the job records
+    size_t workerCount;                  // Threads building and applying buckets
+    std::mutex runMutex;                 // One job at a time
+    std::atomic<bool> stopRequested;     // Stop after the current wave
+
+    // Method to read the targets into hash slices (buckets already done are left out)
+    bool collect(const BulkCreditJob& job, size_t buckets, const std::vector<bool>& done, std::vector<Slice>& slices, size_t& targetCount);
+
+    // Method to build and apply one bucket; returns the ledger's answer (CS_Applied with no credits if it is empty)
+    CommandStatus creditBucket(const BulkCreditJob& job, sqlite3_int64 jobID, size_t bucket, size_t buckets, const std::vector<Slice>& slices,
+        uint64_t& credited, Amount& total);
+
+public:
+    // Constructor that attaches the engine to a ledger and its database (workers = 0: one per hardware thread;
+    // one when the ledger's balance engine is off, whose database path is single-threaded)
+    BulkCredit(Ledger& ledger, SQLData& sqlData, size_t workers = 0);
+
+    // Destructor that closes the connection
+    ~BulkCredit();
+
+    // Method to run a job, or resume it if a job with that name exists; reports progress after every wave.
+    // Returns true once every bucket is done (false on an error, or when stopped: running it again resumes).
+    bool run(const BulkCreditJob& job, const ProgressCallback& onProgress = nullptr);
+
+    // Method to stop the running job after its current wave (thread-safe)
+    void requestStop() { stopRequested = true; }
+
+    // Method to get the hash of an account name (stable across runs and platforms: FNV-1a)
+    static uint64_t hashOf(const char* userID);
+};
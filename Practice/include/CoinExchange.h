@@ -0,0 +1,64 @@
+#pragma once
+#include "Ledger.h"
+#include "OrderBook.h"
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+// Order books for every coin, settled through the ledger.
+// Funds of an order are moved into the owner's '@orderbook:' escrow account when it is placed (USD for bids, coins
+// for asks), every fill pays the seller and the buyer out of their escrow in one journaled transaction, and what is
+// left over goes back to the owner when the order completes or is canceled. The books are only kept in memory: the
+// escrow of orders lost in a crash is returned by Ledger::releaseStaleEscrow at the next start. Not thread-safe: call
+// from one thread (or from the business stage of the pipeline).
+class CoinExchange
+{
+private:
+    // One coin's book and the USD still held in escrow for its resting bids
+    struct Market
+    {
+        std::unique_ptr<OrderBook> book;
+        std::unordered_map<uint64_t, Amount> bidEscrow; // Order ID -> USD reserved and not yet paid
+    };
+
+    Ledger& ledger;                        // Ledger that settles the fills
+    IdRegistry owners;                     // User IDs <-> owner handles stored in the books
+    std::map<std::string, Market> markets; // Coin name -> market
+    std::vector<Fill> fills;               // Reused buffer for the fills of one order
+
+    // Method to move funds between a user and the escrow account (a reservation carries the order's command ID)
+    CommandStatus moveEscrow(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, Amount amount, bool intoEscrow,
+        CommandId commandId = 0);
+
+    // Method to settle the fills of one order (taker escrow is updated in place)
+    void settle(Market& market, const std::string& coinName, Amount& takerEscrow);
+
+    // Method to return the escrow of a canceled order
+    bool refund(Market& market, const std::string& coinName, uint64_t orderId, const CanceledOrder& canceled);
+
+public:
+    // Constructor that attaches the exchange to a ledger
+    explicit CoinExchange(Ledger& ledger);
+
+    // Destructor that cancels the open orders (the books are not persisted, their escrow must go back)
+    ~CoinExchange();
+
+    // Method to open a market for a coin (prices minPrice .. minPrice + (levelCount - 1) * tickSize, in USD)
+    bool addMarket(const std::string& coinName, Amount tickSize, Amount minPrice, uint32_t levelCount);
+
+    // Method to place a limit order (funds are reserved first; rejected if they are missing).
+    // The reservation is applied with the client command ID, so a retried order is only reported as a duplicate.
+    OrderResult placeLimit(const std::string& userID, const std::string& coinName, OrderSide side, Amount price, Amount quantity, CommandId commandId = 0);
+
+    // Method to place a market order (a buy reserves the quoted cost first; unmatched quantity is dropped)
+    OrderResult placeMarket(const std::string& userID, const std::string& coinName, OrderSide side, Amount quantity, CommandId commandId = 0);
+
+    // Method to cancel a resting order of the user (the reserved funds are returned)
+    bool cancel(const std::string& userID, const std::string& coinName, uint64_t orderId);
+
+    // Method to cancel every open order of every market
+    void cancelAll();
+
+    // Method to get the book of a coin (nullptr if there is no market)
+    const OrderBook* book(const std::string& coinName) const;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Client-chosen ID of one ledger mutation; a retry reuses it (0 = no ID, never deduplicated)
+using CommandId = uint64_t;
+
+// Outcome of a command
+enum class CommandStatus : uint8_t
+{
+    CS_Pending,   // Not processed yet (pipeline slots)
+    CS_Applied,   // Balances changed
+    CS_Rejected,  // Invalid or insufficient funds, nothing changed
+    CS_Duplicate  // The command ID was already applied, nothing changed again
+};
+
+// Bounded set of the command IDs applied during the last TTL.
+// The IDs are spread over shards by hash; every shard is an open-addressing table of the raw 64-bit IDs
+// (linear probing, 8 bytes per slot) plus a timer wheel: a ring of slices, each listing the IDs recorded
+// during its time slice. When the clock reaches a new slice, the slice that fell out of the TTL is emptied
+// and its IDs are erased from the table, so expiry costs nothing per lookup and the set stays bounded by
+// the rate of commands times the TTL. Expiry is lazy: a shard advances its wheel when it is accessed.
+// An ID is remembered for at least the TTL and at most the TTL plus one slice.
+class CommandWindow
+{
+public:
+    static constexpr size_t shardCount = 64;
+
+private:
+    // One independently locked part of the set
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;                            // Guards the shard (held while a command is applied)
+        std::vector<CommandId> slots;                // Open-addressing table (0 = empty slot)
+        size_t count = 0;                            // IDs in the table
+        std::vector<std::vector<CommandId>> wheel;   // IDs per time slice (ring of sliceCount + 1 slices)
+        int64_t newestSlice = INT64_MIN;             // Slice of the latest clock reading
+    };
+
+    Shard shards[shardCount];
+    int64_t ttlMillis;            // How long an ID is remembered
+    int64_t sliceMillis;          // Time covered by one wheel slice
+    size_t ringSize;              // Slices in the wheel (the TTL plus the slice still filling)
+
+    // Method to mix the bits of an ID (splitmix64 finalizer; client IDs may be sequential)
+    static uint64_t hashOf(CommandId id);
+
+    // Method to get the shard of a hash (top bits; the table uses the low ones)
+    Shard& shardOf(uint64_t hash) { return shards[hash >> 58]; }
+
+    // Methods on the open-addressing table of a shard (the shard must be locked)
+    static bool find(const Shard& shard, CommandId id, uint64_t hash);
+    static void insert(Shard& shard, CommandId id, uint64_t hash);
+    static void erase(Shard& shard, CommandId id, uint64_t hash);
+    static void grow(Shard& shard);
+
+    // Method to move a shard's wheel to the slice of nowMillis, expiring the slices that leave the TTL
+    void advance(Shard& shard, int64_t nowMillis);
+
+    // Method to add an ID recorded at recordedAt to a locked shard (skipped if it already expired)
+    void recordLocked(Shard& shard, CommandId id, uint64_t hash, int64_t recordedAt);
+
+public:
+    // Constructor that sets the TTL and how many slices the wheel cuts it into
+    explicit CommandWindow(int64_t ttl = 24 * 60 * 60 * 1000LL, size_t slices = 64);
+
+    // Method to run apply once per ID: returns CS_Duplicate without calling it if the ID is in the window,
+    // else calls it and records the ID only if it returned true (CS_Applied; false gives CS_Rejected, so a
+    // rejected command may be retried). The ID's shard stays locked during apply, so concurrent retries of
+    // the same command wait and then see it as a duplicate. ID 0 always runs apply.
+    template <typename Apply>
+    CommandStatus run(CommandId id, int64_t nowMillis, Apply&& apply)
+    {
+        if (id == 0)
+        {
+            return apply() ? CommandStatus::CS_Applied : CommandStatus::CS_Rejected;
+        }
+
+        uint64_t hash = hashOf(id);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        advance(shard, nowMillis);
+        if (find(shard, id, hash))
+        {
+            return CommandStatus::CS_Duplicate;
+        }
+        if (!apply())
+        {
+            return CommandStatus::CS_Rejected;
+        }
+        recordLocked(shard, id, hash, nowMillis);
+        return CommandStatus::CS_Applied;
+    }
+
+    // Method to check if an ID is in the window
+    bool contains(CommandId id, int64_t nowMillis);
+
+    // Method to add an ID applied at recordedAt (loading the persisted IDs); false if it is known or expired
+    bool record(CommandId id, int64_t recordedAt);
+
+    // Method to get the number of IDs remembered (expired slices not yet reached by the clock included)
+    size_t size();
+
+    // Method to get the heap memory used by the tables and the wheels
+    size_t memoryBytes();
+
+    // Method to get the TTL
+    int64_t ttl() const { return ttlMillis; }
+
+    // Method to make a random nonzero ID for a new client command
+    static CommandId newId();
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// Instruction set extensions of the CPU the program runs on (detected once, with CPUID)
+struct CpuFeatures
+{
+    bool sse41 = false;  // SSE4.1
+    bool avx2 = false;   // AVX2 with the YMM state enabled by the OS
+    bool fma = false;    // FMA3
+    bool sha = false;    // SHA extensions (SHA-NI)
+
+    // Method to get the features of this CPU
+    static const CpuFeatures& get();
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// Fixed-point amount with 8 decimal places (1 unit == 1e-8, the satoshi precision)
+using Amount = int64_t;
+
+// Exact fixed-point helpers shared by the ledger, the SQL functions and the batch engines
+struct FixedPoint
+{
+    static constexpr int64_t SCALE = 100000000; // Number of units in 1.0
+    static constexpr int DECIMALS = 8;          // Number of decimal places
+
+    // Converts a floating-point value to fixed point (rounded half away from zero)
+    static Amount fromDouble(double value)
+    {
+        return static_cast<Amount>(std::llround(value * static_cast<double>(SCALE)));
+    }
+
+    // Converts a fixed-point value back to floating point
+    static double toDouble(Amount value)
+    {
+        return static_cast<double>(value) / static_cast<double>(SCALE);
+    }
+
+    // Computes a * b / d with a 128-bit intermediate, rounded half away from zero.
+    // Returns false (and leaves out untouched) on division by zero or if the result does not fit in 64 bits.
+    static bool mulDiv(int64_t a, int64_t b, int64_t d, int64_t& out)
+    {
+        if (d == 0)
+        {
+            return false;
+        }
+
+        bool negative = (a < 0) != (b < 0);
+        if (d < 0)
+        {
+            negative = !negative;
+        }
+
+        uint64_t ua = magnitude(a);
+        uint64_t ub = magnitude(b);
+        uint64_t ud = magnitude(d);
+
+        uint64_t hi = 0;
+        uint64_t lo = mul128(ua, ub, hi);
+        if (hi >= ud)
+        {
+            return false; // Quotient would not fit in 64 bits
+        }
+
+        uint64_t remainder = 0;
+        uint64_t quotient = div128(hi, lo, ud, remainder);
+
+        // Round half away from zero (remainder >= d / 2, written without overflow)
+        if (remainder >= ud - remainder)
+        {
+            if (quotient == std::numeric_limits<uint64_t>::max())
+            {
+                return false;
+            }
+            ++quotient;
+        }
+
+        uint64_t limit = negative ? static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1 : static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        if (quotient > limit)
+        {
+            return false;
+        }
+
+        out = negative ? static_cast<int64_t>(0 - quotient) : static_cast<int64_t>(quotient);
+        return true;
+    }
+
+    // Computes a * b / d for non-negative values, rounded down (used where parts must never add up to more than the rounded whole)
+    static bool mulDivFloor(int64_t a, int64_t b, int64_t d, int64_t& out)
+    {
+        if (a < 0 || b < 0 || d <= 0)
+        {
+            return false;
+        }
+
+        uint64_t hi = 0;
+        uint64_t lo = mul128(static_cast<uint64_t>(a), static_cast<uint64_t>(b), hi);
+        if (hi >= static_cast<uint64_t>(d))
+        {
+            return false;
+        }
+
+        uint64_t remainder = 0;
+        uint64_t quotient = div128(hi, lo, static_cast<uint64_t>(d), remainder);
+        if (quotient > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+        {
+            return false;
+        }
+
+        out = static_cast<int64_t>(quotient);
+        return true;
+    }
+
+    // Multiplies two fixed-point values (e.g. an amount by a price)
+    static bool mul(Amount a, Amount b, Amount& out)
+    {
+        return mulDiv(a, b, SCALE, out);
+    }
+
+    // Divides two fixed-point values (e.g. a USD amount by a price)
+    static bool div(Amount a, Amount b, Amount& out)
+    {
+        return mulDiv(a, SCALE, b, out);
+    }
+
+    // Adds two amounts, returns false on overflow
+    static bool add(Amount a, Amount b, Amount& out)
+    {
+        if ((b > 0 && a > std::numeric_limits<Amount>::max() - b) ||
+            (b < 0 && a < std::numeric_limits<Amount>::min() - b))
+        {
+            return false;
+        }
+        out = a + b;
+        return true;
+    }
+
+private:
+    // Absolute value as unsigned (well defined for INT64_MIN)
+    static uint64_t magnitude(int64_t value)
+    {
+        return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    }
+
+    // Full 64x64 -> 128 bit multiplication, returns the low half and stores the high half
+    static uint64_t mul128(uint64_t a, uint64_t b, uint64_t& hi)
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        hi = static_cast<uint64_t>(product >> 64);
+        return static_cast<uint64_t>(product);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        return _umul128(a, b, &hi);
+#else
+        uint64_t aLo = a & 0xFFFFFFFFull, aHi = a >> 32;
+        uint64_t bLo = b & 0xFFFFFFFFull, bHi = b >> 32;
+        uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+        uint64_t middle = (ll >> 32) + (lh & 0xFFFFFFFFull) + (hl & 0xFFFFFFFFull);
+        hi = hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+        return (middle << 32) | (ll & 0xFFFFFFFFull);
+#endif
+    }
+
+    // 128 / 64 bit division (requires hi < d so the quotient fits in 64 bits)
+    static uint64_t div128(uint64_t hi, uint64_t lo, uint64_t d, uint64_t& remainder)
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 n = (static_cast<unsigned __int128>(hi) << 64) | lo;
+        remainder = static_cast<uint64_t>(n % d);
+        return static_cast<uint64_t>(n / d);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        return _udiv128(hi, lo, d, &remainder);
+#else
+        // Restoring long division, one bit at a time
+        uint64_t quotient = 0;
+        uint64_t rem = hi;
+        for (int bit = 63; bit >= 0; --bit)
+        {
+            bool carry = (rem >> 63) != 0;
+            rem = (rem << 1) | ((lo >> bit) & 1);
+            if (carry || rem >= d)
+            {
+                rem -= d;
+                quotient |= (1ull << bit);
+            }
+        }
+        remainder = rem;
+        return quotient;
+#endif
+    }
+};
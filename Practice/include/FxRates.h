@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Dense index of a currency (ids never change once given out; -1 = unknown)
+using CurrencyId = int32_t;
+
+// One version of the FX rates. Immutable once published: every cross rate is precomputed through USD, so
+// converting is a single multiply, and the rates into one currency are contiguous (a batch reads one column).
+struct FxTable
+{
+    uint64_t version = 0;                              // Increases with every publish
+    std::vector<std::string> names;                    // Currency code of every id
+    std::unordered_map<std::string, CurrencyId> index; // Currency code -> id
+    std::vector<double> usdRates;                      // USD per unit of every currency (0 = no rate yet)
+    std::vector<double> matrix;                        // matrix[to * size() + from] = units of to per unit of from (0 without rates)
+
+    // Method to get the number of currencies
+    size_t size() const { return names.size(); }
+
+    // Method to find the id of a currency (-1 if it is unknown)
+    CurrencyId find(const std::string& moneyName) const;
+
+    // Method to get the rate from one currency into another
+    double rate(CurrencyId from, CurrencyId to) const { return matrix[static_cast<size_t>(to) * size() + from]; }
+
+    // Method to get the rates of every currency into one (indexed by the source id)
+    const double* ratesInto(CurrencyId to) const { return matrix.data() + static_cast<size_t>(to) * size(); }
+};
+
+// Currency registry and FX rates. Writers build a new FxTable and swap the shared pointer atomically; readers take
+// a reference to the published table and use it without the writer lock. A replaced table is freed as soon as the
+// last reader holding it lets go, so publishing often does not grow memory. USD is always id 0, the base of every rate.
+class FxRates
+{
+private:
+    std::atomic<std::shared_ptr<const FxTable>> current; // Published table
+    std::mutex writerMutex;                           // Serializes publishers (never taken by readers)
+
+    // Method to rebuild the cross rates and publish a table (writerMutex must be held)
+    void publishLocked(std::unique_ptr<FxTable> table);
+
+public:
+    // Constructor that registers USD with rate 1
+    FxRates();
+
+    // Method to get the id of a currency, registering it without a rate if it is new
+    CurrencyId intern(const std::string& moneyName);
+
+    // Method to set the value of 1 unit of a currency in USD (registers the currency if needed)
+    void setUsdRate(const std::string& moneyName, double rate);
+
+    // Method to set several rates with a single publish
+    void setUsdRates(const std::vector<std::pair<std::string, double>>& rates);
+
+    // Method to get the published table (it stays valid while the returned pointer is held, even after a publish)
+    std::shared_ptr<const FxTable> table() const { return current.load(std::memory_order_acquire); }
+
+    // Method to convert an amount between two currencies (returns false if either has no rate)
+    bool convert(double amount, const std::string& from, const std::string& to, double& result) const;
+
+    // Method to convert a batch of amounts into one currency: out[i] = amounts[i] in to (0 if from[i] has no rate).
+    // Ids must come from this registry; the same table is used for the whole batch.
+    static void convertBatch(const FxTable& table, const CurrencyId* from, const double* amounts, size_t count, CurrencyId to, double* out, bool allowSimd = true);
+
+    // Method to total a batch of amounts in one currency
+    static double total(const FxTable& table, const CurrencyId* from, const double* amounts, size_t count, CurrencyId to, bool allowSimd = true);
+};
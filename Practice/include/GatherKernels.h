@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// out[i] = values[i] * table[index[i]] for count elements: the price or rate lookup shared by portfolio valuation
+// and currency conversion. Uses AVX2 gathers when allowed and the CPU has AVX2, a scalar loop otherwise.
+void gatherMultiply(const int32_t* index, const double* values, const double* table, double* out, size_t count, bool allowSimd = true);
+
+// Name of the kernel gatherMultiply uses ("AVX2" or "scalar")
+const char* gatherMultiplyKernel(bool allowSimd = true);
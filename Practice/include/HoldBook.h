@@ -0,0 +1,79 @@
+#pragma once
+#include "BalanceEngine.h"
+#include "TimerWheel.h"
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ID of one hold (entry index in the low 32 bits, its generation in the high ones; 0 = no hold)
+using HoldId = uint64_t;
+
+// Funds reserved for a pending payment
+struct Hold
+{
+    std::string userID;                      // Owner of the funds
+    std::string asset;                       // Coin or currency
+    SQLData::DataBaseState book = SQLData::DataBaseState::DBS_NONE;
+    Amount amount = 0;                       // Amount reserved
+    int64_t expiresAtMillis = 0;             // Unix time in milliseconds the hold is released at unless captured first
+};
+
+// Open holds of a ledger. The funds themselves are moved into the owner's hold account when a hold is placed,
+// so this only tracks what is owed back and when: every hold is one fixed-size entry (names interned) and one
+// node in a TimerWheel, so placing, settling and expiring a hold are O(1) and millions of them cost a few dozen
+// bytes each. An ID names an entry and its generation; entries are reused, a stale ID never matches.
+// A hold is settled by exactly one caller: claim (or claimExpired) takes it out of the wheel, settle then frees it
+// or, if the ledger rejected the settlement, puts it back. Thread-safe.
+class HoldBook
+{
+private:
+    // One hold (or a free entry)
+    struct Entry
+    {
+        int64_t expiresAt;         // Unix time in milliseconds
+        Amount amount;
+        uint32_t user;             // Interned names
+        uint32_t asset;
+        uint32_t timer;            // Handle in the wheel (TimerWheel::none while the hold is being settled)
+        uint32_t generation;       // Bumped every time the entry is freed
+        SQLData::DataBaseState book;
+        bool open;                 // Waiting or being settled
+    };
+
+    mutable std::mutex mutex;                  // Guards everything below
+    IdRegistry names;                          // User and asset names
+    TimerWheel wheel;                          // Expiry of the waiting holds (payload = entry index)
+    std::vector<Entry> entries;                // Holds by index
+    std::vector<uint32_t> freeEntries;         // Indices of settled holds
+    std::vector<uint64_t> dueScratch;          // Reused list of expired entries
+    size_t openCount;                          // Open holds
+
+    // Method to find the open entry of an ID (mutex held; nullptr if the ID is stale)
+    Entry* entryOf(HoldId id);
+
+    // Method to turn an entry back into a hold (mutex held)
+    void toHold(const Entry& entry, Hold& hold) const;
+
+public:
+    // Constructor that sets the expiry resolution and the current time
+    HoldBook(int64_t tickMillis, int64_t nowMillis);
+
+    // Method to track a hold whose funds were reserved; returns its ID
+    HoldId add(const Hold& hold);
+
+    // Method to take a waiting hold for settlement (false if it is unknown, settled or being settled)
+    bool claim(HoldId id, Hold& hold);
+
+    // Method to end the settlement of a claimed hold: done frees it, otherwise it waits for its expiry again
+    void settle(HoldId id, bool done);
+
+    // Method to claim every hold expired at nowMillis; returns how many were appended
+    size_t claimExpired(int64_t nowMillis, std::vector<std::pair<HoldId, Hold>>& expired);
+
+    // Method to get the number of open holds
+    size_t size() const;
+
+    // Method to get the heap memory of the entries and the wheel (not the name registry)
+    size_t memoryBytes() const;
+};
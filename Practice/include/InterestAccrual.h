@@ -0,0 +1,65 @@
+#pragma once
+#include "Ledger.h"
+#include <string>
+
+// One interest or staking payment: every balance of the asset holding at least minimumBalance earns the rate of
+// one period, annualRate / periodsPerYear
+struct AccrualJob
+{
+    std::string name;                        // Unique name (e.g. "staking-2026-10-18"); running it again resumes it, and a finished run pays nothing
+    std::string asset;                       // Asset that earns and is paid
+    SQLData::DataBaseState book = SQLData::DataBaseState::DBS_COINS; // Book of the asset
+    Amount annualRate = 0;                   // Yearly rate (fixed point: SCALE = 100%)
+    uint32_t periodsPerYear = 365;           // Payments per year
+    Amount minimumBalance = 1;               // Smallest balance that earns
+    std::string funding = Ledger::externalAccount; // System account that pays the accruals
+};
+
+// Result of an accrual run (counts include the runs before a resume)
+struct AccrualReport
+{
+    const char* kernel = "";       // Accrual kernel used
+    uint32_t periodRate = 0;       // Rate of the period (billionths, rounded down)
+    uint64_t accounts = 0;         // Balances that earned
+    uint64_t credited = 0;         // Balances credited (the others earned less than one unit)
+    Amount total = 0;              // Amount paid
+    uint64_t residue = 0;          // Fractions rounded off (billionths of a unit), kept by the funding account
+    uint64_t processed = 0;        // Balances of this run (a resume does not repeat the ones done before)
+    size_t chunks = 0;             // Write transactions of this run
+    double readMillis = 0.0;       // Time reading the balance columns (with the ledger flush before each chunk)
+    double computeMillis = 0.0;    // Time in the kernel
+    double writeMillis = 0.0;      // Time applying the credits through the ledger (with the progress)
+    double millis = 0.0;           // Wall time of this run
+    bool finished = false;         // Every balance of the run is paid
+};
+
+// Batch accrual of interest or staking yield. Balances are read from the database chunkRows at a time into columns
+// (row IDs, account names, fixed-point amounts) and a SIMD kernel computes every accrual exactly:
+// floor(balance * rate / 10^9), the rounded-off fractions summed as the residue. Each chunk is then paid like any
+// other transaction: one CREDIT command through Ledger::applyCommand (the credits and the funding account's debit,
+// with an ID derived from the run and the chunk), so the balance engine and the integrity chain see the payments.
+// The run's progress is written in the database transaction of the chunk's credits, so a stopped run resumes with
+// the next chunk and no balance is paid twice. The ledger is flushed before each chunk is read.
+class InterestAccrual
+{
+public:
+    static constexpr int chunkRows = 4096; // Balances per credit transaction
+
+private:
+    Ledger& ledger;   // Ledger the credits are applied through
+    SQLData& sqlData; // Connection the balances and the progress are read from
+    bool allowSimd;   // Use the SIMD kernel if the CPU has one
+
+public:
+    // Constructor that attaches the accrual to a ledger and a connection to its database
+    InterestAccrual(Ledger& ledger, SQLData& sqlData, bool allowSimd = true);
+
+    // Method to get the rate of one period in billionths (rounded down); false if it is over 100% per period
+    static bool periodRate(Amount annualRate, uint32_t periodsPerYear, uint32_t& rate);
+
+    // Method to run a job, or resume it if a run with that name exists; false on an invalid job or a database error
+    bool run(const AccrualJob& job, AccrualReport& report);
+
+    // Method to print a report to the console
+    static void print(const AccrualReport& report);
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include "LedgerAudit.h"
+#include "SQLData.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counters of the persister since it was started
+struct PersisterStats
+{
+    uint64_t enqueued = 0;    // Transactions handed to the persister
+    uint64_t persisted = 0;   // Transactions committed to the database
+    uint64_t batches = 0;     // Database transactions used (one commit each)
+    uint64_t retries = 0;     // Batches that failed and were retried
+    size_t maxBatch = 0;      // Largest batch written at once
+    bool failed = false;      // A batch failed every attempt; nothing more is written
+};
+
+// Background writer that streams transactions already applied by the BalanceEngine to the database.
+// Everything queued while a batch is being written goes into the next batch (group commit).
+// Uses its own connection so the caller never waits on SQLite.
+// A failed batch is retried with a growing delay; once it has failed every attempt the persister stops writing
+// and stays failed (the batch is kept in the queue), so flush and stop report it instead of waiting forever.
+class JournalPersister
+{
+private:
+    SQLData storage;                          // Connection owned by the worker thread
+    LedgerAudit* audit;                       // Integrity chain extended by every batch (nullptr = none)
+    std::thread worker;                       // Writer thread
+    std::mutex mutex;                         // Guards pending, writing, running and failed
+    std::condition_variable wakeWorker;       // Signalled when work is queued or on stop
+    std::condition_variable drained;          // Signalled when the queue becomes empty
+    std::vector<SQLData::JournalEntry> pending; // Transactions waiting for the next batch
+    bool writing;                             // The worker is writing a batch right now
+    bool running;                             // Flag to check if the worker should keep running
+    std::atomic<bool> failed;                 // A batch could not be written; the worker has given up
+
+    std::atomic<uint64_t> enqueued;
+    std::atomic<uint64_t> persisted;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> retries;
+    std::atomic<size_t> maxBatch;
+
+    // Worker loop: takes the whole queue and writes it as one batch
+    void run();
+
+public:
+    // Default constructor (not started)
+    JournalPersister();
+
+    // Destructor that writes what is left and stops the worker
+    ~JournalPersister();
+
+    // Method to open a second connection to the same database and start the worker
+    // (with an audit, every batch also writes its integrity chain link in the same transaction)
+    bool start(const std::string& dbName, const char* vfsName, LedgerAudit* audit = nullptr);
+
+    // Method to queue a transaction for persistence
+    void enqueue(SQLData::JournalEntry&& entry);
+
+    // Method to wait until everything queued so far is committed (false if the persister has failed)
+    bool flush();
+
+    // Method to write what is left, stop the worker and close the connection (false if anything was not written)
+    bool stop();
+
+    // Method to check if a batch failed every attempt (the queue is no longer written)
+    bool hasFailed() const { return failed.load(std::memory_order_acquire); }
+
+    // Method to check if the worker is running
+    bool isRunning() const { return worker.joinable(); }
+
+    // Method to get the counters
+    PersisterStats stats() const;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "SQLData.h"
+#include "Sha256.h"
+#include <string>
+#include <vector>
+
+// One balance of the rebuilt or live state
+struct StateRow
+{
+    std::string account;  // User ID
+    std::string asset;    // Coin or currency
+    Amount amount;        // Fixed-point balance
+};
+
+// Result of a replay
+struct ReplayReport
+{
+    uint64_t postings = 0;         // Postings read from the journal
+    uint64_t transactions = 0;     // Transactions read from the journal
+    size_t balances = 0;           // Non-zero user balances rebuilt
+    unsigned threads = 0;          // Worker threads used for the apply phase
+    double readMillis = 0.0;       // Time spent reading and partitioning
+    double applyMillis = 0.0;      // Time spent applying the partitions
+    double hashMillis = 0.0;       // Time spent sorting and hashing
+    uint64_t negativeEvents = 0;   // Postings after which a user balance was negative
+    Digest stateHash = {};         // Hash of the rebuilt state
+    Digest liveHash = {};          // Hash of COINS/BALANCE
+    size_t mismatches = 0;         // Balances that differ between the two
+    std::vector<std::string> mismatchSamples; // The first few differences, human readable
+    bool verified = false;         // stateHash == liveHash
+};
+
+// Rebuilds every balance from the journal (POSTINGS) and checks it against COINS/BALANCE.
+// Postings are read once in journal order and partitioned by account, so each partition keeps the
+// per-account order; the partitions are then applied in parallel. The state hash is computed over the
+// rows sorted by (account, asset), so it is byte-identical for any number of threads.
+class JournalReplay
+{
+private:
+    unsigned threadCount; // Worker threads (0 = one per core)
+
+public:
+    // Constructor that sets the number of worker threads
+    explicit JournalReplay(unsigned threads = 0);
+
+    // Method to replay the journal of the database and verify the live tables
+    bool run(SQLData& sqlData, ReplayReport& report);
+
+    // Method to hash a state (sorts the rows first)
+    static Digest stateHash(std::vector<StateRow>& rows);
+
+    // Method to print a report to the console
+    static void print(const ReplayReport& report);
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <sqlite3.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+// Latency distribution injected into a single kind of VFS call (normal distribution clamped at zero)
+struct LatencyProfile
+{
+    double meanMicros;   // Mean injected delay in microseconds
+    double jitterMicros; // Standard deviation of the injected delay in microseconds
+
+    // Default constructor (no latency)
+    LatencyProfile();
+
+    // Parameterized constructor to initialize the profile with a mean and a jitter
+    LatencyProfile(double mean, double jitter);
+};
+
+// Counters collected by the VFS since the last reset
+struct VFSStats
+{
+    uint64_t reads = 0;        // Number of xRead calls
+    uint64_t writes = 0;       // Number of xWrite calls
+    uint64_t syncs = 0;        // Number of xSync calls (durable writes)
+    uint64_t bytesRead = 0;    // Total bytes read
+    uint64_t bytesWritten = 0; // Total bytes written
+    uint64_t opens = 0;        // Number of files opened (database, journals, temp files)
+    uint64_t injectedMicros = 0; // Total injected latency in microseconds
+};
+
+// In-memory SQLite VFS that can inject write/sync/read latency and counts every I/O call.
+// Used to benchmark the storage path reproducibly without real disk and fsync variance.
+class LatencyVFS
+{
+public:
+    static constexpr const char* vfsName = "ledger-memvfs"; // Name passed to sqlite3_open_v2
+
+    // In-memory contents and lock state of one file
+    struct MemFile
+    {
+        std::mutex mutex;        // Guards data and lock state
+        std::vector<char> data;  // File contents
+        int sharedLocks = 0;     // Number of connections holding SHARED
+        bool reserved = false;   // A connection holds RESERVED
+        bool pending = false;    // A connection holds PENDING
+        bool exclusive = false;  // A connection holds EXCLUSIVE
+    };
+
+    // Returns the process-wide VFS instance
+    static LatencyVFS& instance();
+
+    // Registers the VFS with SQLite (safe to call more than once)
+    bool registerVFS();
+
+    // Methods to configure the injected latency for each kind of call
+    void setReadLatency(const LatencyProfile& profile);
+    void setWriteLatency(const LatencyProfile& profile);
+    void setSyncLatency(const LatencyProfile& profile);
+
+    // Reseeds the latency generator so that a run can be reproduced exactly
+    void seed(uint32_t value);
+
+    // Returns the counters collected since the last reset
+    VFSStats stats() const;
+
+    // Resets all counters (call before the operation to be measured)
+    void resetStats();
+
+    // Drops every in-memory file (the databases must be closed first)
+    void clearFiles();
+
+private:
+    LatencyVFS();
+
+    sqlite3_vfs vfs;           // The VFS structure handed to SQLite
+    bool registered;           // Flag to check if the VFS has been registered
+
+    std::mutex filesMutex;     // Guards the file map
+    std::map<std::string, std::shared_ptr<MemFile>> files; // Named in-memory files
+
+    std::mutex latencyMutex;   // Guards the profiles and the generator
+    LatencyProfile readLatency;
+    LatencyProfile writeLatency;
+    LatencyProfile syncLatency;
+    std::mt19937 generator;    // Deterministic generator for the injected delays
+
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> syncs;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> opens;
+    std::atomic<uint64_t> injectedMicros;
+
+    // Method to wait for a delay drawn from the given profile
+    void inject(const LatencyProfile& profile);
+
+    // Method to find or create a named file
+    std::shared_ptr<MemFile> getFile(const std::string& name, bool create);
+
+    // Method to remove a named file
+    bool removeFile(const std::string& name);
+
+    friend struct LatencyVFSCallbacks;
+};
@@ -1,5 +1,38 @@
 #pragma once
 #include "SQLData.h"  // Include the header for SQLData class
+#include "BalanceEngine.h"
+#include "CommandWindow.h"
+#include "HoldBook.h"
+#include "JournalPersister.h"
+#include "LedgerAudit.h"
+
+using Posting = SQLData::Posting;
+using PostingRecord = SQLData::PostingRecord;
+
+// Kinds of transactions recorded in the journal
+enum class TransactionKind
+{
+    TK_Deposit,   // Money added to the wallet from outside
+    TK_Buy,       // Coins bought with USD from the exchange
+    TK_Send,      // Coins sent to another user
+    TK_Withdraw,  // Coins taken out of the ledger
+    TK_Order,     // Funds moved into or out of order escrow
+    TK_Trade,     // Order book fill paid out of escrow
+    TK_Sell,      // Coins sold to the exchange for USD
+    TK_Credit,    // Bulk credit (airdrop, interest, rebate) paid by a funding account
+    TK_Hold       // Funds moved into or out of a user's hold account (reserved for a pending payment)
+};
+
+// One asset amount of a swap
+struct SwapLeg
+{
+    std::string asset;          // Coin or currency name
+    SQLData::DataBaseState book; // DBS_COINS or DBS_BALANCE
+    Amount amount;              // Positive amount (0 = no leg, for the optional fee)
+};
+
+// Returns the name stored in TRANSACTIONS.kind
+const char* transactionKindName(TransactionKind kind);
 
 // Class Ledger represents a ledger that manages user, seed list, coin data, and SQL interactions
 class Ledger
@@ -11,11 +44,43 @@ private:
     Coin& coin;           // Reference to Coin object for handling coin data
     std::string dbName = "MyLedgerData.db";  // Database name (SQLite file)
     bool userLoad;        // Flag to check if the user has been successfully loaded
+    int batchDepth;       // Number of open beginBatch calls (group commit)
+    BalanceEngine engine; // In-memory balances (authoritative once enabled)
+    LedgerAudit integrity; // Merkle tree and hash chain over the persisted batches
+    JournalPersister persister; // Background writer of the engine's transactions
+    bool engineEnabled;   // Flag to check if transactions go through the balance engine
+    bool chainEnabled;    // Flag to check if journal batches extend the integrity chain
+    CommandWindow commands; // Client command IDs applied during the last day (retries are not applied twice)
+    HoldBook holds;       // Open holds and their expiry
+
+    // Method to move the funds of a hold back from the hold account to its owner
+    bool returnHold(const Hold& hold, const std::string& memo);
+
+    // Method to collect the positive balances of the system accounts starting with prefix (userID = the rest of the name)
+    std::vector<Hold> findPrefixedBalances(const char* prefix);
 
 public:
     // Constructor that initializes the Ledger class with references to the User, SQLData, SeedList, and Coin objects
     Ledger(User& other, SQLData& sqlD, SeedList& sL, Coin& c);
 
+    // Destructor that persists the transactions still queued
+    ~Ledger();
+
+    // Method to load every balance into memory and persist transactions asynchronously from now on
+    // (integrityChain: every persisted batch also extends the hash chain and the Merkle root of the balances)
+    bool enableBalanceEngine(bool integrityChain = true);
+
+    // Method to check if the balance engine is enabled
+    bool isBalanceEngineEnabled() const { return engineEnabled; }
+
+    // Method to split a hot account (omnibus, fees) into sub-balances so concurrent credits to it do not contend;
+    // the sub-balances are folded back every aggregateMillis (requires the balance engine)
+    bool markHotAccount(const std::string& userID, int64_t aggregateMillis = 1000);
+
+    // Method to wait until every transaction applied so far is in the database
+    // (false if the background writer gave up; the engine then rejects new transactions)
+    bool flush();
+
     // Method to verify the password entered by the user
     bool enterPassword(const char* password);
 
@@ -33,4 +98,107 @@ public:
 
     // Method to return the seed phrase as a string
     std::string getSeedPhrase();
+
+    // System accounts on the other side of money entering or leaving the users' books (journal only, no balance row)
+    static constexpr const char* externalAccount = "@external";
+    static constexpr const char* exchangeAccount = "@exchange";
+    static constexpr const char* orderBookAccountPrefix = "@orderbook:"; // Followed by a user ID: the user's funds in open orders
+    static constexpr const char* feeAccount = "@fees";             // Fees charged by swaps
+    static constexpr const char* holdAccountPrefix = "@hold:";     // Followed by a user ID: the user's held funds
+
+    // Method to check if an account is a system account
+    static bool isSystemAccount(const std::string& userID);
+
+    // Method to apply a balanced set of postings to COINS/BALANCE and the journal in one atomic step.
+    // Fails (and changes nothing) if the postings do not sum to zero per asset or a user balance would go negative.
+    bool applyTransaction(TransactionKind kind, const std::vector<Posting>& postings, const std::string& memo = "");
+
+    // Method to apply a transaction at most once per client command ID: a retry of an applied command is a lookup
+    // that returns CS_Duplicate. The ID is persisted with the transaction, so it is still known after a restart.
+    // alsoWrite runs in the database transaction that stores the postings (a job's record of what it applied).
+    CommandStatus applyCommand(CommandId commandId, TransactionKind kind, const std::vector<Posting>& postings, const std::string& memo = "",
+        const SQLData::JournalWrite& alsoWrite = nullptr);
+
+    // Method to add money to the current user's wallet
+    // (the methods below take an optional client command ID; a duplicate counts as success and changes nothing)
+    bool deposit(const std::string& moneyName, Amount amount, CommandId commandId = 0);
+
+    // Method to exchange assets with the exchange in one validated, atomic transaction (one journal entry, one
+    // persistence write): the user pays `pay`, receives `receive` and optionally pays `fee` to '@fees'.
+    // A fee in the paid asset is merged into the pay leg, so the user's balance is updated once.
+    CommandStatus swap(TransactionKind kind, const std::string& userID, const SwapLeg& pay, const SwapLeg& receive,
+        const SwapLeg& fee = { "", SQLData::DataBaseState::DBS_NONE, 0 }, CommandId commandId = 0);
+
+    // Method to buy coins for USD for the current user (usdFee is charged on top of usdAmount)
+    bool buyCoin(const std::string& coinName, Amount usdAmount, Amount coinAmount, CommandId commandId = 0, Amount usdFee = 0);
+
+    // Method to sell coins for USD for the current user (usdFee is taken from the USD received)
+    bool sellCoin(const std::string& coinName, Amount coinAmount, Amount usdAmount, CommandId commandId = 0, Amount usdFee = 0);
+
+    // Method to send coins from the current user to another user
+    bool sendCoins(const std::string& toUserID, const std::string& coinName, Amount amount, CommandId commandId = 0);
+
+    // Method to move coins between any two users. Once the balance engine is enabled this (like applyTransaction)
+    // may be called from many threads at once: accounts are lock-striped and locked in a fixed order.
+    bool transfer(const std::string& fromUserID, const std::string& toUserID, const std::string& coinName, Amount amount, CommandId commandId = 0);
+
+    // Method to get the account holding a user's reserved funds
+    static std::string holdAccount(const std::string& userID) { return holdAccountPrefix + userID; }
+
+    // Method to get the account holding the escrow of a user's open orders
+    static std::string orderBookAccount(const std::string& userID) { return orderBookAccountPrefix + userID; }
+
+    // Method to reserve funds until the hold is captured, released or expires after ttlMillis. The funds move to
+    // the user's hold account in one transaction, so nothing else can spend them and no lock is kept while the user
+    // decides. Returns the hold's ID (0 = invalid or insufficient funds). Expired holds are released lazily by the
+    // hold calls and expireHolds.
+    HoldId placeHold(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, Amount amount, int64_t ttlMillis);
+
+    // Method to pay a hold out to an account (a user, or '@external' for a withdrawal). False if the hold expired or
+    // was settled already, or if the payment was rejected or its command ID was already used (the hold then stays open).
+    bool captureHold(HoldId id, const std::string& toAccount, TransactionKind kind, CommandId commandId = 0);
+
+    // Method to pay a hold out to another user as a send (fails if the user does not exist)
+    bool sendHold(HoldId id, const std::string& toUserID, CommandId commandId = 0);
+
+    // Method to give the funds of a hold back to its owner
+    bool releaseHold(HoldId id);
+
+    // Method to release every hold expired at nowMillis; returns how many were released
+    size_t expireHolds(int64_t nowMillis);
+
+    // Method to give back the funds left in hold accounts by a previous run (call at startup, before placing holds)
+    size_t releaseStaleHolds();
+
+    // Method to give back the escrow left by the open orders of a previous run (the order books are only kept in
+    // memory; call at startup, before placing orders); returns how many balances were returned
+    size_t releaseStaleEscrow();
+
+    // Method to get the open holds
+    const HoldBook& holdBook() const { return holds; }
+
+    // Methods to group many ledger transactions into one database transaction (one commit for the whole batch)
+    bool beginBatch();
+    bool commitBatch();
+
+    // Method to get a balance (from memory when the engine is enabled, else from the database)
+    Amount getBalance(const std::string& userID, const std::string& asset, SQLData::DataBaseState book);
+
+    // Method to get the window of applied command IDs
+    CommandWindow& commandWindow() { return commands; }
+
+    // Method to get the balance engine (benchmarks, statistics)
+    BalanceEngine& balanceEngine() { return engine; }
+
+    // Method to get the integrity chain every journal writer must stage its batches in (nullptr if it is off)
+    LedgerAudit* integrityChain() { return chainEnabled ? &integrity : nullptr; }
+
+    // Method to prove one balance against the newest chain link (waits for the persister first)
+    bool proveBalance(const std::string& userID, const std::string& asset, MerkleProof& proof, SQLData::ChainLink& link);
+
+    // Method to get the persister counters
+    PersisterStats persisterStats() const { return persister.stats(); }
+
+    // Method to read one page of the current user's history (pass the last record's id to get the next page)
+    std::vector<PostingRecord> getHistory(sqlite3_int64 beforeID, int limit);
 };
@@ -0,0 +1,79 @@
+#pragma once
+#include "MerkleTree.h"
+#include "SQLData.h"
+#include <mutex>
+
+// Result of a full audit of the integrity chain
+struct AuditReport
+{
+    uint64_t links = 0;                 // Chain links checked
+    uint64_t transactions = 0;          // Journal transactions re-hashed
+    uint64_t unchainedTransactions = 0; // Transactions between links that no link covers
+    sqlite3_int64 firstBadSeq = 0;      // First link whose hashes do not match (0 = none)
+    bool chainValid = false;            // Every batch hash and chain hash matches
+    bool tablesMatch = false;           // COINS/BALANCE hash to the state root of the newest link
+    size_t balances = 0;                // Leaves of the rebuilt tree
+    double millis = 0.0;                // Time spent
+};
+
+// Tamper evidence for the ledger. Every journal batch (written by the JournalPersister or the LedgerPipeline) gets
+// a CHAIN row in the same database transaction: the hash of the batch's journal entries, the Merkle root over all
+// user balances after the batch, and a chain hash over the previous link. The tree is kept in memory and only the
+// paths of the balances a batch touched are rehashed, so a single balance can be proven against a chained root in O(log n).
+class LedgerAudit
+{
+private:
+    // A change made by the staged batch (undone if its database transaction fails)
+    struct StagedDelta
+    {
+        uint32_t position;  // Leaf
+        Amount delta;       // Amount added
+    };
+
+    std::mutex mutex;              // Held from stage until commitStaged/rollbackStaged, and by prove
+    MerkleTree tree;               // Balances of the user accounts
+    SQLData::ChainLink head;       // Newest committed link (seq 0 before the first batch)
+    SQLData::ChainLink stagedLink; // Link written by the staged batch
+    std::vector<StagedDelta> staged; // Changes of the staged batch
+    size_t stagedLeafCount;        // Leaves before the staged batch
+    bool hasStaged;                // A batch is staged
+
+    // Method to build a tree from the recorded leaf positions and the balance tables (newLeaves gets the unrecorded balances)
+    static bool buildTree(SQLData& sqlData, MerkleTree& tree, std::vector<uint32_t>* newLeaves);
+
+public:
+    // Constructor (empty chain)
+    LedgerAudit();
+
+    // Method to hash one journal entry into a batch hash
+    static void hashEntry(Sha256& sha, sqlite3_int64 txID, const SQLData::JournalEntry& entry);
+
+    // Method to compute the chain hash of a link from the previous one
+    static Digest linkHash(const Digest& previous, sqlite3_int64 seq, const Digest& batchHash, const Digest& stateRoot);
+
+    // Method to build the tree from the balance tables and read the head of the chain (warns if they disagree)
+    bool load(SQLData& sqlData);
+
+    // Method to apply a batch to the tree and write its link; called by a journal writer inside the batch's transaction.
+    // Once stage was called (whatever it returned), the writer must call commitStaged or rollbackStaged
+    bool stage(SQLData& storage, const std::vector<SQLData::JournalEntry>& batch, const std::vector<sqlite3_int64>& txIDs);
+
+    // Methods to finish the staged batch after its transaction committed or failed
+    void commitStaged();
+    void rollbackStaged();
+
+    // Method to prove a balance against the newest link (false if the balance has no leaf)
+    bool prove(const std::string& userID, const std::string& asset, MerkleProof& proof, SQLData::ChainLink& link);
+
+    // Method to get the newest committed link
+    SQLData::ChainLink chainHead();
+
+    // Method to check a proof and that its root is the state root of a link stored in the database
+    static bool verifyProof(SQLData& sqlData, const MerkleProof& proof, sqlite3_int64 seq);
+
+    // Method to re-hash the whole journal against the chain and the balance tables against the newest root
+    static bool verifyChain(SQLData& sqlData, AuditReport& report);
+
+    // Method to print an audit report to the console
+    static void print(const AuditReport& report);
+};
@@ -0,0 +1,149 @@
+#pragma once
+#include "Ledger.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+// Kinds of commands accepted by the pipeline
+enum class CommandType : uint8_t
+{
+    CT_Deposit,   // account receives amount of money (BALANCE) from outside
+    CT_Withdraw,  // account sends amount of a coin (COINS) outside
+    CT_Buy,       // account pays amount USD to the exchange and receives amount2 of asset
+    CT_Send,      // account sends amount of asset to counterparty
+    CT_Sell       // account gives amount of asset to the exchange and receives amount2 USD
+};
+
+// One ledger command (fixed size, no heap memory: lives directly in a ring slot)
+struct LedgerCommand
+{
+    CommandType type;       // What to do
+    CommandStatus status;   // Set by the business logic stage
+    uint32_t account;       // Interned account ID (payer / receiver of a deposit)
+    uint32_t counterparty;  // Interned receiver of a send
+    uint32_t asset;         // Interned asset ID
+    Amount amount;          // Main amount (USD paid for a buy)
+    Amount amount2;         // Coins received for a buy
+    int64_t submittedNanos; // steady_clock time of the submit (latency measurement)
+    int64_t appliedMillis;  // Unix time in milliseconds the business stage applied it (the journal's created_at)
+    uint64_t sequence;      // Position in the ring, set on submit
+    CommandId commandId;    // Client command ID (0 = none; a duplicate gets CS_Duplicate)
+};
+
+// Counters of one stage
+struct StageStats
+{
+    uint64_t processed = 0;  // Commands handled
+    uint64_t batches = 0;    // Times the stage woke up and handled a run of commands
+    uint64_t maxDepth = 0;   // Largest number of commands waiting for the stage
+};
+
+// LMAX-style command pipeline: producers claim slots of a preallocated ring, a single business logic thread
+// applies the commands to the balance engine in sequence order, and two downstream stages follow it:
+// the journal stage writes everything processed so far as one database transaction, the notification stage
+// hands each result to a callback. Stages only communicate through sequence counters, never through locks.
+// A journal batch that keeps failing is retried with a growing delay; after the last attempt the pipeline is failed
+// for good: the journal stage stops, new commands are rejected and drain/stop report it instead of waiting.
+class LedgerPipeline
+{
+public:
+    using Notification = std::function<void(const LedgerCommand&)>;
+
+    static constexpr uint64_t rejectedSequence = ~0ULL; // Returned by submit once the pipeline has failed
+
+    // Constructor that preallocates the ring (capacity is rounded up to a power of two).
+    // The ledger's balance engine must be enabled; the journal stage opens its own connection to sqlData's database.
+    LedgerPipeline(Ledger& ledger, SQLData& sqlData, size_t capacity = 65536, bool journal = true);
+
+    // Destructor that drains and stops the stages
+    ~LedgerPipeline();
+
+    // Method to set the callback of the notification stage (call before start)
+    void setNotification(Notification callback) { notify = std::move(callback); }
+
+    // Method to start the stage threads
+    bool start();
+
+    // Method to process everything submitted so far, then stop the stages (false if the journal stage failed)
+    bool stop();
+
+    // Method to submit a command from any thread (blocks while the ring is full), returns its sequence
+    // (rejectedSequence once the journal stage has failed)
+    uint64_t submit(const LedgerCommand& command);
+
+    // Method to wait until every submitted command went through all stages (false if the journal stage failed)
+    bool drain();
+
+    // Method to check if a journal batch failed every attempt (nothing more is written or accepted)
+    bool hasFailed() const { return journalFailed.load(std::memory_order_acquire); }
+
+    // Methods to build commands from names
+    LedgerCommand deposit(const std::string& userID, const std::string& moneyName, Amount amount);
+    LedgerCommand withdraw(const std::string& userID, const std::string& coinName, Amount amount);
+    LedgerCommand buy(const std::string& userID, const std::string& coinName, Amount usdAmount, Amount coinAmount);
+    LedgerCommand send(const std::string& fromUserID, const std::string& toUserID, const std::string& coinName, Amount amount);
+    LedgerCommand sell(const std::string& userID, const std::string& coinName, Amount coinAmount, Amount usdAmount);
+
+    // Methods to get the counters of each stage
+    StageStats businessStats() const { return readStats(business); }
+    StageStats journalStats() const { return readStats(journalStage); }
+    StageStats notifyStats() const { return readStats(notifyStage); }
+
+private:
+    // Ring slot: the command and the sequence it was published with (a cache line each)
+    struct alignas(64) Slot
+    {
+        LedgerCommand command;
+        std::atomic<int64_t> published;
+    };
+
+    // Consumer cursor and counters of one stage, padded against false sharing
+    struct alignas(64) Stage
+    {
+        std::atomic<int64_t> cursor{ -1 };     // Last sequence handled
+        std::atomic<uint64_t> processed{ 0 };
+        std::atomic<uint64_t> batches{ 0 };
+        std::atomic<uint64_t> maxDepth{ 0 };
+        std::thread thread;
+    };
+
+    Ledger& ledger;                   // Ledger whose balance engine holds the state
+    BalanceEngine& engine;            // Written by the business logic thread only
+    SQLData storage;                  // Connection of the journal stage
+    std::string dbName;               // Database of the journal stage
+    std::string dbVFS;                // VFS of the journal stage ("" for the default one)
+    bool journalEnabled;              // Flag to run the journal stage
+    Notification notify;              // Callback of the notification stage
+
+    std::unique_ptr<Slot[]> ring;     // Preallocated slots
+    size_t mask;                      // Capacity - 1
+    alignas(64) std::atomic<int64_t> claimed{ -1 }; // Last sequence claimed by a producer
+    alignas(64) std::atomic<bool> running{ false }; // Cleared by stop
+    std::atomic<bool> journalFailed{ false };       // Set when the journal stage gave up on a batch
+    Stage business;                   // Applies the commands
+    Stage journalStage;               // Persists what business processed
+    Stage notifyStage;                // Reports what business processed
+
+    uint32_t externalId;              // Interned Ledger::externalAccount
+    uint32_t exchangeId;              // Interned Ledger::exchangeAccount
+    uint32_t usdId;                   // Interned "USD"
+
+    // Stage loops
+    void runBusiness();
+    void runJournal();
+    void runNotify();
+
+    // Method to wait until the sequence is available from upstream (returns the highest available, or -1 on stop)
+    int64_t waitFor(int64_t sequence, const std::function<int64_t()>& available, const Stage& self);
+
+    // Method to build the postings of a command (returns the number of postings)
+    size_t buildPostings(const LedgerCommand& command, EnginePosting* postings) const;
+
+    // Method to record one run of commands in the stage counters
+    static void recordBatch(Stage& stage, uint64_t count, uint64_t depth);
+
+    // Method to copy the counters of a stage
+    static StageStats readStats(const Stage& stage);
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include "SQLData.h"
+#include <string>
+#include <vector>
+
+// One balance whose table value differs from the sum of its journal postings
+struct Discrepancy
+{
+    std::string account;          // User ID
+    std::string asset;            // Coin or currency
+    SQLData::DataBaseState book;  // COINS or BALANCE
+    Amount table = 0;             // Sum of the account's rows
+    Amount journal = 0;           // Sum of its postings up to the transaction the rows were read at
+    uint64_t postings = 0;        // Postings counted in journal
+    sqlite3_int64 lastTxID = 0;   // Newest transaction that posted to it (0 = none)
+};
+
+// Conservation of one asset
+struct AssetSupply
+{
+    std::string asset;            // Coin or currency
+    Amount table = 0;             // Sum of the user rows of COINS/BALANCE
+    Amount journal = 0;           // Sum of the user postings up to the reconciled transaction
+    Amount inFlight = 0;          // Part of journal committed after the rows were read (writers during the scan)
+    Amount issued = 0;            // Amount the system accounts gave out (minus their postings)
+    Amount net = 0;               // Sum of every posting; zero when the asset is conserved
+    bool conserved = false;       // net == 0 and table == journal - inFlight
+};
+
+// Result of a reconciliation
+struct ReconcileReport
+{
+    unsigned threads = 0;         // Worker threads (and shards)
+    uint64_t rows = 0;            // COINS/BALANCE rows read
+    uint64_t postings = 0;        // Postings read
+    uint64_t transactions = 0;    // Transactions read
+    size_t balances = 0;          // Distinct (account, asset) balances compared
+    uint64_t chunks = 0;          // Short read transactions the tables were read in
+    sqlite3_int64 throughTxID = 0; // Newest transaction reconciled
+    double tableMillis = 0.0;     // Time spent reading the tables
+    double journalMillis = 0.0;   // Time spent reading the journal
+    double mergeMillis = 0.0;     // Time spent merging the shards
+    std::vector<AssetSupply> supply;             // Per asset, by name
+    size_t discrepancies = 0;                    // Balances that differ
+    std::vector<Discrepancy> discrepancySamples; // The first ones by (account, asset)
+    uint64_t unbalanced = 0;                     // Transactions whose postings do not net to zero per asset
+    std::vector<std::string> unbalancedSamples;  // The first few, human readable
+    bool reconciled = false;      // No discrepancy, no unbalanced transaction, every asset conserved
+};
+
+// One posting of a drill-down with the balance after it
+struct DrillDownRow
+{
+    sqlite3_int64 txID;           // Transaction
+    std::string kind;             // Transaction kind
+    Amount amount;                // Signed change
+    Amount balance;               // Running balance
+    sqlite3_int64 createdAt;      // Unix time in milliseconds
+};
+
+// Nightly proof that COINS/BALANCE hold exactly the sum of the journal and that every asset is conserved.
+// Both balance tables are split into rowid ranges and the journal into posting ranges aligned to transaction
+// starts; each range is scanned by its own worker on its own connection into per-shard partial sums, and
+// shard s of every worker is merged by thread s. Writers are never held up for long: the tables are read in
+// chunks, each one a short read transaction that also notes the newest committed transaction (its cut). The
+// journal is append-only, so it is read up to the newest cut and every row is compared with its postings up
+// to the cut it was read at. Under WAL the chunks do not block writers at all.
+class LedgerReconciler
+{
+public:
+    static constexpr int chunkRows = 50000;   // Rows per read transaction
+    static constexpr size_t maxSamples = 20;  // Discrepancies and unbalanced transactions kept in a report
+
+private:
+    unsigned threadCount; // Workers (0 = one per core)
+
+public:
+    // Constructor that sets the number of workers
+    explicit LedgerReconciler(unsigned threads = 0);
+
+    // Method to reconcile the database of sqlData (read through connections of the workers' own)
+    bool run(SQLData& sqlData, ReconcileReport& report);
+
+    // Method to list the postings of one balance, oldest first, with the running balance
+    static bool drillDown(SQLData& sqlData, const Discrepancy& discrepancy, std::vector<DrillDownRow>& rows);
+
+    // Methods to print a report and a drill-down to the console
+    static void print(const ReconcileReport& report);
+    static void print(const Discrepancy& discrepancy, const std::vector<DrillDownRow>& rows);
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include "Coin.h"
+#include "FxRates.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Coin names of the published prices. Immutable: a new layout is published only when the set of coins changes,
+// and old layouts stay allocated until the MarketData is destroyed, so a reader may keep using the pointer it read.
+struct PriceLayout
+{
+    std::vector<std::string> names;                // Coin names, in price order
+    std::unordered_map<std::string, size_t> index; // Coin name -> position
+
+    // Method to find the position of a coin (-1 if the coin is unknown)
+    int64_t find(const std::string& coinName) const;
+};
+
+// Consistent copy of every coin price at one version (readers own it, the feed never changes it)
+struct PriceSnapshot
+{
+    uint64_t version = 0;                 // Increases with every publish
+    const PriceLayout* layout = nullptr;  // Coin names of the prices
+    std::vector<double> prices;           // USD price of every coin, in layout order
+
+    // Method to get the number of coins
+    size_t size() const { return prices.size(); }
+
+    // Method to get the name of a coin by position
+    const std::string& name(size_t position) const { return layout->names[position]; }
+
+    // Method to find the price of a coin by name (returns false if the coin is unknown)
+    bool find(const std::string& coinName, double& price) const;
+};
+
+// Current coin prices and FX rates shared between the UI, the ledger, the SQL functions and the price feed.
+// Prices are published under a seqlock: the writer bumps the sequence to odd, stores the prices and bumps it
+// to even again; a reader copies the prices and retries if the sequence moved meanwhile. Readers never take a
+// lock and never wait for each other; writers are serialized among themselves. FX rates live in an FxRates,
+// whose versioned tables are swapped atomically, so conversions do not lock either.
+class MarketData
+{
+public:
+    static constexpr size_t maxCoins = 256; // Capacity of the seqlocked price array
+
+private:
+    std::atomic<uint64_t> sequence;                        // Odd while a publish is in progress
+    std::atomic<uint64_t> version;                         // Version of the published prices
+    std::atomic<const PriceLayout*> layout;                // Layout of the published prices
+    std::array<std::atomic<double>, maxCoins> prices;      // Published prices (layout order)
+    std::mutex writerMutex;                                // Serializes publishers (never taken by readers)
+    std::vector<std::unique_ptr<PriceLayout>> layouts;     // Every layout ever published (freed on destruction)
+
+    FxRates fxRates;                                       // Currencies and their rates (lock-free readers too)
+
+    // Method to store a full set of prices and optionally a new layout (writerMutex must be held)
+    void publishLocked(const PriceLayout* newLayout, const double* newPrices, size_t count);
+
+public:
+    // Constructor that starts with no coins and only USD
+    MarketData();
+
+    // Method to publish a new set of coins and prices (keeps the layout if the coin names did not change)
+    bool publishPrices(const std::list<Coin>& coins);
+
+    // Method to publish new prices for some coins of the current layout (unknown coins are ignored)
+    size_t updatePrices(const std::vector<std::pair<std::string, double>>& updates);
+
+    // Method to copy the current prices into a snapshot (reuses its storage, lock-free)
+    void readPrices(PriceSnapshot& snapshot) const;
+
+    // Method to get a copy of the current prices
+    PriceSnapshot priceSnapshot() const;
+
+    // Method to get the version of the published prices
+    uint64_t priceVersion() const { return version.load(std::memory_order_acquire); }
+
+    // Method to get the USD price of a coin (returns false if the coin is unknown, lock-free)
+    bool coinPrice(const std::string& coinName, double& price) const;
+
+    // Method to set the value of 1 unit of a currency in USD
+    void setUsdRate(const std::string& moneyName, double rate) { fxRates.setUsdRate(moneyName, rate); }
+
+    // Method to convert an amount between two currencies (returns false if either currency is unknown)
+    bool convert(double amount, const std::string& from, const std::string& to, double& result) const { return fxRates.convert(amount, from, to, result); }
+
+    // Methods to get the currency registry and rate tables
+    FxRates& fx() { return fxRates; }
+    const FxRates& fx() const { return fxRates; }
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include "FixedPoint.h"
+#include "Sha256.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Inclusion proof of one balance: the leaf, its position and the sibling hashes up to the root
+struct MerkleProof
+{
+    std::string account;          // User ID
+    std::string asset;            // Coin or currency
+    Amount amount = 0;            // Balance the proof is for
+    uint64_t leafIndex = 0;       // Position of the leaf
+    std::vector<Digest> siblings; // Sibling hash on every level, leaf level first
+    Digest root = {};             // Root the proof leads to
+};
+
+// Binary Merkle tree over balances with stable leaf positions.
+// Leaves are appended when a balance is first seen and never move, so changing a balance only rehashes
+// its path to the root: commit() costs O(changed leaves * log n) and a proof has log n hashes.
+// Leaf hash = SHA-256(0x00, account, asset, amount), node hash = SHA-256(0x01, left, right); unused leaves hash to zero.
+class MerkleTree
+{
+private:
+    struct Leaf
+    {
+        std::string account;  // User ID
+        std::string asset;    // Coin or currency
+        Amount amount;        // Current balance
+    };
+
+    std::vector<Leaf> leaves;                           // Leaves in position order
+    std::unordered_map<std::string, uint32_t> positions; // account + '\x1f' + asset -> position
+    std::vector<std::vector<Digest>> levels;            // levels[0] = leaf hashes (power-of-two size), back() = { root }
+    std::vector<Digest> emptyHashes;                    // Hash of an unused subtree on every level
+    std::vector<uint32_t> dirty;                        // Leaves changed since the last commit
+    bool rebuildAll;                                    // Capacity changed, every level must be recomputed
+    mutable std::string scratchKey;                     // Reused lookup key (no allocation per posting)
+
+    // Method to build the lookup key of a balance in scratchKey
+    const std::string& keyOf(const std::string& account, const std::string& asset) const
+    {
+        scratchKey.assign(account);
+        scratchKey += '\x1f';
+        scratchKey += asset;
+        return scratchKey;
+    }
+
+    // Method to double the capacity until leafCount leaves fit
+    void reserveLeaves(size_t leafCount);
+
+public:
+    // Constructor that creates an empty tree
+    MerkleTree();
+
+    // Methods to hash a leaf and an inner node
+    static Digest leafHash(const std::string& account, const std::string& asset, Amount amount);
+    static Digest nodeHash(const Digest& left, const Digest& right);
+
+    // Method to remove every leaf
+    void clear();
+
+    // Method to get the position of a balance, appending a zero leaf if it is new (created tells which)
+    uint32_t insert(const std::string& account, const std::string& asset, bool& created);
+
+    // Method to find the position of a balance (-1 if it has no leaf)
+    int64_t find(const std::string& account, const std::string& asset) const;
+
+    // Methods to change a balance (hashes are updated by the next commit)
+    void set(uint32_t position, Amount amount);
+    void add(uint32_t position, Amount delta);
+
+    // Method to drop the leaves appended after the first leafCount (undo of insert)
+    void truncate(size_t leafCount);
+
+    // Method to rehash the changed paths
+    void commit();
+
+    // Method to get the root (as of the last commit)
+    const Digest& root() const { return levels.back()[0]; }
+
+    // Method to build the inclusion proof of a balance (as of the last commit)
+    bool prove(const std::string& account, const std::string& asset, MerkleProof& proof) const;
+
+    // Method to check that a proof leads from its leaf to its root
+    static bool verify(const MerkleProof& proof);
+
+    // Method to get the number of leaves
+    size_t size() const { return leaves.size(); }
+
+    // Methods to get the balance of a leaf and whose it is
+    Amount amount(uint32_t position) const { return leaves[position].amount; }
+    const std::string& account(uint32_t position) const { return leaves[position].account; }
+    const std::string& asset(uint32_t position) const { return leaves[position].asset; }
+
+    // Method to get the number of levels below the root (the length of a proof)
+    size_t depth() const { return levels.size() - 1; }
+};
@@ -0,0 +1,139 @@
+#pragma once
+#include "FixedPoint.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Side of an order
+enum class OrderSide : uint8_t
+{
+    OS_Buy,   // Bid: wants the coin, pays USD
+    OS_Sell   // Ask: gives the coin, receives USD
+};
+
+// One match between a resting (maker) order and an incoming (taker) order, at the maker's price
+struct Fill
+{
+    uint64_t makerOrder;  // ID of the resting order
+    uint64_t takerOrder;  // ID of the incoming order
+    uint32_t makerOwner;  // Owner handle of the resting order
+    uint32_t takerOwner;  // Owner handle of the incoming order
+    OrderSide takerSide;  // Side of the incoming order
+    bool makerDone;       // The resting order is completely filled and left the book
+    Amount price;         // Execution price (USD per coin)
+    Amount quantity;      // Coins exchanged
+};
+
+// Outcome of a submitted order
+struct OrderResult
+{
+    bool accepted = false; // False if the price or quantity is invalid (or funds could not be reserved)
+    uint64_t orderId = 0;  // ID of the order (valid for cancel while it rests)
+    Amount filled = 0;     // Quantity matched immediately
+    Amount resting = 0;    // Quantity left in the book (always 0 for market orders)
+    bool duplicate = false; // The order's command ID was already placed (nothing was done again)
+};
+
+// Resting order removed by a cancel
+struct CanceledOrder
+{
+    uint32_t owner;     // Owner handle
+    OrderSide side;     // Side
+    Amount price;       // Limit price
+    Amount remaining;   // Quantity that was still open
+};
+
+// Limit order book for one coin with price-time priority.
+// Prices live on a fixed tick grid mapped to a dense array of levels (index = (price - minPrice) / tick),
+// each level holds an intrusive FIFO list of orders, and orders come from a pooled slab with a free list,
+// so matching walks contiguous memory and never allocates in steady state.
+class OrderBook
+{
+public:
+    // Constructor that covers prices minPrice .. minPrice + (levelCount - 1) * tickSize
+    OrderBook(Amount tickSize, Amount minPrice, uint32_t levelCount, size_t expectedOrders = 4096);
+
+    // Method to submit a limit order: matches what crosses, the rest rests in the book. Fills are appended.
+    OrderResult submitLimit(uint32_t owner, OrderSide side, Amount price, Amount quantity, std::vector<Fill>& fills);
+
+    // Method to submit a market order: matches at any price, the rest is dropped (immediate-or-cancel)
+    OrderResult submitMarket(uint32_t owner, OrderSide side, Amount quantity, std::vector<Fill>& fills);
+
+    // Method to cancel a resting order of the owner (returns false if it is not in the book anymore or not the owner's)
+    bool cancel(uint64_t orderId, uint32_t owner, CanceledOrder& canceled);
+
+    // Method to compute what a market order would match right now: returns the fillable quantity and
+    // stores the USD it would cost or earn (rounded down per level, never less than the fills will pay)
+    Amount quote(OrderSide side, Amount quantity, Amount& usd) const;
+
+    // Method to remove every resting order (appends the order IDs and what was still open)
+    void cancelAll(std::vector<std::pair<uint64_t, CanceledOrder>>& canceled);
+
+    // Methods to get the best prices (0 if that side is empty)
+    Amount bestBid() const;
+    Amount bestAsk() const;
+
+    // Method to get up to maxLevels (price, quantity) levels of one side, best first
+    std::vector<std::pair<Amount, Amount>> depth(OrderSide side, size_t maxLevels) const;
+
+    // Method to get the number of resting orders
+    size_t orderCount() const { return liveOrders; }
+
+    // Method to check if a price is on the grid
+    bool validPrice(Amount price) const;
+
+    // Method to get the USD value of a fill (rounded down)
+    static Amount notional(Amount quantity, Amount price);
+
+private:
+    static constexpr uint32_t nil = 0xFFFFFFFFu; // End of an intrusive list
+
+    // Pooled order, linked into the FIFO of its price level
+    struct Order
+    {
+        uint32_t prev;        // Previous order in the level (older)
+        uint32_t next;        // Next order in the level (newer)
+        uint32_t owner;       // Owner handle
+        uint32_t generation;  // Bumped on reuse so stale IDs are rejected
+        uint32_t level;       // Index of the price level
+        OrderSide side;       // Side
+        bool live;            // In the book
+        Amount remaining;     // Open quantity
+    };
+
+    // One price level: FIFO of orders and their total quantity
+    struct Level
+    {
+        uint32_t head;        // Oldest order
+        uint32_t tail;        // Newest order
+        Amount quantity;      // Sum of the open quantities
+    };
+
+    Amount tick;                      // Price step
+    Amount minPrice;                  // Price of level 0
+    std::vector<Level> levels;        // Dense price levels (bids and asks share the grid)
+    std::vector<Order> pool;          // Order slab
+    std::vector<uint32_t> freeSlots;  // Reusable slab indices
+    int64_t bestBidLevel;             // Highest non-empty bid level (-1 if none)
+    int64_t bestAskLevel;             // Lowest non-empty ask level (levels.size() if none)
+    size_t liveOrders;                // Number of resting orders
+
+    // Methods to convert between prices and level indices
+    Amount priceOf(int64_t level) const { return minPrice + level * tick; }
+    int64_t levelOf(Amount price) const { return (price - minPrice) / tick; }
+
+    // Method to build the public ID of a slab slot
+    uint64_t idOf(uint32_t slot) const { return (static_cast<uint64_t>(pool[slot].generation) << 32) | slot; }
+
+    // Method to take a slot from the pool
+    uint32_t allocate();
+
+    // Method to unlink an order from its level and return its slot to the pool
+    void release(uint32_t slot);
+
+    // Method to match an incoming order against the opposite side up to a limit level
+    Amount match(uint32_t owner, uint64_t takerId, OrderSide side, int64_t limitLevel, Amount quantity, std::vector<Fill>& fills);
+
+    // Method to move the best bid/ask past levels that became empty
+    void refreshBest();
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include "MarketData.h"
+#include "SQLData.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Values every account's holdings at the current prices.
+// Holdings are stored as a struct of arrays grouped by account (asset index, amount in units), so a pass over
+// all accounts is a gather from a dense price vector and a multiply; the AVX2 kernel does four holdings per
+// instruction and a scalar kernel is used when the CPU has no AVX2. Accounts are split into chunks valued on
+// several threads. Not thread-safe: build, price and value from one thread (valueAll uses its own workers).
+class PortfolioValuation
+{
+private:
+    std::vector<std::string> accountNames;                // Account of every row
+    std::unordered_map<std::string, uint32_t> accountIds; // User ID -> row
+    std::vector<uint32_t> offsets;                        // Holdings of row r are [offsets[r], offsets[r + 1])
+    std::vector<int32_t> assetIndex;                      // Asset of every holding
+    std::vector<double> amounts;                          // Units of every holding
+    std::vector<std::string> assetNames;                  // Asset of every price
+    std::unordered_map<std::string, uint32_t> assetIds;   // Asset name -> index
+    std::vector<double> prices;                           // USD per unit of every asset
+    std::vector<double> values;                           // USD value of every account after valueAll
+    unsigned threadCount;                                 // Worker threads (0 = one per core)
+    bool simdEnabled;                                     // Use the AVX2 kernel when the CPU has it
+
+    // Method to value the accounts [firstRow, lastRow) into values (scratch holds one value per holding)
+    void valueRows(size_t firstRow, size_t lastRow, std::vector<double>& scratch);
+
+public:
+    // Constructor that sets the number of worker threads
+    explicit PortfolioValuation(unsigned threads = 0);
+
+    // Method to remove every account and asset
+    void clear();
+
+    // Method to get the index of an asset, adding it with price 0 if it is new
+    uint32_t assetId(const std::string& assetName);
+
+    // Methods to append an account and its holdings (holdings belong to the account added last)
+    void beginAccount(const std::string& userID);
+    void addHolding(uint32_t asset, double units);
+
+    // Method to load every user balance (COINS and BALANCE) from the database
+    bool load(SQLData& sqlData);
+
+    // Method to set the price of one asset in USD
+    void setPrice(uint32_t asset, double usdPrice);
+
+    // Method to price every asset from a snapshot (coins) and the FX rates (currencies); returns the assets left without a price
+    size_t updatePrices(const PriceSnapshot& snapshot, const MarketData& market);
+
+    // Method to value every account at the current prices
+    void valueAll();
+
+    // Method to get the value of an account in USD after valueAll (0 if unknown)
+    double value(const std::string& userID) const;
+
+    // Method to get the values of all accounts in row order
+    const std::vector<double>& accountValues() const { return values; }
+
+    // Method to get the number of accounts and holdings
+    size_t accountCount() const { return accountNames.size(); }
+    size_t holdingCount() const { return amounts.size(); }
+
+    // Method to change the number of worker threads (0 = one per core)
+    void setThreadCount(unsigned threads);
+
+    // Method to allow or forbid the AVX2 kernel (benchmarks compare both; allowed by default)
+    void setSimdEnabled(bool enabled) { simdEnabled = enabled; }
+
+    // Method to get the name of the kernel valueAll uses
+    const char* kernelName() const;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "PriceHistory.h"
+#include "imgui.h"
+#include <string>
+#include <vector>
+
+// How the chart draws its buckets
+enum class ChartStyle
+{
+    CS_Line,      // Close prices joined by a line, with the min-max range of every pixel column
+    CS_Candles,   // One candlestick per few pixels
+};
+
+// Prices of one bucket of the visible range after decimation
+struct ChartBucket
+{
+    double open;      // First price in the bucket
+    double high;      // Highest price
+    double low;       // Lowest price
+    double close;     // Last price
+    bool filled;      // Flag to check if any price fell in the bucket
+};
+
+// Price chart widget for one coin of a PriceHistory.
+// The visible range is cut into buckets (one per pixel column for lines, one per candle for candlesticks) and
+// the finest source data that fits a few points per bucket (raw ticks, or 1s, 1m or 1h candles) is folded into
+// them once: a frame draws at most one primitive per bucket, however long the series is. The buckets are cached
+// and rebuilt only when the history gets new prices, the coin, the style or the size changes, or the view is
+// zoomed (mouse wheel) or panned (drag; double-click returns to the latest prices).
+class PriceChart
+{
+private:
+    // Cached decimation and what it was built from
+    std::vector<ChartBucket> buckets;  // Buckets of the visible range, oldest first
+    std::string cachedCoin;            // Coin the buckets show
+    int64_t cachedFrom;                // Start of the first bucket (milliseconds since the Unix epoch)
+    int64_t cachedBucketMillis;        // Time covered by one bucket
+    uint64_t cachedRevision;           // History revision the buckets were built at
+    double lowest;                     // Lowest price of the buckets
+    double highest;                    // Highest price of the buckets
+    const char* sourceName;            // Data the buckets were built from ("ticks", "1s", "1m", "1h")
+    size_t sourcePoints;               // Number of ticks or candles folded into the buckets
+
+    std::vector<PriceTick> tickScratch;  // Reused query results
+    std::vector<Candle> candleScratch;
+    std::vector<ImVec2> linePoints;      // Close prices of the line being drawn
+
+    // View state
+    ChartStyle style;                  // Lines or candlesticks
+    int64_t spanMillis;                // Visible time range
+    int64_t panMillis;                 // How far the right edge is behind the latest prices
+    size_t pointsPerBucket;            // Most source points folded into one bucket before a coarser tier is used
+    uint64_t rebuildCount;             // Number of times the buckets were rebuilt
+
+    // Method to fold the source data of [from, from + count * bucketMillis) into the buckets
+    void rebuild(const PriceHistory& history, const std::string& coinName, int64_t from, int64_t bucketMillis, size_t count);
+
+public:
+    // Constructor that shows the last hour as a line
+    PriceChart();
+
+    // Methods to fold time-sorted prices into the out.size() buckets of bucketMillis starting at from (a tick is a candle with one price)
+    static void decimate(const PriceTick* ticks, size_t tickCount, int64_t from, int64_t bucketMillis, std::vector<ChartBucket>& out);
+    static void decimate(const Candle* candles, size_t candleCount, int64_t from, int64_t bucketMillis, std::vector<ChartBucket>& out);
+
+    // Method to draw the chart of a coin into the current window (size.x/y <= 0 take the available space)
+    void draw(const char* id, const PriceHistory& history, const std::string& coinName, ImVec2 size);
+
+    // Methods to change the view
+    void setStyle(ChartStyle chartStyle) { style = chartStyle; }
+    ChartStyle getStyle() const { return style; }
+    void setSpan(int64_t millis);
+    int64_t getSpan() const { return spanMillis; }
+    void setDetail(size_t maxPointsPerBucket) { pointsPerBucket = maxPointsPerBucket ? maxPointsPerBucket : 1; }
+
+    // Methods to inspect the cache (the dashboard shows them, benchmarks check them)
+    uint64_t rebuilds() const { return rebuildCount; }
+    size_t bucketCount() const { return buckets.size(); }
+    size_t sourceCount() const { return sourcePoints; }
+    const char* source() const { return sourceName; }
+};
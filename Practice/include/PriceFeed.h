@@ -0,0 +1,70 @@
+#pragma once
+#include "MarketData.h"
+#include "PriceHistory.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Counters of the feed since it was started
+struct PriceFeedStats
+{
+    uint64_t updates = 0;    // Price updates read (lines or simulated ticks)
+    uint64_t publishes = 0;  // Snapshots published (updates read together are published together)
+    uint64_t rejected = 0;   // Lines that could not be parsed or named an unknown coin
+};
+
+// Background service that keeps the MarketData prices live.
+// In file mode it follows a text file that another process appends "<coin> <price>" lines to (like tail -f;
+// lines starting with '#' are ignored and a truncated file is read again from the start). In simulated mode it
+// stands in for a feed with a random walk of every listed coin. Either way, everything read in one poll is
+// published as one snapshot, so readers see all of it or none of it. Published prices are also recorded
+// in the price history when one is attached.
+class PriceFeed
+{
+private:
+    MarketData& market;                  // Prices to keep up to date
+    PriceHistory* history;               // Where published prices are recorded (optional)
+    std::thread worker;                  // Feed thread
+    std::mutex mutex;                    // Guards running (for the timed wait)
+    std::condition_variable wakeWorker;  // Signalled on stop
+    bool running;                        // Flag to check if the worker should keep running
+    PriceSnapshot recorded;              // Reused snapshot for recording the history
+
+    std::atomic<uint64_t> updates;
+    std::atomic<uint64_t> publishes;
+    std::atomic<uint64_t> rejected;
+
+    // Method to record the prices of a batch that the market knows
+    void record(const std::vector<std::pair<std::string, double>>& batch);
+
+    // Method to wait for the next poll (false once stopped)
+    bool waitFor(int millis);
+
+    // Worker loops of the two modes
+    void runFile(std::string path, int pollMillis);
+    void runSimulated(int ticksPerSecond, double volatility, unsigned seed);
+
+public:
+    // Constructor that attaches the feed to the market data (and the history the prices are recorded in)
+    explicit PriceFeed(MarketData& market, PriceHistory* history = nullptr);
+
+    // Destructor that stops the worker
+    ~PriceFeed();
+
+    // Method to follow a price file, polling it every pollMillis
+    bool startFile(const std::string& path, int pollMillis = 50);
+
+    // Method to simulate a feed: every tick moves every coin by a random relative step (volatility = its standard deviation)
+    bool startSimulated(int ticksPerSecond = 20, double volatility = 0.0005, unsigned seed = 1);
+
+    // Method to stop the worker
+    void stop();
+
+    // Method to check if the worker is running
+    bool isRunning() const { return worker.joinable(); }
+
+    // Method to get the counters
+    PriceFeedStats stats() const;
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// One raw price update
+struct PriceTick
+{
+    int64_t time;   // Milliseconds since the Unix epoch
+    double price;   // USD per coin
+};
+
+// Open/high/low/close of one time bucket
+struct Candle
+{
+    int64_t start;    // Start of the bucket (milliseconds since the Unix epoch)
+    double open;      // First price in the bucket
+    double high;      // Highest price
+    double low;       // Lowest price
+    double close;     // Last price
+    uint32_t ticks;   // Number of ticks aggregated
+};
+
+// Aggregation levels, finest first
+enum class HistoryTier
+{
+    HT_Second,
+    HT_Minute,
+    HT_Hour,
+};
+
+// Price history of every coin: a ring buffer of the latest raw ticks plus 1s, 1m and 1h candles built as
+// the ticks arrive. Charts read the candles of the tier that fits their range instead of the ticks.
+// Series are sorted by time, so a range query is a binary search plus a copy of the result.
+// Closed candles are appended to one file per coin and tier (<directory>/<coin>.1s, .1m, .1h; 44-byte
+// records) and read back by open(). Thread-safe: one writer (the price feed) and any number of readers.
+class PriceHistory
+{
+public:
+    static constexpr size_t tierCount = 3;
+
+    // Method to get the bucket width of a tier in milliseconds
+    static int64_t tierMillis(HistoryTier tier);
+
+    // Method to get the short name of a tier ("1s", "1m", "1h")
+    static const char* tierName(HistoryTier tier);
+
+private:
+    // Candles of one tier: closed ones in time order and the one still filling
+    struct CandleSeries
+    {
+        std::vector<Candle> closed;   // Closed candles, oldest first (the oldest are dropped past the memory limit)
+        Candle current = {};          // Candle of the newest bucket
+        bool hasCurrent = false;      // Flag to check if current holds a tick
+        int64_t closedUntil = INT64_MIN; // End of the newest persisted bucket (older ticks are not aggregated again)
+        std::ofstream file;           // Append-only file of the closed candles
+    };
+
+    // History of one coin
+    struct CoinSeries
+    {
+        std::vector<PriceTick> ring;  // Latest raw ticks (circular)
+        size_t ringStart = 0;         // Position of the oldest tick in ring
+        size_t ringCount = 0;         // Ticks held
+        CandleSeries tiers[tierCount];
+    };
+
+    mutable std::shared_mutex mutex;                         // Guards series (shared by readers)
+    std::map<std::string, std::unique_ptr<CoinSeries>> series; // Coin name -> history
+    std::string directory;                                   // Where candles are persisted (empty = memory only)
+    size_t ringCapacity;                                     // Raw ticks kept per coin
+    size_t closedLimits[tierCount];                          // Closed candles kept in memory per coin and tier
+    std::atomic<uint64_t> revisionCounter;                   // Changes on every tick (charts cache by it)
+
+    // Method to find or create the history of a coin
+    CoinSeries& coinSeries(const std::string& coinName);
+
+    // Method to fold a tick into a tier, closing (and persisting) the previous candle when a new bucket starts
+    void aggregate(CandleSeries& tier, HistoryTier level, int64_t time, double price);
+
+    // Method to get the i-th oldest raw tick
+    static const PriceTick& tickAt(const CoinSeries& coin, size_t i) { return coin.ring[(coin.ringStart + i) % coin.ring.size()]; }
+
+    // Method to find the first raw tick at or after a time (binary search)
+    static size_t firstTickAt(const CoinSeries& coin, int64_t time);
+
+public:
+    // Constructor that sets how many raw ticks are kept per coin
+    explicit PriceHistory(size_t ticksPerCoin = 65536);
+
+    // Destructor that closes the files
+    ~PriceHistory();
+
+    // Method to load the candles persisted in a directory and append new ones there (created if needed)
+    bool open(const std::string& directoryPath);
+
+    // Method to set how many closed candles of a tier stay in memory per coin (0 = no limit)
+    void setMemoryLimit(HistoryTier tier, size_t candles);
+
+    // Method to record a price; ticks older than the coin's newest tick are rejected (returns false)
+    bool addTick(const std::string& coinName, int64_t time, double price);
+
+    // Method to copy the raw ticks with from <= time <= to; returns how many were copied
+    size_t ticks(const std::string& coinName, int64_t from, int64_t to, std::vector<PriceTick>& out) const;
+
+    // Method to count the raw ticks with from <= time <= to; complete tells if the ring still holds every tick since from
+    size_t tickCount(const std::string& coinName, int64_t from, int64_t to, bool& complete) const;
+
+    // Method to copy the candles of a tier whose bucket overlaps [from, to] (the unfinished one included); returns how many
+    size_t candles(const std::string& coinName, HistoryTier tier, int64_t from, int64_t to, std::vector<Candle>& out) const;
+
+    // Method to pick the finest tier that covers [from, to] with at most maxCandles candles
+    static HistoryTier tierFor(int64_t from, int64_t to, size_t maxCandles);
+
+    // Method to get the time span of a coin's history (false if it has none)
+    bool timeRange(const std::string& coinName, int64_t& first, int64_t& last) const;
+
+    // Method to get the names of the coins with history
+    std::vector<std::string> coinNames() const;
+
+    // Method to get a counter that changes whenever a tick is added
+    uint64_t revision() const { return revisionCounter.load(std::memory_order_acquire); }
+
+    // Method to get the current time in milliseconds since the Unix epoch
+    static int64_t nowMillis();
+};
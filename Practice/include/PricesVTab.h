@@ -0,0 +1,42 @@
+#pragma once
+#include <sqlite3.h>
+#include "MarketData.h"
+
+// Prices the SQL of one connection reads (PRICES and coin_value). A pin copies one snapshot and every statement
+// run under it reads only that copy, so a join (which filters PRICES again for each outer row) or a coin_value per
+// row never mixes two price versions. Without a pin, each PRICES cursor copies a snapshot when its statement opens it.
+struct PinnedPrices
+{
+    MarketData* market = nullptr;   // Source of the snapshots
+    PriceSnapshot snapshot;         // Copy taken by the outermost pin
+    int depth = 0;                  // Pins held (0 = not pinned)
+
+    // Method to copy the current prices unless a pin is already held
+    void pin();
+
+    // Method to release one pin
+    void unpin() { --depth; }
+};
+
+// Holds a pin for the lifetime of a query
+class PricePin
+{
+private:
+    PinnedPrices& prices;
+
+public:
+    // Constructor that pins the current prices
+    explicit PricePin(PinnedPrices& pinned) : prices(pinned) { prices.pin(); }
+
+    // Destructor that releases the pin
+    ~PricePin() { prices.unpin(); }
+
+    PricePin(const PricePin&) = delete;
+    PricePin& operator=(const PricePin&) = delete;
+};
+
+// Registers the eponymous PRICES virtual table on a connection.
+// PRICES(coin_name TEXT, price REAL, snapshot_version INTEGER) reads the MarketData prices without a lock:
+// a statement sees one consistent snapshot (the pinned one, or one copied when it opens the table).
+// Equality on coin_name is answered with a hash lookup, so JOINs against COINS stay index-like.
+bool registerPricesModule(sqlite3* db, PinnedPrices* prices);
@@ -1,11 +1,32 @@
 #pragma once
 #include <sqlite3.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
 #include "User.h"
+#include "LatencyVFS.h"
+#include "SQLFunctions.h"
+#include "PricesVTab.h"
+#include "FixedPoint.h"
+#include "Sha256.h"
+
+// One coin row of a user joined with its current price
+struct CoinHolding
+{
+    std::string coinName; // Name of the coin
+    float amount;         // Amount held
+    double value;         // Value in USD at the current price (0 if the coin has no price)
+};
 
 class SQLData
 {
 private:
     sqlite3* db;
+    std::map<std::string, sqlite3_stmt*> statementCache; // Prepared statements reused by the hot paths
+    std::string openedName;  // File name passed to open (so other connections can open the same database)
+    std::string openedVFS;   // VFS passed to open (empty for the default VFS)
+    PinnedPrices pinnedPrices; // Prices read by PRICES and coin_value (pinned around every valuation query)
 
 #pragma region CREATE_ID_TABLE
     std::string createTableQuery =
@@ -26,7 +47,8 @@ private:
         "coin_name TEXT NOT NULL, "
         "amount REAL NOT NULL, "
         "FOREIGN KEY(user_id) REFERENCES DATA(id)"
-        ");";
+        ");"
+        "CREATE INDEX IF NOT EXISTS COINS_USER_COIN ON COINS (user_id, coin_name);";
 #pragma endregion
 
 #pragma region CREATE_MONEY_DATA
@@ -37,9 +59,156 @@ private:
         "money_name TEXT NOT NULL, "  
         "amount REAL NOT NULL, "
         "FOREIGN KEY(user_id) REFERENCES DATA(id)"
-        ");";
+        ");"
+        "CREATE INDEX IF NOT EXISTS BALANCE_USER_MONEY ON BALANCE (user_id, money_name);";
+
+
+#pragma endregion
+
+#pragma region CREATE_FX_RATES
+    // usd_rate is the value of 1 unit of money_name in USD
+    std::string createFxRates =
+        "CREATE TABLE IF NOT EXISTS FX_RATES ("
+        "money_name TEXT PRIMARY KEY, "
+        "usd_rate REAL NOT NULL"
+        ");"
+        "INSERT OR IGNORE INTO FX_RATES (money_name, usd_rate) VALUES "
+        "('USD', 1.0), ('EUR', 1.08), ('GBP', 1.27), ('JPY', 0.0067), ('UAH', 0.024), "
+        "('CAD', 0.73), ('AUD', 0.66), ('CHF', 1.13), ('CNY', 0.138), ('INR', 0.012);";
+#pragma endregion
 
+#pragma region CREATE_JOURNAL
+    // Append-only double-entry journal: every balance change is one TRANSACTIONS row plus postings that sum to zero per asset.
+    // Amounts are fixed-point integers (FixedPoint::SCALE); book is the DataBaseState of the balance table the posting belongs to.
+    std::string createTransactions =
+        "CREATE TABLE IF NOT EXISTS TRANSACTIONS ("
+        "id INTEGER PRIMARY KEY, "
+        "kind TEXT NOT NULL, "
+        "created_at INTEGER NOT NULL, "
+        "memo TEXT NOT NULL DEFAULT ''"
+        ");";
 
+    std::string createPostings =
+        "CREATE TABLE IF NOT EXISTS POSTINGS ("
+        "id INTEGER PRIMARY KEY, "
+        "tx_id INTEGER NOT NULL, "
+        "user_id TEXT NOT NULL, "
+        "asset TEXT NOT NULL, "
+        "book INTEGER NOT NULL, "
+        "amount INTEGER NOT NULL, "
+        "created_at INTEGER NOT NULL, "
+        "FOREIGN KEY(tx_id) REFERENCES TRANSACTIONS(id)"
+        ");"
+        "CREATE INDEX IF NOT EXISTS POSTINGS_USER ON POSTINGS (user_id);"
+        "CREATE INDEX IF NOT EXISTS POSTINGS_ASSET ON POSTINGS (asset);"
+        "CREATE INDEX IF NOT EXISTS POSTINGS_TX ON POSTINGS (tx_id);";
+
+    // Integrity chain: one row per committed journal batch, chain_hash = SHA-256(previous chain_hash, seq, batch_hash, state_root).
+    // state_root is the Merkle root over every user balance after the batch; MERKLE_LEAVES fixes the leaf position of each balance.
+    std::string createChain =
+        "CREATE TABLE IF NOT EXISTS CHAIN ("
+        "seq INTEGER PRIMARY KEY, "
+        "first_tx INTEGER NOT NULL, "
+        "last_tx INTEGER NOT NULL, "
+        "batch_hash BLOB NOT NULL, "
+        "state_root BLOB NOT NULL, "
+        "chain_hash BLOB NOT NULL, "
+        "created_at INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS MERKLE_LEAVES ("
+        "position INTEGER PRIMARY KEY, "
+        "user_id TEXT NOT NULL, "
+        "asset TEXT NOT NULL"
+        ");";
+    // Client command IDs applied, with the journal transaction they wrote; rows older than the dedup window are pruned by recorded_at
+    std::string createCommands =
+        "CREATE TABLE IF NOT EXISTS COMMANDS ("
+        "command_id INTEGER PRIMARY KEY, "
+        "tx_id INTEGER NOT NULL, "
+        "recorded_at INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_commands_recorded ON COMMANDS(recorded_at);";
+    // Scheduled and recurring transfers still pending: next_due is the next run (Unix ms), interval_ms = 0 for a one-off,
+    // runs_left = 0 for no limit, occurrence numbers the runs so each one has its own command ID
+    std::string createSchedules =
+        "CREATE TABLE IF NOT EXISTS SCHEDULES ("
+        "id INTEGER PRIMARY KEY, "
+        "kind INTEGER NOT NULL, "
+        "user_id TEXT NOT NULL, "
+        "counterparty TEXT NOT NULL, "
+        "asset TEXT NOT NULL, "
+        "book INTEGER NOT NULL, "
+        "amount INTEGER NOT NULL, "
+        "next_due INTEGER NOT NULL, "
+        "interval_ms INTEGER NOT NULL, "
+        "runs_left INTEGER NOT NULL, "
+        "occurrence INTEGER NOT NULL"
+        ");";
+    // Bulk credit jobs (airdrops, interest, rebates): the accounts are hashed into buckets, one journal transaction per
+    // bucket; a bucket's BULK_CREDIT_BUCKETS row (with what it paid) is written in the database transaction of its credits,
+    // so a rerun skips exactly the buckets that were paid
+    std::string createBulkCredits =
+        "CREATE TABLE IF NOT EXISTS BULK_CREDITS ("
+        "id INTEGER PRIMARY KEY, "
+        "name TEXT NOT NULL UNIQUE, "
+        "targets INTEGER NOT NULL, "
+        "asset TEXT NOT NULL, "
+        "book INTEGER NOT NULL, "
+        "amount INTEGER NOT NULL, "
+        "rate INTEGER NOT NULL, "
+        "funding TEXT NOT NULL, "
+        "buckets INTEGER NOT NULL, "
+        "credited INTEGER NOT NULL DEFAULT 0, "
+        "total INTEGER NOT NULL DEFAULT 0, "
+        "finished INTEGER NOT NULL DEFAULT 0, "
+        "created_at INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS BULK_CREDIT_BUCKETS ("
+        "job_id INTEGER NOT NULL, "
+        "bucket INTEGER NOT NULL, "
+        "credited INTEGER NOT NULL DEFAULT 0, "
+        "total INTEGER NOT NULL DEFAULT 0, "
+        "PRIMARY KEY (job_id, bucket)"
+        ") WITHOUT ROWID;";
+    // Balance checkpoints: a CHECKPOINTS row closes the journal through tx_id (its last posting is posting_id, created_at is
+    // the time of tx_id); BALANCE_CHECKPOINTS holds the new amount of every balance the checkpoint's postings changed, so the
+    // balance at a checkpoint is its newest row at or before it
+    std::string createCheckpoints =
+        "CREATE TABLE IF NOT EXISTS CHECKPOINTS ("
+        "tx_id INTEGER PRIMARY KEY, "
+        "posting_id INTEGER NOT NULL, "
+        "created_at INTEGER NOT NULL, "
+        "balances INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS CHECKPOINTS_TIME ON CHECKPOINTS (created_at);"
+        "CREATE TABLE IF NOT EXISTS BALANCE_CHECKPOINTS ("
+        "user_id TEXT NOT NULL, "
+        "asset TEXT NOT NULL, "
+        "book INTEGER NOT NULL, "
+        "checkpoint INTEGER NOT NULL, "
+        "amount INTEGER NOT NULL, "
+        "PRIMARY KEY (user_id, asset, book, checkpoint)"
+        ") WITHOUT ROWID;";
+    // Interest and staking accruals: one row per run, updated in the write transaction of every chunk, so a rerun
+    // resumes after last_id and a finished run is never paid twice. end_id is the last balance row of the run;
+    // residue is the sum of the fractions rounded off, in billionths of a unit
+    std::string createAccruals =
+        "CREATE TABLE IF NOT EXISTS ACCRUALS ("
+        "id INTEGER PRIMARY KEY, "
+        "name TEXT NOT NULL UNIQUE, "
+        "asset TEXT NOT NULL, "
+        "book INTEGER NOT NULL, "
+        "rate INTEGER NOT NULL, "
+        "funding TEXT NOT NULL, "
+        "end_id INTEGER NOT NULL, "
+        "last_id INTEGER NOT NULL DEFAULT 0, "
+        "accounts INTEGER NOT NULL DEFAULT 0, "
+        "credited INTEGER NOT NULL DEFAULT 0, "
+        "total INTEGER NOT NULL DEFAULT 0, "
+        "residue INTEGER NOT NULL DEFAULT 0, "
+        "finished INTEGER NOT NULL DEFAULT 0, "
+        "created_at INTEGER NOT NULL"
+        ");";
 #pragma endregion
 
 #pragma region ID_QUERY
@@ -64,24 +233,176 @@ public:
         DBS_NONE,
         DBS_DATA,
         DBS_COINS,
-        DBS_BALANCE
+        DBS_BALANCE,
+        DBS_FX_RATES,
+        DBS_TRANSACTIONS,
+        DBS_POSTINGS,
+        DBS_CHAIN,
+        DBS_COMMANDS,
+        DBS_SCHEDULES,
+        DBS_BULK_CREDITS,
+        DBS_CHECKPOINTS,
+        DBS_ACCRUALS
+    };
+
+    // One leg of a journal transaction
+    struct Posting
+    {
+        std::string userID;   // Account (a user ID, or a system account starting with '@')
+        std::string asset;    // Coin or currency name
+        DataBaseState book;   // DBS_COINS or DBS_BALANCE
+        Amount amount;        // Signed fixed-point change
+    };
+
+    // One posting read back from the journal together with its transaction kind
+    struct PostingRecord
+    {
+        sqlite3_int64 id;        // Posting ID (also the pagination cursor)
+        sqlite3_int64 txID;      // Transaction the posting belongs to
+        std::string kind;        // Transaction kind (DEPOSIT, BUY, SEND, ...)
+        std::string userID;      // Account
+        std::string asset;       // Coin or currency name
+        DataBaseState book;      // Balance table
+        Amount amount;           // Signed fixed-point change
+        sqlite3_int64 createdAt; // Unix time in milliseconds
+    };
+
+    // Extra writes committed in the same database transaction as a journal entry (e.g. a job's progress record)
+    using JournalWrite = std::function<bool(SQLData& sqlData, sqlite3_int64 txID)>;
+
+    // One complete transaction waiting to be written to the balance tables and the journal
+    struct JournalEntry
+    {
+        std::string kind;            // Transaction kind
+        std::string memo;            // Free text (e.g. the recipient)
+        sqlite3_int64 createdAt;     // Unix time in milliseconds
+        std::vector<Posting> postings; // Balanced postings
+        uint64_t commandId = 0;      // Client command ID recorded with the transaction (0 = none)
+        JournalWrite alsoWrite;      // Written with the transaction (optional)
+    };
+
+    // One scheduled (possibly recurring) ledger command
+    struct ScheduleRow
+    {
+        sqlite3_int64 id;            // Schedule ID
+        int kind;                    // ScheduleKind
+        std::string userID;          // Payer
+        std::string counterparty;    // Receiver of a send (empty otherwise)
+        std::string asset;           // Coin bought, or asset sent
+        DataBaseState book;          // Book of the asset sent
+        Amount amount;               // USD spent per buy, or amount sent
+        sqlite3_int64 nextDue;       // Unix time in milliseconds of the next run
+        sqlite3_int64 intervalMillis; // Time between runs (0 = once)
+        sqlite3_int64 runsLeft;      // Runs still to do (0 = until canceled)
+        sqlite3_int64 occurrence;    // Runs done so far
+    };
+
+    // One bulk credit job
+    struct BulkCreditRow
+    {
+        sqlite3_int64 id;            // Job ID
+        std::string name;            // Unique name (a rerun with the same name resumes the job)
+        int targets;                 // CreditTargets
+        std::string asset;           // Asset credited
+        DataBaseState book;          // Book of the asset
+        Amount amount;               // Fixed credit per account
+        Amount rate;                 // Credit per unit of the account's base amount (fixed point)
+        std::string funding;         // Account debited with the total
+        sqlite3_int64 buckets;       // Number of buckets (fixed when the job is created)
+        sqlite3_int64 credited;      // Accounts credited so far
+        Amount total;                // Amount credited so far
+        bool finished;               // Every bucket is done
+    };
+
+    // One interest or staking accrual run
+    struct AccrualRow
+    {
+        sqlite3_int64 id = 0;        // Run ID
+        std::string name;            // Unique name (a rerun with the same name resumes the run)
+        std::string asset;           // Asset accrued
+        DataBaseState book = DataBaseState::DBS_COINS; // Book of the asset
+        uint32_t rate = 0;           // Rate of the period (billionths)
+        std::string funding;         // System account debited with each chunk's total
+        sqlite3_int64 endID = 0;     // Last balance row of the run (rows added later are not paid)
+        sqlite3_int64 lastID = 0;    // Last balance row done
+        sqlite3_int64 accounts = 0;  // Balances that qualified so far
+        sqlite3_int64 credited = 0;  // Balances credited so far (the rest rounded to zero)
+        Amount total = 0;            // Amount credited so far
+        sqlite3_int64 residue = 0;   // Fractions rounded off so far (billionths of a unit)
+        bool finished = false;       // Every row through endID is done
     };
 
+    // One balance checkpoint
+    struct CheckpointRow
+    {
+        sqlite3_int64 txID = 0;      // Newest transaction included (0 = no checkpoint: the empty ledger)
+        sqlite3_int64 postingID = 0; // Newest posting included
+        sqlite3_int64 createdAt = 0; // Time of txID (Unix milliseconds)
+        sqlite3_int64 balances = 0;  // Balances the checkpoint stored
+    };
+
+    // One link of the integrity chain (one committed journal batch)
+    struct ChainLink
+    {
+        sqlite3_int64 seq;        // Position in the chain (1 = first batch)
+        sqlite3_int64 firstTxID;  // First transaction of the batch
+        sqlite3_int64 lastTxID;   // Last transaction of the batch
+        Digest batchHash;         // Hash of the batch's transactions and postings
+        Digest stateRoot;         // Merkle root of the user balances after the batch
+        Digest chainHash;         // Hash over the previous link and this one
+        sqlite3_int64 createdAt;  // Unix time in milliseconds
+    };
+
+    static constexpr int maxPostingsPerInsert = 16; // Rows per multi-row POSTINGS insert
+
     DataBaseState dbs;
 
     SQLData() : db(nullptr), dbs(DataBaseState::DBS_NONE) {}
     ~SQLData() {}
-    bool open(const std::string& dbID)
+    bool open(const std::string& dbID, const char* vfsName = nullptr)
     {
-        if (sqlite3_open(dbID.c_str(), &db))
+        if (sqlite3_open_v2(dbID.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfsName))
         {
             std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
             return false;
         }
+
+        // Other connections (background writers) may hold the write lock for a moment
+        sqlite3_busy_timeout(db, 5000);
+
+        openedName = dbID;
+        openedVFS = vfsName ? vfsName : "";
         return true;
     }
+    const std::string& databaseName() const
+    {
+        return openedName;
+    }
+    const char* vfsName() const
+    {
+        return openedVFS.empty() ? nullptr : openedVFS.c_str();
+    }
+    bool isOpen() const
+    {
+        return db != nullptr;
+    }
+    // Opens the database inside the in-memory VFS that injects disk latency and counts I/O (benchmarks only)
+    bool openInLatencyVFS(const std::string& dbID)
+    {
+        if (!LatencyVFS::instance().registerVFS())
+        {
+            return false;
+        }
+        return open(dbID, LatencyVFS::vfsName);
+    }
     bool close()
     {
+        for (auto& cached : statementCache)
+        {
+            sqlite3_finalize(cached.second);
+        }
+        statementCache.clear();
+
         if (db)
         {
             sqlite3_close(db);
@@ -120,12 +441,1845 @@ public:
             std::cout << "[DEBUG] Creating MONEY BALANCE table...\n";
             return execute(createMoneyBalance);  
 
+        case DataBaseState::DBS_FX_RATES:
+            std::cout << "[DEBUG] Creating FX RATES table...\n";
+            return execute(createFxRates);
+
+        case DataBaseState::DBS_TRANSACTIONS:
+            std::cout << "[DEBUG] Creating TRANSACTIONS table...\n";
+            return execute(createTransactions);
+
+        case DataBaseState::DBS_POSTINGS:
+            std::cout << "[DEBUG] Creating POSTINGS table...\n";
+            return execute(createPostings);
+
+        case DataBaseState::DBS_CHAIN:
+            std::cout << "[DEBUG] Creating CHAIN table...\n";
+            return execute(createChain);
+
+        case DataBaseState::DBS_COMMANDS:
+            std::cout << "[DEBUG] Creating COMMANDS table...\n";
+            return execute(createCommands);
+
+        case DataBaseState::DBS_SCHEDULES:
+            std::cout << "[DEBUG] Creating SCHEDULES table...\n";
+            return execute(createSchedules);
+
+        case DataBaseState::DBS_BULK_CREDITS:
+            std::cout << "[DEBUG] Creating BULK CREDITS tables...\n";
+            return execute(createBulkCredits);
+
+        case DataBaseState::DBS_CHECKPOINTS:
+            std::cout << "[DEBUG] Creating CHECKPOINTS tables...\n";
+            return execute(createCheckpoints);
+
+        case DataBaseState::DBS_ACCRUALS:
+            std::cout << "[DEBUG] Creating ACCRUALS table...\n";
+            return execute(createAccruals);
+
         default:
             std::cout << "[ERROR] Invalid table selection\n";
             return false;  
         }
     }
 
+    // Returns a reset prepared statement for the query, preparing it only the first time
+    sqlite3_stmt* prepareCached(const std::string& query)
+    {
+        auto it = statementCache.find(query);
+        if (it != statementCache.end())
+        {
+            sqlite3_reset(it->second);
+            sqlite3_clear_bindings(it->second);
+            return it->second;
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(db, query.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "[ERROR] Prepare failed: " << sqlite3_errmsg(db) << "\n";
+            return nullptr;
+        }
+
+        statementCache[query] = stmt;
+        return stmt;
+    }
+
+    // Savepoints nest, so a ledger transaction can run on its own or inside a larger batch
+    bool savepoint(const std::string& name)
+    {
+        return execute("SAVEPOINT " + name + ";");
+    }
+    bool release(const std::string& name)
+    {
+        return execute("RELEASE " + name + ";");
+    }
+    bool rollbackTo(const std::string& name)
+    {
+        return execute("ROLLBACK TO " + name + ";") && execute("RELEASE " + name + ";");
+    }
+
+    // Reads a COINS/BALANCE amount (0 if the row does not exist) without the float rounding of getCurrentValuteAmount
+    bool readValuteAmount(const std::string& userID, const std::string& valuteName, DataBaseState dbs, double& amount)
+    {
+        const char* query = nullptr;
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            query = "SELECT amount FROM COINS WHERE user_id = ? AND coin_name = ?;";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            query = "SELECT amount FROM BALANCE WHERE user_id = ? AND money_name = ?;";
+            break;
+        default:
+            return false;
+        }
+
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, valuteName.c_str(), -1, SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt);
+        amount = rc == SQLITE_ROW ? sqlite3_column_double(stmt, 0) : 0.0;
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read valute: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Adds a signed delta to a COINS/BALANCE row (creating it if needed) and returns the new amount
+    bool applyValuteDelta(const std::string& userID, const std::string& valuteName, Amount delta, DataBaseState dbs, double& newAmount)
+    {
+        const char* updateQuery = nullptr;
+        const char* insertQuery = nullptr;
+
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            updateQuery = "UPDATE COINS SET amount = amount + ? WHERE user_id = ? AND coin_name = ? RETURNING amount;";
+            insertQuery = "INSERT INTO COINS (user_id, coin_name, amount) VALUES (?, ?, ?);";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            updateQuery = "UPDATE BALANCE SET amount = amount + ? WHERE user_id = ? AND money_name = ? RETURNING amount;";
+            insertQuery = "INSERT INTO BALANCE (user_id, money_name, amount) VALUES (?, ?, ?);";
+            break;
+        default:
+            return false;
+        }
+
+        double deltaValue = FixedPoint::toDouble(delta);
+
+        sqlite3_stmt* stmt = prepareCached(updateQuery);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_double(stmt, 1, deltaValue);
+        sqlite3_bind_text(stmt, 2, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, valuteName.c_str(), -1, SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            newAmount = sqlite3_column_double(stmt, 0);
+            sqlite3_reset(stmt);
+            return true;
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to update valute: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+
+        stmt = prepareCached(insertQuery);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, valuteName.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, deltaValue);
+
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert valute: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+
+        newAmount = deltaValue;
+        return true;
+    }
+
+    // Adds a signed delta to a COINS/BALANCE row (creating it if needed) without reading it back.
+    // Used by the persister, whose deltas were validated in memory: no RETURNING, which costs more than the UPDATE itself.
+    bool addValuteDelta(const std::string& userID, const std::string& valuteName, Amount delta, DataBaseState dbs)
+    {
+        const char* updateQuery = nullptr;
+        const char* insertQuery = nullptr;
+
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            updateQuery = "UPDATE COINS SET amount = amount + ? WHERE user_id = ? AND coin_name = ?;";
+            insertQuery = "INSERT INTO COINS (user_id, coin_name, amount) VALUES (?, ?, ?);";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            updateQuery = "UPDATE BALANCE SET amount = amount + ? WHERE user_id = ? AND money_name = ?;";
+            insertQuery = "INSERT INTO BALANCE (user_id, money_name, amount) VALUES (?, ?, ?);";
+            break;
+        default:
+            return false;
+        }
+
+        double deltaValue = FixedPoint::toDouble(delta);
+
+        sqlite3_stmt* stmt = prepareCached(updateQuery);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_double(stmt, 1, deltaValue);
+        sqlite3_bind_text(stmt, 2, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, valuteName.c_str(), -1, SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to update valute: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        if (sqlite3_changes(db) > 0)
+        {
+            return true;
+        }
+
+        stmt = prepareCached(insertQuery);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, valuteName.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, deltaValue);
+
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert valute: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Appends one transaction and its postings to the journal (postings go in multi-row inserts) and returns the transaction ID
+    sqlite3_int64 insertJournalEntry(const std::string& kind, const std::string& memo, sqlite3_int64 createdAt, const std::vector<Posting>& postings)
+    {
+        sqlite3_stmt* stmt = prepareCached("INSERT INTO TRANSACTIONS (kind, created_at, memo) VALUES (?, ?, ?);");
+        if (!stmt)
+        {
+            return 0;
+        }
+
+        sqlite3_bind_text(stmt, 1, kind.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, createdAt);
+        sqlite3_bind_text(stmt, 3, memo.c_str(), -1, SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert transaction: " << sqlite3_errmsg(db) << "\n";
+            return 0;
+        }
+
+        sqlite3_int64 txID = sqlite3_last_insert_rowid(db);
+
+        for (size_t first = 0; first < postings.size(); first += maxPostingsPerInsert)
+        {
+            size_t count = std::min(postings.size() - first, static_cast<size_t>(maxPostingsPerInsert));
+
+            std::string query = "INSERT INTO POSTINGS (tx_id, user_id, asset, book, amount, created_at) VALUES ";
+            for (size_t i = 0; i < count; ++i)
+            {
+                query += (i == 0) ? "(?, ?, ?, ?, ?, ?)" : ", (?, ?, ?, ?, ?, ?)";
+            }
+            query += ";";
+
+            stmt = prepareCached(query);
+            if (!stmt)
+            {
+                return 0;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const Posting& posting = postings[first + i];
+                int column = static_cast<int>(i) * 6;
+                sqlite3_bind_int64(stmt, column + 1, txID);
+                sqlite3_bind_text(stmt, column + 2, posting.userID.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, column + 3, posting.asset.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, column + 4, static_cast<int>(posting.book));
+                sqlite3_bind_int64(stmt, column + 5, posting.amount);
+                sqlite3_bind_int64(stmt, column + 6, createdAt);
+            }
+
+            rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE)
+            {
+                std::cerr << "Failed to insert postings: " << sqlite3_errmsg(db) << "\n";
+                return 0;
+            }
+        }
+
+        return txID;
+    }
+
+    // Records the client command ID of a transaction (stored as its signed 64-bit bit pattern; an ID reused after
+    // it expired replaces the old row)
+    bool insertCommand(uint64_t commandId, sqlite3_int64 txID, sqlite3_int64 recordedAt)
+    {
+        sqlite3_stmt* stmt = prepareCached("INSERT OR REPLACE INTO COMMANDS (command_id, tx_id, recorded_at) VALUES (?, ?, ?);");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(commandId));
+        sqlite3_bind_int64(stmt, 2, txID);
+        sqlite3_bind_int64(stmt, 3, recordedAt);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert command: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Deletes the command IDs recorded before a time, then calls visit for every remaining one
+    bool loadCommands(sqlite3_int64 recordedSince, const std::function<void(uint64_t, sqlite3_int64)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached("DELETE FROM COMMANDS WHERE recorded_at < ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+        sqlite3_bind_int64(stmt, 1, recordedSince);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to prune commands: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+
+        stmt = prepareCached("SELECT command_id, recorded_at FROM COMMANDS ORDER BY recorded_at;");
+        if (!stmt)
+        {
+            return false;
+        }
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(static_cast<uint64_t>(sqlite3_column_int64(stmt, 0)), sqlite3_column_int64(stmt, 1));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read commands: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Inserts a schedule and returns its ID (0 on failure)
+    sqlite3_int64 insertSchedule(const ScheduleRow& row)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "INSERT INTO SCHEDULES (kind, user_id, counterparty, asset, book, amount, next_due, interval_ms, runs_left, occurrence) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+        if (!stmt)
+        {
+            return 0;
+        }
+
+        sqlite3_bind_int(stmt, 1, row.kind);
+        sqlite3_bind_text(stmt, 2, row.userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, row.counterparty.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, row.asset.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 5, static_cast<int>(row.book));
+        sqlite3_bind_int64(stmt, 6, row.amount);
+        sqlite3_bind_int64(stmt, 7, row.nextDue);
+        sqlite3_bind_int64(stmt, 8, row.intervalMillis);
+        sqlite3_bind_int64(stmt, 9, row.runsLeft);
+        sqlite3_bind_int64(stmt, 10, row.occurrence);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert schedule: " << sqlite3_errmsg(db) << "\n";
+            return 0;
+        }
+        return sqlite3_last_insert_rowid(db);
+    }
+
+    // Moves a schedule to its next run
+    bool updateSchedule(sqlite3_int64 id, sqlite3_int64 nextDue, sqlite3_int64 runsLeft, sqlite3_int64 occurrence)
+    {
+        sqlite3_stmt* stmt = prepareCached("UPDATE SCHEDULES SET next_due = ?, runs_left = ?, occurrence = ? WHERE id = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, nextDue);
+        sqlite3_bind_int64(stmt, 2, runsLeft);
+        sqlite3_bind_int64(stmt, 3, occurrence);
+        sqlite3_bind_int64(stmt, 4, id);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to update schedule: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Deletes a finished or canceled schedule
+    bool deleteSchedule(sqlite3_int64 id)
+    {
+        sqlite3_stmt* stmt = prepareCached("DELETE FROM SCHEDULES WHERE id = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, id);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to delete schedule: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every schedule
+    bool forEachSchedule(const std::function<void(const ScheduleRow&)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT id, kind, user_id, counterparty, asset, book, amount, next_due, interval_ms, runs_left, occurrence FROM SCHEDULES;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        ScheduleRow row;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            row.id = sqlite3_column_int64(stmt, 0);
+            row.kind = sqlite3_column_int(stmt, 1);
+            row.userID = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            row.counterparty = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            row.asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            row.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 5));
+            row.amount = sqlite3_column_int64(stmt, 6);
+            row.nextDue = sqlite3_column_int64(stmt, 7);
+            row.intervalMillis = sqlite3_column_int64(stmt, 8);
+            row.runsLeft = sqlite3_column_int64(stmt, 9);
+            row.occurrence = sqlite3_column_int64(stmt, 10);
+            visit(row);
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read schedules: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Inserts a bulk credit job and returns its ID (0 on failure)
+    sqlite3_int64 insertBulkCredit(const BulkCreditRow& row, sqlite3_int64 createdAt)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "INSERT INTO BULK_CREDITS (name, targets, asset, book, amount, rate, funding, buckets, created_at) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);");
+        if (!stmt)
+        {
+            return 0;
+        }
+
+        sqlite3_bind_text(stmt, 1, row.name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, row.targets);
+        sqlite3_bind_text(stmt, 3, row.asset.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, static_cast<int>(row.book));
+        sqlite3_bind_int64(stmt, 5, row.amount);
+        sqlite3_bind_int64(stmt, 6, row.rate);
+        sqlite3_bind_text(stmt, 7, row.funding.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 8, row.buckets);
+        sqlite3_bind_int64(stmt, 9, createdAt);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert bulk credit: " << sqlite3_errmsg(db) << "\n";
+            return 0;
+        }
+        return sqlite3_last_insert_rowid(db);
+    }
+
+    // Reads a bulk credit job by name (false if there is none)
+    bool findBulkCredit(const std::string& name, BulkCreditRow& row)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT id, targets, asset, book, amount, rate, funding, buckets, credited, total, finished FROM BULK_CREDITS WHERE name = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            row.id = sqlite3_column_int64(stmt, 0);
+            row.name = name;
+            row.targets = sqlite3_column_int(stmt, 1);
+            row.asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            row.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 3));
+            row.amount = sqlite3_column_int64(stmt, 4);
+            row.rate = sqlite3_column_int64(stmt, 5);
+            row.funding = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+            row.buckets = sqlite3_column_int64(stmt, 7);
+            row.credited = sqlite3_column_int64(stmt, 8);
+            row.total = sqlite3_column_int64(stmt, 9);
+            row.finished = sqlite3_column_int(stmt, 10) != 0;
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW;
+    }
+
+    // Stores the progress of a bulk credit job
+    bool updateBulkCredit(sqlite3_int64 id, sqlite3_int64 credited, Amount total, bool finished)
+    {
+        sqlite3_stmt* stmt = prepareCached("UPDATE BULK_CREDITS SET credited = ?, total = ?, finished = ? WHERE id = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, credited);
+        sqlite3_bind_int64(stmt, 2, total);
+        sqlite3_bind_int(stmt, 3, finished ? 1 : 0);
+        sqlite3_bind_int64(stmt, 4, id);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to update bulk credit: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Marks a bucket of a bulk credit job as done
+    bool insertBulkCreditBucket(sqlite3_int64 jobID, sqlite3_int64 bucket, sqlite3_int64 credited, Amount total)
+    {
+        sqlite3_stmt* stmt = prepareCached("INSERT OR IGNORE INTO BULK_CREDIT_BUCKETS (job_id, bucket, credited, total) VALUES (?, ?, ?, ?);");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, jobID);
+        sqlite3_bind_int64(stmt, 2, bucket);
+        sqlite3_bind_int64(stmt, 3, credited);
+        sqlite3_bind_int64(stmt, 4, total);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert bulk credit bucket: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every done bucket of a bulk credit job, with the accounts and the amount it credited
+    bool forEachBulkCreditBucket(sqlite3_int64 jobID, const std::function<void(sqlite3_int64 bucket, sqlite3_int64 credited, Amount total)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT bucket, credited, total FROM BULK_CREDIT_BUCKETS WHERE job_id = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, jobID);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1), sqlite3_column_int64(stmt, 2));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read bulk credit buckets: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every registered user ID
+    bool forEachUserID(const std::function<void(const char* userID)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT DISTINCT user_id FROM DATA;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read user IDs: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Inserts an accrual run and returns its ID (0 on failure)
+    sqlite3_int64 insertAccrual(const AccrualRow& row, sqlite3_int64 createdAt)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "INSERT INTO ACCRUALS (name, asset, book, rate, funding, end_id, created_at) VALUES (?, ?, ?, ?, ?, ?, ?);");
+        if (!stmt)
+        {
+            return 0;
+        }
+
+        sqlite3_bind_text(stmt, 1, row.name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, row.asset.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, static_cast<int>(row.book));
+        sqlite3_bind_int64(stmt, 4, row.rate);
+        sqlite3_bind_text(stmt, 5, row.funding.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 6, row.endID);
+        sqlite3_bind_int64(stmt, 7, createdAt);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert accrual: " << sqlite3_errmsg(db) << "\n";
+            return 0;
+        }
+        return sqlite3_last_insert_rowid(db);
+    }
+
+    // Reads an accrual run by name (false if there is none)
+    bool findAccrual(const std::string& name, AccrualRow& row)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT id, asset, book, rate, funding, end_id, last_id, accounts, credited, total, residue, finished FROM ACCRUALS WHERE name = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            row.id = sqlite3_column_int64(stmt, 0);
+            row.name = name;
+            row.asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            row.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 2));
+            row.rate = static_cast<uint32_t>(sqlite3_column_int64(stmt, 3));
+            row.funding = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            row.endID = sqlite3_column_int64(stmt, 5);
+            row.lastID = sqlite3_column_int64(stmt, 6);
+            row.accounts = sqlite3_column_int64(stmt, 7);
+            row.credited = sqlite3_column_int64(stmt, 8);
+            row.total = sqlite3_column_int64(stmt, 9);
+            row.residue = sqlite3_column_int64(stmt, 10);
+            row.finished = sqlite3_column_int(stmt, 11) != 0;
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW;
+    }
+
+    // Stores the progress of an accrual run (inside the chunk's write transaction)
+    bool updateAccrual(const AccrualRow& row)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "UPDATE ACCRUALS SET last_id = ?, accounts = ?, credited = ?, total = ?, residue = ?, finished = ? WHERE id = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, row.lastID);
+        sqlite3_bind_int64(stmt, 2, row.accounts);
+        sqlite3_bind_int64(stmt, 3, row.credited);
+        sqlite3_bind_int64(stmt, 4, row.total);
+        sqlite3_bind_int64(stmt, 5, row.residue);
+        sqlite3_bind_int(stmt, 6, row.finished ? 1 : 0);
+        sqlite3_bind_int64(stmt, 7, row.id);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to update accrual: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads up to limit COINS or BALANCE rows of an asset with afterID < id <= toID and at least minimum as columns:
+    // row IDs, account names (packed back to back, '\0'-terminated) and fixed-point amounts. Call inside a transaction.
+    bool readBalanceColumns(DataBaseState dbs, const std::string& asset, Amount minimum, sqlite3_int64 afterID, sqlite3_int64 toID, int limit,
+        std::vector<sqlite3_int64>& rowIDs, std::vector<char>& names, std::vector<Amount>& amounts)
+    {
+        const char* query = nullptr;
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            query = "SELECT id, user_id, amount FROM COINS WHERE id > ? AND id <= ? AND coin_name = ? AND amount >= ? ORDER BY id LIMIT ?;";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            query = "SELECT id, user_id, amount FROM BALANCE WHERE id > ? AND id <= ? AND money_name = ? AND amount >= ? ORDER BY id LIMIT ?;";
+            break;
+        default:
+            return false;
+        }
+
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        rowIDs.clear();
+        names.clear();
+        amounts.clear();
+        sqlite3_bind_int64(stmt, 1, afterID);
+        sqlite3_bind_int64(stmt, 2, toID);
+        sqlite3_bind_text(stmt, 3, asset.c_str(), -1, SQLITE_STATIC);
+        // Half a unit below the minimum, for the float history of the REAL columns
+        sqlite3_bind_double(stmt, 4, (static_cast<double>(minimum) - 0.5) / static_cast<double>(FixedPoint::SCALE));
+        sqlite3_bind_int(stmt, 5, limit);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            const char* userID = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            rowIDs.push_back(sqlite3_column_int64(stmt, 0));
+            names.insert(names.end(), userID, userID + std::strlen(userID) + 1);
+            amounts.push_back(FixedPoint::fromDouble(sqlite3_column_double(stmt, 2)));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read balances of " << asset << ": " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every account holding at least minimum of an asset
+    bool forEachHolder(const std::string& asset, DataBaseState dbs, Amount minimum, const std::function<void(const char* userID, Amount held)>& visit)
+    {
+        const char* query = nullptr;
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            query = "SELECT user_id, amount FROM COINS WHERE coin_name = ? AND amount >= ?;";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            query = "SELECT user_id, amount FROM BALANCE WHERE money_name = ? AND amount >= ?;";
+            break;
+        default:
+            return false;
+        }
+
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, asset.c_str(), -1, SQLITE_STATIC);
+        // Half a unit below the minimum, for the float history of the REAL columns
+        sqlite3_bind_double(stmt, 2, (static_cast<double>(minimum) - 0.5) / static_cast<double>(FixedPoint::SCALE));
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), FixedPoint::fromDouble(sqlite3_column_double(stmt, 1)));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read holders of " << asset << ": " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the newest checkpoint (row.txID = 0 if there is none)
+    bool lastCheckpoint(CheckpointRow& row)
+    {
+        return readCheckpoint("SELECT tx_id, posting_id, created_at, balances FROM CHECKPOINTS ORDER BY tx_id DESC LIMIT 1;", 0, row);
+    }
+
+    // Reads the newest checkpoint taken at or before timeMillis (row.txID = 0 if there is none)
+    bool findCheckpoint(sqlite3_int64 timeMillis, CheckpointRow& row)
+    {
+        return readCheckpoint("SELECT tx_id, posting_id, created_at, balances FROM CHECKPOINTS WHERE created_at <= ? "
+            "ORDER BY created_at DESC, tx_id DESC LIMIT 1;", timeMillis, row);
+    }
+
+    // Reads the first checkpoint after transaction txID (row.txID = 0 if there is none)
+    bool nextCheckpoint(sqlite3_int64 txID, CheckpointRow& row)
+    {
+        return readCheckpoint("SELECT tx_id, posting_id, created_at, balances FROM CHECKPOINTS WHERE tx_id > ? ORDER BY tx_id LIMIT 1;", txID, row);
+    }
+
+    // Runs one of the checkpoint queries above with its single parameter
+    bool readCheckpoint(const char* query, sqlite3_int64 parameter, CheckpointRow& row)
+    {
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!stmt)
+        {
+            return false;
+        }
+
+        row = CheckpointRow();
+        if (sqlite3_bind_parameter_count(stmt) > 0)
+        {
+            sqlite3_bind_int64(stmt, 1, parameter);
+        }
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            row.txID = sqlite3_column_int64(stmt, 0);
+            row.postingID = sqlite3_column_int64(stmt, 1);
+            row.createdAt = sqlite3_column_int64(stmt, 2);
+            row.balances = sqlite3_column_int64(stmt, 3);
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read checkpoints: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the first transaction with an id of at least txID (false if there is none)
+    bool findTransaction(sqlite3_int64 txID, sqlite3_int64& foundID, sqlite3_int64& createdAt)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT id, created_at FROM TRANSACTIONS WHERE id >= ? ORDER BY id LIMIT 1;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, txID);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            foundID = sqlite3_column_int64(stmt, 0);
+            createdAt = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW;
+    }
+
+    // Returns the last transaction recorded at or before timeMillis among low..high (low if none after it is), by binary
+    // search over the transaction IDs: the journal is appended in time order. lookups counts the transactions read.
+    sqlite3_int64 lastTransactionAt(sqlite3_int64 timeMillis, sqlite3_int64 low, sqlite3_int64 high, int* lookups = nullptr)
+    {
+        while (low < high)
+        {
+            sqlite3_int64 middle = low + (high - low + 1) / 2;
+            sqlite3_int64 found = 0, createdAt = 0;
+            if (lookups)
+            {
+                ++*lookups;
+            }
+            if (findTransaction(middle, found, createdAt) && found <= high && createdAt <= timeMillis)
+            {
+                low = found;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+        return low;
+    }
+
+    // Returns the transaction of the newest posting at or before postingID (0 if there is none)
+    sqlite3_int64 postingTransaction(sqlite3_int64 postingID)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT tx_id FROM POSTINGS WHERE id <= ? ORDER BY id DESC LIMIT 1;");
+        if (!stmt)
+        {
+            return 0;
+        }
+        sqlite3_bind_int64(stmt, 1, postingID);
+        sqlite3_int64 txID = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        return txID;
+    }
+
+    // Returns the last posting of transaction txID (0 if it has none)
+    sqlite3_int64 lastPostingOf(sqlite3_int64 txID)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT COALESCE(MAX(id), 0) FROM POSTINGS WHERE tx_id = ?;");
+        if (!stmt)
+        {
+            return 0;
+        }
+        sqlite3_bind_int64(stmt, 1, txID);
+        sqlite3_int64 id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        return id;
+    }
+
+    // Writes a checkpoint closing the journal through transaction txID, whose postings are the ones after fromPostingID up
+    // to toPostingID: every balance they touch gets its previous checkpoint amount plus their sum. Call inside a transaction.
+    bool insertCheckpoint(sqlite3_int64 txID, sqlite3_int64 fromPostingID, sqlite3_int64 toPostingID, sqlite3_int64& balances)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "INSERT INTO BALANCE_CHECKPOINTS (user_id, asset, book, checkpoint, amount) "
+            "SELECT p.user_id, p.asset, p.book, ?1, SUM(p.amount) + COALESCE((SELECT c.amount FROM BALANCE_CHECKPOINTS c "
+            "WHERE c.user_id = p.user_id AND c.asset = p.asset AND c.book = p.book AND c.checkpoint < ?1 "
+            "ORDER BY c.checkpoint DESC LIMIT 1), 0) "
+            "FROM POSTINGS p WHERE p.id > ?2 AND p.id <= ?3 GROUP BY p.user_id, p.asset, p.book;");
+        sqlite3_stmt* row = prepareCached(
+            "INSERT INTO CHECKPOINTS (tx_id, posting_id, created_at, balances) "
+            "VALUES (?1, ?2, (SELECT created_at FROM TRANSACTIONS WHERE id = ?1), ?3);");
+        if (!stmt || !row)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, txID);
+        sqlite3_bind_int64(stmt, 2, fromPostingID);
+        sqlite3_bind_int64(stmt, 3, toPostingID);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to write checkpoint balances: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        balances = sqlite3_changes(db);
+
+        sqlite3_bind_int64(row, 1, txID);
+        sqlite3_bind_int64(row, 2, toPostingID);
+        sqlite3_bind_int64(row, 3, balances);
+        rc = sqlite3_step(row);
+        sqlite3_reset(row);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to write checkpoint: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit with every balance of an account at checkpoint checkpointTxID. One index seek per asset: the next
+    // (asset, book) of the account, then its newest row at or before the checkpoint, however many checkpoints are older.
+    bool forEachCheckpointBalance(const std::string& userID, sqlite3_int64 checkpointTxID,
+        const std::function<void(const char* asset, DataBaseState book, Amount amount)>& visit)
+    {
+        sqlite3_stmt* next = prepareCached(
+            "SELECT asset, book FROM BALANCE_CHECKPOINTS WHERE user_id = ? AND (asset, book) > (?, ?) ORDER BY asset, book LIMIT 1;");
+        sqlite3_stmt* amount = prepareCached(
+            "SELECT amount FROM BALANCE_CHECKPOINTS WHERE user_id = ? AND asset = ? AND book = ? AND checkpoint <= ? "
+            "ORDER BY checkpoint DESC LIMIT 1;");
+        if (!next || !amount)
+        {
+            return false;
+        }
+
+        std::string asset;
+        int book = -1;
+        sqlite3_bind_text(amount, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(amount, 4, checkpointTxID);
+        for (;;)
+        {
+            sqlite3_bind_text(next, 1, userID.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(next, 2, asset.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(next, 3, book);
+            int rc = sqlite3_step(next);
+            if (rc != SQLITE_ROW)
+            {
+                sqlite3_reset(next);
+                if (rc != SQLITE_DONE)
+                {
+                    std::cerr << "Failed to read checkpoint balances: " << sqlite3_errmsg(db) << "\n";
+                    return false;
+                }
+                return true;
+            }
+            asset = reinterpret_cast<const char*>(sqlite3_column_text(next, 0));
+            book = sqlite3_column_int(next, 1);
+            sqlite3_reset(next);
+
+            sqlite3_bind_text(amount, 2, asset.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(amount, 3, book);
+            if (sqlite3_step(amount) == SQLITE_ROW)
+            {
+                visit(asset.c_str(), static_cast<DataBaseState>(book), sqlite3_column_int64(amount, 0));
+            }
+            sqlite3_reset(amount);
+        }
+    }
+
+    // Calls visit with the sum of an account's postings after fromPostingID up to toPostingID, per (asset, book)
+    bool forEachPostingDelta(const std::string& userID, sqlite3_int64 fromPostingID, sqlite3_int64 toPostingID,
+        const std::function<void(const char* asset, DataBaseState book, Amount amount, sqlite3_int64 postings)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT asset, book, SUM(amount), COUNT(*) FROM POSTINGS WHERE user_id = ? AND id > ? AND id <= ? GROUP BY asset, book;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, fromPostingID);
+        sqlite3_bind_int64(stmt, 3, toPostingID);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), static_cast<DataBaseState>(sqlite3_column_int(stmt, 1)),
+                sqlite3_column_int64(stmt, 2), sqlite3_column_int64(stmt, 3));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read the postings of " << userID << ": " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit with the nonzero journal balances of the accounts in [fromUserID, toUserID), per (asset, book).
+    // Meant for system accounts, which have no balance row (one POSTINGS_USER range scan).
+    bool forEachJournalBalance(const std::string& fromUserID, const std::string& toUserID,
+        const std::function<void(const char* userID, const char* asset, DataBaseState book, Amount amount)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT user_id, asset, book, SUM(amount) FROM POSTINGS WHERE user_id >= ? AND user_id < ? "
+            "GROUP BY user_id, asset, book HAVING SUM(amount) != 0;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, fromUserID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, toUserID.c_str(), -1, SQLITE_STATIC);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                static_cast<DataBaseState>(sqlite3_column_int(stmt, 2)), sqlite3_column_int64(stmt, 3));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read the journal balances from " << fromUserID << ": " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every account with a COINS or BALANCE row, in key order (a merge of the two user indexes)
+    bool forEachAccountKey(const std::function<void(const char* userID)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT user_id FROM COINS UNION SELECT user_id FROM BALANCE ORDER BY 1;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read accounts: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every COINS and BALANCE row of the accounts fromUserID <= user_id < toUserID, ordered by (account, asset)
+    bool forEachBalanceInRange(const std::string& fromUserID, const std::string& toUserID,
+        const std::function<void(const char* userID, const char* asset, DataBaseState book, Amount amount)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT user_id, coin_name, 2, amount FROM COINS WHERE user_id >= ?1 AND user_id < ?2 "
+            "UNION ALL SELECT user_id, money_name, 3, amount FROM BALANCE WHERE user_id >= ?1 AND user_id < ?2 ORDER BY 1, 2, 3;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, fromUserID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, toUserID.c_str(), -1, SQLITE_STATIC);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                static_cast<DataBaseState>(sqlite3_column_int(stmt, 2)), FixedPoint::fromDouble(sqlite3_column_double(stmt, 3)));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read balances: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every posting after afterPostingID of the accounts fromUserID <= user_id < toUserID, ordered by
+    // (account, posting), with its transaction kind. Walks POSTINGS_USER, whose entries carry the posting ID.
+    bool forEachPostingInRange(const std::string& fromUserID, const std::string& toUserID, sqlite3_int64 afterPostingID,
+        const std::function<void(const char* userID, const PostingRecord& record)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT p.user_id, p.id, p.tx_id, t.kind, p.asset, p.book, p.amount, p.created_at "
+            "FROM POSTINGS p JOIN TRANSACTIONS t ON t.id = p.tx_id "
+            "WHERE p.user_id >= ? AND p.user_id < ? AND p.id > ? ORDER BY p.user_id, p.id;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, fromUserID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, toUserID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 3, afterPostingID);
+        PostingRecord record;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            record.id = sqlite3_column_int64(stmt, 1);
+            record.txID = sqlite3_column_int64(stmt, 2);
+            record.kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            record.asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            record.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 5));
+            record.amount = sqlite3_column_int64(stmt, 6);
+            record.createdAt = sqlite3_column_int64(stmt, 7);
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), record);
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read postings: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Writes a batch of already validated transactions (balance deltas + journal) in one database transaction.
+    // Deltas are netted per (account, asset, book) first, so a hot account costs one UPDATE per batch.
+    bool persistJournalBatch(const std::vector<JournalEntry>& entries,
+        const std::function<bool(const std::vector<sqlite3_int64>& txIDs)>& beforeCommit = nullptr)
+    {
+        std::vector<Posting> netDeltas;
+        std::unordered_map<std::string, size_t> netIndex;
+        for (const auto& entry : entries)
+        {
+            for (const auto& posting : entry.postings)
+            {
+                // System accounts ('@...') live in the journal only
+                if (posting.userID[0] == '@')
+                {
+                    continue;
+                }
+                // The book is part of the key: the same asset can sit in the balance book and the coin book
+                auto inserted = netIndex.emplace(posting.userID + '\x1f' + posting.asset + '\x1f' + std::to_string(static_cast<int>(posting.book)),
+                    netDeltas.size());
+                if (inserted.second)
+                {
+                    netDeltas.push_back(posting);
+                }
+                else
+                {
+                    netDeltas[inserted.first->second].amount += posting.amount;
+                }
+            }
+        }
+
+        if (!execute("BEGIN IMMEDIATE;"))
+        {
+            return false;
+        }
+
+        for (const auto& delta : netDeltas)
+        {
+            if (delta.amount != 0 && !addValuteDelta(delta.userID, delta.asset, delta.amount, delta.book))
+            {
+                execute("ROLLBACK;");
+                return false;
+            }
+        }
+
+        std::vector<sqlite3_int64> txIDs;
+        txIDs.reserve(entries.size());
+        for (const auto& entry : entries)
+        {
+            txIDs.push_back(insertJournalEntry(entry.kind, entry.memo, entry.createdAt, entry.postings));
+            if (txIDs.back() == 0 || (entry.commandId != 0 && !insertCommand(entry.commandId, txIDs.back(), entry.createdAt)) ||
+                (entry.alsoWrite && !entry.alsoWrite(*this, txIDs.back())))
+            {
+                execute("ROLLBACK;");
+                return false;
+            }
+        }
+
+        // Writes that must commit together with the batch (the integrity chain)
+        if (beforeCommit && !beforeCommit(txIDs))
+        {
+            execute("ROLLBACK;");
+            return false;
+        }
+
+        if (!execute("COMMIT;"))
+        {
+            execute("ROLLBACK;");
+            return false;
+        }
+        return true;
+    }
+
+    // Returns the largest id of a table (0 if it is empty); table is a fixed name, never user input
+    sqlite3_int64 maxID(const char* table)
+    {
+        sqlite3_stmt* stmt = prepareCached(std::string("SELECT COALESCE(MAX(id), 0) FROM ") + table + ";");
+        if (!stmt)
+        {
+            return 0;
+        }
+        sqlite3_int64 id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        return id;
+    }
+
+    // Returns the first posting of the transaction of the first posting at or after postingID (0 if there is none)
+    sqlite3_int64 transactionStart(sqlite3_int64 postingID)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT id FROM POSTINGS WHERE tx_id = (SELECT tx_id FROM POSTINGS WHERE id >= ? ORDER BY id LIMIT 1) ORDER BY id LIMIT 1;");
+        if (!stmt)
+        {
+            return 0;
+        }
+        sqlite3_bind_int64(stmt, 1, postingID);
+        sqlite3_int64 id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        return id;
+    }
+
+    // Reads up to limit COINS or BALANCE rows with fromID <= id < toID in one short read transaction, together with the
+    // newest committed transaction: the rows are the journal up to cutTxID. lastID gets the id of the last row (0 if none).
+    bool readBalanceChunk(DataBaseState dbs, sqlite3_int64 fromID, sqlite3_int64 toID, int limit, sqlite3_int64& cutTxID, sqlite3_int64& lastID,
+        const std::function<void(const char* userID, const char* asset, Amount amount)>& visit)
+    {
+        const char* query = nullptr;
+        switch (dbs)
+        {
+        case DataBaseState::DBS_COINS:
+            query = "SELECT id, user_id, coin_name, amount FROM COINS WHERE id >= ? AND id < ? ORDER BY id LIMIT ?;";
+            break;
+        case DataBaseState::DBS_BALANCE:
+            query = "SELECT id, user_id, money_name, amount FROM BALANCE WHERE id >= ? AND id < ? ORDER BY id LIMIT ?;";
+            break;
+        default:
+            return false;
+        }
+
+        lastID = 0;
+        if (!execute("BEGIN;"))
+        {
+            return false;
+        }
+        sqlite3_stmt* cut = prepareCached("SELECT COALESCE(MAX(id), 0) FROM TRANSACTIONS;");
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!cut || !stmt || sqlite3_step(cut) != SQLITE_ROW)
+        {
+            execute("ROLLBACK;");
+            return false;
+        }
+        cutTxID = sqlite3_column_int64(cut, 0);
+        sqlite3_reset(cut);
+
+        sqlite3_bind_int64(stmt, 1, fromID);
+        sqlite3_bind_int64(stmt, 2, toID);
+        sqlite3_bind_int(stmt, 3, limit);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            lastID = sqlite3_column_int64(stmt, 0);
+            visit(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)),
+                FixedPoint::fromDouble(sqlite3_column_double(stmt, 3)));
+        }
+        sqlite3_reset(stmt);
+        execute("COMMIT;");
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read balances: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads up to limit postings with fromID <= id < toID in id order (one statement, so one short read).
+    // lastID gets the id of the last posting (0 if none).
+    bool readPostingChunk(sqlite3_int64 fromID, sqlite3_int64 toID, int limit, sqlite3_int64& lastID,
+        const std::function<void(sqlite3_int64 txID, const char* userID, const char* asset, DataBaseState book, Amount amount)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached("SELECT id, tx_id, user_id, asset, book, amount FROM POSTINGS WHERE id >= ? AND id < ? ORDER BY id LIMIT ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        lastID = 0;
+        sqlite3_bind_int64(stmt, 1, fromID);
+        sqlite3_bind_int64(stmt, 2, toID);
+        sqlite3_bind_int(stmt, 3, limit);
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            lastID = sqlite3_column_int64(stmt, 0);
+            visit(sqlite3_column_int64(stmt, 1),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)),
+                static_cast<DataBaseState>(sqlite3_column_int(stmt, 4)),
+                sqlite3_column_int64(stmt, 5));
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read postings: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every posting of one account in one asset, oldest first
+    bool forEachAccountPosting(const std::string& userID, const std::string& asset, const std::function<void(const PostingRecord&)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT p.id, p.tx_id, t.kind, p.book, p.amount, p.created_at "
+            "FROM POSTINGS p JOIN TRANSACTIONS t ON t.id = p.tx_id "
+            "WHERE p.user_id = ? AND p.asset = ? ORDER BY p.id;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, asset.c_str(), -1, SQLITE_STATIC);
+        PostingRecord record;
+        record.userID = userID;
+        record.asset = asset;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            record.id = sqlite3_column_int64(stmt, 0);
+            record.txID = sqlite3_column_int64(stmt, 1);
+            record.kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            record.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 3));
+            record.amount = sqlite3_column_int64(stmt, 4);
+            record.createdAt = sqlite3_column_int64(stmt, 5);
+            visit(record);
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to read the postings of " << userID << ": " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every COINS and BALANCE row, then for every system account balance summed from the journal
+    bool forEachBalance(const std::function<void(const std::string&, const std::string&, DataBaseState, Amount)>& visit)
+    {
+        const char* query =
+            "SELECT user_id, coin_name, 2, amount FROM COINS "
+            "UNION ALL SELECT user_id, money_name, 3, amount FROM BALANCE "
+            "UNION ALL SELECT user_id, asset, book, SUM(amount) FROM POSTINGS WHERE user_id LIKE '@%' GROUP BY user_id, asset, book;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare forEachBalance: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            std::string userID = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            std::string asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            // Balance rows are REAL, journal sums are already fixed-point INTEGER
+            Amount amount = sqlite3_column_type(stmt, 3) == SQLITE_FLOAT
+                ? FixedPoint::fromDouble(sqlite3_column_double(stmt, 3))
+                : sqlite3_column_int64(stmt, 3);
+            visit(userID, asset, static_cast<DataBaseState>(sqlite3_column_int(stmt, 2)), amount);
+        }
+
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // Streams every posting in journal order (oldest first) without building a row object per posting
+    bool forEachPosting(const std::function<void(sqlite3_int64 txID, const char* userID, const char* asset, DataBaseState book, Amount amount)>& visit)
+    {
+        const char* query = "SELECT tx_id, user_id, asset, book, amount FROM POSTINGS ORDER BY id;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare forEachPosting: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(sqlite3_column_int64(stmt, 0),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)),
+                static_cast<DataBaseState>(sqlite3_column_int(stmt, 3)),
+                sqlite3_column_int64(stmt, 4));
+        }
+
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // Appends a link to the integrity chain
+    bool insertChainLink(const ChainLink& link)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "INSERT INTO CHAIN (seq, first_tx, last_tx, batch_hash, state_root, chain_hash, created_at) VALUES (?, ?, ?, ?, ?, ?, ?);");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, link.seq);
+        sqlite3_bind_int64(stmt, 2, link.firstTxID);
+        sqlite3_bind_int64(stmt, 3, link.lastTxID);
+        sqlite3_bind_blob(stmt, 4, link.batchHash.data(), static_cast<int>(link.batchHash.size()), SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 5, link.stateRoot.data(), static_cast<int>(link.stateRoot.size()), SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 6, link.chainHash.data(), static_cast<int>(link.chainHash.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 7, link.createdAt);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert chain link: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the chain link of the current row (columns seq .. created_at)
+    static void readChainLink(sqlite3_stmt* stmt, ChainLink& link)
+    {
+        auto readDigest = [stmt](int column)
+            {
+                Digest digest = {};
+                if (sqlite3_column_bytes(stmt, column) == static_cast<int>(digest.size()))
+                {
+                    std::memcpy(digest.data(), sqlite3_column_blob(stmt, column), digest.size());
+                }
+                return digest;
+            };
+
+        link.seq = sqlite3_column_int64(stmt, 0);
+        link.firstTxID = sqlite3_column_int64(stmt, 1);
+        link.lastTxID = sqlite3_column_int64(stmt, 2);
+        link.batchHash = readDigest(3);
+        link.stateRoot = readDigest(4);
+        link.chainHash = readDigest(5);
+        link.createdAt = sqlite3_column_int64(stmt, 6);
+    }
+
+    // Calls visit for every chain link in order
+    bool forEachChainLink(const std::function<void(const ChainLink&)>& visit)
+    {
+        const char* query = "SELECT seq, first_tx, last_tx, batch_hash, state_root, chain_hash, created_at FROM CHAIN ORDER BY seq;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare forEachChainLink: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        int rc;
+        ChainLink link;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            readChainLink(stmt, link);
+            visit(link);
+        }
+
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // Reads one chain link (seq = 0 reads the newest). link.seq is 0 if there is no such link.
+    bool getChainLink(sqlite3_int64 seq, ChainLink& link)
+    {
+        sqlite3_stmt* stmt = prepareCached(seq == 0
+            ? "SELECT seq, first_tx, last_tx, batch_hash, state_root, chain_hash, created_at FROM CHAIN ORDER BY seq DESC LIMIT 1;"
+            : "SELECT seq, first_tx, last_tx, batch_hash, state_root, chain_hash, created_at FROM CHAIN WHERE seq = ?;");
+        if (!stmt)
+        {
+            return false;
+        }
+        if (seq != 0)
+        {
+            sqlite3_bind_int64(stmt, 1, seq);
+        }
+
+        link = ChainLink();
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+        {
+            readChainLink(stmt, link);
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW || rc == SQLITE_DONE;
+    }
+
+    // Records the Merkle leaf position of a balance
+    bool insertMerkleLeaf(sqlite3_int64 position, const std::string& userID, const std::string& asset)
+    {
+        sqlite3_stmt* stmt = prepareCached("INSERT INTO MERKLE_LEAVES (position, user_id, asset) VALUES (?, ?, ?);");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, position);
+        sqlite3_bind_text(stmt, 2, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, asset.c_str(), -1, SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            std::cerr << "Failed to insert Merkle leaf: " << sqlite3_errmsg(db) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Calls visit for every recorded Merkle leaf in position order
+    bool forEachMerkleLeaf(const std::function<void(sqlite3_int64 position, const char* userID, const char* asset)>& visit)
+    {
+        const char* query = "SELECT position, user_id, asset FROM MERKLE_LEAVES ORDER BY position;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare forEachMerkleLeaf: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            visit(sqlite3_column_int64(stmt, 0),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)));
+        }
+
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // Calls visit for every transaction with an ID in [firstTxID, lastTxID], with its postings in journal order
+    bool forEachJournalEntry(sqlite3_int64 firstTxID, sqlite3_int64 lastTxID,
+        const std::function<void(sqlite3_int64 txID, const JournalEntry& entry)>& visit)
+    {
+        sqlite3_stmt* stmt = prepareCached(
+            "SELECT t.id, t.kind, t.created_at, t.memo, p.user_id, p.asset, p.book, p.amount "
+            "FROM TRANSACTIONS t JOIN POSTINGS p ON p.tx_id = t.id "
+            "WHERE t.id BETWEEN ? AND ? ORDER BY t.id, p.id;");
+        if (!stmt)
+        {
+            return false;
+        }
+
+        sqlite3_bind_int64(stmt, 1, firstTxID);
+        sqlite3_bind_int64(stmt, 2, lastTxID);
+
+        JournalEntry entry;
+        sqlite3_int64 currentTxID = 0;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            sqlite3_int64 txID = sqlite3_column_int64(stmt, 0);
+            if (txID != currentTxID)
+            {
+                if (currentTxID != 0)
+                {
+                    visit(currentTxID, entry);
+                }
+                currentTxID = txID;
+                entry.kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                entry.createdAt = sqlite3_column_int64(stmt, 2);
+                entry.memo = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+                entry.postings.clear();
+            }
+            entry.postings.push_back({ reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4)),
+                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5)),
+                static_cast<DataBaseState>(sqlite3_column_int(stmt, 6)),
+                sqlite3_column_int64(stmt, 7) });
+        }
+        if (currentTxID != 0)
+        {
+            visit(currentTxID, entry);
+        }
+
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // Reads one page of postings, newest first. Pass beforeID = 0 for the first page,
+    // then the id of the last record of the previous page (keyset pagination, index-backed at any depth).
+    std::vector<PostingRecord> getPostingHistory(const std::string& column, const std::string& key, sqlite3_int64 beforeID, int limit)
+    {
+        std::vector<PostingRecord> records;
+
+        std::string query =
+            "SELECT p.id, p.tx_id, t.kind, p.user_id, p.asset, p.book, p.amount, p.created_at "
+            "FROM POSTINGS p JOIN TRANSACTIONS t ON t.id = p.tx_id "
+            "WHERE p." + column + " = ? AND p.id < ? ORDER BY p.id DESC LIMIT ?;";
+
+        sqlite3_stmt* stmt = prepareCached(query);
+        if (!stmt)
+        {
+            return records;
+        }
+
+        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, beforeID > 0 ? beforeID : std::numeric_limits<sqlite3_int64>::max());
+        sqlite3_bind_int(stmt, 3, limit);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            PostingRecord record;
+            record.id = sqlite3_column_int64(stmt, 0);
+            record.txID = sqlite3_column_int64(stmt, 1);
+            record.kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            record.userID = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            record.asset = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            record.book = static_cast<DataBaseState>(sqlite3_column_int(stmt, 5));
+            record.amount = sqlite3_column_int64(stmt, 6);
+            record.createdAt = sqlite3_column_int64(stmt, 7);
+            records.push_back(record);
+        }
+
+        sqlite3_reset(stmt);
+        return records;
+    }
+
+    std::vector<PostingRecord> getAccountHistory(const std::string& userID, sqlite3_int64 beforeID, int limit)
+    {
+        return getPostingHistory("user_id", userID, beforeID, limit);
+    }
+
+    std::vector<PostingRecord> getAssetHistory(const std::string& asset, sqlite3_int64 beforeID, int limit)
+    {
+        return getPostingHistory("asset", asset, beforeID, limit);
+    }
+
+    // Registers the native SQL functions (fp_*, fx_convert, coin_value) and loads FX_RATES into the market data
+    bool attachMarketData(MarketData& market)
+    {
+        if (!db)
+        {
+            std::cerr << "Database not open." << std::endl;
+            return false;
+        }
+
+        pinnedPrices.market = &market;
+        if (!registerLedgerFunctions(db, &pinnedPrices) || !registerPricesModule(db, &pinnedPrices))
+        {
+            return false;
+        }
+
+        return loadFxRates(market);
+    }
+
+    bool loadFxRates(MarketData& market)
+    {
+        const char* query = "SELECT money_name, usd_rate FROM FX_RATES;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare loadFxRates: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        // Every rate is published at once: a single new table instead of one per currency
+        std::vector<std::pair<std::string, double>> rates;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            rates.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), sqlite3_column_double(stmt, 1));
+        }
+
+        sqlite3_finalize(stmt);
+        market.fx().setUsdRates(rates);
+        return true;
+    }
+
+    // Values every coin and money balance of the user in the target currency with one query inside SQLite
+    double getWalletValuation(const std::string& userID, const std::string& currencyName)
+    {
+        const char* query =
+            "SELECT fp_sum(value) FROM ("
+            "SELECT fx_convert(coin_value(coin_name, amount), 'USD', ?2) AS value FROM COINS WHERE user_id = ?1 "
+            "UNION ALL "
+            "SELECT fx_convert(amount, money_name, ?2) FROM BALANCE WHERE user_id = ?1"
+            ");";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << "Failed to prepare getWalletValuation: " << sqlite3_errmsg(db) << std::endl;
+            return 0.0;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, currencyName.c_str(), -1, SQLITE_STATIC);
+
+        PricePin pin(pinnedPrices); // Every coin_value of the query uses one price version
+        double value = 0.0;
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            value = sqlite3_column_double(stmt, 0);
+        }
+        else
+        {
+            std::cerr << "Failed to value wallet: " << sqlite3_errmsg(db) << std::endl;
+        }
+
+        sqlite3_finalize(stmt);
+        return value;
+    }
+
+    // Returns the user's coins with their current USD value (COINS joined with PRICES)
+    std::vector<CoinHolding> getUserCoinValues(const std::string& userID)
+    {
+        std::vector<CoinHolding> holdings;
+
+        const char* query =
+            "SELECT c.coin_name, c.amount, COALESCE(c.amount * p.price, 0) "
+            "FROM COINS c LEFT JOIN PRICES p ON p.coin_name = c.coin_name "
+            "WHERE c.user_id = ?;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to prepare getUserCoinValues: " << sqlite3_errmsg(db) << std::endl;
+            return holdings;
+        }
+
+        sqlite3_bind_text(stmt, 1, userID.c_str(), -1, SQLITE_STATIC);
+
+        PricePin pin(pinnedPrices); // PRICES is filtered again for every coin: all of them see one snapshot
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            CoinHolding holding;
+            holding.coinName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            holding.amount = static_cast<float>(sqlite3_column_double(stmt, 1));
+            holding.value = sqlite3_column_double(stmt, 2);
+            holdings.push_back(holding);
+        }
+
+        sqlite3_finalize(stmt);
+        return holdings;
+    }
+
+    // Ranks users by the USD value of their coins (COINS joined with PRICES)
+    std::vector<std::pair<std::string, double>> getTopPortfolios(int limit)
+    {
+        std::vector<std::pair<std::string, double>> ranking;
+
+        const char* query =
+            "SELECT c.user_id, SUM(c.amount * p.price) AS value "
+            "FROM COINS c JOIN PRICES p ON p.coin_name = c.coin_name "
+            "GROUP BY c.user_id ORDER BY value DESC LIMIT ?;";
+        sqlite3_stmt* stmt;
+
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to prepare getTopPortfolios: " << sqlite3_errmsg(db) << std::endl;
+            return ranking;
+        }
+
+        sqlite3_bind_int(stmt, 1, limit);
+
+        PricePin pin(pinnedPrices); // The whole ranking is priced at one snapshot
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string userID = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            ranking.emplace_back(userID, sqlite3_column_double(stmt, 1));
+        }
+
+        sqlite3_finalize(stmt);
+        return ranking;
+    }
+
     bool valuteExists(const std::string& userID, const std::string& valuteName, DataBaseState dbs)
     {
         sqlite3_stmt* stmt = nullptr;
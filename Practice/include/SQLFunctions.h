@@ -0,0 +1,13 @@
+#pragma once
+#include <sqlite3.h>
+#include "PricesVTab.h"
+
+// Registers the ledger's native SQL functions on a connection:
+//   fp(x)                        REAL -> fixed-point INTEGER (8 decimals)
+//   fp_real(i)                   fixed-point INTEGER -> REAL
+//   fp_mul(a, b)                 fixed-point product, rounded half away from zero
+//   fp_sum(x)                    aggregate: exact fixed-point sum of REAL values, returned as REAL
+//   fx_convert(amount, from, to) converts an amount between currencies with the current rates
+//   coin_value(coin, amount)     USD value of a coin amount at the pinned price (the current one without a pin)
+// fx_convert and coin_value return NULL for unknown currencies or coins, fp_sum skips NULLs.
+bool registerLedgerFunctions(sqlite3* db, PinnedPrices* prices);
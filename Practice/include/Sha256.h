@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 32-byte SHA-256 digest
+using Digest = std::array<uint8_t, 32>;
+
+// Incremental SHA-256 (FIPS 180-4)
+class Sha256
+{
+private:
+    uint32_t state[8];      // Hash state
+    uint8_t buffer[64];     // Partial block
+    size_t bufferLength;    // Bytes in buffer
+    uint64_t totalLength;   // Bytes hashed so far
+
+public:
+    // Constructor that starts a new hash
+    Sha256();
+
+    // Method to restart the hash
+    void reset();
+
+    // Method to hash more bytes
+    void update(const void* data, size_t length);
+
+    // Methods to hash fixed-size values in a canonical (little-endian) byte order
+    void updateInt64(int64_t value);
+    void updateString(const std::string& value); // Length-prefixed, so "ab"+"c" differs from "a"+"bc"
+
+    // Method to finish the hash (the object must be reset before it is used again)
+    Digest finish();
+
+    // Method to hash a buffer in one call
+    static Digest hash(const void* data, size_t length);
+
+    // Method to format a digest as lowercase hex
+    static std::string toHex(const Digest& digest);
+
+    // Method to compress whole 64-byte blocks into a state (SHA extensions when the CPU has them)
+    static void compress(uint32_t state[8], const uint8_t* blocks, size_t blockCount);
+
+    // Method to compress with the portable implementation only
+    static void compressPortable(uint32_t state[8], const uint8_t* blocks, size_t blockCount);
+
+    // Method to check if the CPU has the SHA extensions (SHA-NI)
+    static bool hardwareSupported();
+
+    // Method to allow or forbid the hardware path (benchmarks compare both; allowed by default)
+    static void setHardwareEnabled(bool enabled);
+
+    // Method to get the name of the implementation compress uses right now
+    static const char* implementationName();
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "SQLData.h"
+#include <string>
+#include <vector>
+
+// Layout of the statements
+enum class StatementFormat : uint8_t
+{
+    SF_Csv,   // One row per movement plus an opening and a closing row per asset (a header line per file)
+    SF_Text   // One printable block per account
+};
+
+// One statement run: every account with a balance or a movement in [fromMillis, toMillis)
+struct StatementJob
+{
+    int64_t fromMillis = 0;                          // Start of the period (Unix milliseconds, included)
+    int64_t toMillis = 0;                            // End of the period (excluded)
+    StatementFormat format = StatementFormat::SF_Csv;
+    std::string directory = "statements";            // Output directory (created if missing)
+};
+
+// Result of a statement run
+struct StatementReport
+{
+    unsigned threads = 0;         // Rendering threads
+    uint64_t statements = 0;      // Accounts with a statement
+    uint64_t movements = 0;       // Postings listed
+    uint64_t files = 0;           // Files written (one per account range)
+    uint64_t bytes = 0;           // Bytes written
+    double readMillis = 0.0;      // Time of the workers in database reads (summed over workers)
+    double renderMillis = 0.0;    // Time of the workers merging and rendering (summed over workers)
+    double waitMillis = 0.0;      // Time the workers waited for a free buffer (the writer fell behind)
+    double writeMillis = 0.0;     // Time of the writer thread in file writes
+    double millis = 0.0;          // Wall time of the run
+};
+
+// Statement generator that walks the accounts in key order. The account keys are split into ranges of
+// accountsPerRange accounts; a worker takes the next range and, in one short read transaction, streams the
+// range's balance rows (COINS and BALANCE merged by key) and its postings since the period started (POSTINGS_USER,
+// also in key order). Both streams are merged account by account: the opening balance is the current balance
+// minus every posting since the start, the closing balance the current balance minus the postings after the end,
+// and the postings in between are the movements. Each range is rendered into a buffer from a pool that is reused
+// for the whole run, and a writer thread writes the full buffers to files (one per range) while the workers go on.
+class StatementGenerator
+{
+public:
+    static constexpr size_t accountsPerRange = 2048;  // Accounts per read transaction and per file
+
+private:
+    SQLData& sqlData;     // Connection used to plan the run (the workers open their own)
+    unsigned threadCount; // Rendering threads (0 = one per core)
+
+public:
+    // Constructor that attaches the generator to the ledger's database
+    StatementGenerator(SQLData& sqlData, unsigned threads = 0);
+
+    // Method to write the statements of a period; false on a database or file error
+    bool run(const StatementJob& job, StatementReport& report);
+
+    // Method to print a report to the console
+    static void print(const StatementReport& report);
+};
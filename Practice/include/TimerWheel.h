@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timer wheel: 4 levels of 256 slots, level l slot i holding the timers whose due tick has i in
+// bits 8l..8l+7 (and is less than 256^(l+1) ticks ahead). Adding and canceling a timer are O(1) list operations
+// on preallocated nodes; when the lowest level wraps, the next level's current slot is cascaded down, so every
+// timer is moved at most 3 times before it fires. Covers 2^32 ticks ahead (later timers are re-filed when they
+// come into range). Not thread-safe: the owner locks.
+class TimerWheel
+{
+public:
+    static constexpr uint32_t none = 0xFFFFFFFFu;  // Invalid handle / end of a list
+    static constexpr int levels = 4;
+    static constexpr int slotBits = 8;
+    static constexpr uint32_t slotsPerLevel = 1u << slotBits;
+
+private:
+    // One timer (nodes are reused through a free list)
+    struct Node
+    {
+        int64_t dueTick;    // First tick at or after the due time
+        uint64_t payload;   // Caller data returned when the timer fires
+        uint32_t next;      // Next node in the slot (or in the free list)
+        uint32_t prev;      // Previous node in the slot
+        uint32_t slot;      // Slot the node is linked in (none = free)
+    };
+
+    std::vector<Node> nodes;                           // Timers by handle
+    std::vector<uint32_t> heads;                       // First node of every slot (levels * slotsPerLevel)
+    uint32_t freeList;                                 // First free node
+    size_t active;                                     // Timers waiting
+    int64_t tickMillis;                                // Resolution
+    int64_t nextTick;                                  // Next tick to process
+
+    // Methods to link a node into the slot of its due tick, and to unlink it
+    void link(uint32_t handle);
+    void unlink(uint32_t handle);
+
+    // Method to re-file every timer of a slot relative to nextTick
+    void cascade(int level, uint32_t index);
+
+public:
+    // Constructor that sets the resolution and the current time
+    TimerWheel(int64_t tickMillis, int64_t nowMillis);
+
+    // Method to add a timer that fires once the clock reaches dueMillis (at most one tick late); returns its handle
+    uint32_t add(int64_t dueMillis, uint64_t payload);
+
+    // Method to cancel a waiting timer (false if the handle is not waiting)
+    bool cancel(uint32_t handle);
+
+    // Method to move the clock to nowMillis and append the payloads of the timers that became due (in due order);
+    // their handles are free again afterwards
+    size_t advance(int64_t nowMillis, std::vector<uint64_t>& due);
+
+    // Method to reserve nodes for a number of timers
+    void reserve(size_t timers) { nodes.reserve(timers); }
+
+    // Method to get the number of waiting timers
+    size_t size() const { return active; }
+
+    // Method to get the heap memory of the nodes and slots
+    size_t memoryBytes() const { return nodes.capacity() * sizeof(Node) + heads.capacity() * sizeof(uint32_t); }
+
+    // Method to get the resolution
+    int64_t resolution() const { return tickMillis; }
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include "Ledger.h"
+#include "TimerWheel.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// What a schedule does when it is due
+enum class ScheduleKind : uint8_t
+{
+    SK_Buy,    // Spends amount USD on asset at the current price (recurring buys: dollar-cost averaging)
+    SK_Send    // Sends amount of asset from the user to counterparty (scheduled payouts)
+};
+
+// A scheduled, possibly recurring, ledger command
+struct ScheduledTransfer
+{
+    ScheduleKind kind = ScheduleKind::SK_Send;
+    std::string userID;                      // Payer
+    std::string counterparty;                // Receiver of a send
+    std::string asset;                       // Coin bought, or asset sent
+    SQLData::DataBaseState book = SQLData::DataBaseState::DBS_COINS; // Book of the asset sent
+    Amount amount = 0;                       // USD spent per buy, or amount sent per run
+    int64_t firstDueMillis = 0;              // Unix time in milliseconds of the first run
+    int64_t intervalMillis = 0;              // Time between runs (0 = runs once)
+    uint32_t runs = 1;                       // Number of runs (0 = until canceled)
+};
+
+// Counters of the scheduler since it was created
+struct SchedulerStats
+{
+    uint64_t executed = 0;    // Runs applied to the ledger
+    uint64_t rejected = 0;    // Runs the ledger rejected (insufficient funds, no price); the schedule moves on
+    uint64_t duplicates = 0;  // Runs already applied before a restart (found by their command ID)
+    uint64_t batches = 0;     // Batches of due runs
+    size_t maxBatch = 0;      // Most runs in one batch
+};
+
+// Scheduler of time-based ledger commands. Pending schedules sit in a TimerWheel (O(1) schedule and cancel,
+// millions of them in a few hundred bytes each). Everything that became due since the last run is executed as
+// one batch through the ledger's write path, then the schedules' next runs are written in one database
+// transaction on the scheduler's own connection (SCHEDULES table, reloaded by load()).
+// Every run is applied with a command ID derived from the schedule and the run number, and the ledger's journal
+// is flushed before the schedules are updated, so a crash between the two repeats no run after a restart: the
+// repeated command is found in the ledger's command window.
+// Thread-safe. The background worker needs the ledger's balance engine (its transactions are thread-safe);
+// without it, call runDue from the thread that owns the ledger.
+class TransferScheduler
+{
+public:
+    using PriceSource = std::function<bool(const std::string& coinName, double& usdPerCoin)>;
+
+private:
+    // One pending schedule (names interned, so a schedule costs no heap memory of its own)
+    struct Entry
+    {
+        sqlite3_int64 id;          // SCHEDULES row ID
+        int64_t dueMillis;         // Next run
+        int64_t intervalMillis;    // Time between runs (0 = once)
+        uint64_t occurrence;       // Runs done so far (the next run's command ID derives from it)
+        Amount amount;             // USD per buy, or amount per send
+        uint32_t runsLeft;         // Runs still to do (0 = until canceled)
+        uint32_t user;             // Interned names
+        uint32_t counterparty;
+        uint32_t asset;
+        uint32_t timer;            // Handle in the wheel
+        ScheduleKind kind;
+        SQLData::DataBaseState book;
+    };
+
+    Ledger& ledger;                                     // Ledger the runs are applied to
+    std::string dbName;                                 // Database of the ledger
+    const char* vfsName;                                // VFS of that database
+    SQLData storage;                                    // Scheduler's connection (SCHEDULES)
+    std::mutex mutex;                                   // Guards everything below
+    IdRegistry names;                                   // User and asset names
+    TimerWheel wheel;                                   // Pending runs (payload = entry index)
+    std::vector<Entry> entries;                         // Schedules by index
+    std::vector<uint32_t> freeEntries;                  // Indices of removed schedules
+    std::unordered_map<sqlite3_int64, uint32_t> byId;   // Schedule ID -> index
+    std::vector<uint64_t> dueScratch;                   // Reused list of due entries
+    PriceSource priceSource;                            // Prices for the buys
+    SchedulerStats counters;
+
+    std::thread worker;                                 // Background runner
+    std::condition_variable wakeWorker;                 // Signalled on stop
+    bool running;                                       // Flag to check if the worker should keep running
+
+    // Method to add a persisted schedule to the wheel (mutex held)
+    void insertLocked(const SQLData::ScheduleRow& row);
+
+    // Method to apply one run to the ledger
+    CommandStatus execute(const Entry& entry);
+
+    // Worker loop
+    void run(int64_t pollMillis);
+
+public:
+    // Constructor that attaches the scheduler to a ledger and its database (tickMillis = wheel resolution)
+    TransferScheduler(Ledger& ledger, SQLData& sqlData, int64_t tickMillis = 1000);
+
+    // Destructor that stops the worker
+    ~TransferScheduler();
+
+    // Method to open the scheduler's connection and load the persisted schedules (runs missed while the
+    // application was down are due at once, each schedule once)
+    bool load();
+
+    // Method to set where the buys get their prices from
+    void setPriceSource(PriceSource source);
+
+    // Method to add a schedule; returns its ID (0 if it is invalid or could not be stored)
+    sqlite3_int64 schedule(const ScheduledTransfer& transfer);
+
+    // Method to add many schedules in one database transaction; returns how many were added
+    size_t scheduleMany(const std::vector<ScheduledTransfer>& transfers, std::vector<sqlite3_int64>* ids = nullptr);
+
+    // Method to cancel a schedule (false if it is unknown or already finished)
+    bool cancel(sqlite3_int64 id);
+
+    // Method to execute every run due at nowMillis as one batch; returns the number of runs
+    size_t runDue(int64_t nowMillis);
+
+    // Methods to run runDue in the background every pollMillis, and to stop it
+    bool start(int64_t pollMillis = 1000);
+    void stop();
+
+    // Method to get the number of pending schedules
+    size_t pending();
+
+    // Method to get the heap memory of the wheel and the schedules (not the name registry)
+    size_t memoryBytes();
+
+    // Method to get the counters
+    SchedulerStats stats();
+
+    // Method to get the current time in milliseconds since the Unix epoch
+    static int64_t nowMillis();
+};
@@ -62,8 +62,11 @@ struct User
             allCharSymbolsString += symbol;
         }
 
-        // Shuffle the characters to create randomness
-        std::shuffle(allCharSymbolsString.begin(), allCharSymbolsString.end(), rd);
+        // Shuffle the characters to create randomness ('@' is reserved as the first character of ledger system accounts)
+        do
+        {
+            std::shuffle(allCharSymbolsString.begin(), allCharSymbolsString.end(), rd);
+        } while (allCharSymbolsString[0] == '@');
 
         // Return a random user ID with 10 characters
         std::string userID = allCharSymbolsString.substr(0, 10);
@@ -0,0 +1,115 @@
+#include "AccrualKernels.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define ACCRUAL_HAS_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// The balance is split at bit 32 and the rate is prepared once per call: r * 2^32 = whole * S + part, so
+// b * r = high * whole * S + (high * part + low * r), and floor(b * r / S) = high * whole + floor((high * part + low * r) / S),
+// one division per balance. With high < 2^31, part < S < 2^30 and r <= S the sum stays below 2^63.
+
+// One balance at a time
+static void accrueInterestScalar(const Amount* balances, uint32_t rate, Amount* accruals, size_t count, uint64_t& remainderSum)
+{
+    const uint64_t whole = (static_cast<uint64_t>(rate) << 32) / accrualRateScale;
+    const uint64_t part = (static_cast<uint64_t>(rate) << 32) % accrualRateScale;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t balance = static_cast<uint64_t>(balances[i]);
+        uint64_t rest = (balance >> 32) * part + (balance & 0xFFFFFFFFull) * rate;
+        accruals[i] = static_cast<Amount>((balance >> 32) * whole + rest / accrualRateScale);
+        remainderSum += rest % accrualRateScale;
+    }
+}
+
+#ifdef ACCRUAL_HAS_AVX2
+// Divides four values in [0, 2^63) by accrualRateScale: a double estimate (the values are converted through their
+// 32-bit halves, each exact), then an integer correction, since the estimate can be off by one either way
+AVX2_TARGET static inline __m256i divideByRateScale(__m256i value, __m256i& remainder)
+{
+    const __m256i exponent = _mm256_set1_epi64x(0x4330000000000000LL); // Bits of 2^52: OR-ing a value below 2^32 into it is exact
+    const __m256d twoTo52 = _mm256_set1_pd(4503599627370496.0);
+    const __m256i scale = _mm256_set1_epi64x(accrualRateScale);
+
+    __m256d high = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(value, 32), exponent)), twoTo52);
+    __m256d low = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(value, _mm256_set1_epi64x(0xFFFFFFFFLL)), exponent)), twoTo52);
+    __m256d estimate = _mm256_floor_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(high, _mm256_set1_pd(4294967296.0)), low),
+        _mm256_set1_pd(1.0 / accrualRateScale)));
+    __m256i quotient = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(estimate, twoTo52)), exponent);
+
+    // quotient * scale with 32-bit multiplies (the quotient is below 2^34)
+    __m256i product = _mm256_add_epi64(_mm256_mul_epu32(quotient, scale),
+        _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(quotient, 32), scale), 32));
+    __m256i rest = _mm256_sub_epi64(value, product);
+
+    __m256i under = _mm256_cmpgt_epi64(_mm256_setzero_si256(), rest); // All ones (-1) where the estimate was one too high
+    quotient = _mm256_add_epi64(quotient, under);
+    rest = _mm256_add_epi64(rest, _mm256_and_si256(under, scale));
+    __m256i over = _mm256_cmpgt_epi64(rest, _mm256_set1_epi64x(accrualRateScale - 1));
+    quotient = _mm256_sub_epi64(quotient, over);
+    remainder = _mm256_sub_epi64(rest, _mm256_and_si256(over, scale));
+    return quotient;
+}
+
+// Four balances per iteration
+AVX2_TARGET static void accrueInterestAvx2(const Amount* balances, uint32_t rate, Amount* accruals, size_t count, uint64_t& remainderSum)
+{
+    if (rate >= accrualRateScale)
+    {
+        accrueInterestScalar(balances, rate, accruals, count, remainderSum); // whole is 2^32, too wide for the 32-bit multiplies
+        return;
+    }
+
+    const __m256i rateVector = _mm256_set1_epi64x(rate);
+    const __m256i whole = _mm256_set1_epi64x(static_cast<long long>((static_cast<uint64_t>(rate) << 32) / accrualRateScale));
+    const __m256i part = _mm256_set1_epi64x(static_cast<long long>((static_cast<uint64_t>(rate) << 32) % accrualRateScale));
+    __m256i remainders = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i balance = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(balances + i));
+        __m256i high = _mm256_srli_epi64(balance, 32);
+        __m256i remainder;
+        __m256i quotient = divideByRateScale(_mm256_add_epi64(_mm256_mul_epu32(high, part), _mm256_mul_epu32(balance, rateVector)), remainder);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accruals + i), _mm256_add_epi64(_mm256_mul_epu32(high, whole), quotient));
+        remainders = _mm256_add_epi64(remainders, remainder);
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), remainders);
+    remainderSum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    accrueInterestScalar(balances + i, rate, accruals + i, count - i, remainderSum);
+}
+#endif
+
+// Picks the kernel
+void accrueInterest(const Amount* balances, uint32_t rate, Amount* accruals, size_t count, uint64_t& remainderSum, bool allowSimd)
+{
+#ifdef ACCRUAL_HAS_AVX2
+    if (allowSimd && CpuFeatures::get().avx2)
+    {
+        accrueInterestAvx2(balances, rate, accruals, count, remainderSum);
+        return;
+    }
+#endif
+    accrueInterestScalar(balances, rate, accruals, count, remainderSum);
+}
+
+// Name of the kernel accrueInterest picks
+const char* accrueInterestKernel(bool allowSimd)
+{
+#ifdef ACCRUAL_HAS_AVX2
+    if (allowSimd && CpuFeatures::get().avx2)
+    {
+        return "AVX2";
+    }
+#endif
+    return "scalar";
+}
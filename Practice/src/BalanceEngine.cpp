@@ -0,0 +1,515 @@
+#include "BalanceEngine.h"
+#include <algorithm>
+#include <chrono>
+
+// Returns the ID of a name, registering it if needed
+uint32_t IdRegistry::intern(const std::string& name)
+{
+    Shard& shard = shardOf(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(name);
+        if (it != shard.ids.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.ids.find(name);
+    if (it != shard.ids.end())
+    {
+        return it->second; // Registered by another thread in the meantime
+    }
+
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> namesLock(namesMutex);
+        id = static_cast<uint32_t>(names.size());
+        names.push_back(name);
+    }
+    shard.ids.emplace(name, id);
+    return id;
+}
+
+// Returns the ID of a name or invalidId
+uint32_t IdRegistry::find(const std::string& name) const
+{
+    const Shard& shard = shardOf(name);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.ids.find(name);
+    return it != shard.ids.end() ? it->second : invalidId;
+}
+
+// Returns the name of an ID
+std::string IdRegistry::name(uint32_t id) const
+{
+    std::lock_guard<std::mutex> lock(namesMutex);
+    return names[id];
+}
+
+// Returns the number of registered names
+size_t IdRegistry::size() const
+{
+    std::lock_guard<std::mutex> lock(namesMutex);
+    return names.size();
+}
+
+// Constructor for BalanceTable
+BalanceTable::BalanceTable(size_t initialCapacity)
+    : mask(0), count(0)
+{
+    size_t capacity = 16;
+    while (capacity < initialCapacity)
+    {
+        capacity <<= 1;  // Round up to a power of two
+    }
+
+    slots.assign(capacity, Slot{ emptyKey, 0 });
+    mask = capacity - 1;
+}
+
+// Doubles the slot array until the extra keys fit under a 50% load factor, then rehashes
+void BalanceTable::reserve(size_t extra)
+{
+    size_t capacity = slots.size();
+    while ((count + extra) * 2 > capacity)
+    {
+        capacity <<= 1;
+    }
+    if (capacity == slots.size())
+    {
+        return;
+    }
+
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(capacity, Slot{ emptyKey, 0 });
+    mask = capacity - 1;
+    count = 0;
+
+    for (const auto& slot : old)
+    {
+        if (slot.key != emptyKey)
+        {
+            *findOrInsert(slot.key) = slot.amount;
+        }
+    }
+}
+
+// Constructor for BalanceEngine
+BalanceEngine::BalanceEngine(size_t expectedBalances)
+    : stripes(new Stripe[stripeCount]), hotIds(), hotCount(0), aggregating(false)
+{
+    // Start every stripe at a 50% load factor for its share of the balances
+    for (size_t i = 0; i < stripeCount; ++i)
+    {
+        stripes[i].table.reserve(expectedBalances / stripeCount + 1);
+    }
+}
+
+// Destructor for BalanceEngine
+BalanceEngine::~BalanceEngine()
+{
+    stopAggregation();
+}
+
+// Rebuilds the balances from storage
+bool BalanceEngine::load(SQLData& sqlData)
+{
+    size_t loaded = 0;
+    bool ok = sqlData.forEachBalance([&](const std::string& userID, const std::string& asset, SQLData::DataBaseState book, Amount amount)
+        {
+            uint32_t account = accountId(userID);
+            uint32_t assetIndex = assetId(asset, book);
+            Stripe& stripe = stripes[stripeOf(account)];
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            stripe.table.reserve(1);
+            *stripe.table.findOrInsert(BalanceTable::makeKey(account, assetIndex)) += amount;
+            ++loaded;
+        });
+
+    std::cout << "[INFO] Balance engine loaded " << loaded << " balances.\n";
+    return ok;
+}
+
+// Interns an account name (system accounts get the system bit)
+uint32_t BalanceEngine::accountId(const std::string& userID)
+{
+    uint32_t id = accounts.intern(userID);
+    return (!userID.empty() && userID[0] == '@') ? (id | systemBit) : id;
+}
+
+// Interns an asset of a book (the same name in the other book gets its own ID)
+uint32_t BalanceEngine::assetId(const std::string& asset, SQLData::DataBaseState book)
+{
+    uint32_t id = assets.intern(assetKey(asset, book));
+
+    std::lock_guard<std::mutex> lock(booksMutex);
+    if (id >= assetBook.size())
+    {
+        assetBook.resize(id + 1, SQLData::DataBaseState::DBS_NONE);
+        assetNames.resize(id + 1);
+    }
+    if (assetBook[id] == SQLData::DataBaseState::DBS_NONE)
+    {
+        assetBook[id] = book;
+        assetNames[id] = asset;
+    }
+    return id;
+}
+
+// Returns the name of an asset
+std::string BalanceEngine::assetName(uint32_t asset) const
+{
+    std::lock_guard<std::mutex> lock(booksMutex);
+    return asset < assetNames.size() ? assetNames[asset] : std::string();
+}
+
+// Returns the book of an asset
+SQLData::DataBaseState BalanceEngine::bookOf(uint32_t asset) const
+{
+    std::lock_guard<std::mutex> lock(booksMutex);
+    return asset < assetBook.size() ? assetBook[asset] : SQLData::DataBaseState::DBS_NONE;
+}
+
+// Locks the stripes of the postings in ascending order, applies the postings one by one
+// and undoes them if a user balance would go negative. A posting of a hot account goes to the calling thread's
+// sub-balance instead, except a user debit, which locks every sub-balance too and folds them into the stripe.
+bool BalanceEngine::apply(const EnginePosting* postings, size_t count, const std::function<void()>& whileLocked)
+{
+    size_t hots = hotCount.load(std::memory_order_acquire);
+    size_t targetIndex[16];
+    size_t stripeIndex[16];
+    Amount* touched[16];
+    std::vector<size_t> targetOverflow;
+    std::vector<size_t> stripeOverflow;
+    std::vector<Amount*> touchedOverflow;
+    size_t* target = targetIndex;
+    size_t* order = stripeIndex;
+    Amount** slotsUsed = touched;
+    if (count > 16)
+    {
+        targetOverflow.resize(count);
+        touchedOverflow.resize(count);
+        target = targetOverflow.data();
+        slotsUsed = touchedOverflow.data();
+    }
+
+    // Where each posting is applied, and every lock it needs
+    size_t lockNeeds = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const EnginePosting& posting = postings[i];
+        int hot = hots == 0 ? -1 : hotIndexOf(posting.account);
+        bool split = hot >= 0 && static_cast<size_t>(hot) < hots && (posting.amount > 0 || isSystem(posting.account));
+        target[i] = split ? hotLock(static_cast<size_t>(hot), threadShard()) : stripeOf(posting.account);
+        lockNeeds += (hot >= 0 && static_cast<size_t>(hot) < hots && !split) ? 1 + hotShardCount : 1;
+    }
+    if (lockNeeds > 16)
+    {
+        stripeOverflow.resize(lockNeeds);
+        order = stripeOverflow.data();
+    }
+    size_t orderCount = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        order[orderCount++] = target[i];
+        int hot = target[i] < stripeCount && hots != 0 ? hotIndexOf(postings[i].account) : -1;
+        if (hot >= 0 && static_cast<size_t>(hot) < hots)
+        {
+            for (size_t shard = 0; shard < hotShardCount; ++shard)
+            {
+                order[orderCount++] = hotLock(static_cast<size_t>(hot), shard);
+            }
+        }
+    }
+
+    // Deterministic lock order: ascending index (stripes, then sub-balances), each lock once
+    std::sort(order, order + orderCount);
+
+    size_t lockCount = 0;
+    for (size_t i = 0; i < orderCount;)
+    {
+        size_t run = i;
+        while (run < orderCount && order[run] == order[i])
+        {
+            ++run;
+        }
+        Stripe& stripe = lockTarget(order[i]);
+        stripe.mutex.lock();
+        stripe.table.reserve(run - i); // No rehash while we hold slot pointers (room for this lock's postings only)
+        order[lockCount++] = order[i];
+        i = run;
+    }
+
+    bool applied = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const EnginePosting& posting = postings[i];
+        uint64_t key = BalanceTable::makeKey(posting.account, posting.asset);
+        Amount* amount = lockTarget(target[i]).table.findOrInsert(key);
+
+        // A user debit of a hot account: the sub-balances are folded in first (they only hold credits)
+        int hot = target[i] < stripeCount && hots != 0 ? hotIndexOf(posting.account) : -1;
+        if (hot >= 0 && static_cast<size_t>(hot) < hots)
+        {
+            for (size_t shard = 0; shard < hotShardCount; ++shard)
+            {
+                Amount* part = lockTarget(hotLock(static_cast<size_t>(hot), shard)).table.find(key);
+                if (part && *part != 0 && FixedPoint::add(*amount, *part, *amount))
+                {
+                    *part = 0;
+                }
+            }
+        }
+
+        Amount updated = 0;
+        bool overflow = !FixedPoint::add(*amount, posting.amount, updated);
+        if (overflow || (updated < 0 && !isSystem(posting.account)))
+        {
+            // Undo what was applied so far
+            for (size_t j = 0; j < i; ++j)
+            {
+                *slotsUsed[j] -= postings[j].amount;
+            }
+            applied = false;
+            break;
+        }
+
+        *amount = updated;
+        slotsUsed[i] = amount;
+    }
+
+    if (applied && whileLocked)
+    {
+        whileLocked();
+    }
+
+    for (size_t i = lockCount; i-- > 0;)
+    {
+        lockTarget(order[i]).mutex.unlock();
+    }
+    return applied;
+}
+
+// Interns the names and applies the postings
+bool BalanceEngine::apply(const std::vector<SQLData::Posting>& postings, const std::function<void()>& whileLocked)
+{
+    EnginePosting interned[16];
+    std::vector<EnginePosting> internedOverflow;
+    EnginePosting* target = postings.size() <= 16 ? interned : (internedOverflow.resize(postings.size()), internedOverflow.data());
+
+    for (size_t i = 0; i < postings.size(); ++i)
+    {
+        target[i].account = accountId(postings[i].userID);
+        target[i].asset = assetId(postings[i].asset, postings[i].book);
+        target[i].amount = postings[i].amount;
+    }
+
+    return apply(target, postings.size(), whileLocked);
+}
+
+// Returns a balance by IDs (a hot account's stripe and sub-balances are locked together, so a fold in between
+// cannot be missed or counted twice)
+Amount BalanceEngine::balance(uint32_t account, uint32_t asset) const
+{
+    uint64_t key = BalanceTable::makeKey(account, asset);
+    Stripe& stripe = stripes[stripeOf(account)];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    const Amount* amount = stripe.table.find(key);
+    Amount total = amount ? *amount : 0;
+
+    int hot = hotIndexOf(account);
+    if (hot >= 0)
+    {
+        std::unique_lock<std::mutex> shardLocks[hotShardCount];
+        for (size_t shard = 0; shard < hotShardCount; ++shard)
+        {
+            Stripe& part = hotShards[hotLock(static_cast<size_t>(hot), shard) - stripeCount];
+            shardLocks[shard] = std::unique_lock<std::mutex>(part.mutex);
+            const Amount* partAmount = part.table.find(key);
+            total += partAmount ? *partAmount : 0;
+        }
+    }
+    return total;
+}
+
+// Returns a balance by names
+Amount BalanceEngine::balance(const std::string& userID, const std::string& asset, SQLData::DataBaseState book) const
+{
+    uint32_t account = accounts.find(userID);
+    uint32_t assetIndex = assets.find(assetKey(asset, book));
+    if (account == IdRegistry::invalidId || assetIndex == IdRegistry::invalidId)
+    {
+        return 0;
+    }
+    if (!userID.empty() && userID[0] == '@')
+    {
+        account |= systemBit;
+    }
+    return balance(account, assetIndex);
+}
+
+// Spreads the calling threads over the sub-balances in the order they first post to a hot account
+size_t BalanceEngine::threadShard()
+{
+    static std::atomic<size_t> nextShard(0);
+    thread_local size_t shard = nextShard++ % hotShardCount;
+    return shard;
+}
+
+// Splits an account: its stripe balance stays, new credits go to the sub-balances
+bool BalanceEngine::markHot(const std::string& userID)
+{
+    uint32_t account = accountId(userID);
+    std::lock_guard<std::mutex> lock(hotMutex);
+    if (hotIndexOf(account) >= 0)
+    {
+        return true;
+    }
+    size_t hots = hotCount.load(std::memory_order_relaxed);
+    if (hots == maxHotAccounts)
+    {
+        std::cerr << "[ERROR] Could not split " << userID << ": " << maxHotAccounts << " accounts are split already\n";
+        return false;
+    }
+    if (!hotShards)
+    {
+        hotShards.reset(new Stripe[maxHotAccounts * hotShardCount]);
+    }
+    hotIds[hots] = account;
+    hotCount.store(hots + 1, std::memory_order_release);
+    return true;
+}
+
+// Sums a hot account's stripe balances and sub-balances per asset
+void BalanceEngine::hotBalances(size_t hot, std::vector<std::pair<uint32_t, Amount>>& perAsset) const
+{
+    perAsset.clear();
+    uint32_t account = hotIds[hot];
+    auto add = [&](uint64_t key, Amount amount)
+        {
+            if (static_cast<uint32_t>(key >> 32) != account)
+            {
+                return;
+            }
+            uint32_t asset = static_cast<uint32_t>(key & 0xFFFFFFFFu);
+            auto it = std::find_if(perAsset.begin(), perAsset.end(), [asset](const std::pair<uint32_t, Amount>& entry) { return entry.first == asset; });
+            if (it == perAsset.end())
+            {
+                perAsset.emplace_back(asset, amount);
+            }
+            else
+            {
+                it->second += amount;
+            }
+        };
+
+    std::lock_guard<std::mutex> lock(stripes[stripeOf(account)].mutex);
+    stripes[stripeOf(account)].table.forEach(add);
+    for (size_t shard = 0; shard < hotShardCount; ++shard)
+    {
+        Stripe& part = hotShards[hotLock(hot, shard) - stripeCount];
+        std::lock_guard<std::mutex> partLock(part.mutex);
+        part.table.forEach(add);
+    }
+}
+
+// Folds the sub-balances of every hot account into its stripe, one account at a time
+size_t BalanceEngine::aggregateHot()
+{
+    size_t moved = 0;
+    size_t hots = hotCount.load(std::memory_order_acquire);
+    for (size_t hot = 0; hot < hots; ++hot)
+    {
+        Stripe& stripe = stripes[stripeOf(hotIds[hot])];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        for (size_t shard = 0; shard < hotShardCount; ++shard)
+        {
+            Stripe& part = hotShards[hotLock(hot, shard) - stripeCount];
+            std::lock_guard<std::mutex> partLock(part.mutex);
+            part.table.forEachAmount([&](uint64_t key, Amount& amount)
+                {
+                    if (amount == 0)
+                    {
+                        return;
+                    }
+                    stripe.table.reserve(1);
+                    Amount* folded = stripe.table.findOrInsert(key);
+                    if (FixedPoint::add(*folded, amount, *folded))
+                    {
+                        amount = 0;
+                        ++moved;
+                    }
+                });
+        }
+    }
+    return moved;
+}
+
+// Starts the aggregator thread
+void BalanceEngine::startAggregation(int64_t intervalMillis)
+{
+    std::lock_guard<std::mutex> lock(aggregatorMutex);
+    if (aggregator.joinable())
+    {
+        return;
+    }
+    aggregating = true;
+    aggregator = std::thread([this, intervalMillis]()
+        {
+            std::unique_lock<std::mutex> wait(aggregatorMutex);
+            while (!wakeAggregator.wait_for(wait, std::chrono::milliseconds(std::max<int64_t>(1, intervalMillis)), [this]() { return !aggregating; }))
+            {
+                wait.unlock();
+                aggregateHot();
+                wait.lock();
+            }
+        });
+}
+
+// Stops the aggregator thread
+void BalanceEngine::stopAggregation()
+{
+    {
+        std::lock_guard<std::mutex> lock(aggregatorMutex);
+        if (!aggregator.joinable())
+        {
+            return;
+        }
+        aggregating = false;
+    }
+    wakeAggregator.notify_one();
+    aggregator.join();
+}
+
+// Returns the number of stored balances
+size_t BalanceEngine::size() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < stripeCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(stripes[i].mutex);
+        total += stripes[i].table.size();
+    }
+    return total;
+}
+
+// Returns the memory used by the balance tables
+size_t BalanceEngine::memoryBytes() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < stripeCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(stripes[i].mutex);
+        total += stripes[i].table.memoryBytes();
+    }
+    size_t hots = hotCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < hots * hotShardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(hotShards[i].mutex);
+        total += hotShards[i].table.memoryBytes();
+    }
+    return total;
+}
@@ -0,0 +1,191 @@
+#include "BalanceHistory.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+// Constructor for BalanceHistory
+BalanceHistory::BalanceHistory(SQLData& sqlData, uint64_t intervalPostings)
+    : dbName(sqlData.databaseName()), vfsName(sqlData.vfsName()), intervalPostings(std::max<uint64_t>(1, intervalPostings)), running(false), stopping(false)
+{
+}
+
+// Destructor for BalanceHistory
+BalanceHistory::~BalanceHistory()
+{
+    stop();
+    storage.close();
+}
+
+// Opens the connection once and creates the checkpoint tables
+bool BalanceHistory::openLocked()
+{
+    if (storage.isOpen())
+    {
+        return true;
+    }
+    if (!storage.open(dbName, vfsName))
+    {
+        std::cerr << "[ERROR] Balance history could not open " << dbName << "\n";
+        return false;
+    }
+    return storage.createTable(SQLData::DataBaseState::DBS_CHECKPOINTS);
+}
+
+// One checkpoint per full interval, each in its own write transaction; the lock is let go between them so queries
+// are not held up while a long journal is caught up on
+size_t BalanceHistory::checkpoint()
+{
+    size_t written = 0;
+    for (;;)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SQLData::CheckpointRow last;
+        if (stopping || !openLocked() || !storage.lastCheckpoint(last))
+        {
+            return written;
+        }
+
+        // The checkpoint ends with the transaction of the interval's last posting, so no transaction is split
+        sqlite3_int64 boundary = last.postingID + static_cast<sqlite3_int64>(intervalPostings);
+        if (storage.maxID("POSTINGS") < boundary)
+        {
+            return written;
+        }
+        sqlite3_int64 txID = storage.postingTransaction(boundary);
+        sqlite3_int64 postingID = storage.lastPostingOf(txID);
+        sqlite3_int64 balances = 0;
+        if (txID <= last.txID || postingID < boundary || !storage.execute("BEGIN IMMEDIATE;"))
+        {
+            return written;
+        }
+        if (!storage.insertCheckpoint(txID, last.postingID, postingID, balances) || !storage.execute("COMMIT;"))
+        {
+            storage.execute("ROLLBACK;");
+            std::cerr << "[ERROR] Could not write the balance checkpoint of transaction " << txID << "\n";
+            return written;
+        }
+        ++written;
+    }
+}
+
+// Checkpoint at or before the time, transaction at the time, then the account's postings in between
+bool BalanceHistory::balancesAt(const std::string& userID, int64_t timeMillis, std::vector<AsOfBalance>& balances, AsOfInfo* info)
+{
+    balances.clear();
+    AsOfInfo query;
+    std::map<std::pair<std::string, int>, Amount> sums;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SQLData::CheckpointRow from, next;
+        if (!openLocked() || !storage.findCheckpoint(timeMillis, from) || !storage.nextCheckpoint(from.txID, next))
+        {
+            return false;
+        }
+
+        // Largest transaction recorded at or before the time: after the checkpoint, before the next one
+        sqlite3_int64 low = storage.lastTransactionAt(timeMillis, from.txID,
+            next.txID != 0 ? next.txID - 1 : storage.maxID("TRANSACTIONS"), &query.timeLookups);
+        query.throughTxID = low;
+        query.checkpointTxID = from.txID;
+
+        if (from.txID != 0 && !storage.forEachCheckpointBalance(userID, from.txID,
+            [&](const char* asset, SQLData::DataBaseState book, Amount amount) { sums[{ asset, static_cast<int>(book) }] += amount; }))
+        {
+            return false;
+        }
+        sqlite3_int64 toPostingID = low == from.txID ? from.postingID : storage.lastPostingOf(low);
+        if (toPostingID > from.postingID && !storage.forEachPostingDelta(userID, from.postingID, toPostingID,
+            [&](const char* asset, SQLData::DataBaseState book, Amount amount, sqlite3_int64 postings)
+            {
+                sums[{ asset, static_cast<int>(book) }] += amount;
+                query.deltaPostings += static_cast<uint64_t>(postings);
+            }))
+        {
+            return false;
+        }
+    }
+
+    for (const auto& sum : sums)
+    {
+        if (sum.second != 0)
+        {
+            balances.push_back({ sum.first.first, static_cast<SQLData::DataBaseState>(sum.first.second), sum.second });
+        }
+    }
+    if (info)
+    {
+        *info = query;
+    }
+    return true;
+}
+
+// Picks one balance out of the account's balances at the time
+bool BalanceHistory::balanceAt(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, int64_t timeMillis, Amount& amount)
+{
+    std::vector<AsOfBalance> balances;
+    if (!balancesAt(userID, timeMillis, balances))
+    {
+        return false;
+    }
+    amount = 0;
+    for (const auto& balance : balances)
+    {
+        if (balance.asset == asset && balance.book == book)
+        {
+            amount = balance.amount;
+        }
+    }
+    return true;
+}
+
+// Starts the worker
+bool BalanceHistory::start(int64_t pollMillis)
+{
+    if (worker.joinable())
+    {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!openLocked())
+        {
+            return false;
+        }
+        running = true;
+        stopping = false;
+    }
+    worker = std::thread(&BalanceHistory::run, this, std::max<int64_t>(1, pollMillis));
+    return true;
+}
+
+// Stops the worker
+void BalanceHistory::stop()
+{
+    if (!worker.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        stopping = true;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+}
+
+// Writes the checkpoints that are due, then sleeps until the next poll or a stop
+void BalanceHistory::run(int64_t pollMillis)
+{
+    for (;;)
+    {
+        checkpoint();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wakeWorker.wait_for(lock, std::chrono::milliseconds(pollMillis), [this]() { return !running; }))
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,2987 @@
+#include "Benchmark.h"
+#include "AccrualKernels.h"
+#include "BalanceHistory.h"
+#include "BulkCredit.h"
+#include "CoinExchange.h"
+#include "FxRates.h"
+#include "GatherKernels.h"
+#include "InterestAccrual.h"
+#include "JournalReplay.h"
+#include "Ledger.h"
+#include "LedgerPipeline.h"
+#include "LedgerReconciler.h"
+#include "PortfolioValuation.h"
+#include "PriceChart.h"
+#include "PriceFeed.h"
+#include "PriceHistory.h"
+#include "StatementGenerator.h"
+#include "TimerWheel.h"
+#include "TransferScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// Prints the VFS counters collected for one measured operation
+static void printVFSStats(const std::string& operation, const VFSStats& stats, double elapsedMicros)
+{
+    std::cout << std::left << std::setw(24) << operation
+        << " syncs: " << std::setw(4) << stats.syncs
+        << " writes: " << std::setw(4) << stats.writes
+        << " reads: " << std::setw(4) << stats.reads
+        << " bytes written: " << std::setw(8) << stats.bytesWritten
+        << " time: " << std::fixed << std::setprecision(1) << elapsedMicros << " us\n";
+}
+
+// Resets the VFS counters, runs the operation and prints what it cost
+static void measureVFS(const std::string& operation, const std::function<void()>& body)
+{
+    LatencyVFS::instance().resetStats();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printVFSStats(operation, LatencyVFS::instance().stats(), elapsed);
+}
+
+// Counts the durable writes of the wallet operations against a simulated slow disk
+static int benchmarkVFS()
+{
+    LatencyVFS& vfs = LatencyVFS::instance();
+    vfs.seed(42);
+    vfs.setWriteLatency(LatencyProfile(20.0, 5.0));   // 20us +- 5us per write
+    vfs.setSyncLatency(LatencyProfile(2000.0, 500.0)); // 2ms +- 0.5ms per fsync
+
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-vfs.db"))
+    {
+        return 1;
+    }
+
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+
+    user.userID = "alice";
+    sqlData.insertData("alice", "alice-password", "abandon ability absorb");
+    sqlData.insertData("bob", "bob-password", "baby balance basket");
+
+    // The same Ledger calls AddMoneyInWallet, BuyCoins and EnterCryptoAccount make
+    measureVFS("AddMoneyInWallet", [&]() { ledger.deposit("USD", FixedPoint::fromDouble(1000.0)); });
+    measureVFS("BuyCoins", [&]() { ledger.buyCoin("Bitcoin", FixedPoint::fromDouble(100.0), FixedPoint::fromDouble(100.0 / 63250.0)); });
+    measureVFS("BuyCoins + fee", [&]() { ledger.buyCoin("Bitcoin", FixedPoint::fromDouble(100.0), FixedPoint::fromDouble(100.0 / 63250.0), 0, FixedPoint::fromDouble(0.25)); });
+    measureVFS("SellCoins + fee", [&]() { ledger.sellCoin("Bitcoin", FixedPoint::fromDouble(0.001), FixedPoint::fromDouble(63.25), 0, FixedPoint::fromDouble(0.25)); });
+    measureVFS("sendCoinsToUser", [&]() { ledger.sendCoins("bob", "Bitcoin", FixedPoint::fromDouble(0.0005)); });
+    measureVFS("sendCoins (rejected)", [&]() { ledger.sendCoins("bob", "Bitcoin", FixedPoint::fromDouble(5.0)); });
+
+    sqlData.close();
+    vfs.clearFiles();
+    return 0;
+}
+
+// Compares valuing a wallet row by row in C++ with the single fp_sum/fx_convert/coin_value query
+static int benchmarkSQLFunctions()
+{
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-sqlfunc.db"))
+    {
+        return 1;
+    }
+
+    sqlData.createTable(SQLData::DataBaseState::DBS_COINS);
+    sqlData.createTable(SQLData::DataBaseState::DBS_BALANCE);
+    sqlData.createTable(SQLData::DataBaseState::DBS_FX_RATES);
+
+    std::list<Coin> coins;
+    const int coinCount = 200;
+    sqlData.execute("BEGIN;");
+    for (int i = 0; i < coinCount; ++i)
+    {
+        std::string coinName = "Coin" + std::to_string(i);
+        coins.push_back(Coin(coinName, 1.0f + i));
+        sqlData.insertValute("alice", coinName, 0.5 + i * 0.01, SQLData::DataBaseState::DBS_COINS);
+    }
+    sqlData.insertValute("alice", "EUR", 250.0, SQLData::DataBaseState::DBS_BALANCE);
+    sqlData.execute("COMMIT;");
+
+    MarketData market;
+    market.publishPrices(coins);
+    sqlData.attachMarketData(market);
+
+    const int rounds = 200;
+    double perRowValue = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        perRowValue = 0.0;
+        for (const auto& holding : sqlData.getUserCoins("alice"))
+        {
+            double price = 0.0;
+            if (market.coinPrice(holding.first, price))
+            {
+                perRowValue += holding.second * price;
+            }
+        }
+        for (const auto& money : sqlData.getUserBalance("alice"))
+        {
+            double converted = 0.0;
+            if (market.convert(money.second, money.first, "USD", converted))
+            {
+                perRowValue += converted;
+            }
+        }
+    }
+    auto perRowMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    double queryValue = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        queryValue = sqlData.getWalletValuation("alice", "USD");
+    }
+    auto queryMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "Per-row C++ valuation:  " << perRowValue << " USD in " << perRowMicros << " us\n"
+        << "Single SQL valuation:   " << queryValue << " USD in " << queryMicros << " us\n";
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return 0;
+}
+
+// Ranks portfolios with a single COINS x PRICES join
+static int benchmarkPricesTable()
+{
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-prices.db"))
+    {
+        return 1;
+    }
+
+    sqlData.createTable(SQLData::DataBaseState::DBS_COINS);
+    sqlData.createTable(SQLData::DataBaseState::DBS_FX_RATES);
+
+    std::list<Coin> coins =
+    {
+        Coin("Bitcoin", 63250.0f), Coin("Ethereum", 3100.0f), Coin("Dogecoin", 0.14f),
+        Coin("Litecoin", 85.0f), Coin("Cardano", 0.45f)
+    };
+    MarketData market;
+    market.publishPrices(coins);
+    sqlData.attachMarketData(market);
+
+    const int userCount = 20000;
+    sqlData.execute(
+        "WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(userCount - 1) + ") "
+        "INSERT INTO COINS (user_id, coin_name, amount) "
+        "SELECT 'user' || i, 'Bitcoin', 0.001 * (i % 97) FROM n "
+        "UNION ALL SELECT 'user' || i, 'Dogecoin', 10.0 * (i % 13) FROM n;");
+
+    auto start = std::chrono::steady_clock::now();
+    auto ranking = sqlData.getTopPortfolios(3);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Top portfolios over " << userCount * 2 << " holdings in " << std::fixed << std::setprecision(2) << elapsed << " ms:\n";
+    for (const auto& entry : ranking)
+    {
+        std::cout << "  " << entry.first << " - " << entry.second << " USD\n";
+    }
+
+    start = std::chrono::steady_clock::now();
+    auto holdings = sqlData.getUserCoinValues("user96");
+    elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "user96 holdings valued in " << elapsed << " us:\n";
+    for (const auto& holding : holdings)
+    {
+        std::cout << "  " << holding.coinName << " " << holding.amount << " = " << holding.value << " USD\n";
+    }
+
+    // A feed scales every price by the same factor while the join runs: coins priced at one version agree on it
+    PriceSnapshot base = market.priceSnapshot();
+    std::vector<std::pair<std::string, double>> basePrices;
+    for (size_t i = 0; i < base.size(); ++i)
+    {
+        basePrices.emplace_back(base.name(i), base.prices[i]);
+    }
+    std::atomic<bool> feeding(true);
+    std::thread feed([&]()
+        {
+            std::vector<std::pair<std::string, double>> updates = basePrices;
+            for (int step = 1; feeding.load(std::memory_order_relaxed); ++step)
+            {
+                for (size_t i = 0; i < updates.size(); ++i)
+                {
+                    updates[i].second = basePrices[i].second * (1.0 + (step % 1000) * 0.001);
+                }
+                market.updatePrices(updates);
+            }
+        });
+    const int valuations = 20000;
+    int mixed = 0;
+    for (int i = 0; i < valuations; ++i)
+    {
+        double factor = 0.0;
+        for (const auto& holding : sqlData.getUserCoinValues("user96"))
+        {
+            double price = 0.0;
+            base.find(holding.coinName, price);
+            double rowFactor = holding.value / (holding.amount * price);
+            if (factor == 0.0)
+            {
+                factor = rowFactor;
+            }
+            else if (std::fabs(rowFactor - factor) > 1e-4)
+            {
+                ++mixed;
+                break;
+            }
+        }
+    }
+    feeding.store(false);
+    feed.join();
+    std::cout << valuations << " valuations during price updates, " << mixed << " mixed two price versions\n";
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return mixed == 0 ? 0 : 1;
+}
+
+// Milliseconds elapsed since start
+static double elapsedMillis(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Group-committed ledger transactions and deep history pages
+static int benchmarkJournal()
+{
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-journal.db"))
+    {
+        return 1;
+    }
+
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+
+    user.userID = "alice";
+    sqlData.insertData("alice", "alice-password", "abandon ability absorb");
+    sqlData.insertData("bob", "bob-password", "baby balance basket");
+
+    ledger.deposit("USD", FixedPoint::fromDouble(1000000.0));
+    ledger.buyCoin("Bitcoin", FixedPoint::fromDouble(6325.0), FixedPoint::fromDouble(0.1));
+    ledger.sendCoins("bob", "Bitcoin", FixedPoint::fromDouble(0.01));
+
+    const int batchSize = 1000;
+    const int batches = 50;
+    auto start = std::chrono::steady_clock::now();
+    LatencyVFS::instance().resetStats();
+    for (int batch = 0; batch < batches; ++batch)
+    {
+        ledger.beginBatch();
+        for (int i = 0; i < batchSize; ++i)
+        {
+            ledger.buyCoin("Dogecoin", FixedPoint::fromDouble(1.0), FixedPoint::fromDouble(1.0 / 0.14));
+        }
+        ledger.commitBatch();
+    }
+    double millis = elapsedMillis(start);
+    VFSStats stats = LatencyVFS::instance().stats();
+    std::cout << "Batched buys: " << batches * batchSize << " in " << std::fixed << std::setprecision(1) << millis << " ms ("
+        << batches * batchSize / (millis / 1000.0) << " tx/s, " << stats.syncs << " syncs)\n";
+
+    // Walk the whole history of alice page by page: every page is an index seek, not an OFFSET scan
+    start = std::chrono::steady_clock::now();
+    sqlite3_int64 cursor = 0;
+    int pages = 0;
+    size_t postings = 0;
+    for (;;)
+    {
+        auto page = ledger.getHistory(cursor, 100);
+        if (page.empty())
+        {
+            break;
+        }
+        postings += page.size();
+        cursor = page.back().id;
+        ++pages;
+    }
+    millis = elapsedMillis(start);
+    std::cout << "History: " << postings << " postings in " << pages << " pages, " << millis / pages << " ms per page\n";
+
+    auto dogecoin = sqlData.getAssetHistory("Dogecoin", 0, 2);
+    std::cout << "Latest Dogecoin posting: tx " << dogecoin.front().txID << " " << dogecoin.front().kind << " "
+        << dogecoin.front().userID << " " << FixedPoint::toDouble(dogecoin.front().amount) << "\n";
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return 0;
+}
+
+// Returns the given percentile of sorted latencies
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+    return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+// Prints p50/p99/p99.9 of a set of latencies in microseconds
+static void printLatencies(const std::string& label, std::vector<double>& micros, double millis)
+{
+    std::sort(micros.begin(), micros.end());
+    std::cout << std::left << std::setw(26) << label << std::right << std::fixed << std::setprecision(0)
+        << micros.size() / (millis / 1000.0) << " ops/s  p50 " << std::setprecision(2) << percentile(micros, 0.50)
+        << " us  p99 " << percentile(micros, 0.99) << " us  p99.9 " << percentile(micros, 0.999) << " us\n";
+}
+
+// Transfers through the in-memory balance engine while the journal is persisted in the background
+static int benchmarkEngine()
+{
+    LatencyVFS& vfs = LatencyVFS::instance();
+    vfs.setSyncLatency(LatencyProfile(2000.0, 500.0)); // 2ms fsync: the engine must not wait for it
+
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-engine.db"))
+    {
+        return 1;
+    }
+
+    const int accountCount = 10000;
+    std::vector<std::string> accounts;
+    for (int i = 0; i < accountCount; ++i)
+    {
+        accounts.push_back("acct" + std::to_string(i));
+    }
+
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        if (!ledger.enableBalanceEngine())
+        {
+            return 1;
+        }
+
+        // Fund every account with 1000 BTC
+        for (const auto& account : accounts)
+        {
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { account, "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1000 * FixedPoint::SCALE },
+                });
+        }
+        ledger.flush();
+
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int> pick(0, accountCount - 1);
+
+        // Raw engine: interned IDs, no validation or persistence (a standalone copy, the ledger's stays in sync with the database)
+        BalanceEngine engine(accountCount);
+        uint32_t bitcoin = engine.assetId("Bitcoin", SQLData::DataBaseState::DBS_COINS);
+        std::vector<uint32_t> ids;
+        for (const auto& account : accounts)
+        {
+            ids.push_back(engine.accountId(account));
+            EnginePosting funding = { ids.back(), bitcoin, 1000 * FixedPoint::SCALE };
+            engine.apply(&funding, 1);
+        }
+
+        const int engineOps = 1000000;
+        std::vector<double> latencies;
+        latencies.reserve(engineOps);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < engineOps; ++i)
+        {
+            uint32_t from = ids[pick(random)];
+            uint32_t to = ids[pick(random)];
+            EnginePosting postings[2] = { { from, bitcoin, -1000 }, { to, bitcoin, 1000 } };
+
+            auto opStart = std::chrono::steady_clock::now();
+            engine.apply(postings, 2);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - opStart).count());
+        }
+        printLatencies("engine.apply", latencies, elapsedMillis(start));
+
+        // Full ledger path: validation, engine, queued for the persister
+        const int ledgerOps = 200000;
+        latencies.clear();
+        vfs.resetStats();
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ledgerOps; ++i)
+        {
+            const std::string& from = accounts[pick(random)];
+            const std::string& to = accounts[pick(random)];
+
+            auto opStart = std::chrono::steady_clock::now();
+            ledger.applyTransaction(TransactionKind::TK_Send,
+                {
+                    { from, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1000 },
+                    { to, "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000 },
+                });
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - opStart).count());
+        }
+        double applyMillis = elapsedMillis(start);
+        printLatencies("ledger.applyTransaction", latencies, applyMillis);
+
+        ledger.flush();
+        double drainMillis = elapsedMillis(start);
+        PersisterStats stats = ledger.persisterStats();
+        std::cout << "Persisted " << stats.persisted << " transactions in " << stats.batches << " batches (max "
+            << stats.maxBatch << "), " << std::setprecision(1) << drainMillis - applyMillis << " ms after the last apply, "
+            << vfs.stats().syncs << " syncs\n";
+
+        // Restart: rebuild from storage and compare with the live engine
+        BalanceEngine& live = ledger.balanceEngine();
+        BalanceEngine rebuilt;
+        rebuilt.load(sqlData);
+        size_t mismatches = 0;
+        live.forEach([&](uint32_t account, uint32_t asset, Amount amount)
+            {
+                if (rebuilt.balance(live.accountName(account), live.assetName(asset), live.bookOf(asset)) != amount)
+                {
+                    ++mismatches;
+                }
+            });
+        std::cout << "Rebuilt " << rebuilt.size() << " balances, " << mismatches << " mismatches, table "
+            << live.memoryBytes() / 1024 << " KiB\n";
+    }
+
+    sqlData.close();
+    vfs.clearFiles();
+    return 0;
+}
+
+// Runs transfers from 1 to N threads on one engine, uniform or with most transfers touching a few hot accounts
+static int benchmarkConcurrency()
+{
+    const int accountCount = 100000;
+    const int hotAccounts = 8;
+    const int opsPerThread = 500000;
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency()); // At least 4 so the locking is exercised
+
+    std::cout << "threads  workload   ops/s        speedup  rejected\n";
+    for (int skewed = 0; skewed < 2; ++skewed)
+    {
+        double baseline = 0.0;
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            BalanceEngine engine(accountCount);
+            uint32_t bitcoin = engine.assetId("Bitcoin", SQLData::DataBaseState::DBS_COINS);
+            std::vector<uint32_t> ids;
+            for (int i = 0; i < accountCount; ++i)
+            {
+                ids.push_back(engine.accountId("acct" + std::to_string(i)));
+                EnginePosting funding = { ids.back(), bitcoin, 1000 * FixedPoint::SCALE };
+                engine.apply(&funding, 1);
+            }
+
+            std::atomic<uint64_t> rejected(0);
+            std::vector<std::thread> workers;
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&, t]()
+                    {
+                        std::mt19937 random(1000 + t);
+                        std::uniform_int_distribution<int> pick(0, accountCount - 1);
+                        std::uniform_int_distribution<int> pickHot(0, hotAccounts - 1);
+                        std::uniform_int_distribution<int> percent(0, 99);
+                        uint64_t failed = 0;
+                        for (int i = 0; i < opsPerThread; ++i)
+                        {
+                            // Skewed: 90% of the transfers pay into one of the hot accounts
+                            uint32_t from = ids[pick(random)];
+                            uint32_t to = (skewed && percent(random) < 90) ? ids[pickHot(random)] : ids[pick(random)];
+                            EnginePosting postings[2] = { { from, bitcoin, -1000 }, { to, bitcoin, 1000 } };
+                            if (!engine.apply(postings, 2))
+                            {
+                                ++failed;
+                            }
+                        }
+                        rejected += failed;
+                    });
+            }
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+            double millis = elapsedMillis(start);
+
+            double opsPerSecond = threads * opsPerThread / (millis / 1000.0);
+            if (threads == 1)
+            {
+                baseline = opsPerSecond;
+            }
+            std::cout << std::left << std::setw(9) << threads << std::setw(11) << (skewed ? "skewed" : "uniform")
+                << std::setw(13) << std::fixed << std::setprecision(0) << opsPerSecond
+                << std::setw(9) << std::setprecision(2) << opsPerSecond / baseline << rejected.load() << "\n";
+        }
+    }
+
+    // Full ledger path (journal queued for the persister) from every thread at once
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-concurrency.db"))
+    {
+        return 1;
+    }
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        ledger.enableBalanceEngine();
+
+        const int ledgerAccounts = 10000;
+        for (int i = 0; i < ledgerAccounts; ++i)
+        {
+            std::string account = "acct" + std::to_string(i);
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { account, "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1000 * FixedPoint::SCALE },
+                });
+        }
+        ledger.flush();
+
+        const int ledgerOpsPerThread = 50000;
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < maxThreads; ++t)
+        {
+            workers.emplace_back([&, t]()
+                {
+                    std::mt19937 random(2000 + t);
+                    std::uniform_int_distribution<int> pick(0, ledgerAccounts - 1);
+                    for (int i = 0; i < ledgerOpsPerThread; ++i)
+                    {
+                        int from = pick(random);
+                        int to = (from + 1 + pick(random) % (ledgerAccounts - 1)) % ledgerAccounts;
+                        ledger.transfer("acct" + std::to_string(from), "acct" + std::to_string(to), "Bitcoin", 1000);
+                    }
+                });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        double millis = elapsedMillis(start);
+        ledger.flush();
+
+        // Money is conserved: the user balances still sum to what was deposited
+        Amount total = 0;
+        ledger.balanceEngine().forEach([&](uint32_t account, uint32_t, Amount amount)
+            {
+                if (!BalanceEngine::isSystem(account))
+                {
+                    total += amount;
+                }
+            });
+        std::cout << "Ledger::transfer x" << maxThreads << " threads: " << std::setprecision(0)
+            << maxThreads * ledgerOpsPerThread / (millis / 1000.0) << " ops/s, persisted " << ledger.persisterStats().persisted
+            << ", total " << (total == static_cast<Amount>(ledgerAccounts) * 1000 * FixedPoint::SCALE ? "conserved" : "MISMATCH") << "\n";
+    }
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return 0;
+}
+
+// Prints the counters of one pipeline stage
+static void printStage(const std::string& name, const StageStats& stats, double millis)
+{
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(0)
+        << std::setw(10) << stats.processed / (millis / 1000.0) << " cmd/s  batches " << std::setw(8) << stats.batches
+        << "  avg batch " << std::setw(6) << std::setprecision(1) << (stats.batches ? double(stats.processed) / stats.batches : 0.0)
+        << "  max depth " << stats.maxDepth << "\n";
+}
+
+// Mixed commands through the ring-buffer pipeline, without and with the journal stage
+static int benchmarkPipeline()
+{
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-pipeline.db"))
+    {
+        return 1;
+    }
+    bool chained = false;
+
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        ledger.enableBalanceEngine();
+
+        const int accountCount = 10000;
+        std::vector<std::string> accounts;
+        for (int i = 0; i < accountCount; ++i)
+        {
+            accounts.push_back("acct" + std::to_string(i));
+        }
+
+        for (int journal = 0; journal < 2; ++journal)
+        {
+            LedgerPipeline pipeline(ledger, sqlData, 65536, journal != 0);
+
+            // Notification stage: end-to-end latency of every 16th command
+            std::vector<double> latencies;
+            uint64_t rejected = 0;
+            pipeline.setNotification([&](const LedgerCommand& command)
+                {
+                    if (command.status == CommandStatus::CS_Rejected)
+                    {
+                        ++rejected;
+                    }
+                    if ((command.sequence & 15) == 0)
+                    {
+                        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                        latencies.push_back((now - command.submittedNanos) / 1000.0);
+                    }
+                });
+            pipeline.start();
+
+            // Fund every account: USD deposit, then a coin purchase
+            std::vector<LedgerCommand> commands;
+            for (const auto& account : accounts)
+            {
+                commands.push_back(pipeline.deposit(account, "USD", 100000 * FixedPoint::SCALE));
+                commands.push_back(pipeline.buy(account, "Bitcoin", 6325 * FixedPoint::SCALE, FixedPoint::SCALE / 10));
+            }
+
+            // Mixed traffic: 70% sends, 10% deposits, 10% buys, 10% withdrawals
+            const int commandCount = journal ? 200000 : 2000000;
+            std::mt19937 random(11);
+            std::uniform_int_distribution<int> pick(0, accountCount - 1);
+            std::uniform_int_distribution<int> percent(0, 99);
+            for (int i = 0; i < commandCount; ++i)
+            {
+                const std::string& account = accounts[pick(random)];
+                int kind = percent(random);
+                if (kind < 70)
+                {
+                    commands.push_back(pipeline.send(account, accounts[pick(random)], "Bitcoin", 1000));
+                }
+                else if (kind < 80)
+                {
+                    commands.push_back(pipeline.deposit(account, "USD", FixedPoint::SCALE));
+                }
+                else if (kind < 90)
+                {
+                    commands.push_back(pipeline.buy(account, "Bitcoin", FixedPoint::SCALE, 1581));
+                }
+                else
+                {
+                    commands.push_back(pipeline.withdraw(account, "Bitcoin", 500));
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& command : commands)
+            {
+                pipeline.submit(command);
+            }
+            double submitMillis = elapsedMillis(start);
+            pipeline.drain();
+            double millis = elapsedMillis(start);
+
+            std::cout << (journal ? "With journal stage" : "Without journal stage") << ": " << commands.size() << " commands, submit "
+                << std::fixed << std::setprecision(0) << commands.size() / (submitMillis / 1000.0) << " cmd/s, drained in "
+                << std::setprecision(1) << millis << " ms, " << rejected << " rejected\n";
+            printStage("business", pipeline.businessStats(), millis);
+            if (journal)
+            {
+                printStage("journal", pipeline.journalStats(), millis);
+            }
+            printStage("notify", pipeline.notifyStats(), millis);
+            printLatencies("  end-to-end", latencies, millis * latencies.size() / commands.size());
+        }
+
+        // The journal stage's writes must match the engine
+        ledger.flush();
+        BalanceEngine rebuilt;
+        rebuilt.load(sqlData);
+        std::cout << "Rebuilt " << rebuilt.size() << " balances from the database\n";
+
+        // The journal stage's batches extend the ledger's integrity chain like the persister's
+        AuditReport audit;
+        chained = LedgerAudit::verifyChain(sqlData, audit) && audit.chainValid && audit.tablesMatch && audit.unchainedTransactions == 0;
+        std::cout << "Integrity chain " << (chained ? "covers every journal batch" : "BROKEN") << " (" << audit.links << " links)\n";
+    }
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return chained ? 0 : 1;
+}
+
+// Matching engine alone (random limit, market and cancel traffic), then the same flow settled through the ledger
+static int benchmarkOrderBook()
+{
+    const Amount tick = FixedPoint::SCALE / 100; // $0.01
+    const Amount mid = 63250 * FixedPoint::SCALE;
+    const int orderCount = 2000000;
+
+    std::mt19937 random(5);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> offset(-500, 500);
+    std::uniform_int_distribution<int> lots(1, 100);
+
+    OrderBook book(tick, mid - (1 << 19) * tick, 1 << 20, 1 << 16); // $63250 +- $5242
+    std::vector<uint64_t> resting;
+    std::vector<Fill> fills;
+    fills.reserve(1024);
+    std::vector<double> orderLatency;
+    std::vector<double> matchLatency;
+    orderLatency.reserve(orderCount);
+    size_t totalFills = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < orderCount; ++i)
+    {
+        int kind = percent(random);
+        OrderSide side = percent(random) < 50 ? OrderSide::OS_Buy : OrderSide::OS_Sell;
+        Amount quantity = lots(random) * (FixedPoint::SCALE / 1000);
+        // Bids below the mid and asks above it, with some overlap so that limit orders also cross
+        Amount price = mid + (side == OrderSide::OS_Buy ? -1 : 1) * (offset(random) + 450) * tick;
+        fills.clear();
+
+        auto opStart = std::chrono::steady_clock::now();
+        if (kind < 20 && !resting.empty())
+        {
+            size_t pick = random() % resting.size();
+            CanceledOrder canceled;
+            book.cancel(resting[pick], 0, canceled);
+            resting[pick] = resting.back();
+            resting.pop_back();
+        }
+        else if (kind < 30)
+        {
+            book.submitMarket(0, side, quantity, fills);
+        }
+        else
+        {
+            OrderResult result = book.submitLimit(0, side, price, quantity, fills);
+            if (result.resting > 0)
+            {
+                resting.push_back(result.orderId);
+            }
+        }
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - opStart).count();
+
+        orderLatency.push_back(micros);
+        if (!fills.empty())
+        {
+            matchLatency.push_back(micros / fills.size());
+            totalFills += fills.size();
+        }
+    }
+    double millis = elapsedMillis(start);
+    printLatencies("orders", orderLatency, millis);
+    printLatencies("per match", matchLatency, millis * matchLatency.size() / orderCount);
+    std::cout << "Fills: " << totalFills << ", resting orders: " << book.orderCount() << ", best bid "
+        << FixedPoint::toDouble(book.bestBid()) << ", best ask " << FixedPoint::toDouble(book.bestAsk()) << "\n";
+
+    // Settled through the ledger: balances must be conserved and the escrow empty once the books are closed
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-orderbook.db"))
+    {
+        return 1;
+    }
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        ledger.enableBalanceEngine();
+
+        const int traders = 100;
+        std::vector<std::string> names;
+        for (int i = 0; i < traders; ++i)
+        {
+            names.push_back("trader" + std::to_string(i));
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { names.back(), "USD", SQLData::DataBaseState::DBS_BALANCE, 1000000 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "USD", SQLData::DataBaseState::DBS_BALANCE, -1000000 * FixedPoint::SCALE },
+                    { names.back(), "Bitcoin", SQLData::DataBaseState::DBS_COINS, 10 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -10 * FixedPoint::SCALE },
+                });
+        }
+
+        const int settledOrders = 50000;
+        size_t accepted = 0;
+        {
+            CoinExchange exchange(ledger);
+            exchange.addMarket("Bitcoin", tick, mid - (1 << 19) * tick, 1 << 20);
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < settledOrders; ++i)
+            {
+                const std::string& trader = names[random() % traders];
+                OrderSide side = percent(random) < 50 ? OrderSide::OS_Buy : OrderSide::OS_Sell;
+                Amount quantity = lots(random) * (FixedPoint::SCALE / 1000) + random() % 1000; // Odd sizes exercise rounding
+                Amount price = mid + (side == OrderSide::OS_Buy ? -1 : 1) * (offset(random) + 450) * tick;
+                OrderResult result = percent(random) < 10
+                    ? exchange.placeMarket(trader, "Bitcoin", side, quantity)
+                    : exchange.placeLimit(trader, "Bitcoin", side, price, quantity);
+                accepted += result.accepted;
+            }
+            millis = elapsedMillis(start);
+            std::cout << "Settled exchange: " << settledOrders << " orders (" << accepted << " accepted) in " << std::setprecision(1) << millis
+                << " ms, " << std::setprecision(0) << settledOrders / (millis / 1000.0) << " orders/s, "
+                << exchange.book("Bitcoin")->orderCount() << " resting\n";
+        } // Closing the exchange cancels the resting orders
+
+        // Crash: the books of a second exchange are lost with their orders still resting (never canceled), and
+        // the next start returns what their owners' escrow accounts still hold
+        CoinExchange* crashed = new CoinExchange(ledger); // Never deleted: its destructor would cancel the orders
+        crashed->addMarket("Bitcoin", tick, mid - (1 << 19) * tick, 1 << 20);
+        for (int i = 0; i < traders; ++i)
+        {
+            crashed->placeLimit(names[i], "Bitcoin", OrderSide::OS_Buy, mid - (i + 1) * tick, FixedPoint::SCALE / 100);
+            crashed->placeLimit(names[i], "Bitcoin", OrderSide::OS_Sell, mid + (i + 1) * tick, FixedPoint::SCALE / 100);
+        }
+        size_t released = ledger.releaseStaleEscrow();
+
+        BalanceEngine& engine = ledger.balanceEngine();
+        Amount usd = 0, bitcoin = 0, usdEscrow = 0, bitcoinEscrow = 0;
+        for (const auto& name : names)
+        {
+            usd += engine.balance(name, "USD", SQLData::DataBaseState::DBS_BALANCE);
+            bitcoin += engine.balance(name, "Bitcoin", SQLData::DataBaseState::DBS_COINS);
+            usdEscrow += engine.balance(Ledger::orderBookAccount(name), "USD", SQLData::DataBaseState::DBS_BALANCE);
+            bitcoinEscrow += engine.balance(Ledger::orderBookAccount(name), "Bitcoin", SQLData::DataBaseState::DBS_COINS);
+        }
+        std::cout << "Escrow after close and crash (" << released << " stale balances released): " << usdEscrow << " USD units, "
+            << bitcoinEscrow << " BTC units; traders hold "
+            << (usd == traders * 1000000 * FixedPoint::SCALE ? "all USD" : "USD MISMATCH") << ", "
+            << (bitcoin == traders * 10 * FixedPoint::SCALE ? "all BTC" : "BTC MISMATCH") << "\n";
+        ledger.flush();
+    }
+
+    sqlData.close();
+    LatencyVFS::instance().clearFiles();
+    return 0;
+}
+
+// Journal replay: rebuild the state of a generated history with 1, 2 and 4 threads and verify it
+static int benchmarkReplay()
+{
+    LatencyVFS& vfs = LatencyVFS::instance();
+    vfs.setSyncLatency(LatencyProfile(0.0, 0.0));
+
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-replay.db"))
+    {
+        return 1;
+    }
+
+    const int accountCount = 5000;
+    const int transferCount = 200000;
+    const char* coins[] = { "Bitcoin", "Ethereum", "Solana" };
+    std::vector<std::string> accounts;
+    for (int i = 0; i < accountCount; ++i)
+    {
+        accounts.push_back("acct" + std::to_string(i));
+    }
+
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        if (!ledger.enableBalanceEngine())
+        {
+            return 1;
+        }
+
+        // Fund every account with every coin and some USD, then move coins around at random
+        for (const auto& account : accounts)
+        {
+            std::vector<SQLData::Posting> postings;
+            for (const char* coinName : coins)
+            {
+                postings.push_back({ account, coinName, SQLData::DataBaseState::DBS_COINS, 100 * FixedPoint::SCALE });
+                postings.push_back({ Ledger::externalAccount, coinName, SQLData::DataBaseState::DBS_COINS, -100 * FixedPoint::SCALE });
+            }
+            postings.push_back({ account, "USD", SQLData::DataBaseState::DBS_BALANCE, 5000 * FixedPoint::SCALE });
+            postings.push_back({ Ledger::externalAccount, "USD", SQLData::DataBaseState::DBS_BALANCE, -5000 * FixedPoint::SCALE });
+            ledger.applyTransaction(TransactionKind::TK_Deposit, postings);
+        }
+
+        std::mt19937 random(11);
+        std::uniform_int_distribution<int> pick(0, accountCount - 1);
+        std::uniform_int_distribution<int> cents(1, 100000);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < transferCount; ++i)
+        {
+            ledger.transfer(accounts[pick(random)], accounts[pick(random)], coins[i % 3], cents(random) * (FixedPoint::SCALE / 100000));
+        }
+        ledger.flush();
+        std::cout << "History: " << transferCount << " transfers between " << accountCount << " accounts written in "
+            << std::fixed << std::setprecision(0) << elapsedMillis(start) << " ms\n";
+    }
+
+    Digest firstHash = {};
+    bool identical = true;
+    for (unsigned threads : { 1u, 2u, 4u })
+    {
+        JournalReplay replay(threads);
+        ReplayReport report;
+        if (!replay.run(sqlData, report))
+        {
+            return 1;
+        }
+        JournalReplay::print(report);
+        if (threads == 1)
+        {
+            firstHash = report.stateHash;
+        }
+        identical = identical && report.verified && report.stateHash == firstHash;
+    }
+    std::cout << (identical ? "State hash identical for every thread count and equal to the live tables\n"
+        : "[ERROR] Replay state differs\n");
+    return identical ? 0 : 1;
+}
+
+// Integrity chain: SHA-256 implementations, write path overhead, proofs, full audit and tamper detection
+static int benchmarkIntegrity()
+{
+    // SHA-256 throughput, long messages and Merkle node sized ones
+    std::vector<uint8_t> data(64 << 20);
+    std::mt19937 random(3);
+    for (auto& byte : data)
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+    Digest digests[2];
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        bool hardware = pass == 0 && Sha256::hardwareSupported();
+        if (pass == 0 && !hardware)
+        {
+            continue;
+        }
+        Sha256::setHardwareEnabled(hardware);
+
+        auto start = std::chrono::steady_clock::now();
+        digests[pass] = Sha256::hash(data.data(), data.size());
+        double bulkMillis = elapsedMillis(start);
+
+        const int nodeCount = 1000000;
+        Digest node = {};
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nodeCount; ++i)
+        {
+            node = MerkleTree::nodeHash(node, digests[pass]);
+        }
+        double nodeMillis = elapsedMillis(start);
+
+        std::cout << std::left << std::setw(9) << Sha256::implementationName() << std::right << std::fixed << std::setprecision(0)
+            << (data.size() / 1048576.0) / (bulkMillis / 1000.0) << " MB/s, "
+            << nodeCount / (nodeMillis / 1000.0) << " Merkle nodes/s\n";
+    }
+    Sha256::setHardwareEnabled(true);
+    if (Sha256::hardwareSupported() && digests[0] != digests[1])
+    {
+        std::cerr << "[ERROR] SHA-NI and portable digests differ\n";
+        return 1;
+    }
+
+    LatencyVFS& vfs = LatencyVFS::instance();
+    vfs.setSyncLatency(LatencyProfile(0.0, 0.0));
+
+    const int accountCount = 10000;
+    const int transferCount = 100000;
+    std::vector<std::string> accounts;
+    for (int i = 0; i < accountCount; ++i)
+    {
+        accounts.push_back("acct" + std::to_string(i));
+    }
+
+    // Same workload with and without the chain; the persister is the part that pays for it
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        bool chained = pass == 1;
+        SQLData target;
+        if (!target.openInLatencyVFS(chained ? "bench-integrity.db" : "bench-integrity-plain.db"))
+        {
+            return 1;
+        }
+
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, target, seedList, coin);
+        if (!ledger.enableBalanceEngine(chained))
+        {
+            return 1;
+        }
+        for (const auto& account : accounts)
+        {
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { account, "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1000 * FixedPoint::SCALE },
+                });
+        }
+        ledger.flush();
+
+        std::mt19937 pickRandom(9);
+        std::uniform_int_distribution<int> pick(0, accountCount - 1);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < transferCount; ++i)
+        {
+            ledger.transfer(accounts[pick(pickRandom)], accounts[pick(pickRandom)], "Bitcoin", FixedPoint::SCALE / 1000);
+        }
+        ledger.flush();
+        double millis = elapsedMillis(start);
+        PersisterStats stats = ledger.persisterStats();
+        std::cout << (chained ? "chained   " : "unchained ") << std::setprecision(0) << transferCount / (millis / 1000.0)
+            << " tx/s persisted (" << stats.batches << " batches)\n";
+
+        if (!chained)
+        {
+            continue;
+        }
+
+        // Proofs of single balances against the newest link
+        std::vector<double> proveMicros;
+        std::vector<double> verifyMicros;
+        size_t depth = 0;
+        auto proofStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10000; ++i)
+        {
+            MerkleProof proof;
+            SQLData::ChainLink link;
+            auto opStart = std::chrono::steady_clock::now();
+            if (!ledger.proveBalance(accounts[pick(pickRandom)], "Bitcoin", proof, link))
+            {
+                std::cerr << "[ERROR] No proof\n";
+                return 1;
+            }
+            proveMicros.push_back(elapsedMillis(opStart) * 1000.0);
+            opStart = std::chrono::steady_clock::now();
+            if (!LedgerAudit::verifyProof(target, proof, link.seq))
+            {
+                std::cerr << "[ERROR] Proof does not verify\n";
+                return 1;
+            }
+            verifyMicros.push_back(elapsedMillis(opStart) * 1000.0);
+            depth = proof.siblings.size();
+        }
+        double proofMillis = elapsedMillis(proofStart);
+        std::cout << "Proofs have " << depth << " hashes\n";
+        printLatencies("prove (flush + path)", proveMicros, proofMillis);
+        printLatencies("verify (path + link)", verifyMicros, proofMillis);
+
+        AuditReport report;
+        if (!LedgerAudit::verifyChain(target, report))
+        {
+            return 1;
+        }
+        LedgerAudit::print(report);
+        if (!report.chainValid || !report.tablesMatch)
+        {
+            return 1;
+        }
+
+        // Tampering: a balance row edited directly, then a posting of an old batch
+        ledger.flush();
+        target.execute("UPDATE COINS SET amount = amount + 1 WHERE user_id = 'acct7' AND coin_name = 'Bitcoin';");
+        LedgerAudit::verifyChain(target, report);
+        std::cout << "After editing a COINS row:   tables " << (report.tablesMatch ? "MATCH" : "DO NOT MATCH") << "\n";
+        target.execute("UPDATE POSTINGS SET amount = amount + 1 WHERE id = 20000;");
+        LedgerAudit::verifyChain(target, report);
+        std::cout << "After editing a posting:     chain " << (report.chainValid ? "VALID" : "BROKEN")
+            << " at link " << report.firstBadSeq << "\n";
+        if (report.chainValid)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Portfolio valuation of 1M accounts: scalar vs AVX2 kernel, then more threads
+static int benchmarkValuation()
+{
+    const int accountCount = 1000000;
+    const int assetCount = 1000;
+    std::mt19937 random(13);
+    std::uniform_int_distribution<int> holdingsPerAccount(1, 8);
+    std::uniform_int_distribution<int> pickAsset(0, assetCount - 1);
+    std::uniform_real_distribution<double> units(0.001, 100.0);
+
+    PortfolioValuation valuation;
+    std::vector<uint32_t> assets;
+    for (int i = 0; i < assetCount; ++i)
+    {
+        assets.push_back(valuation.assetId("asset" + std::to_string(i)));
+        valuation.setPrice(assets.back(), units(random) * 100.0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < accountCount; ++i)
+    {
+        valuation.beginAccount("acct" + std::to_string(i));
+        for (int holding = holdingsPerAccount(random); holding > 0; --holding)
+        {
+            valuation.addHolding(assets[pickAsset(random)], units(random));
+        }
+    }
+    std::cout << valuation.accountCount() << " accounts, " << valuation.holdingCount() << " holdings, "
+        << assetCount << " assets built in " << std::fixed << std::setprecision(0) << elapsedMillis(start) << " ms\n";
+
+    std::vector<double> reference;
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            if (simd == 0 && threads > 1)
+            {
+                break; // The scalar kernel is the single-thread baseline
+            }
+
+            valuation.setSimdEnabled(simd == 1);
+            valuation.setThreadCount(threads);
+
+            const int repeats = 10;
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeats; ++i)
+            {
+                valuation.valueAll();
+            }
+            double millis = elapsedMillis(start) / repeats;
+            std::cout << std::left << std::setw(7) << valuation.kernelName() << std::right << threads << " threads  "
+                << std::setprecision(2) << millis << " ms per pass  " << std::setprecision(0)
+                << accountCount / (millis / 1000.0) << " accounts/s  " << std::setprecision(2)
+                << millis * 1e6 / valuation.holdingCount() << " ns/holding\n";
+
+            if (reference.empty())
+            {
+                reference = valuation.accountValues();
+            }
+            else if (reference != valuation.accountValues())
+            {
+                std::cerr << "[ERROR] Kernels disagree\n";
+                return 1;
+            }
+        }
+    }
+
+    // Price ticks: one asset moves, every account is revalued
+    const int tickCount = 50;
+    std::uniform_real_distribution<double> move(0.99, 1.01);
+    start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < tickCount; ++tick)
+    {
+        valuation.setPrice(assets[pickAsset(random)], units(random) * 100.0 * move(random));
+        valuation.valueAll();
+    }
+    std::cout << "Price ticks: " << std::setprecision(1) << tickCount / (elapsedMillis(start) / 1000.0)
+        << " full revaluations/s\n";
+    return 0;
+}
+
+// Reads per second while one writer publishes as fast as it can; every publish sets price[i] = tag + i,
+// so a read that mixes two publishes is caught
+template <typename Read>
+static bool measureReads(const std::string& label, unsigned readerCount, const std::function<void(double)>& publish, Read read)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> reads(0);
+    std::atomic<uint64_t> torn(0);
+    uint64_t publishes = 0;
+
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < readerCount; ++r)
+    {
+        readers.emplace_back([&]()
+            {
+                std::vector<double> copy;
+                uint64_t count = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    read(copy);
+                    for (size_t i = 1; i < copy.size(); ++i)
+                    {
+                        if (copy[i] - copy[0] != static_cast<double>(i))
+                        {
+                            torn.fetch_add(1);
+                            break;
+                        }
+                    }
+                    ++count;
+                }
+                reads.fetch_add(count);
+            });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (elapsedMillis(start) < 1000.0)
+    {
+        publish(static_cast<double>(++publishes) * 1000.0);
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    double seconds = elapsedMillis(start) / 1000.0;
+
+    std::cout << std::left << std::setw(14) << label << std::right << readerCount << " readers  " << std::fixed
+        << std::setprecision(0) << reads.load() / seconds << " reads/s  " << publishes / seconds << " publishes/s  "
+        << torn.load() << " torn\n";
+    return torn.load() == 0;
+}
+
+static int benchmarkPriceFeed()
+{
+    const int coinCount = 64;
+    std::list<Coin> coins;
+    std::vector<std::pair<std::string, double>> batch;
+    for (int i = 0; i < coinCount; ++i)
+    {
+        coins.push_back(Coin("coin" + std::to_string(i), static_cast<float>(i)));
+        batch.emplace_back("coin" + std::to_string(i), 0.0);
+    }
+
+    MarketData market;
+    market.publishPrices(coins);
+
+    // Baseline: the price vector behind a mutex, readers copy it under the lock
+    std::mutex lockedMutex;
+    std::vector<double> lockedPrices(coinCount);
+
+    unsigned maxReaders = std::max(4u, std::thread::hardware_concurrency());
+    bool ok = true;
+    for (unsigned readers = 1; readers <= maxReaders; readers *= 2)
+    {
+        ok &= measureReads("seqlock", readers,
+            [&](double tag)
+            {
+                for (int i = 0; i < coinCount; ++i)
+                {
+                    batch[i].second = tag + i;
+                }
+                market.updatePrices(batch);
+            },
+            [&](std::vector<double>& copy)
+            {
+                static thread_local PriceSnapshot snapshot;
+                market.readPrices(snapshot);
+                copy.assign(snapshot.prices.begin(), snapshot.prices.end());
+            });
+
+        ok &= measureReads("mutex", readers,
+            [&](double tag)
+            {
+                std::lock_guard<std::mutex> lock(lockedMutex);
+                for (int i = 0; i < coinCount; ++i)
+                {
+                    lockedPrices[i] = tag + i;
+                }
+            },
+            [&](std::vector<double>& copy)
+            {
+                std::lock_guard<std::mutex> lock(lockedMutex);
+                copy = lockedPrices;
+            });
+    }
+
+    // File mode: lines appended to the file reach the snapshot
+    const char* path = "bench_prices.feed";
+    std::remove(path);
+    PriceFeed feed(market);
+    feed.startFile(path, 5);
+
+    uint64_t before = market.priceVersion();
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::ofstream file(path);
+        file << "# coin price\ncoin1 1234.5\ncoin2 99\nunknown 1\nbroken line\n";
+    }
+    while (market.priceVersion() == before && elapsedMillis(start) < 2000.0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double latency = elapsedMillis(start);
+    feed.stop();
+    std::remove(path);
+
+    double price = 0.0;
+    PriceFeedStats stats = feed.stats();
+    bool fileOk = market.coinPrice("coin1", price) && price == 1234.5 && stats.rejected == 2;
+    std::cout << "File feed: " << stats.updates << " updates, " << stats.publishes << " publishes, " << stats.rejected
+        << " rejected, visible after " << std::setprecision(1) << latency << " ms  " << (fileOk ? "OK" : "FAILED") << "\n";
+
+    return ok && fileOk ? 0 : 1;
+}
+
+static int benchmarkHistory()
+{
+    const int coinCount = 4;
+    const int ticksPerCoin = 500000;
+    const int64_t spacing = 100; // 10 ticks per second per coin, ~14 hours of history
+    const int64_t begin = 1700000000000LL;
+    const std::string directory = "bench_history";
+    std::filesystem::remove_all(directory);
+
+    std::vector<Candle> firstRun;
+    std::mt19937 random(5);
+    std::normal_distribution<double> step(0.0, 0.0005);
+    {
+        PriceHistory history;
+        if (!history.open(directory))
+        {
+            return 1;
+        }
+
+        std::vector<double> prices(coinCount, 100.0);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ticksPerCoin; ++i)
+        {
+            for (int coin = 0; coin < coinCount; ++coin)
+            {
+                prices[coin] *= std::exp(step(random));
+                history.addTick("coin" + std::to_string(coin), begin + i * spacing, prices[coin]);
+            }
+        }
+        double millis = elapsedMillis(start);
+        std::cout << coinCount * ticksPerCoin << " ticks ingested in " << std::fixed << std::setprecision(0) << millis
+            << " ms (" << coinCount * ticksPerCoin / (millis / 1000.0) << " ticks/s)\n";
+
+        // Range queries: the last hour in every tier, and the raw ticks of the last minute
+        int64_t end = begin + (ticksPerCoin - 1) * spacing;
+        const int queries = 2000;
+        std::vector<Candle> candles;
+        for (size_t level = 0; level < PriceHistory::tierCount; ++level)
+        {
+            HistoryTier tier = static_cast<HistoryTier>(level);
+            size_t returned = 0;
+            start = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; ++q)
+            {
+                returned = history.candles("coin1", tier, end - 60 * 60 * 1000, end, candles);
+            }
+            std::cout << "Last hour, " << PriceHistory::tierName(tier) << ": " << returned << " candles, "
+                << std::setprecision(2) << elapsedMillis(start) * 1000.0 / queries << " us/query\n";
+        }
+
+        std::vector<PriceTick> ticks;
+        start = std::chrono::steady_clock::now();
+        size_t returned = 0;
+        for (int q = 0; q < queries; ++q)
+        {
+            returned = history.ticks("coin1", end - 60 * 1000, end, ticks);
+        }
+        std::cout << "Last minute, raw: " << returned << " ticks, " << elapsedMillis(start) * 1000.0 / queries << " us/query\n";
+
+        history.candles("coin1", HistoryTier::HT_Minute, begin, end, firstRun);
+    }
+
+    uintmax_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        bytes += entry.file_size();
+    }
+    std::cout << "Persisted: " << bytes / 1024 << " KB for " << coinCount << " coins\n";
+
+    // Reopen: the candles come back from the files
+    PriceHistory reopened;
+    auto start = std::chrono::steady_clock::now();
+    reopened.open(directory);
+    double millis = elapsedMillis(start);
+    std::vector<Candle> secondRun;
+    reopened.candles("coin1", HistoryTier::HT_Minute, begin, begin + ticksPerCoin * spacing, secondRun);
+
+    bool same = firstRun.size() == secondRun.size();
+    for (size_t i = 0; same && i < firstRun.size(); ++i)
+    {
+        same = firstRun[i].start == secondRun[i].start && firstRun[i].close == secondRun[i].close
+            && firstRun[i].high == secondRun[i].high && firstRun[i].ticks == secondRun[i].ticks;
+    }
+    std::cout << "Reloaded in " << std::setprecision(1) << millis << " ms, " << secondRun.size() << " minute candles "
+        << (same ? "match" : "DIFFER") << "\n";
+
+    std::filesystem::remove_all(directory);
+    return same ? 0 : 1;
+}
+
+// Runs one headless ImGui frame with the given body inside an 800x300 window; returns the vertices emitted
+static int chartFrame(const std::function<void()>& body)
+{
+    ImGui::GetIO().DeltaTime = 1.0f / 60.0f;
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::SetNextWindowSize(ImVec2(820.0f, 320.0f));
+    ImGui::Begin("Chart");
+    body();
+    ImGui::End();
+    ImGui::Render();
+    return ImGui::GetDrawData()->TotalVtxCount;
+}
+
+static int benchmarkChart()
+{
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1280.0f, 720.0f);
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height); // No renderer: the font atlas is built once up front
+
+    const int frames = 200;
+    bool ok = true;
+    for (int tickCount : { 10000, 100000, 1000000 })
+    {
+        // tickCount ticks over the last hour, all kept raw
+        PriceHistory history(static_cast<size_t>(tickCount) + 1024);
+        std::mt19937 random(3);
+        std::normal_distribution<double> step(0.0, 0.001);
+        int64_t end = PriceHistory::nowMillis();
+        int64_t hour = 60 * 60 * 1000LL;
+        double price = 100.0;
+        for (int i = 0; i < tickCount; ++i)
+        {
+            price *= std::exp(step(random));
+            history.addTick("coin", end - hour + hour * i / tickCount, price);
+        }
+        std::vector<float> naive;
+        std::vector<PriceTick> ticks;
+
+        // Lines and candles folding every raw tick (the worst case for a rebuild), then lines at the default detail
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            PriceChart chart;
+            chart.setStyle(mode == 1 ? ChartStyle::CS_Candles : ChartStyle::CS_Line);
+            if (mode < 2)
+            {
+                chart.setDetail(1 << 20);
+            }
+            auto draw = [&]() { chart.draw("##chart", history, "coin", ImVec2(800.0f, 260.0f)); };
+
+            // Cached: nothing changes between frames
+            chartFrame(draw);
+            uint64_t rebuildsBefore = chart.rebuilds();
+            int vertices = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                vertices = chartFrame(draw);
+            }
+            double cachedMicros = elapsedMillis(start) * 1000.0 / frames;
+            uint64_t cachedRebuilds = chart.rebuilds() - rebuildsBefore;
+
+            // A new tick every frame: every frame rebuilds the buckets
+            start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames / 10; ++frame)
+            {
+                price *= std::exp(step(random));
+                history.addTick("coin", PriceHistory::nowMillis(), price);
+                chartFrame(draw);
+            }
+            double rebuildMicros = elapsedMillis(start) * 1000.0 / (frames / 10);
+
+            std::cout << std::setw(8) << tickCount << " ticks  " << (mode == 0 ? "line   " : mode == 1 ? "candles" : "line/8 ") << "  " << std::fixed
+                << std::setprecision(1) << cachedMicros << " us/frame cached (" << cachedRebuilds << " rebuilds)  "
+                << rebuildMicros << " us/frame rebuilding  " << vertices << " vertices, " << chart.bucketCount() << " buckets from "
+                << chart.sourceCount() << " " << chart.source() << "\n";
+            ok &= cachedRebuilds == 0;
+        }
+
+        // Naive baseline: every tick handed to PlotLines every frame
+        auto start = std::chrono::steady_clock::now();
+        int vertices = 0;
+        for (int frame = 0; frame < frames / 10; ++frame)
+        {
+            vertices = chartFrame([&]()
+                {
+                    history.ticks("coin", end - hour, INT64_MAX, ticks);
+                    naive.clear();
+                    for (const auto& tick : ticks)
+                    {
+                        naive.push_back(static_cast<float>(tick.price));
+                    }
+                    ImGui::PlotLines("##naive", naive.data(), static_cast<int>(naive.size()), 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(800.0f, 260.0f));
+                });
+        }
+        std::cout << std::setw(8) << tickCount << " ticks  PlotLines " << elapsedMillis(start) * 1000.0 / (frames / 10)
+            << " us/frame  " << vertices << " vertices\n";
+    }
+
+    ImGui::DestroyContext();
+    return ok ? 0 : 1;
+}
+
+static int benchmarkFx()
+{
+    const std::vector<std::pair<std::string, double>> usdRates =
+    {
+        { "USD", 1.0 }, { "EUR", 1.08 }, { "GBP", 1.27 }, { "JPY", 0.0067 }, { "UAH", 0.024 },
+        { "CAD", 0.73 }, { "AUD", 0.66 }, { "CHF", 1.13 }, { "CNY", 0.14 }, { "INR", 0.012 },
+    };
+    FxRates fx;
+    fx.setUsdRates(usdRates);
+    std::shared_ptr<const FxTable> published = fx.table();
+    const FxTable& rates = *published;
+    CurrencyId eur = rates.find("EUR");
+
+    const size_t balanceCount = 10000000;
+    std::mt19937 random(17);
+    std::uniform_int_distribution<int> pickCurrency(0, static_cast<int>(usdRates.size()) - 1);
+    std::uniform_real_distribution<double> pickAmount(0.0, 10000.0);
+    std::vector<CurrencyId> currencies(balanceCount);
+    std::vector<double> amounts(balanceCount);
+    for (size_t i = 0; i < balanceCount; ++i)
+    {
+        currencies[i] = pickCurrency(random);
+        amounts[i] = pickAmount(random);
+    }
+
+    // Batched kernels into EUR
+    std::vector<double> scalarOut(balanceCount);
+    std::vector<double> simdOut(balanceCount);
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        std::vector<double>& out = simd ? simdOut : scalarOut;
+        const int repeats = 5;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i)
+        {
+            FxRates::convertBatch(rates, currencies.data(), amounts.data(), balanceCount, eur, out.data(), simd == 1);
+        }
+        double millis = elapsedMillis(start) / repeats;
+        std::cout << std::left << std::setw(8) << gatherMultiplyKernel(simd == 1) << std::right << " batch: " << std::fixed
+            << std::setprecision(1) << millis << " ms per 10M  " << std::setprecision(0) << balanceCount / (millis / 1000.0) << " balances/s\n";
+    }
+    bool ok = scalarOut == simdOut;
+
+    auto start = std::chrono::steady_clock::now();
+    double total = FxRates::total(rates, currencies.data(), amounts.data(), balanceCount, eur);
+    std::cout << "Total: " << std::setprecision(0) << total << " EUR in " << std::setprecision(1) << elapsedMillis(start) << " ms\n";
+
+    // Per-balance conversion by name (every call looks both currencies up)
+    const size_t namedCount = 1000000;
+    double namedSum = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < namedCount; ++i)
+    {
+        double converted = 0.0;
+        fx.convert(amounts[i], rates.names[currencies[i]], "EUR", converted);
+        namedSum += converted;
+    }
+    double millis = elapsedMillis(start);
+    std::cout << "By name: " << std::setprecision(0) << namedCount / (millis / 1000.0) << " balances/s\n";
+
+    // Baseline: rates in a map behind a mutex, as MarketData kept them before
+    std::mutex mapMutex;
+    std::map<std::string, double> mapRates(usdRates.begin(), usdRates.end());
+    double mapSum = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < namedCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(mapMutex);
+        mapSum += amounts[i] * mapRates[rates.names[currencies[i]]] / mapRates["EUR"];
+    }
+    millis = elapsedMillis(start);
+    std::cout << "Map + mutex: " << namedCount / (millis / 1000.0) << " balances/s\n";
+    ok &= std::fabs(namedSum - mapSum) < 1e-6 * std::fabs(mapSum);
+
+    // Cost of a rate update (copy of the table, cross rates, pointer swap)
+    const int publishes = 2000;
+    std::uniform_real_distribution<double> move(0.99, 1.01);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < publishes; ++i)
+    {
+        fx.setUsdRate("EUR", 1.08 * move(random));
+    }
+    std::cout << "Publish: " << std::setprecision(2) << elapsedMillis(start) * 1000.0 / publishes << " us per rate update\n";
+
+    // Rate updates while a reader converts: every table the reader sees is internally consistent
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> inconsistent(0);
+    std::atomic<uint64_t> versionsSeen(0);
+    std::thread reader([&]()
+        {
+            uint64_t lastVersion = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                std::shared_ptr<const FxTable> held = fx.table();
+                const FxTable& table = *held;
+                if (table.version != lastVersion)
+                {
+                    lastVersion = table.version;
+                    versionsSeen.fetch_add(1);
+                }
+                for (CurrencyId from = 0; from < static_cast<CurrencyId>(table.size()); ++from)
+                {
+                    if (std::fabs(table.rate(from, eur) * table.rate(eur, from) - 1.0) > 1e-12)
+                    {
+                        inconsistent.fetch_add(1);
+                    }
+                }
+            }
+        });
+
+    for (int i = 0; i < publishes; ++i)
+    {
+        fx.setUsdRate("EUR", 1.08 * move(random));
+        std::this_thread::yield(); // Lets the reader run between publishes on machines with few cores
+    }
+    stop = true;
+    reader.join();
+    std::cout << "Concurrent reader saw " << versionsSeen.load() << " versions, " << inconsistent.load() << " inconsistent\n";
+    ok &= inconsistent.load() == 0;
+
+    // A replaced table lives as long as a reader holds it, then it is freed
+    std::weak_ptr<const FxTable> retired = fx.table();
+    std::shared_ptr<const FxTable> holder = retired.lock();
+    fx.setUsdRate("EUR", 1.08);
+    bool keptWhileHeld = !retired.expired();
+    holder.reset();
+    std::cout << "Retired table " << (keptWhileHeld ? "kept while held" : "FREED WHILE HELD") << ", "
+        << (retired.expired() ? "freed after release" : "NEVER FREED") << "\n";
+    ok &= keptWhileHeld && retired.expired();
+
+    std::cout << (ok ? "Kernels agree" : "[ERROR] Mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Idempotent commands: window memory and lookup cost at 10M outstanding IDs, expiry, retries through the ledger
+// and the IDs surviving a restart
+static int benchmarkDedup()
+{
+    const size_t idCount = 10000000;
+    const int64_t start = 1700000000000LL;
+    const int64_t hour = 60 * 60 * 1000LL;
+    std::mt19937_64 random(23);
+    std::vector<CommandId> ids(idCount);
+    for (auto& id : ids)
+    {
+        id = random() | 1; // Never 0
+    }
+
+    // 10M commands over one hour (all still inside the 24h TTL)
+    CommandWindow window;
+    auto timer = std::chrono::steady_clock::now();
+    size_t applied = 0;
+    for (size_t i = 0; i < idCount; ++i)
+    {
+        applied += window.run(ids[i], start + static_cast<int64_t>(i * hour / idCount), []() { return true; }) == CommandStatus::CS_Applied;
+    }
+    double millis = elapsedMillis(timer);
+    size_t bytes = window.memoryBytes();
+    std::cout << "Recorded " << window.size() << " IDs in " << std::fixed << std::setprecision(0) << millis << " ms ("
+        << idCount / (millis / 1000.0) << " inserts/s)\n";
+    std::cout << "Memory: " << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MiB, " << static_cast<double>(bytes) / idCount
+        << " bytes per ID (table + wheel)\n";
+
+    // Lookups in random order: retries (hits) and new commands (misses)
+    const size_t lookups = 2000000;
+    std::vector<CommandId> probes(lookups);
+    std::uniform_int_distribution<size_t> pick(0, idCount - 1);
+    for (auto& probe : probes)
+    {
+        probe = ids[pick(random)];
+    }
+    int64_t now = start + hour;
+    size_t found = 0;
+    timer = std::chrono::steady_clock::now();
+    for (CommandId probe : probes)
+    {
+        found += window.contains(probe, now);
+    }
+    double hitNanos = elapsedMillis(timer) * 1e6 / lookups;
+    for (auto& probe : probes)
+    {
+        probe = random() & ~1ULL; // Even: never one of the recorded IDs
+    }
+    size_t falseHits = 0;
+    timer = std::chrono::steady_clock::now();
+    for (CommandId probe : probes)
+    {
+        falseHits += window.contains(probe, now);
+    }
+    double missNanos = elapsedMillis(timer) * 1e6 / lookups;
+    std::cout << "Lookup: hit " << std::setprecision(0) << hitNanos << " ns, miss " << missNanos << " ns (" << found << "/" << lookups
+        << " hits, " << falseHits << " false)\n";
+    bool ok = applied == idCount && found == lookups && falseHits == 0;
+
+    // A retry through run() is the same lookup and never calls apply
+    size_t duplicates = 0;
+    timer = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+    {
+        duplicates += window.run(ids[i], now, []() { return true; }) == CommandStatus::CS_Duplicate;
+    }
+    std::cout << "Retry: " << std::setprecision(0) << elapsedMillis(timer) * 1e6 / lookups << " ns, " << duplicates << "/" << lookups << " duplicates\n";
+    ok &= duplicates == lookups;
+
+    // Everything expires once the clock passes the TTL: one sweep per shard when it is next touched
+    timer = std::chrono::steady_clock::now();
+    now = start + 26 * hour;
+    size_t stillKnown = 0;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        stillKnown += window.contains(ids[i], now);
+    }
+    std::cout << "Expiry after 26h: " << window.size() << " IDs left, " << stillKnown << " still known, "
+        << std::setprecision(0) << elapsedMillis(timer) << " ms (" << std::setprecision(1) << window.memoryBytes() / (1024.0 * 1024.0) << " MiB)\n";
+    ok &= window.size() == 0 && stillKnown == 0;
+
+    // Through the ledger: retries are lookups that change nothing, also after a restart
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-dedup.db"))
+    {
+        return 1;
+    }
+    const int accountCount = 1000;
+    const int transferCount = 100000;
+    std::vector<std::string> accounts;
+    for (int i = 0; i < accountCount; ++i)
+    {
+        accounts.push_back("acct" + std::to_string(i));
+    }
+    std::vector<CommandId> transferIds(transferCount);
+    for (auto& id : transferIds)
+    {
+        id = CommandWindow::newId();
+    }
+    auto sendOf = [&](int i) { return accounts[i % accountCount]; };
+    auto receiveOf = [&](int i) { return accounts[(i * 7 + 1) % accountCount]; };
+
+    Amount before = 0;
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        if (!ledger.enableBalanceEngine(false))
+        {
+            return 1;
+        }
+        for (const auto& account : accounts)
+        {
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { account, "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000 * FixedPoint::SCALE },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1000 * FixedPoint::SCALE },
+                });
+        }
+
+        timer = std::chrono::steady_clock::now();
+        for (int i = 0; i < transferCount; ++i)
+        {
+            ledger.transfer(sendOf(i), receiveOf(i), "Bitcoin", FixedPoint::SCALE, transferIds[i]);
+        }
+        double applyMillis = elapsedMillis(timer);
+        before = ledger.getBalance(accounts[1], "Bitcoin", SQLData::DataBaseState::DBS_COINS);
+
+        timer = std::chrono::steady_clock::now();
+        size_t retried = 0;
+        for (int i = 0; i < transferCount; ++i)
+        {
+            retried += ledger.transfer(sendOf(i), receiveOf(i), "Bitcoin", FixedPoint::SCALE, transferIds[i]);
+        }
+        double retryMillis = elapsedMillis(timer);
+        ledger.flush();
+        std::cout << "Ledger: transfer " << std::setprecision(2) << applyMillis * 1000.0 / transferCount << " us, retry "
+            << retryMillis * 1000.0 / transferCount << " us (" << retried << " reported as done, "
+            << ledger.persisterStats().persisted << " transactions persisted)\n";
+        ok &= retried == static_cast<size_t>(transferCount) && ledger.persisterStats().persisted == static_cast<uint64_t>(accountCount + transferCount);
+        ok &= ledger.getBalance(accounts[1], "Bitcoin", SQLData::DataBaseState::DBS_COINS) == before;
+    }
+
+    // A new ledger on the same database reloads the IDs
+    {
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        timer = std::chrono::steady_clock::now();
+        Ledger ledger(user, sqlData, seedList, coin);
+        double loadMillis = elapsedMillis(timer);
+        if (!ledger.enableBalanceEngine(false))
+        {
+            return 1;
+        }
+        size_t duplicateAfterRestart = 0;
+        for (int i = 0; i < transferCount; ++i)
+        {
+            duplicateAfterRestart += ledger.applyCommand(transferIds[i], TransactionKind::TK_Send,
+                {
+                    { sendOf(i), "Bitcoin", SQLData::DataBaseState::DBS_COINS, -FixedPoint::SCALE },
+                    { receiveOf(i), "Bitcoin", SQLData::DataBaseState::DBS_COINS, FixedPoint::SCALE },
+                }) == CommandStatus::CS_Duplicate;
+        }
+        std::cout << "Restart: " << ledger.commandWindow().size() << " IDs reloaded in " << std::setprecision(0) << loadMillis << " ms, "
+            << duplicateAfterRestart << "/" << transferCount << " retries detected\n";
+        ok &= duplicateAfterRestart == static_cast<size_t>(transferCount) &&
+            ledger.getBalance(accounts[1], "Bitcoin", SQLData::DataBaseState::DBS_COINS) == before;
+    }
+
+    std::cout << (ok ? "No command applied twice" : "[ERROR] Deduplication failed") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Timer wheel with millions of timers (insert, cancel, firing on time), then scheduled transfers through the ledger:
+// batched runs, reload after a restart and no repeated run after a crash between the ledger and the schedules
+static int benchmarkScheduler()
+{
+    const size_t timerCount = 4000000;
+    const int64_t start = 1700000000000LL;
+    const int64_t day = 24 * 60 * 60 * 1000LL;
+    std::mt19937_64 random(29);
+    std::uniform_int_distribution<int64_t> pickDue(start, start + 30 * day);
+    std::vector<int64_t> dues(timerCount);
+    for (auto& due : dues)
+    {
+        due = pickDue(random);
+    }
+
+    TimerWheel wheel(1000, start);
+    std::vector<uint32_t> handles(timerCount);
+    auto timer = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < timerCount; ++i)
+    {
+        handles[i] = wheel.add(dues[i], i);
+    }
+    double addNanos = elapsedMillis(timer) * 1e6 / timerCount;
+
+    std::vector<bool> canceled(timerCount, false);
+    size_t cancelCount = 0;
+    timer = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < timerCount; i += 10)
+    {
+        canceled[i] = wheel.cancel(handles[i]);
+        cancelCount += canceled[i];
+    }
+    double cancelNanos = elapsedMillis(timer) * 1e6 / cancelCount;
+    std::cout << "Wheel: " << timerCount << " timers over 30 days, add " << std::fixed << std::setprecision(0) << addNanos << " ns, cancel "
+        << cancelNanos << " ns, " << std::setprecision(1) << static_cast<double>(wheel.memoryBytes()) / timerCount << " bytes per timer\n";
+
+    // Every timer fires once, never early and at most one tick after its due time
+    std::vector<uint64_t> due;
+    size_t fired = 0;
+    size_t early = 0;
+    size_t late = 0;
+    timer = std::chrono::steady_clock::now();
+    for (int64_t now = start; now <= start + 31 * day; now += 1000)
+    {
+        due.clear();
+        wheel.advance(now, due);
+        for (uint64_t index : due)
+        {
+            early += dues[index] > now || canceled[index];
+            late += now - dues[index] >= 1000;
+        }
+        fired += due.size();
+    }
+    std::cout << "Advance 31 days in 1s ticks: " << std::setprecision(0) << elapsedMillis(timer) << " ms, " << fired << " fired, "
+        << early << " early or canceled, " << late << " late\n";
+    bool ok = fired == timerCount - cancelCount && early == 0 && late == 0 && wheel.size() == 0;
+
+    // Scheduled payouts through the ledger
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-scheduler.db"))
+    {
+        return 1;
+    }
+    const int accountCount = 1000;
+    const int scheduleCount = 200000;
+    const int64_t hour = 60 * 60 * 1000LL;
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+    if (!ledger.enableBalanceEngine(false))
+    {
+        return 1;
+    }
+    ledger.applyTransaction(TransactionKind::TK_Deposit,
+        {
+            { "treasury", "USD", SQLData::DataBaseState::DBS_BALANCE, 10000000 * FixedPoint::SCALE },
+            { Ledger::externalAccount, "USD", SQLData::DataBaseState::DBS_BALANCE, -10000000 * FixedPoint::SCALE },
+        });
+
+    int64_t now = TransferScheduler::nowMillis() / 1000 * 1000; // On a tick, so the last poll catches runs due exactly then
+    std::vector<ScheduledTransfer> transfers(scheduleCount);
+    std::uniform_int_distribution<int64_t> pickStart(now, now + hour);
+    for (int i = 0; i < scheduleCount; ++i)
+    {
+        ScheduledTransfer& transfer = transfers[i];
+        transfer.kind = ScheduleKind::SK_Send;
+        transfer.userID = "treasury";
+        transfer.counterparty = "acct" + std::to_string(i % accountCount);
+        transfer.asset = "USD";
+        transfer.book = SQLData::DataBaseState::DBS_BALANCE;
+        transfer.amount = FixedPoint::SCALE;
+        transfer.firstDueMillis = pickStart(random);
+        transfer.intervalMillis = hour;
+        transfer.runs = 3;
+    }
+
+    std::vector<sqlite3_int64> ids;
+    {
+        TransferScheduler scheduler(ledger, sqlData);
+        scheduler.load();
+        timer = std::chrono::steady_clock::now();
+        scheduler.scheduleMany(transfers, &ids);
+        std::cout << "Scheduled " << scheduler.pending() << " recurring payouts in " << std::setprecision(0) << elapsedMillis(timer)
+            << " ms (" << std::setprecision(1) << static_cast<double>(scheduler.memoryBytes()) / scheduleCount << " bytes each in memory)\n";
+
+        // Two of the three runs, polled every minute
+        timer = std::chrono::steady_clock::now();
+        for (int64_t clock = now; clock <= now + 2 * hour; clock += 60 * 1000)
+        {
+            scheduler.runDue(clock);
+        }
+        SchedulerStats stats = scheduler.stats();
+        std::cout << "Ran " << stats.executed << " payouts in " << stats.batches << " batches (largest " << stats.maxBatch << ") in "
+            << std::setprecision(0) << elapsedMillis(timer) << " ms, " << stats.rejected << " rejected\n";
+        ok &= stats.executed == static_cast<uint64_t>(2 * scheduleCount) && scheduler.pending() == static_cast<size_t>(scheduleCount);
+    }
+
+    // Crash between the ledger and the schedules: one schedule's row still says it has done no run
+    sqlData.updateSchedule(ids[0], transfers[0].firstDueMillis, 3, 0);
+    Amount paid = ledger.getBalance("acct0", "USD", SQLData::DataBaseState::DBS_BALANCE);
+    {
+        TransferScheduler scheduler(ledger, sqlData);
+        timer = std::chrono::steady_clock::now();
+        scheduler.load();
+        double loadMillis = elapsedMillis(timer);
+        size_t reloaded = scheduler.pending();
+        for (int64_t clock = now + 2 * hour; clock <= now + 4 * hour; clock += 60 * 1000)
+        {
+            scheduler.runDue(clock);
+        }
+        SchedulerStats stats = scheduler.stats();
+        Amount expected = paid + static_cast<Amount>(scheduleCount / accountCount - 1) * FixedPoint::SCALE + 1 * FixedPoint::SCALE;
+        Amount after = ledger.getBalance("acct0", "USD", SQLData::DataBaseState::DBS_BALANCE);
+        std::cout << "Restart: " << reloaded << " schedules reloaded in " << std::setprecision(0) << loadMillis << " ms, " << stats.executed
+            << " final runs, " << stats.duplicates << " repeated runs skipped, " << scheduler.pending() << " left\n";
+        ok &= reloaded == static_cast<size_t>(scheduleCount) && stats.executed == static_cast<uint64_t>(scheduleCount) &&
+            stats.duplicates == 2 && scheduler.pending() == 0 && after == expected;
+    }
+
+    std::cout << (ok ? "Every run happened once, on time" : "[ERROR] Scheduler mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Airdrop to every account, stopped halfway, "crashed" and resumed; then interest to the holders and a credit list
+static int benchmarkBulkCredit()
+{
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-bulk.db"))
+    {
+        return 1;
+    }
+    const int accountCount = 1000000;
+    const Amount airdrop = 5 * FixedPoint::SCALE;
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+    if (!ledger.enableBalanceEngine(false))
+    {
+        return 1;
+    }
+    auto timer = std::chrono::steady_clock::now();
+    sqlData.execute("WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < " + std::to_string(accountCount) + ") "
+        "INSERT INTO DATA (user_id, password, seed) SELECT 'user' || i, 'password', 'seed' FROM n;");
+    std::cout << "Registered " << accountCount << " users in " << std::fixed << std::setprecision(0) << elapsedMillis(timer) << " ms\n";
+
+    BulkCreditJob job;
+    job.name = "airdrop-1";
+    job.targets = CreditTargets::BT_AllAccounts;
+    job.asset = "Solana";
+    job.book = SQLData::DataBaseState::DBS_COINS;
+    job.amount = airdrop;
+
+    // First run: stopped after half of the buckets; the progress of the wave before the last one is kept
+    BulkCreditProgress previous;
+    BulkCreditProgress last;
+    bool finished = false;
+    {
+        BulkCredit bulk(ledger, sqlData);
+        timer = std::chrono::steady_clock::now();
+        finished = bulk.run(job, [&](const BulkCreditProgress& progress)
+            {
+                previous = last;
+                last = progress;
+                if (progress.bucketsDone * 2 >= progress.buckets)
+                {
+                    bulk.requestStop();
+                }
+            });
+        std::cout << "Run 1: " << last.credited << " accounts in " << last.bucketsDone << "/" << last.buckets << " buckets, "
+            << std::setprecision(0) << last.elapsedMillis << " ms (" << last.credited / (last.elapsedMillis / 1000.0) << " accounts/s), stopped\n";
+    }
+    bool ok = !finished && last.bucketsDone * 2 >= last.buckets && last.bucketsDone < last.buckets;
+
+    // Crash before the job's totals were recorded, resumed long after the command IDs left the window: the last
+    // wave's bucket rows were committed with its credits, so the resume skips them without asking the window
+    SQLData::BulkCreditRow row;
+    sqlData.findBulkCredit(job.name, row);
+    sqlData.updateBulkCredit(row.id, static_cast<sqlite3_int64>(previous.credited), previous.total, false);
+    sqlData.execute("DELETE FROM COMMANDS;");
+
+    {
+        BulkCredit bulk(ledger, sqlData);
+        finished = bulk.run(job, [&](const BulkCreditProgress& progress) { last = progress; });
+        std::cout << "Run 2 (resumed): " << last.credited << " accounts in " << last.bucketsDone << "/" << last.buckets << " buckets, "
+            << std::setprecision(0) << last.elapsedMillis << " ms, " << last.duplicates << " buckets applied twice\n";
+    }
+    ok &= finished && last.finished && last.credited == static_cast<uint64_t>(accountCount) && last.duplicates == 0 &&
+        last.total == airdrop * accountCount;
+
+    // Every account exactly once: in memory and in the database
+    size_t wrong = 0;
+    for (int i = 0; i < accountCount; i += 997)
+    {
+        wrong += ledger.getBalance("user" + std::to_string(i), "Solana", SQLData::DataBaseState::DBS_COINS) != airdrop;
+    }
+    Amount paid = ledger.getBalance(Ledger::externalAccount, "Solana", SQLData::DataBaseState::DBS_COINS);
+    double dbTotal = 0.0;
+    double dbRows = 0.0;
+    {
+        sqlite3_stmt* stmt = sqlData.prepareCached("SELECT COUNT(*), SUM(amount) FROM COINS WHERE coin_name = 'Solana';");
+        if (stmt && sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            dbRows = sqlite3_column_double(stmt, 0);
+            dbTotal = sqlite3_column_double(stmt, 1);
+        }
+        sqlite3_reset(stmt); // Ends the read, so the writers of the next jobs are not blocked
+    }
+    std::cout << "Check: " << wrong << " sampled balances wrong, funding paid " << std::setprecision(0) << FixedPoint::toDouble(-paid)
+        << ", database rows " << dbRows << " holding " << dbTotal << "\n";
+    ok &= wrong == 0 && paid == -airdrop * accountCount && dbRows == accountCount && dbTotal == FixedPoint::toDouble(airdrop) * accountCount;
+
+    // Interest: 1.5% of every Solana holding, paid by the fees account
+    BulkCreditJob interest;
+    interest.name = "interest-1";
+    interest.targets = CreditTargets::BT_Holders;
+    interest.asset = "Solana";
+    interest.rate = FixedPoint::SCALE * 15 / 1000;
+    interest.funding = Ledger::feeAccount;
+    interest.filterAsset = "Solana";
+    {
+        BulkCredit bulk(ledger, sqlData);
+        finished = bulk.run(interest, [&](const BulkCreditProgress& progress) { last = progress; });
+        std::cout << "Interest to holders: " << last.credited << " accounts in " << std::setprecision(0) << last.elapsedMillis << " ms\n";
+    }
+    Amount expected = airdrop + airdrop * 15 / 1000;
+    ok &= finished && last.credited == static_cast<uint64_t>(accountCount) &&
+        ledger.getBalance("user12345", "Solana", SQLData::DataBaseState::DBS_COINS) == expected;
+
+    // Credit list: per-line amounts (rate 1.0), comments and a broken line
+    const char* path = "bench_rebates.csv";
+    {
+        std::ofstream file(path);
+        file << "# rebates\n";
+        for (int i = 0; i < 10000; ++i)
+        {
+            file << "user" << i << ",2.5\n";
+        }
+        file << "user10000,not a number\n";
+    }
+    BulkCreditJob rebates;
+    rebates.name = "rebates-1";
+    rebates.targets = CreditTargets::BT_File;
+    rebates.asset = "USD";
+    rebates.book = SQLData::DataBaseState::DBS_BALANCE;
+    rebates.rate = FixedPoint::SCALE;
+    rebates.funding = Ledger::feeAccount;
+    rebates.filePath = path;
+    {
+        BulkCredit bulk(ledger, sqlData);
+        finished = bulk.run(rebates, [&](const BulkCreditProgress& progress) { last = progress; });
+        std::cout << "Rebates from a file: " << last.credited << " accounts in " << std::setprecision(0) << last.elapsedMillis << " ms\n";
+        ok &= finished && last.credited == 10000 && ledger.getBalance("user9999", "USD", SQLData::DataBaseState::DBS_BALANCE) == 250000000 &&
+            bulk.run(rebates) && ledger.getBalance("user9999", "USD", SQLData::DataBaseState::DBS_BALANCE) == 250000000;
+    }
+    std::remove(path);
+    ledger.flush();
+
+    std::cout << (ok ? "Every account credited exactly once" : "[ERROR] Bulk credit mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Reconciliation: balance tables against the journal on 1-4 threads, with a writer running, then planted errors
+static int benchmarkReconcile()
+{
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-reconcile.db"))
+    {
+        return 1;
+    }
+
+    const int accountCount = 100000;
+    const int transferCount = 300000;
+    const char* coins[] = { "Bitcoin", "Ethereum", "Solana" };
+    std::vector<std::string> accounts;
+    for (int i = 0; i < accountCount; ++i)
+    {
+        accounts.push_back("acct" + std::to_string(i));
+    }
+
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+    if (!ledger.enableBalanceEngine())
+    {
+        return 1;
+    }
+
+    // Every account holds every coin and some USD, then coins move around at random
+    auto timer = std::chrono::steady_clock::now();
+    ledger.beginBatch();
+    for (const auto& account : accounts)
+    {
+        std::vector<SQLData::Posting> postings;
+        for (const char* coinName : coins)
+        {
+            postings.push_back({ account, coinName, SQLData::DataBaseState::DBS_COINS, 100 * FixedPoint::SCALE });
+            postings.push_back({ Ledger::externalAccount, coinName, SQLData::DataBaseState::DBS_COINS, -100 * FixedPoint::SCALE });
+        }
+        postings.push_back({ account, "USD", SQLData::DataBaseState::DBS_BALANCE, 5000 * FixedPoint::SCALE });
+        postings.push_back({ Ledger::externalAccount, "USD", SQLData::DataBaseState::DBS_BALANCE, -5000 * FixedPoint::SCALE });
+        ledger.applyTransaction(TransactionKind::TK_Deposit, postings);
+    }
+    ledger.commitBatch();
+
+    std::mt19937 random(17);
+    std::uniform_int_distribution<int> pick(0, accountCount - 1);
+    std::uniform_int_distribution<int> cents(1, 100000);
+    for (int i = 0; i < transferCount; ++i)
+    {
+        ledger.transfer(accounts[pick(random)], accounts[pick(random)], coins[i % 3], cents(random) * (FixedPoint::SCALE / 100000));
+    }
+    ledger.flush();
+    std::cout << "History: " << accountCount << " accounts, " << transferCount << " transfers written in "
+        << std::fixed << std::setprecision(0) << elapsedMillis(timer) << " ms\n";
+
+    // Quiet database, 1, 2 and 4 workers
+    bool ok = true;
+    for (unsigned threads : { 1u, 2u, 4u })
+    {
+        LedgerReconciler reconciler(threads);
+        ReconcileReport report;
+        if (!reconciler.run(sqlData, report))
+        {
+            return 1;
+        }
+        LedgerReconciler::print(report);
+        ok &= report.reconciled && report.rows == static_cast<uint64_t>(accountCount) * 4;
+    }
+
+    // A writer keeps transferring while the reconciliation runs (a few thousand a second): the rows read after its
+    // commits must still match
+    std::atomic<bool> writing(true);
+    std::atomic<uint64_t> written(0);
+    std::thread writer([&]()
+        {
+            std::mt19937 writerRandom(23);
+            for (int i = 0; writing; ++i)
+            {
+                ledger.transfer(accounts[pick(writerRandom)], accounts[pick(writerRandom)], coins[i % 3], cents(writerRandom) * (FixedPoint::SCALE / 100000));
+                ++written;
+                if (i % 5 == 4)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1)); // A steady load, not a backlog the persister writes in one batch
+                }
+            }
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint64_t writtenBefore = written;
+    ReconcileReport live;
+    bool ran = LedgerReconciler(4).run(sqlData, live);
+    uint64_t writtenDuring = written - writtenBefore;
+    writing = false;
+    writer.join();
+    ledger.flush();
+    if (!ran)
+    {
+        return 1;
+    }
+    LedgerReconciler::print(live);
+    size_t assetsInFlight = 0;
+    for (const auto& supply : live.supply)
+    {
+        assetsInFlight += supply.inFlight != 0;
+    }
+    std::cout << "Writer: " << writtenDuring << " transfers during the reconciliation (" << std::fixed << std::setprecision(0)
+        << writtenDuring / ((live.tableMillis + live.journalMillis + live.mergeMillis) / 1000.0) << " transfers/s), "
+        << assetsInFlight << " assets with postings in flight\n";
+    ok &= live.reconciled && writtenDuring > 0;
+
+    // Planted errors: a row changed without a posting, and a posting changed without its row
+    sqlData.execute("UPDATE COINS SET amount = amount + 0.5 WHERE user_id = 'acct4242' AND coin_name = 'Ethereum';");
+    sqlite3_int64 postingID = 0;
+    {
+        sqlite3_stmt* stmt = sqlData.prepareCached("SELECT id FROM POSTINGS WHERE user_id = 'acct777' AND asset = 'Bitcoin' ORDER BY id DESC LIMIT 1;");
+        if (stmt && sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            postingID = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlData.execute("UPDATE POSTINGS SET amount = amount - 3 WHERE id = " + std::to_string(postingID) + ";");
+
+    ReconcileReport broken;
+    if (!LedgerReconciler(4).run(sqlData, broken))
+    {
+        return 1;
+    }
+    LedgerReconciler::print(broken);
+    size_t found = 0;
+    for (const auto& discrepancy : broken.discrepancySamples)
+    {
+        std::vector<DrillDownRow> rows;
+        if (!LedgerReconciler::drillDown(sqlData, discrepancy, rows))
+        {
+            return 1;
+        }
+        LedgerReconciler::print(discrepancy, rows);
+        Amount journal = rows.empty() ? 0 : rows.back().balance;
+        found += journal == discrepancy.journal &&
+            ((discrepancy.account == "acct4242" && discrepancy.asset == "Ethereum" && discrepancy.table - journal == FixedPoint::SCALE / 2) ||
+             (discrepancy.account == "acct777" && discrepancy.asset == "Bitcoin" && discrepancy.table - journal == 3));
+    }
+    bool bitcoinBroken = false;
+    for (const auto& supply : broken.supply)
+    {
+        bitcoinBroken |= supply.asset == "Bitcoin" && !supply.conserved && supply.net == -3;
+    }
+    ok &= !broken.reconciled && broken.discrepancies == 2 && found == 2 && broken.unbalanced == 1 && bitcoinBroken;
+
+    std::cout << (ok ? "Reconciled with and without a writer; both planted errors found and drilled down" : "[ERROR] Reconciliation mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Point-in-time balances: checkpoint writing, then as-of queries from the start of the journal to now against a full
+// scan of the account's postings
+static int benchmarkAsOf()
+{
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-asof.db") || !sqlData.createTable(SQLData::DataBaseState::DBS_TRANSACTIONS) ||
+        !sqlData.createTable(SQLData::DataBaseState::DBS_POSTINGS))
+    {
+        return 1;
+    }
+
+    // One transaction a second for 1M seconds (11.5 days): a user receives a coin from the outside world
+    const sqlite3_int64 transactionCount = 1000000;
+    const sqlite3_int64 userCount = 200;    // 5000 postings each: a long history behind every account
+    const sqlite3_int64 startMillis = 1700000000000;
+    auto timer = std::chrono::steady_clock::now();
+    auto appendJournal = [&](sqlite3_int64 from, sqlite3_int64 to)
+        {
+            std::string range = "WITH RECURSIVE n(i) AS (SELECT " + std::to_string(from) + " UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(to) + ") ";
+            std::string user = "'user' || (i * 7919 % " + std::to_string(userCount) + ")";
+            std::string asset = "CASE i % 3 WHEN 0 THEN 'Bitcoin' WHEN 1 THEN 'Ethereum' ELSE 'Solana' END";
+            std::string amount = "((i % 1000) + 1) * 1000000";
+            std::string time = std::to_string(startMillis) + " + i * 1000";
+            return sqlData.execute("BEGIN;") &&
+                sqlData.execute(range + "INSERT INTO TRANSACTIONS (id, kind, created_at) SELECT i, 'DEPOSIT', " + time + " FROM n;") &&
+                sqlData.execute(range + "INSERT INTO POSTINGS (id, tx_id, user_id, asset, book, amount, created_at) "
+                    "SELECT 2 * i - 1, i, " + user + ", " + asset + ", 2, " + amount + ", " + time + " FROM n;") &&
+                sqlData.execute(range + "INSERT INTO POSTINGS (id, tx_id, user_id, asset, book, amount, created_at) "
+                    "SELECT 2 * i, i, '@external', " + asset + ", 2, -" + amount + ", " + time + " FROM n;") &&
+                sqlData.execute("COMMIT;");
+        };
+    if (!appendJournal(1, transactionCount))
+    {
+        return 1;
+    }
+    std::cout << "Journal: " << transactionCount << " transactions, " << 2 * transactionCount << " postings, " << userCount
+        << " users written in " << std::fixed << std::setprecision(0) << elapsedMillis(timer) << " ms\n";
+
+    BalanceHistory history(sqlData);
+    timer = std::chrono::steady_clock::now();
+    size_t checkpoints = history.checkpoint();
+    double checkpointMillis = elapsedMillis(timer);
+    std::cout << "Checkpoints: " << checkpoints << " in " << checkpointMillis << " ms (" << std::setprecision(1)
+        << checkpointMillis / std::max<size_t>(1, checkpoints) << " ms each, " << BalanceHistory::defaultInterval << " postings apart)\n";
+    bool ok = checkpoints == static_cast<size_t>(2 * transactionCount / BalanceHistory::defaultInterval);
+
+    // The journal grows past the newest checkpoint (less than an interval, so no checkpoint is due)
+    ok &= appendJournal(transactionCount + 1, transactionCount + 30000) && history.checkpoint() == 0;
+    const sqlite3_int64 lastTransaction = transactionCount + 30000;
+
+    // The same users at ages from the first hour to now: as-of query against summing every posting up to that transaction
+    sqlite3_stmt* scan = sqlData.prepareCached("SELECT asset, SUM(amount) FROM POSTINGS WHERE user_id = ? AND tx_id <= ? GROUP BY asset;");
+    std::mt19937 random(29);
+    std::uniform_int_distribution<sqlite3_int64> pickUser(0, userCount - 1);
+    const int queries = 300;
+    size_t wrong = 0;
+    std::cout << "  T at journal     as-of us   full scan us   postings after checkpoint   time lookups\n";
+    for (double fraction : { 0.0001, 0.01, 0.1, 0.5, 0.9, 1.0 })
+    {
+        sqlite3_int64 throughTx = std::max<sqlite3_int64>(1, static_cast<sqlite3_int64>(fraction * lastTransaction));
+        int64_t at = startMillis + throughTx * 1000 + 500; // Half a second after the transaction
+        double asOfMicros = 0.0, scanMicros = 0.0;
+        uint64_t deltaPostings = 0, lookups = 0;
+        for (int q = 0; q < queries; ++q)
+        {
+            std::string userID = "user" + std::to_string(pickUser(random));
+            std::vector<AsOfBalance> balances;
+            AsOfInfo info;
+            auto start = std::chrono::steady_clock::now();
+            if (!history.balancesAt(userID, at, balances, &info))
+            {
+                return 1;
+            }
+            asOfMicros += elapsedMillis(start) * 1000.0;
+            deltaPostings += info.deltaPostings;
+            lookups += static_cast<uint64_t>(info.timeLookups);
+
+            start = std::chrono::steady_clock::now();
+            std::map<std::string, Amount> expected;
+            sqlite3_reset(scan);
+            sqlite3_bind_text(scan, 1, userID.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(scan, 2, throughTx);
+            while (sqlite3_step(scan) == SQLITE_ROW)
+            {
+                Amount sum = sqlite3_column_int64(scan, 1);
+                if (sum != 0)
+                {
+                    expected[reinterpret_cast<const char*>(sqlite3_column_text(scan, 0))] = sum;
+                }
+            }
+            sqlite3_reset(scan);
+            scanMicros += elapsedMillis(start) * 1000.0;
+
+            bool same = info.throughTxID == throughTx && balances.size() == expected.size();
+            for (const auto& balance : balances)
+            {
+                auto it = expected.find(balance.asset);
+                same = same && it != expected.end() && it->second == balance.amount;
+            }
+            wrong += !same;
+        }
+        std::cout << "  " << std::setw(8) << std::setprecision(2) << fraction * 100.0 << "%" << std::setw(14) << std::setprecision(1)
+            << asOfMicros / queries << std::setw(15) << scanMicros / queries << std::setw(28)
+            << static_cast<double>(deltaPostings) / queries << std::setw(15) << static_cast<double>(lookups) / queries << "\n";
+    }
+
+    // Before the first transaction everything is zero
+    std::vector<AsOfBalance> before;
+    ok &= history.balancesAt("user1", startMillis, before) && before.empty();
+    std::cout << wrong << " of " << queries * 6 << " as-of results differ from the full scan\n";
+    ok &= wrong == 0;
+    std::cout << (ok ? "Every as-of balance matches the journal" : "[ERROR] As-of balance mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Parses an amount as written in a statement ("-12.50000000") back to fixed point
+static bool parseStatementAmount(const std::string& text, Amount& amount)
+{
+    size_t dot = text.find('.');
+    if (text.empty() || dot == std::string::npos || text.size() - dot - 1 != 8)
+    {
+        return false;
+    }
+    bool negative = text[0] == '-';
+    Amount units = std::atoll(text.substr(negative ? 1 : 0, dot - (negative ? 1 : 0)).c_str());
+    Amount fraction = std::atoll(text.substr(dot + 1).c_str());
+    amount = units * FixedPoint::SCALE + fraction;
+    amount = negative ? -amount : amount;
+    return true;
+}
+
+// Statements of 100k accounts over a period in the middle of a 1M-transaction journal
+static int benchmarkStatements()
+{
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-statements.db") || !sqlData.createTable(SQLData::DataBaseState::DBS_TRANSACTIONS) ||
+        !sqlData.createTable(SQLData::DataBaseState::DBS_POSTINGS) || !sqlData.createTable(SQLData::DataBaseState::DBS_COINS) ||
+        !sqlData.createTable(SQLData::DataBaseState::DBS_BALANCE))
+    {
+        return 1;
+    }
+
+    // A deposit every 10 ms: account i * 7919 % accountCount receives a coin or USD from the outside world; the
+    // balance tables hold the sums of the journal
+    const sqlite3_int64 transactionCount = 1000000;
+    const sqlite3_int64 accountCount = 100000;
+    const sqlite3_int64 startMillis = 1700000000000;
+    auto timer = std::chrono::steady_clock::now();
+    std::string range = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(transactionCount) + ") ";
+    std::string account = "'acct' || (i * 7919 % " + std::to_string(accountCount) + ")";
+    std::string asset = "CASE i % 4 WHEN 0 THEN 'Bitcoin' WHEN 1 THEN 'Ethereum' WHEN 2 THEN 'Solana' ELSE 'USD' END";
+    std::string book = "CASE i % 4 WHEN 3 THEN 3 ELSE 2 END";
+    std::string amount = "((i % 1000) + 1) * 1000000";
+    std::string time = std::to_string(startMillis) + " + i * 10";
+    if (!sqlData.execute("BEGIN;") ||
+        !sqlData.execute(range + "INSERT INTO TRANSACTIONS (id, kind, created_at) SELECT i, 'DEPOSIT', " + time + " FROM n;") ||
+        !sqlData.execute(range + "INSERT INTO POSTINGS (id, tx_id, user_id, asset, book, amount, created_at) "
+            "SELECT 2 * i - 1, i, " + account + ", " + asset + ", " + book + ", " + amount + ", " + time + " FROM n;") ||
+        !sqlData.execute(range + "INSERT INTO POSTINGS (id, tx_id, user_id, asset, book, amount, created_at) "
+            "SELECT 2 * i, i, '@external', " + asset + ", " + book + ", -" + amount + ", " + time + " FROM n;") ||
+        !sqlData.execute("INSERT INTO COINS (user_id, coin_name, amount) "
+            "SELECT user_id, asset, SUM(amount) / 100000000.0 FROM POSTINGS WHERE book = 2 AND user_id <> '@external' GROUP BY 1, 2;") ||
+        !sqlData.execute("INSERT INTO BALANCE (user_id, money_name, amount) "
+            "SELECT user_id, asset, SUM(amount) / 100000000.0 FROM POSTINGS WHERE book = 3 AND user_id <> '@external' GROUP BY 1, 2;") ||
+        !sqlData.execute("COMMIT;"))
+    {
+        return 1;
+    }
+    std::cout << "Ledger: " << accountCount << " accounts, " << transactionCount << " transactions written in " << std::fixed
+        << std::setprecision(0) << elapsedMillis(timer) << " ms\n";
+
+    // The middle third of the journal
+    StatementJob job;
+    job.fromMillis = startMillis + transactionCount / 3 * 10 + 5;
+    job.toMillis = startMillis + transactionCount * 2 / 3 * 10 + 5;
+    job.directory = (std::filesystem::temp_directory_path() / "bench-statements").string();
+
+    // Expected opening and closing balance of every (account, asset) held by the end of the period, and the movements
+    std::map<std::pair<std::string, std::string>, std::pair<Amount, Amount>> expected;
+    uint64_t expectedMovements = 0;
+    sqlite3_stmt* sums = sqlData.prepareCached("SELECT user_id, asset, SUM(CASE WHEN created_at < ?1 THEN amount ELSE 0 END), SUM(amount), "
+        "SUM(created_at >= ?1) FROM POSTINGS WHERE created_at < ?2 AND user_id <> '@external' GROUP BY 1, 2;");
+    sqlite3_bind_int64(sums, 1, job.fromMillis);
+    sqlite3_bind_int64(sums, 2, job.toMillis);
+    while (sqlite3_step(sums) == SQLITE_ROW)
+    {
+        expected[{ reinterpret_cast<const char*>(sqlite3_column_text(sums, 0)), reinterpret_cast<const char*>(sqlite3_column_text(sums, 1)) }] =
+            { sqlite3_column_int64(sums, 2), sqlite3_column_int64(sums, 3) };
+        expectedMovements += static_cast<uint64_t>(sqlite3_column_int64(sums, 4));
+    }
+    sqlite3_reset(sums);
+
+    bool ok = true;
+    for (unsigned threads : { 1u, 2u, 4u })
+    {
+        std::filesystem::remove_all(job.directory);
+        StatementGenerator generator(sqlData, threads);
+        StatementReport report;
+        if (!generator.run(job, report))
+        {
+            return 1;
+        }
+        StatementGenerator::print(report);
+
+        // Every OPENING and CLOSING row against the journal
+        size_t checked = 0, wrong = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(job.directory))
+        {
+            std::ifstream file(entry.path());
+            std::string line;
+            std::getline(file, line); // Header
+            while (std::getline(file, line))
+            {
+                std::vector<std::string> fields;
+                size_t at = 0;
+                for (size_t comma; (comma = line.find(',', at)) != std::string::npos; at = comma + 1)
+                {
+                    fields.push_back(line.substr(at, comma - at));
+                }
+                fields.push_back(line.substr(at));
+                if (fields.size() != 8 || (fields[5] != "OPENING" && fields[5] != "CLOSING"))
+                {
+                    continue;
+                }
+                auto it = expected.find({ fields[0], fields[1] });
+                Amount balance;
+                if (it == expected.end() || !parseStatementAmount(fields[7], balance) ||
+                    balance != (fields[5] == "OPENING" ? it->second.first : it->second.second))
+                {
+                    ++wrong;
+                }
+                ++checked;
+            }
+        }
+        bool same = wrong == 0 && checked == 2 * expected.size() && report.movements == expectedMovements &&
+            report.statements == static_cast<uint64_t>(accountCount);
+        std::cout << "  " << checked << " opening and closing balances checked, " << wrong << " wrong\n";
+        ok &= same;
+    }
+
+    // The same period as printable text
+    job.format = StatementFormat::SF_Text;
+    std::filesystem::remove_all(job.directory);
+    StatementGenerator text(sqlData, 4);
+    StatementReport report;
+    ok &= text.run(job, report) && report.statements == static_cast<uint64_t>(accountCount);
+    StatementGenerator::print(report);
+    std::filesystem::remove_all(job.directory);
+
+    std::cout << (ok ? "Every statement matches the journal" : "[ERROR] Statement mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Interest accrual: the kernels against exact 128-bit arithmetic, then a run over 1M balances against the float
+// path of the balance table helpers
+static int benchmarkAccrual()
+{
+    // Balances of every magnitude, from one unit to the largest amount
+    const size_t kernelCount = 1 << 22;
+    std::mt19937_64 random(48);
+    std::vector<Amount> balances(kernelCount);
+    for (size_t i = 0; i < kernelCount; ++i)
+    {
+        int bits = static_cast<int>(random() % 63) + 1;
+        balances[i] = static_cast<Amount>(random() >> (64 - bits));
+    }
+    balances[0] = 0;
+    balances[1] = std::numeric_limits<Amount>::max();
+    balances[2] = std::numeric_limits<Amount>::max() - 1;
+
+    bool ok = true;
+    std::vector<Amount> simd(kernelCount), scalar(kernelCount);
+    for (uint32_t rate : { 0u, 1u, 136986u, 999999999u, accrualRateScale, static_cast<uint32_t>(random() % accrualRateScale) })
+    {
+        uint64_t simdResidue = 0, scalarResidue = 0;
+        auto timer = std::chrono::steady_clock::now();
+        accrueInterest(balances.data(), rate, simd.data(), kernelCount, simdResidue);
+        double simdMillis = elapsedMillis(timer);
+        timer = std::chrono::steady_clock::now();
+        accrueInterest(balances.data(), rate, scalar.data(), kernelCount, scalarResidue, false);
+        double scalarMillis = elapsedMillis(timer);
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < kernelCount; ++i)
+        {
+            int64_t expected = 0;
+            FixedPoint::mulDivFloor(balances[i], rate, accrualRateScale, expected);
+            wrong += simd[i] != expected || scalar[i] != expected;
+        }
+        std::cout << "Rate " << std::setw(10) << rate << ": " << accrueInterestKernel() << " " << std::fixed << std::setprecision(0)
+            << kernelCount / simdMillis / 1000.0 << "M/s, scalar " << kernelCount / scalarMillis / 1000.0 << "M/s, " << wrong
+            << " wrong, residues " << (simdResidue == scalarResidue ? "equal" : "DIFFER") << "\n";
+        ok &= wrong == 0 && simdResidue == scalarResidue;
+    }
+
+    // 1M holders of Solana (up to 1000 coins each) and 100k of Bitcoin, which must not change
+    LatencyVFS::instance().setSyncLatency(LatencyProfile(0.0, 0.0));
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-accrual.db") || !sqlData.createTable(SQLData::DataBaseState::DBS_COINS) ||
+        !sqlData.createTable(SQLData::DataBaseState::DBS_TRANSACTIONS) || !sqlData.createTable(SQLData::DataBaseState::DBS_POSTINGS))
+    {
+        return 1;
+    }
+    const int holderCount = 1000000;
+    auto timer = std::chrono::steady_clock::now();
+    if (!sqlData.execute("WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < " + std::to_string(holderCount) + ") "
+        "INSERT INTO COINS (user_id, coin_name, amount) SELECT 'user' || i, CASE WHEN i % 10 = 9 THEN 'Bitcoin' ELSE 'Solana' END, "
+        "(i * 2654435761 % 100000000000) / 100000000.0 FROM n;") ||
+        !sqlData.execute("WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i + 1 < " + std::to_string(holderCount / 10) + ") "
+            "INSERT INTO COINS (user_id, coin_name, amount) SELECT 'user' || (i * 10 + 9), 'Solana', (i % 1000) / 100000000.0 FROM n;"))
+    {
+        return 1;
+    }
+    std::cout << "Balances: " << holderCount + holderCount / 10 << " rows written in " << elapsedMillis(timer) << " ms\n";
+
+    std::map<sqlite3_int64, std::pair<std::string, Amount>> before;
+    auto readAll = [&](std::map<sqlite3_int64, std::pair<std::string, Amount>>& rows)
+        {
+            sqlite3_stmt* all = sqlData.prepareCached("SELECT id, user_id, coin_name, amount FROM COINS;");
+            while (sqlite3_step(all) == SQLITE_ROW)
+            {
+                rows[sqlite3_column_int64(all, 0)] = { std::string(reinterpret_cast<const char*>(sqlite3_column_text(all, 2))),
+                    FixedPoint::fromDouble(sqlite3_column_double(all, 3)) };
+            }
+            sqlite3_reset(all);
+        };
+    readAll(before);
+
+    // The float path for comparison (rolled back): read, multiply and write back one row at a time
+    const int floatRows = 50000;
+    sqlData.execute("BEGIN;");
+    timer = std::chrono::steady_clock::now();
+    for (int i = 0; i < floatRows; ++i)
+    {
+        std::string userID = "user" + std::to_string(i);
+        float amount = sqlData.getCurrentValuteAmount(userID, "Solana", SQLData::DataBaseState::DBS_COINS);
+        sqlData.updateValuteAmount(userID, "Solana", amount * (1.0f + 0.05f / 365.0f), SQLData::DataBaseState::DBS_COINS);
+    }
+    double floatMillis = elapsedMillis(timer);
+    sqlData.execute("ROLLBACK;");
+    std::cout << "Float path: " << floatRows / (floatMillis / 1000.0) << " accounts/s\n";
+
+    AccrualJob job;
+    job.name = "staking-solana-1";
+    job.asset = "Solana";
+    job.annualRate = FixedPoint::fromDouble(0.05);
+    job.periodsPerYear = 365;
+    job.minimumBalance = 100; // The dust rows of the Bitcoin holders earn nothing
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    Ledger ledger(user, sqlData, seedList, coin);
+    if (!ledger.enableBalanceEngine())
+    {
+        return 1;
+    }
+    InterestAccrual accrual(ledger, sqlData);
+    AccrualReport report;
+    if (!accrual.run(job, report))
+    {
+        return 1;
+    }
+    InterestAccrual::print(report);
+
+    // Every Solana row of at least the minimum grew by floor(amount * rate / 10^9), every other row is unchanged
+    std::map<sqlite3_int64, std::pair<std::string, Amount>> after;
+    readAll(after);
+    size_t wrong = 0, earning = 0;
+    uint64_t residue = 0;
+    Amount total = 0;
+    for (const auto& row : before)
+    {
+        Amount expected = row.second.second;
+        if (row.second.first == "Solana" && expected >= job.minimumBalance)
+        {
+            int64_t accrued = 0;
+            FixedPoint::mulDivFloor(expected, report.periodRate, accrualRateScale, accrued);
+            residue += static_cast<uint64_t>(expected % accrualRateScale) * report.periodRate % accrualRateScale;
+            expected += accrued;
+            total += accrued;
+            ++earning;
+        }
+        wrong += after[row.first].second != expected;
+    }
+    std::cout << wrong << " of " << before.size() << " balances differ from the exact accrual\n";
+    ok &= wrong == 0 && earning == report.accounts && total == report.total && residue == report.residue;
+
+    // The payments went through the engine and the integrity chain: memory and the chain agree with the tables (row 1 is user0's Solana)
+    Amount inMemory = ledger.getBalance("user0", "Solana", SQLData::DataBaseState::DBS_COINS);
+    AuditReport audit;
+    bool chained = LedgerAudit::verifyChain(sqlData, audit) && audit.chainValid && audit.tablesMatch && audit.unchainedTransactions == 0;
+    std::cout << "Engine " << (inMemory == after[1].second ? "matches" : "DIFFERS FROM") << " the tables, chain "
+        << (chained ? "covers every payment" : "BROKEN") << "\n";
+    ok &= inMemory == after[1].second && chained;
+
+    // The journal nets to zero and holds the total; a rerun pays nothing
+    sqlite3_stmt* journal = sqlData.prepareCached("SELECT SUM(amount), SUM(CASE WHEN user_id = '@external' THEN 0 ELSE amount END) FROM POSTINGS;");
+    sqlite3_step(journal);
+    ok &= sqlite3_column_int64(journal, 0) == 0 && sqlite3_column_int64(journal, 1) == report.total;
+    sqlite3_reset(journal);
+    sqlite3_int64 transactions = sqlData.maxID("TRANSACTIONS");
+    AccrualReport again;
+    ok &= accrual.run(job, again) && again.processed == 0 && again.total == report.total && sqlData.maxID("TRANSACTIONS") == transactions;
+
+    std::cout << (ok ? "Every accrual is exact and paid once" : "[ERROR] Accrual mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Every thread pays into one fee account, with the account whole and split into sub-balances
+static int benchmarkHotAccount()
+{
+    const int payersPerThread = 1000;
+    const int opsPerThread = 500000;
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    bool ok = true;
+
+    std::cout << "threads  fee account  ops/s        speedup\n";
+    for (int split = 0; split < 2; ++split)
+    {
+        double baseline = 0.0;
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            BalanceEngine engine(threads * payersPerThread + 1);
+            uint32_t bitcoin = engine.assetId("Bitcoin", SQLData::DataBaseState::DBS_COINS);
+            uint32_t fees = engine.accountId("fees");
+            if (split)
+            {
+                ok &= engine.markHot("fees");
+                engine.startAggregation(10);
+            }
+            std::vector<uint32_t> payers;
+            for (unsigned i = 0; i < threads * payersPerThread; ++i)
+            {
+                payers.push_back(engine.accountId("payer" + std::to_string(i)));
+                EnginePosting funding = { payers.back(), bitcoin, 1000 * FixedPoint::SCALE };
+                engine.apply(&funding, 1);
+            }
+
+            std::vector<std::thread> workers;
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&, t]()
+                    {
+                        for (int i = 0; i < opsPerThread; ++i)
+                        {
+                            uint32_t from = payers[t * payersPerThread + i % payersPerThread];
+                            EnginePosting postings[2] = { { from, bitcoin, -1000 }, { fees, bitcoin, 1000 } };
+                            engine.apply(postings, 2);
+                        }
+                    });
+            }
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+            double millis = elapsedMillis(start);
+            engine.stopAggregation();
+
+            // Nothing is lost in the sub-balances: the fee account holds every payment and the totals are conserved
+            Amount expected = static_cast<Amount>(threads) * opsPerThread * 1000;
+            Amount total = 0;
+            Amount feesSeen = 0;
+            engine.forEach([&](uint32_t account, uint32_t, Amount amount)
+                {
+                    total += amount;
+                    feesSeen += account == fees ? amount : 0;
+                });
+            ok &= engine.balance(fees, bitcoin) == expected && feesSeen == expected
+                && total == static_cast<Amount>(threads) * payersPerThread * 1000 * FixedPoint::SCALE;
+
+            // A debit sees the whole balance, folded or not
+            engine.aggregateHot();
+            EnginePosting sweep[2] = { { fees, bitcoin, -expected }, { payers[0], bitcoin, expected } };
+            EnginePosting overdraw = { fees, bitcoin, -1 };
+            ok &= engine.apply(sweep, 2) && !engine.apply(&overdraw, 1) && engine.balance(fees, bitcoin) == 0;
+
+            double opsPerSecond = threads * opsPerThread / (millis / 1000.0);
+            if (threads == 1)
+            {
+                baseline = opsPerSecond;
+            }
+            std::cout << std::left << std::setw(9) << threads << std::setw(13) << (split ? "split" : "whole")
+                << std::setw(13) << std::fixed << std::setprecision(0) << opsPerSecond
+                << std::setprecision(2) << opsPerSecond / baseline << "\n";
+        }
+    }
+
+    std::cout << (ok ? "Every payment reached the fee account" : "[ERROR] Hot account mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Withdrawal holds: the hold book alone at millions outstanding, then holds placed, captured, released and expired
+// through the ledger, and holds left open by a "crash" given back at the next start
+static int benchmarkHolds()
+{
+    const uint32_t holdCount = 2000000;
+    const int64_t start = 1700000000000LL;
+    bool ok = true;
+
+    HoldBook book(100, start);
+    std::vector<HoldId> ids(holdCount);
+    auto timer = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < holdCount; ++i)
+    {
+        ids[i] = book.add({ "user" + std::to_string(i % 100000), "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1000, start + 60000 + i % 600000 });
+    }
+    double addNanos = elapsedMillis(timer) * 1e6 / holdCount;
+    size_t bytes = book.memoryBytes();
+
+    // Every other hold is settled by its owner, the rest expire; no hold is handed out twice
+    Hold hold;
+    timer = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < holdCount; i += 2)
+    {
+        ok &= book.claim(ids[i], hold) && hold.amount == 1000;
+        book.settle(ids[i], true);
+    }
+    double settleNanos = elapsedMillis(timer) * 2e6 / holdCount;
+    ok &= !book.claim(ids[0], hold) && book.size() == holdCount / 2;
+
+    std::vector<std::pair<HoldId, Hold>> expired;
+    timer = std::chrono::steady_clock::now();
+    for (int64_t now = start; now <= start + 700000; now += 1000)
+    {
+        book.claimExpired(now, expired);
+    }
+    double expireMillis = elapsedMillis(timer);
+    for (const auto& entry : expired)
+    {
+        book.settle(entry.first, true);
+    }
+    ok &= expired.size() == holdCount / 2 && book.size() == 0 && !book.claim(ids[1], hold);
+    std::cout << "Hold book: " << holdCount << " holds, add " << std::fixed << std::setprecision(0) << addNanos << " ns, settle "
+        << settleNanos << " ns, " << std::setprecision(1) << static_cast<double>(bytes) / holdCount << " bytes per hold, "
+        << expired.size() << " expired in " << std::setprecision(0) << expireMillis << " ms\n";
+
+    // Through the ledger: every user holds its whole balance, so nothing else can be spent meanwhile
+    SQLData sqlData;
+    if (!sqlData.openInLatencyVFS("bench-holds.db"))
+    {
+        return 1;
+    }
+    const int userCount = 20000;
+    const int holdsPerUser = 10;
+    const Amount holdAmount = FixedPoint::SCALE;
+    User user;
+    SeedList seedList(12);
+    Coin coin;
+    {
+        Ledger ledger(user, sqlData, seedList, coin);
+        if (!ledger.enableBalanceEngine(false))
+        {
+            return 1;
+        }
+        for (int i = 0; i < userCount; ++i)
+        {
+            ledger.applyTransaction(TransactionKind::TK_Deposit,
+                {
+                    { "acct" + std::to_string(i), "Bitcoin", SQLData::DataBaseState::DBS_COINS, holdsPerUser * holdAmount },
+                    { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -holdsPerUser * holdAmount },
+                });
+        }
+
+        std::vector<HoldId> placed;
+        timer = std::chrono::steady_clock::now();
+        for (int h = 0; h < holdsPerUser; ++h)
+        {
+            for (int i = 0; i < userCount; ++i)
+            {
+                placed.push_back(ledger.placeHold("acct" + std::to_string(i), "Bitcoin", SQLData::DataBaseState::DBS_COINS, holdAmount, 60000));
+            }
+        }
+        double placeMillis = elapsedMillis(timer);
+        ok &= std::count(placed.begin(), placed.end(), HoldId(0)) == 0 && !ledger.transfer("acct0", "acct1", "Bitcoin", 1)
+            && ledger.placeHold("acct0", "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1, 60000) == 0;
+
+        // A third is withdrawn, a third released, a third left open for the restart
+        size_t captured = 0;
+        size_t released = 0;
+        timer = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < placed.size(); ++i)
+        {
+            if (i % 3 == 0)
+            {
+                captured += ledger.captureHold(placed[i], Ledger::externalAccount, TransactionKind::TK_Withdraw) ? 1 : 0;
+            }
+            else if (i % 3 == 1)
+            {
+                released += ledger.releaseHold(placed[i]) ? 1 : 0;
+            }
+        }
+        double settleMillis = elapsedMillis(timer);
+        ok &= !ledger.captureHold(placed[0], Ledger::externalAccount, TransactionKind::TK_Withdraw) && !ledger.releaseHold(placed[1]);
+
+        // A capture under a command ID another payment already used pays nothing and leaves the hold open
+        size_t open = ledger.holdBook().size();
+        ok &= ledger.applyCommand(4242, TransactionKind::TK_Deposit,
+            {
+                { "other", "Bitcoin", SQLData::DataBaseState::DBS_COINS, 1 },
+                { Ledger::externalAccount, "Bitcoin", SQLData::DataBaseState::DBS_COINS, -1 },
+            }) == CommandStatus::CS_Applied;
+        ok &= !ledger.captureHold(placed[2], Ledger::externalAccount, TransactionKind::TK_Withdraw, 4242) && ledger.holdBook().size() == open;
+        std::cout << "Ledger: " << placed.size() << " holds placed in " << std::setprecision(0) << placeMillis << " ms, " << captured
+            << " captured and " << released << " released in " << settleMillis << " ms, " << ledger.holdBook().size() << " open\n";
+        ok &= captured + released + ledger.holdBook().size() == placed.size();
+        ledger.flush();
+    }
+
+    // The next start gives the open holds back from the journal (before the engine is loaded)
+    {
+        Ledger ledger(user, sqlData, seedList, coin);
+        timer = std::chrono::steady_clock::now();
+        size_t stale = ledger.releaseStaleHolds();
+        double staleMillis = elapsedMillis(timer);
+        ok &= ledger.enableBalanceEngine(false) && ledger.releaseStaleHolds() == 0;
+
+        // Every user lost exactly its captured holds, every hold account is empty
+        size_t wrong = 0;
+        for (int i = 0; i < userCount; ++i)
+        {
+            std::string account = "acct" + std::to_string(i);
+            Amount capturedHere = 0;
+            for (int h = 0; h < holdsPerUser; ++h)
+            {
+                capturedHere += (static_cast<size_t>(h) * userCount + i) % 3 == 0 ? holdAmount : 0;
+            }
+            wrong += ledger.getBalance(account, "Bitcoin", SQLData::DataBaseState::DBS_COINS) != holdsPerUser * holdAmount - capturedHere
+                || ledger.getBalance(Ledger::holdAccount(account), "Bitcoin", SQLData::DataBaseState::DBS_COINS) != 0;
+        }
+        std::cout << "Restart: " << stale << " stale hold balances released in " << std::setprecision(0) << staleMillis << " ms, "
+            << wrong << " of " << userCount << " users wrong\n";
+        ok &= stale > 0 && wrong == 0;
+
+        // Expiry: a hold not captured in time goes back, and a late capture fails
+        HoldId late = ledger.placeHold("acct1", "Bitcoin", SQLData::DataBaseState::DBS_COINS, holdAmount, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        Amount before = ledger.getBalance("acct1", "Bitcoin", SQLData::DataBaseState::DBS_COINS);
+        ok &= late != 0 && !ledger.captureHold(late, Ledger::externalAccount, TransactionKind::TK_Withdraw)
+            && ledger.getBalance("acct1", "Bitcoin", SQLData::DataBaseState::DBS_COINS) == before + holdAmount;
+        HoldId timedOut = ledger.placeHold("acct1", "Bitcoin", SQLData::DataBaseState::DBS_COINS, holdAmount, 1);
+        ok &= timedOut != 0 && ledger.expireHolds(TransferScheduler::nowMillis() + 1000) == 1 && ledger.holdBook().size() == 0;
+        ledger.flush();
+    }
+
+    std::cout << (ok ? "Every hold was settled exactly once" : "[ERROR] Hold mismatch") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Table of the available benchmarks
+struct BenchmarkEntry
+{
+    const char* name;          // Name used on the command line
+    int (*run)();              // Function that runs the benchmark
+};
+
+static const BenchmarkEntry benchmarks[] =
+{
+    { "vfs", benchmarkVFS },
+    { "sqlfunc", benchmarkSQLFunctions },
+    { "prices", benchmarkPricesTable },
+    { "journal", benchmarkJournal },
+    { "engine", benchmarkEngine },
+    { "concurrency", benchmarkConcurrency },
+    { "pipeline", benchmarkPipeline },
+    { "orderbook", benchmarkOrderBook },
+    { "replay", benchmarkReplay },
+    { "integrity", benchmarkIntegrity },
+    { "valuation", benchmarkValuation },
+    { "pricefeed", benchmarkPriceFeed },
+    { "history", benchmarkHistory },
+    { "chart", benchmarkChart },
+    { "fx", benchmarkFx },
+    { "dedup", benchmarkDedup },
+    { "scheduler", benchmarkScheduler },
+    { "bulk", benchmarkBulkCredit },
+    { "reconcile", benchmarkReconcile },
+    { "asof", benchmarkAsOf },
+    { "statements", benchmarkStatements },
+    { "accrual", benchmarkAccrual },
+    { "hot", benchmarkHotAccount },
+    { "holds", benchmarkHolds },
+};
+
+// Runs the benchmark with the given name
+int runBenchmark(const std::string& name)
+{
+    for (const auto& entry : benchmarks)
+    {
+        if (name == entry.name)
+        {
+            std::cout << "=== [BENCHMARK] " << entry.name << " ===\n";
+            return entry.run();
+        }
+    }
+
+    std::cerr << "[ERROR] Unknown benchmark: " << name << "\nAvailable:";
+    for (const auto& entry : benchmarks)
+    {
+        std::cerr << " " << entry.name;
+    }
+    std::cerr << "\n";
+    return 1;
+}
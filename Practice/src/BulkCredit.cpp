@@ -0,0 +1,409 @@
+#include "BulkCredit.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+// Buckets applied between two flushes (one progress record and one report per wave)
+static const size_t bucketsPerWave = 64;
+
+// Command ID of one bucket of a job: the same bucket always gets the same ID (splitmix64, never 0)
+static CommandId commandIdOf(const std::string& jobName, size_t bucket)
+{
+    uint64_t x = BulkCredit::hashOf(jobName.c_str()) + (static_cast<uint64_t>(bucket) + 1) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+// Constructor for BulkCredit
+BulkCredit::BulkCredit(Ledger& ledger, SQLData& sqlData, size_t workers)
+    : ledger(ledger), dbName(sqlData.databaseName()), vfsName(sqlData.vfsName()), workerCount(workers), stopRequested(false)
+{
+    if (workerCount == 0)
+    {
+        workerCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+}
+
+// Destructor for BulkCredit
+BulkCredit::~BulkCredit()
+{
+    storage.close();
+}
+
+// FNV-1a over the bytes of the name
+uint64_t BulkCredit::hashOf(const char* userID)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char* c = reinterpret_cast<const unsigned char*>(userID); *c; ++c)
+    {
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Streams the targets into the slice of their hash
+bool BulkCredit::collect(const BulkCreditJob& job, size_t buckets, const std::vector<bool>& done, std::vector<Slice>& slices, size_t& targetCount)
+{
+    slices.assign(sliceCount, Slice());
+    targetCount = 0;
+    auto add = [&](const char* userID, Amount base)
+        {
+            size_t slice = static_cast<size_t>(hashOf(userID)) & (sliceCount - 1);
+            if (!done.empty() && done[slice & (buckets - 1)])
+            {
+                return;
+            }
+            Slice& target = slices[slice];
+            target.names.insert(target.names.end(), userID, userID + std::strlen(userID) + 1);
+            target.bases.push_back(base);
+            ++targetCount;
+        };
+
+    switch (job.targets)
+    {
+    case CreditTargets::BT_AllAccounts:
+        return storage.forEachUserID([&](const char* userID) { add(userID, 0); });
+
+    case CreditTargets::BT_Holders:
+        if (ledger.isBalanceEngineEnabled())
+        {
+            // The engine is ahead of the database, so its balances decide who holds the asset
+            BalanceEngine& engine = ledger.balanceEngine();
+            uint32_t asset = engine.assetId(job.filterAsset, job.filterBook);
+            engine.forEach([&](uint32_t account, uint32_t assetId, Amount held)
+                {
+                    if (assetId == asset && held >= job.filterMinimum && !BalanceEngine::isSystem(account))
+                    {
+                        add(engine.accountName(account).c_str(), held);
+                    }
+                });
+            return true;
+        }
+        return storage.forEachHolder(job.filterAsset, job.filterBook, job.filterMinimum, add);
+
+    case CreditTargets::BT_File:
+    {
+        std::ifstream file(job.filePath);
+        if (!file)
+        {
+            std::cerr << "[ERROR] Could not open " << job.filePath << "\n";
+            return false;
+        }
+
+        std::string line;
+        size_t invalid = 0;
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            Amount base = 0;
+            size_t comma = line.find(',');
+            if (comma != std::string::npos)
+            {
+                char* end = nullptr;
+                double value = std::strtod(line.c_str() + comma + 1, &end);
+                if (end == line.c_str() + comma + 1 || !(value >= 0.0))
+                {
+                    ++invalid;
+                    continue;
+                }
+                base = FixedPoint::fromDouble(value);
+                line.resize(comma);
+            }
+            if (line.empty())
+            {
+                ++invalid;
+                continue;
+            }
+            add(line.c_str(), base);
+        }
+        if (invalid > 0)
+        {
+            std::cerr << "[ERROR] " << invalid << " invalid lines in " << job.filePath << " were skipped\n";
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// Every account of the bucket gets its credit, the funding account pays the total, all in one transaction
+CommandStatus BulkCredit::creditBucket(const BulkCreditJob& job, sqlite3_int64 jobID, size_t bucket, size_t buckets, const std::vector<Slice>& slices,
+    uint64_t& credited, Amount& total)
+{
+    credited = 0;
+    total = 0;
+    std::vector<Posting> postings;
+    postings.reserve(accountsPerBucket + accountsPerBucket / 4);
+
+    for (size_t s = bucket; s < sliceCount; s += buckets)
+    {
+        const Slice& slice = slices[s];
+        const char* name = slice.names.data();
+        for (Amount base : slice.bases)
+        {
+            std::string userID(name);
+            name += userID.size() + 1;
+            if (Ledger::isSystemAccount(userID) || (job.filter && !job.filter(userID)))
+            {
+                continue;
+            }
+
+            Amount credit = job.amount;
+            Amount share = 0;
+            if (job.rate > 0 && base > 0 &&
+                (!FixedPoint::mulDivFloor(base, job.rate, FixedPoint::SCALE, share) || !FixedPoint::add(credit, share, credit)))
+            {
+                std::cerr << "[ERROR] Credit of " << userID << " overflows, skipped\n";
+                continue;
+            }
+            if (credit <= 0)
+            {
+                continue;
+            }
+            if (!FixedPoint::add(total, credit, total))
+            {
+                std::cerr << "[ERROR] Total of bucket " << bucket << " overflows\n";
+                return CommandStatus::CS_Rejected;
+            }
+            postings.push_back({ std::move(userID), job.asset, job.book, credit });
+        }
+    }
+
+    credited = postings.size();
+    if (postings.empty())
+    {
+        return CommandStatus::CS_Applied; // Nothing to credit, the bucket is simply done
+    }
+    postings.push_back({ job.funding, job.asset, job.book, -total });
+
+    // The bucket is recorded as done by the database transaction that pays it
+    sqlite3_int64 accounts = static_cast<sqlite3_int64>(credited);
+    Amount paid = total;
+    return ledger.applyCommand(commandIdOf(job.name, bucket), TransactionKind::TK_Credit, postings, "bulk credit " + job.name,
+        [jobID, bucket, accounts, paid](SQLData& sqlData, sqlite3_int64)
+        {
+            return sqlData.insertBulkCreditBucket(jobID, static_cast<sqlite3_int64>(bucket), accounts, paid);
+        });
+}
+
+// Creates or resumes the job, then applies the buckets not done yet wave by wave
+bool BulkCredit::run(const BulkCreditJob& job, const ProgressCallback& onProgress)
+{
+    std::lock_guard<std::mutex> lock(runMutex);
+    stopRequested = false;
+    auto started = std::chrono::steady_clock::now();
+    auto elapsed = [&started]()
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        };
+
+    bool valid = !job.name.empty() && !job.asset.empty() && !job.funding.empty() && job.amount >= 0 && job.rate >= 0 &&
+        (job.amount > 0 || job.rate > 0) &&
+        (job.book == SQLData::DataBaseState::DBS_COINS || job.book == SQLData::DataBaseState::DBS_BALANCE);
+    if (job.targets == CreditTargets::BT_Holders)
+    {
+        valid = valid && !job.filterAsset.empty();
+    }
+    else if (job.targets == CreditTargets::BT_File)
+    {
+        valid = valid && !job.filePath.empty();
+    }
+    if (!valid)
+    {
+        std::cerr << "[ERROR] Invalid bulk credit " << job.name << "\n";
+        return false;
+    }
+
+    if (!storage.isOpen() && !storage.open(dbName, vfsName))
+    {
+        std::cerr << "[ERROR] Bulk credit could not open " << dbName << "\n";
+        return false;
+    }
+    if (!storage.createTable(SQLData::DataBaseState::DBS_BULK_CREDITS))
+    {
+        return false;
+    }
+
+    // A job that exists is resumed: same buckets, minus the ones recorded as done (their counts are summed back)
+    SQLData::BulkCreditRow row;
+    sqlite3_int64 doneCredited = 0;
+    Amount doneTotal = 0;
+    std::vector<Slice> slices;
+    std::vector<bool> done;
+    size_t targetCount = 0;
+    if (storage.findBulkCredit(job.name, row))
+    {
+        if (row.targets != static_cast<int>(job.targets) || row.asset != job.asset || row.book != job.book || row.amount != job.amount ||
+            row.rate != job.rate || row.funding != job.funding)
+        {
+            std::cerr << "[ERROR] Bulk credit " << job.name << " already exists with other terms\n";
+            return false;
+        }
+        done.assign(static_cast<size_t>(row.buckets), false);
+        if (!row.finished && !storage.forEachBulkCreditBucket(row.id, [&](sqlite3_int64 bucket, sqlite3_int64 credited, Amount total)
+            {
+                if (bucket >= 0 && static_cast<size_t>(bucket) < done.size())
+                {
+                    done[static_cast<size_t>(bucket)] = true;
+                    doneCredited += credited;
+                    FixedPoint::add(doneTotal, total, doneTotal);
+                }
+            }))
+        {
+            return false;
+        }
+        if (!row.finished && !collect(job, done.size(), done, slices, targetCount))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (!collect(job, 0, done, slices, targetCount))
+        {
+            return false;
+        }
+        size_t buckets = 1;
+        while (buckets < sliceCount && buckets * accountsPerBucket < targetCount)
+        {
+            buckets <<= 1;
+        }
+
+        row.name = job.name;
+        row.targets = static_cast<int>(job.targets);
+        row.asset = job.asset;
+        row.book = job.book;
+        row.amount = job.amount;
+        row.rate = job.rate;
+        row.funding = job.funding;
+        row.buckets = static_cast<sqlite3_int64>(buckets);
+        row.credited = 0;
+        row.total = 0;
+        row.finished = false;
+        row.id = storage.insertBulkCredit(row,
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        if (row.id == 0)
+        {
+            return false;
+        }
+        done.assign(buckets, false);
+    }
+
+    BulkCreditProgress progress;
+    progress.buckets = done.size();
+    progress.bucketsDone = static_cast<size_t>(std::count(done.begin(), done.end(), true));
+    progress.credited = static_cast<uint64_t>(row.finished ? row.credited : doneCredited);
+    progress.total = row.finished ? row.total : doneTotal;
+    progress.finished = row.finished;
+
+    std::vector<size_t> pending;
+    for (size_t bucket = 0; bucket < done.size() && !row.finished; ++bucket)
+    {
+        if (!done[bucket])
+        {
+            pending.push_back(bucket);
+        }
+    }
+
+    // The database path of a ledger without its balance engine is single-threaded
+    size_t workers = ledger.isBalanceEngineEnabled() ? workerCount : 1;
+    bool failed = false;
+    for (size_t first = 0; first < pending.size() && !failed && !stopRequested; first += bucketsPerWave)
+    {
+        size_t waveSize = std::min(bucketsPerWave, pending.size() - first);
+        std::vector<CommandStatus> statuses(waveSize, CommandStatus::CS_Pending);
+        std::vector<uint64_t> credited(waveSize, 0);
+        std::vector<Amount> totals(waveSize, 0);
+        std::atomic<size_t> next(0);
+        auto work = [&]()
+            {
+                for (size_t i = next++; i < waveSize; i = next++)
+                {
+                    statuses[i] = creditBucket(job, row.id, pending[first + i], done.size(), slices, credited[i], totals[i]);
+                    for (size_t s = pending[first + i]; s < sliceCount; s += done.size())
+                    {
+                        std::vector<char>().swap(slices[s].names); // The bucket's targets are no longer needed
+                        std::vector<Amount>().swap(slices[s].bases);
+                    }
+                }
+            };
+
+        ledger.beginBatch();
+        if (workers <= 1)
+        {
+            work();
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+            for (size_t w = 0; w < std::min(workers, waveSize); ++w)
+            {
+                threads.emplace_back(work);
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+        ledger.commitBatch();
+        if (!ledger.flush())
+        {
+            std::cerr << "[ERROR] The credits of " << job.name << " could not be written to the database\n";
+            return false;
+        }
+
+        // The wave is durable in the ledger with its bucket rows; record the empty buckets and the job's totals
+        bool stored = storage.execute("BEGIN IMMEDIATE;");
+        for (size_t i = 0; i < waveSize && stored; ++i)
+        {
+            if (statuses[i] == CommandStatus::CS_Rejected)
+            {
+                std::cerr << "[ERROR] Bucket " << pending[first + i] << " of " << job.name << " was rejected (funding of " << job.funding << "?)\n";
+                failed = true;
+                continue;
+            }
+            progress.duplicates += statuses[i] == CommandStatus::CS_Duplicate;
+            progress.credited += credited[i];
+            FixedPoint::add(progress.total, totals[i], progress.total);
+            ++progress.bucketsDone;
+            stored = storage.insertBulkCreditBucket(row.id, static_cast<sqlite3_int64>(pending[first + i]),
+                static_cast<sqlite3_int64>(credited[i]), totals[i]);
+        }
+        progress.finished = progress.bucketsDone == progress.buckets;
+        stored = stored && storage.updateBulkCredit(row.id, static_cast<sqlite3_int64>(progress.credited), progress.total, progress.finished);
+        if (!stored || !storage.execute("COMMIT;"))
+        {
+            storage.execute("ROLLBACK;");
+            std::cerr << "[ERROR] Could not record the progress of " << job.name << "\n";
+            return false;
+        }
+
+        progress.elapsedMillis = elapsed();
+        if (onProgress)
+        {
+            onProgress(progress);
+        }
+    }
+
+    progress.elapsedMillis = elapsed();
+    if (pending.empty() && onProgress)
+    {
+        onProgress(progress);
+    }
+    return progress.finished && !failed;
+}
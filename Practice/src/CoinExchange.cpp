@@ -0,0 +1,229 @@
+#include "CoinExchange.h"
+
+// Constructor for CoinExchange
+CoinExchange::CoinExchange(Ledger& ledger)
+    : ledger(ledger)
+{
+}
+
+// Destructor for CoinExchange
+CoinExchange::~CoinExchange()
+{
+    cancelAll();
+}
+
+// Opens a market
+bool CoinExchange::addMarket(const std::string& coinName, Amount tickSize, Amount minPrice, uint32_t levelCount)
+{
+    if (tickSize <= 0 || levelCount == 0 || markets.count(coinName))
+    {
+        return false;
+    }
+
+    markets[coinName].book.reset(new OrderBook(tickSize, minPrice, levelCount));
+    return true;
+}
+
+// Returns the book of a coin
+const OrderBook* CoinExchange::book(const std::string& coinName) const
+{
+    auto it = markets.find(coinName);
+    return it != markets.end() ? it->second.book.get() : nullptr;
+}
+
+// Moves funds into or out of the user's order escrow account
+CommandStatus CoinExchange::moveEscrow(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, Amount amount, bool intoEscrow,
+    CommandId commandId)
+{
+    if (amount == 0)
+    {
+        return CommandStatus::CS_Applied;
+    }
+
+    Amount signedAmount = intoEscrow ? amount : -amount;
+    return ledger.applyCommand(commandId, TransactionKind::TK_Order,
+        {
+            { userID, asset, book, -signedAmount },
+            { Ledger::orderBookAccount(userID), asset, book, signedAmount },
+        }, intoEscrow ? "reserve" : "release");
+}
+
+// Pays every fill out of escrow: USD to the seller, coins to the buyer
+void CoinExchange::settle(Market& market, const std::string& coinName, Amount& takerEscrow)
+{
+    for (const Fill& fill : fills)
+    {
+        bool takerBuys = fill.takerSide == OrderSide::OS_Buy;
+        const std::string buyer = owners.name(takerBuys ? fill.takerOwner : fill.makerOwner);
+        const std::string seller = owners.name(takerBuys ? fill.makerOwner : fill.takerOwner);
+        Amount usd = OrderBook::notional(fill.quantity, fill.price);
+
+        std::vector<Posting> postings =
+        {
+            { Ledger::orderBookAccount(seller), coinName, SQLData::DataBaseState::DBS_COINS, -fill.quantity },
+            { buyer, coinName, SQLData::DataBaseState::DBS_COINS, fill.quantity },
+        };
+        if (usd > 0) // A dust fill can be worth less than one unit of USD
+        {
+            postings.push_back({ Ledger::orderBookAccount(buyer), "USD", SQLData::DataBaseState::DBS_BALANCE, -usd });
+            postings.push_back({ seller, "USD", SQLData::DataBaseState::DBS_BALANCE, usd });
+        }
+
+        // Cannot fail: escrow always holds at least what the fills pay out (amounts are rounded down)
+        ledger.applyTransaction(TransactionKind::TK_Trade, postings, coinName + " @ " + std::to_string(FixedPoint::toDouble(fill.price)));
+
+        if (takerBuys)
+        {
+            takerEscrow -= usd;
+        }
+        else
+        {
+            // The maker is a resting bid: pay from its escrow, return the rounding rest once it is filled
+            auto it = market.bidEscrow.find(fill.makerOrder);
+            if (it != market.bidEscrow.end())
+            {
+                it->second -= usd;
+                if (fill.makerDone)
+                {
+                    moveEscrow(buyer, "USD", SQLData::DataBaseState::DBS_BALANCE, it->second, false);
+                    market.bidEscrow.erase(it);
+                }
+            }
+        }
+    }
+}
+
+// Reserves, matches, settles and rests a limit order
+OrderResult CoinExchange::placeLimit(const std::string& userID, const std::string& coinName, OrderSide side, Amount price, Amount quantity, CommandId commandId)
+{
+    auto it = markets.find(coinName);
+    if (it == markets.end() || quantity <= 0 || !it->second.book->validPrice(price))
+    {
+        return OrderResult();
+    }
+    Market& market = it->second;
+
+    Amount reserve = side == OrderSide::OS_Buy ? 0 : quantity;
+    if (side == OrderSide::OS_Buy && !FixedPoint::mul(quantity, price, reserve))
+    {
+        return OrderResult();
+    }
+
+    CommandStatus reserved = side == OrderSide::OS_Buy
+        ? moveEscrow(userID, "USD", SQLData::DataBaseState::DBS_BALANCE, reserve, true, commandId)
+        : moveEscrow(userID, coinName, SQLData::DataBaseState::DBS_COINS, reserve, true, commandId);
+    if (reserved != CommandStatus::CS_Applied)
+    {
+        OrderResult result; // Not enough funds, or a retry of an order already placed
+        result.duplicate = reserved == CommandStatus::CS_Duplicate;
+        return result;
+    }
+
+    fills.clear();
+    OrderResult result = market.book->submitLimit(owners.intern(userID), side, price, quantity, fills);
+    Amount takerEscrow = reserve;
+    settle(market, coinName, takerEscrow);
+
+    if (side == OrderSide::OS_Buy)
+    {
+        if (result.resting > 0)
+        {
+            market.bidEscrow[result.orderId] = takerEscrow; // Still covers the resting quantity at the limit price
+        }
+        else
+        {
+            moveEscrow(userID, "USD", SQLData::DataBaseState::DBS_BALANCE, takerEscrow, false); // Price improvement and rounding
+        }
+    }
+    return result;
+}
+
+// Reserves the quoted amount and matches a market order
+OrderResult CoinExchange::placeMarket(const std::string& userID, const std::string& coinName, OrderSide side, Amount quantity, CommandId commandId)
+{
+    auto it = markets.find(coinName);
+    if (it == markets.end() || quantity <= 0)
+    {
+        return OrderResult();
+    }
+    Market& market = it->second;
+
+    Amount usd = 0;
+    Amount fillable = market.book->quote(side, quantity, usd);
+    if (fillable == 0)
+    {
+        return OrderResult();
+    }
+
+    // Only what can match is reserved: USD for a buy (the quote is an upper bound), coins for a sell
+    CommandStatus reserved = side == OrderSide::OS_Buy
+        ? moveEscrow(userID, "USD", SQLData::DataBaseState::DBS_BALANCE, usd, true, commandId)
+        : moveEscrow(userID, coinName, SQLData::DataBaseState::DBS_COINS, fillable, true, commandId);
+    if (reserved != CommandStatus::CS_Applied)
+    {
+        OrderResult result;
+        result.duplicate = reserved == CommandStatus::CS_Duplicate;
+        return result;
+    }
+
+    fills.clear();
+    OrderResult result = market.book->submitMarket(owners.intern(userID), side, fillable, fills);
+    Amount takerEscrow = side == OrderSide::OS_Buy ? usd : 0;
+    settle(market, coinName, takerEscrow);
+
+    if (side == OrderSide::OS_Buy)
+    {
+        moveEscrow(userID, "USD", SQLData::DataBaseState::DBS_BALANCE, takerEscrow, false);
+    }
+    return result;
+}
+
+// Cancels a resting order and returns its escrow
+bool CoinExchange::cancel(const std::string& userID, const std::string& coinName, uint64_t orderId)
+{
+    auto it = markets.find(coinName);
+    if (it == markets.end())
+    {
+        return false;
+    }
+    Market& market = it->second;
+
+    // Only the owner may cancel
+    uint32_t owner = owners.find(userID);
+    CanceledOrder canceled;
+    if (owner == IdRegistry::invalidId || !market.book->cancel(orderId, owner, canceled))
+    {
+        return false;
+    }
+
+    return refund(market, coinName, orderId, canceled);
+}
+
+// Returns USD (bids) or coins (asks) from escrow to the owner
+bool CoinExchange::refund(Market& market, const std::string& coinName, uint64_t orderId, const CanceledOrder& canceled)
+{
+    const std::string userID = owners.name(canceled.owner);
+    if (canceled.side == OrderSide::OS_Buy)
+    {
+        auto escrow = market.bidEscrow.find(orderId);
+        Amount amount = escrow != market.bidEscrow.end() ? escrow->second : 0;
+        market.bidEscrow.erase(orderId);
+        return moveEscrow(userID, "USD", SQLData::DataBaseState::DBS_BALANCE, amount, false) == CommandStatus::CS_Applied;
+    }
+    return moveEscrow(userID, coinName, SQLData::DataBaseState::DBS_COINS, canceled.remaining, false) == CommandStatus::CS_Applied;
+}
+
+// Cancels everything in every book
+void CoinExchange::cancelAll()
+{
+    std::vector<std::pair<uint64_t, CanceledOrder>> canceled;
+    for (auto& market : markets)
+    {
+        canceled.clear();
+        market.second.book->cancelAll(canceled);
+        for (const auto& order : canceled)
+        {
+            refund(market.second, market.first, order.first, order.second);
+        }
+    }
+}
@@ -0,0 +1,246 @@
+#include "CommandWindow.h"
+#include <algorithm>
+#include <random>
+
+// Slots of a shard's table before the first growth
+static const size_t initialSlots = 1024;
+
+// Constructor for CommandWindow
+CommandWindow::CommandWindow(int64_t ttl, size_t slices)
+    : ttlMillis(std::max<int64_t>(1, ttl)), sliceMillis(1), ringSize(1)
+{
+    slices = std::max<size_t>(1, slices);
+    sliceMillis = std::max<int64_t>(1, (ttlMillis + static_cast<int64_t>(slices) - 1) / static_cast<int64_t>(slices));
+    ringSize = slices + 1;
+    for (auto& shard : shards)
+    {
+        shard.slots.assign(initialSlots, 0);
+        shard.wheel.resize(ringSize);
+    }
+}
+
+// splitmix64 finalizer
+uint64_t CommandWindow::hashOf(CommandId id)
+{
+    uint64_t x = id;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Linear probing until the ID or an empty slot
+bool CommandWindow::find(const Shard& shard, CommandId id, uint64_t hash)
+{
+    size_t mask = shard.slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (shard.slots[i] == id)
+        {
+            return true;
+        }
+        if (shard.slots[i] == 0)
+        {
+            return false;
+        }
+    }
+}
+
+// Puts an ID in the first empty slot of its probe sequence, growing at 3/4 load
+void CommandWindow::insert(Shard& shard, CommandId id, uint64_t hash)
+{
+    if ((shard.count + 1) * 4 > shard.slots.size() * 3)
+    {
+        grow(shard);
+    }
+    size_t mask = shard.slots.size() - 1;
+    size_t i = hash & mask;
+    while (shard.slots[i] != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    shard.slots[i] = id;
+    ++shard.count;
+}
+
+// Backward-shift deletion: the following entries of the cluster move up, so no tombstones are needed
+void CommandWindow::erase(Shard& shard, CommandId id, uint64_t hash)
+{
+    size_t mask = shard.slots.size() - 1;
+    size_t hole = hash & mask;
+    while (shard.slots[hole] != id)
+    {
+        if (shard.slots[hole] == 0)
+        {
+            return;
+        }
+        hole = (hole + 1) & mask;
+    }
+
+    for (size_t next = (hole + 1) & mask; shard.slots[next] != 0; next = (next + 1) & mask)
+    {
+        // An entry may fill the hole only if its home slot is not between the hole and itself
+        size_t home = hashOf(shard.slots[next]) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            shard.slots[hole] = shard.slots[next];
+            hole = next;
+        }
+    }
+    shard.slots[hole] = 0;
+    --shard.count;
+}
+
+// Doubles the table and reinserts every ID
+void CommandWindow::grow(Shard& shard)
+{
+    std::vector<CommandId> old(shard.slots.size() * 2, 0);
+    old.swap(shard.slots);
+    size_t mask = shard.slots.size() - 1;
+    for (CommandId id : old)
+    {
+        if (id != 0)
+        {
+            size_t i = hashOf(id) & mask;
+            while (shard.slots[i] != 0)
+            {
+                i = (i + 1) & mask;
+            }
+            shard.slots[i] = id;
+        }
+    }
+}
+
+// Each step reuses the slot of the slice ringSize slices back, whose IDs are now older than the TTL
+void CommandWindow::advance(Shard& shard, int64_t nowMillis)
+{
+    int64_t now = nowMillis / sliceMillis;
+    if (shard.newestSlice == INT64_MIN || now <= shard.newestSlice)
+    {
+        shard.newestSlice = std::max(shard.newestSlice, now);
+        return;
+    }
+
+    // After a long pause every slice is expired: one pass over the ring is enough
+    int64_t steps = std::min<int64_t>(now - shard.newestSlice, static_cast<int64_t>(ringSize));
+    for (int64_t slice = now - steps + 1; slice <= now; ++slice)
+    {
+        auto& expired = shard.wheel[static_cast<size_t>(slice % static_cast<int64_t>(ringSize))];
+        for (CommandId id : expired)
+        {
+            erase(shard, id, hashOf(id));
+        }
+        std::vector<CommandId>().swap(expired); // Frees the slice (a burst would otherwise stay allocated for the whole TTL)
+    }
+    shard.newestSlice = now;
+
+    // Shrink a table left mostly empty by a burst that expired
+    if (shard.slots.size() > initialSlots && shard.count * 8 < shard.slots.size())
+    {
+        std::vector<CommandId> ids;
+        ids.reserve(shard.count);
+        for (CommandId id : shard.slots)
+        {
+            if (id != 0)
+            {
+                ids.push_back(id);
+            }
+        }
+        size_t slots = initialSlots;
+        while (ids.size() * 2 > slots)
+        {
+            slots *= 2;
+        }
+        std::vector<CommandId>(slots, 0).swap(shard.slots);
+        shard.count = 0;
+        for (CommandId id : ids)
+        {
+            insert(shard, id, hashOf(id));
+        }
+    }
+}
+
+// Files the ID under the slice it was recorded in
+void CommandWindow::recordLocked(Shard& shard, CommandId id, uint64_t hash, int64_t recordedAt)
+{
+    int64_t slice = recordedAt / sliceMillis;
+    if (slice <= shard.newestSlice - static_cast<int64_t>(ringSize))
+    {
+        return; // Its slice was already expired
+    }
+    insert(shard, id, hash);
+    shard.wheel[static_cast<size_t>(slice % static_cast<int64_t>(ringSize))].push_back(id);
+}
+
+// Lookup without applying anything
+bool CommandWindow::contains(CommandId id, int64_t nowMillis)
+{
+    if (id == 0)
+    {
+        return false;
+    }
+    uint64_t hash = hashOf(id);
+    Shard& shard = shardOf(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    advance(shard, nowMillis);
+    return find(shard, id, hash);
+}
+
+// Records a persisted ID (the clock moves to its time if it is newer)
+bool CommandWindow::record(CommandId id, int64_t recordedAt)
+{
+    if (id == 0)
+    {
+        return false;
+    }
+    uint64_t hash = hashOf(id);
+    Shard& shard = shardOf(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    advance(shard, recordedAt);
+    if (find(shard, id, hash))
+    {
+        return false;
+    }
+    size_t before = shard.count;
+    recordLocked(shard, id, hash, recordedAt);
+    return shard.count != before;
+}
+
+// Sums the shards
+size_t CommandWindow::size()
+{
+    size_t total = 0;
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.count;
+    }
+    return total;
+}
+
+// Capacity of the tables and the wheel slices (what the allocator holds, not just what is used)
+size_t CommandWindow::memoryBytes()
+{
+    size_t total = 0;
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.slots.capacity() * sizeof(CommandId) + shard.wheel.capacity() * sizeof(shard.wheel[0]);
+        for (const auto& slice : shard.wheel)
+        {
+            total += slice.capacity() * sizeof(CommandId);
+        }
+    }
+    return total;
+}
+
+// 64 random bits from a per-thread generator
+CommandId CommandWindow::newId()
+{
+    thread_local std::mt19937_64 generator(std::random_device{}() ^ (static_cast<uint64_t>(std::random_device{}()) << 32));
+    CommandId id;
+    do
+    {
+        id = generator();
+    } while (id == 0);
+    return id;
+}
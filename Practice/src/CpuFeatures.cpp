@@ -0,0 +1,63 @@
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Runs CPUID for a leaf and subleaf
+static void cpuid(int leaf, int subleaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, leaf, subleaf);
+    for (int i = 0; i < 4; ++i)
+    {
+        registers[i] = static_cast<unsigned int>(values[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Reads XCR0 (which register states the OS saves on a context switch)
+static unsigned long long readXcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int low, high;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+}
+#endif
+
+// Detects the features on first use
+const CpuFeatures& CpuFeatures::get()
+{
+    static const CpuFeatures features = []()
+        {
+            CpuFeatures detected;
+#if defined(_M_X64) || defined(__x86_64__)
+            unsigned int leaf0[4], leaf1[4], leaf7[4] = {};
+            cpuid(0, 0, leaf0);
+            cpuid(1, 0, leaf1);
+            if (leaf0[0] >= 7)
+            {
+                cpuid(7, 0, leaf7);
+            }
+
+            bool osSavesYmm = (leaf1[2] & (1u << 27)) && (readXcr0() & 6) == 6; // OSXSAVE, then XMM and YMM state
+            detected.sse41 = (leaf1[2] & (1u << 19)) != 0;
+            detected.fma = osSavesYmm && (leaf1[2] & (1u << 12)) != 0;
+            detected.avx2 = osSavesYmm && (leaf1[2] & (1u << 28)) && (leaf7[1] & (1u << 5)) != 0;
+            detected.sha = detected.sse41 && (leaf7[1] & (1u << 29)) != 0;
+#endif
+            return detected;
+        }();
+    return features;
+}
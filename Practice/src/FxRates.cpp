@@ -0,0 +1,136 @@
+#include "FxRates.h"
+#include "GatherKernels.h"
+#include <algorithm>
+
+// Finds a currency id in the table
+CurrencyId FxTable::find(const std::string& moneyName) const
+{
+    auto it = index.find(moneyName);
+    return it != index.end() ? it->second : -1;
+}
+
+// Constructor for FxRates
+FxRates::FxRates()
+{
+    auto table = std::make_unique<FxTable>();
+    table->names.push_back("USD");
+    table->index["USD"] = 0;
+    table->usdRates.push_back(1.0);  // USD is the base currency
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    publishLocked(std::move(table));
+}
+
+// Triangulates every pair through USD: units of to per unit of from = usd(from) / usd(to)
+void FxRates::publishLocked(std::unique_ptr<FxTable> table)
+{
+    size_t count = table->size();
+    table->matrix.assign(count * count, 0.0);
+    for (size_t to = 0; to < count; ++to)
+    {
+        double toRate = table->usdRates[to];
+        if (toRate <= 0.0)
+        {
+            continue;
+        }
+        for (size_t from = 0; from < count; ++from)
+        {
+            table->matrix[to * count + from] = table->usdRates[from] / toRate;
+        }
+    }
+
+    std::shared_ptr<const FxTable> previous = current.load(std::memory_order_relaxed);
+    table->version = previous ? previous->version + 1 : 1;
+    current.store(std::move(table), std::memory_order_release); // previous is freed once no reader holds it
+}
+
+// Registers a currency without a rate
+CurrencyId FxRates::intern(const std::string& moneyName)
+{
+    CurrencyId id = table()->find(moneyName);
+    if (id >= 0)
+    {
+        return id;
+    }
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    std::shared_ptr<const FxTable> latest = current.load(std::memory_order_relaxed);
+    const FxTable& published = *latest;
+    id = published.find(moneyName);
+    if (id >= 0)
+    {
+        return id; // Registered by another writer meanwhile
+    }
+
+    auto table = std::make_unique<FxTable>(published);
+    id = static_cast<CurrencyId>(table->size());
+    table->names.push_back(moneyName);
+    table->index[moneyName] = id;
+    table->usdRates.push_back(0.0);
+    publishLocked(std::move(table));
+    return id;
+}
+
+// Sets one rate
+void FxRates::setUsdRate(const std::string& moneyName, double rate)
+{
+    setUsdRates({ { moneyName, rate } });
+}
+
+// Copies the published table, changes the rates and publishes the copy
+void FxRates::setUsdRates(const std::vector<std::pair<std::string, double>>& rates)
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    auto table = std::make_unique<FxTable>(*current.load(std::memory_order_relaxed));
+    for (const auto& rate : rates)
+    {
+        auto inserted = table->index.emplace(rate.first, static_cast<CurrencyId>(table->size()));
+        if (inserted.second)
+        {
+            table->names.push_back(rate.first);
+            table->usdRates.push_back(0.0);
+        }
+        table->usdRates[inserted.first->second] = rate.second;
+    }
+    publishLocked(std::move(table));
+}
+
+// Looks both currencies up in one table
+bool FxRates::convert(double amount, const std::string& from, const std::string& to, double& result) const
+{
+    std::shared_ptr<const FxTable> published = table();
+    const FxTable& rates = *published;
+    CurrencyId fromId = rates.find(from);
+    CurrencyId toId = rates.find(to);
+    if (fromId < 0 || toId < 0 || rates.usdRates[fromId] <= 0.0 || rates.usdRates[toId] <= 0.0)
+    {
+        return false;
+    }
+
+    result = amount * rates.rate(fromId, toId);
+    return true;
+}
+
+// A gather from the column of the target currency and a multiply per amount
+void FxRates::convertBatch(const FxTable& table, const CurrencyId* from, const double* amounts, size_t count, CurrencyId to, double* out, bool allowSimd)
+{
+    gatherMultiply(from, amounts, table.ratesInto(to), out, count, allowSimd);
+}
+
+// Converts in blocks that stay in L1 and sums them
+double FxRates::total(const FxTable& table, const CurrencyId* from, const double* amounts, size_t count, CurrencyId to, bool allowSimd)
+{
+    const size_t blockSize = 1024;
+    double block[blockSize];
+    double sum = 0.0;
+    for (size_t first = 0; first < count; first += blockSize)
+    {
+        size_t length = std::min(blockSize, count - first);
+        gatherMultiply(from + first, amounts + first, table.ratesInto(to), block, length, allowSimd);
+        for (size_t i = 0; i < length; ++i)
+        {
+            sum += block[i];
+        }
+    }
+    return sum;
+}
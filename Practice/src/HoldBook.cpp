@@ -0,0 +1,124 @@
+#include "HoldBook.h"
+
+// Constructor for HoldBook
+HoldBook::HoldBook(int64_t tickMillis, int64_t nowMillis)
+    : wheel(tickMillis, nowMillis), openCount(0)
+{
+}
+
+// The index must exist, be open and still carry the ID's generation
+HoldBook::Entry* HoldBook::entryOf(HoldId id)
+{
+    uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+    if (index >= entries.size())
+    {
+        return nullptr;
+    }
+    Entry& entry = entries[index];
+    return entry.open && entry.generation == static_cast<uint32_t>(id >> 32) ? &entry : nullptr;
+}
+
+// Copies the entry out with its names
+void HoldBook::toHold(const Entry& entry, Hold& hold) const
+{
+    hold.userID = names.name(entry.user);
+    hold.asset = names.name(entry.asset);
+    hold.book = entry.book;
+    hold.amount = entry.amount;
+    hold.expiresAtMillis = entry.expiresAt;
+}
+
+// Reuses a settled entry if there is one and files the expiry
+HoldId HoldBook::add(const Hold& hold)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t index;
+    if (!freeEntries.empty())
+    {
+        index = freeEntries.back();
+        freeEntries.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(entries.size());
+        entries.emplace_back();
+        entries.back().generation = 1;
+    }
+
+    Entry& entry = entries[index];
+    entry.expiresAt = hold.expiresAtMillis;
+    entry.amount = hold.amount;
+    entry.user = names.intern(hold.userID);
+    entry.asset = names.intern(hold.asset);
+    entry.book = hold.book;
+    entry.open = true;
+    entry.timer = wheel.add(entry.expiresAt, index);
+    ++openCount;
+    return (static_cast<uint64_t>(entry.generation) << 32) | index;
+}
+
+// Cancelling the timer is what makes the claim exclusive
+bool HoldBook::claim(HoldId id, Hold& hold)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = entryOf(id);
+    if (!entry || entry->timer == TimerWheel::none)
+    {
+        return false;
+    }
+    wheel.cancel(entry->timer);
+    entry->timer = TimerWheel::none;
+    toHold(*entry, hold);
+    return true;
+}
+
+// Frees the entry for good, or files its expiry again (at once if it is already due)
+void HoldBook::settle(HoldId id, bool done)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = entryOf(id);
+    if (!entry || entry->timer != TimerWheel::none)
+    {
+        return;
+    }
+    uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+    if (!done)
+    {
+        entry->timer = wheel.add(entry->expiresAt, index);
+        return;
+    }
+    entry->open = false;
+    entry->generation = entry->generation == 0xFFFFFFFFu ? 1 : entry->generation + 1;
+    freeEntries.push_back(index);
+    --openCount;
+}
+
+// The wheel hands out each expired hold once; it stays open until it is settled
+size_t HoldBook::claimExpired(int64_t nowMillis, std::vector<std::pair<HoldId, Hold>>& expired)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    dueScratch.clear();
+    wheel.advance(nowMillis, dueScratch);
+    for (uint64_t index : dueScratch)
+    {
+        Entry& entry = entries[static_cast<size_t>(index)];
+        entry.timer = TimerWheel::none;
+        expired.emplace_back((static_cast<uint64_t>(entry.generation) << 32) | index, Hold());
+        toHold(entry, expired.back().second);
+    }
+    return dueScratch.size();
+}
+
+// Returns the number of open holds
+size_t HoldBook::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return openCount;
+}
+
+// Returns the heap memory of the entries and the wheel
+size_t HoldBook::memoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.capacity() * sizeof(Entry) + freeEntries.capacity() * sizeof(uint32_t) + wheel.memoryBytes();
+}
@@ -0,0 +1,187 @@
+#include "InterestAccrual.h"
+#include "AccrualKernels.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+// Returns the milliseconds since start
+static double millisSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ID of the chunk of a run that starts after row lastID (a retry of the chunk is found as a duplicate)
+static CommandId commandIdOf(sqlite3_int64 accrualID, sqlite3_int64 lastID)
+{
+    uint64_t x = static_cast<uint64_t>(accrualID) * 0x9e3779b97f4a7c15ULL ^ (static_cast<uint64_t>(lastID) + 0x3c6ef372fe94f82bULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+// Constructor for InterestAccrual
+InterestAccrual::InterestAccrual(Ledger& ledger, SQLData& sqlData, bool allowSimd)
+    : ledger(ledger), sqlData(sqlData), allowSimd(allowSimd)
+{
+}
+
+// annualRate / periodsPerYear in billionths: annualRate * 10^9 / (SCALE * periodsPerYear), rounded down
+bool InterestAccrual::periodRate(Amount annualRate, uint32_t periodsPerYear, uint32_t& rate)
+{
+    int64_t perPeriod = 0;
+    if (periodsPerYear == 0 || !FixedPoint::mulDivFloor(annualRate, accrualRateScale, FixedPoint::SCALE * periodsPerYear, perPeriod) ||
+        perPeriod > accrualRateScale)
+    {
+        return false;
+    }
+    rate = static_cast<uint32_t>(perPeriod);
+    return true;
+}
+
+// Creates or resumes the run, then reads, computes and pays one chunk per ledger transaction
+bool InterestAccrual::run(const AccrualJob& job, AccrualReport& report)
+{
+    report = AccrualReport();
+    report.kernel = accrueInterestKernel(allowSimd);
+    auto start = std::chrono::steady_clock::now();
+
+    if (job.name.empty() || job.asset.empty() || job.minimumBalance < 1 || !Ledger::isSystemAccount(job.funding) ||
+        (job.book != SQLData::DataBaseState::DBS_COINS && job.book != SQLData::DataBaseState::DBS_BALANCE))
+    {
+        std::cerr << "[ERROR] Invalid accrual job " << job.name << " (the funding account must be a system account)\n";
+        return false;
+    }
+    if (!periodRate(job.annualRate, job.periodsPerYear, report.periodRate))
+    {
+        std::cerr << "[ERROR] Invalid accrual rate for " << job.name << "\n";
+        return false;
+    }
+    if (!sqlData.createTable(SQLData::DataBaseState::DBS_ACCRUALS))
+    {
+        return false;
+    }
+
+    SQLData::AccrualRow row;
+    auto createdAt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (sqlData.findAccrual(job.name, row))
+    {
+        if (row.asset != job.asset || row.book != job.book || row.rate != report.periodRate || row.funding != job.funding)
+        {
+            std::cerr << "[ERROR] Accrual " << job.name << " already exists with other terms\n";
+            return false;
+        }
+    }
+    else
+    {
+        // Rows added after the run starts (new holders) are not part of it
+        row.name = job.name;
+        row.asset = job.asset;
+        row.book = job.book;
+        row.rate = report.periodRate;
+        row.funding = job.funding;
+        row.endID = sqlData.maxID(job.book == SQLData::DataBaseState::DBS_COINS ? "COINS" : "BALANCE");
+        row.id = sqlData.insertAccrual(row, createdAt);
+        if (row.id == 0)
+        {
+            return false;
+        }
+    }
+
+    // Columns of a chunk, reused for every chunk
+    std::vector<sqlite3_int64> rowIDs;
+    std::vector<char> names;
+    std::vector<Amount> balances, accruals;
+    std::vector<Posting> postings;
+    const std::string memo = job.name;
+
+    while (!row.finished)
+    {
+        // The balance tables must hold every transaction the ledger applied before the chunk is read
+        auto phase = std::chrono::steady_clock::now();
+        if (!ledger.flush())
+        {
+            std::cerr << "[ERROR] Accrual " << job.name << " stopped: the ledger's journal can no longer be written\n";
+            return false;
+        }
+        bool ok = sqlData.readBalanceColumns(job.book, job.asset, job.minimumBalance, row.lastID, row.endID, chunkRows, rowIDs, names, balances);
+        report.readMillis += millisSince(phase);
+
+        phase = std::chrono::steady_clock::now();
+        uint64_t remainders = 0;
+        accruals.resize(balances.size());
+        accrueInterest(balances.data(), report.periodRate, accruals.data(), balances.size(), remainders, allowSimd);
+        report.computeMillis += millisSince(phase);
+
+        // One posting per credited row, then the funding account's debit
+        phase = std::chrono::steady_clock::now();
+        postings.clear();
+        Amount chunkTotal = 0;
+        const char* name = names.data();
+        for (size_t i = 0; ok && i < rowIDs.size(); name += std::strlen(name) + 1, ++i)
+        {
+            if (accruals[i] == 0)
+            {
+                continue;
+            }
+            ok = FixedPoint::add(chunkTotal, accruals[i], chunkTotal);
+            postings.push_back({ name, job.asset, job.book, accruals[i] });
+        }
+
+        SQLData::AccrualRow next = row;
+        next.lastID = rowIDs.empty() ? row.endID : rowIDs.back();
+        next.accounts += static_cast<sqlite3_int64>(rowIDs.size());
+        next.credited += static_cast<sqlite3_int64>(postings.size());
+        next.total += chunkTotal;
+        next.residue += static_cast<sqlite3_int64>(remainders);
+        next.finished = rowIDs.size() < static_cast<size_t>(chunkRows);
+
+        if (ok && !postings.empty())
+        {
+            // The progress is written by the transaction that stores the credits; a duplicate chunk was paid (and recorded) before
+            postings.push_back({ job.funding, job.asset, job.book, -chunkTotal });
+            CommandStatus status = ledger.applyCommand(commandIdOf(row.id, row.lastID), TransactionKind::TK_Credit, postings, memo,
+                [next](SQLData& storage, sqlite3_int64) { return storage.updateAccrual(next); });
+            ok = status == CommandStatus::CS_Applied || (status == CommandStatus::CS_Duplicate && sqlData.updateAccrual(next));
+        }
+        else if (ok)
+        {
+            ok = sqlData.updateAccrual(next); // Nothing to pay in this chunk
+        }
+        if (!ok)
+        {
+            std::cerr << "[ERROR] Accrual " << job.name << " stopped after row " << row.lastID << "\n";
+            return false;
+        }
+        report.writeMillis += millisSince(phase);
+        row = next;
+        report.processed += rowIDs.size();
+        ++report.chunks;
+    }
+    if (!ledger.flush())
+    {
+        std::cerr << "[ERROR] Accrual " << job.name << " was paid in memory but not written to the database\n";
+        return false;
+    }
+
+    report.accounts = static_cast<uint64_t>(row.accounts);
+    report.credited = static_cast<uint64_t>(row.credited);
+    report.total = row.total;
+    report.residue = static_cast<uint64_t>(row.residue);
+    report.finished = true;
+    report.millis = millisSince(start);
+    return true;
+}
+
+// Prints the report
+void InterestAccrual::print(const AccrualReport& report)
+{
+    double seconds = report.millis / 1000.0;
+    std::cout << "Accrued " << report.accounts << " balances (" << report.credited << " credited) at " << report.periodRate
+        << " billionths per period, " << report.kernel << " kernel\n" << std::fixed << std::setprecision(8)
+        << "  paid " << FixedPoint::toDouble(report.total) << ", rounding residue " << static_cast<double>(report.residue) / accrualRateScale
+        << " units (" << static_cast<double>(report.residue) / accrualRateScale / FixedPoint::SCALE << ")\n" << std::setprecision(0)
+        << "  " << report.chunks << " chunks in " << report.millis << " ms, " << (seconds > 0.0 ? report.processed / seconds : 0.0)
+        << " accounts/s\n" << std::setprecision(1) << "  read " << report.readMillis << " ms, compute " << report.computeMillis
+        << " ms, write " << report.writeMillis << " ms\n" << std::defaultfloat;
+}
@@ -0,0 +1,192 @@
+#include "JournalPersister.h"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace
+{
+    const int maxAttempts = 10;             // Attempts per batch before the persister gives up
+    const int firstDelayMillis = 50;        // Delay after the first failure, doubled after each one
+    const int maxDelayMillis = 5000;        // Longest delay between two attempts
+}
+
+// Constructor for JournalPersister
+JournalPersister::JournalPersister()
+    : audit(nullptr), writing(false), running(false), failed(false), enqueued(0), persisted(0), batches(0), retries(0), maxBatch(0)
+{
+}
+
+// Destructor for JournalPersister
+JournalPersister::~JournalPersister()
+{
+    stop();
+}
+
+// Opens the worker's connection and starts the thread
+bool JournalPersister::start(const std::string& dbName, const char* vfsName, LedgerAudit* chainAudit)
+{
+    if (worker.joinable())
+    {
+        return true;
+    }
+
+    if (!storage.open(dbName, vfsName))
+    {
+        std::cerr << "[ERROR] Journal persister could not open " << dbName << "\n";
+        return false;
+    }
+
+    audit = chainAudit;
+    running = true;
+    worker = std::thread(&JournalPersister::run, this);
+    return true;
+}
+
+// Queues a transaction and wakes the worker
+void JournalPersister::enqueue(SQLData::JournalEntry&& entry)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(entry));
+    }
+    enqueued.fetch_add(1, std::memory_order_relaxed);
+    wakeWorker.notify_one();
+}
+
+// Blocks until the queue is empty and no batch is being written, or the worker has given up
+bool JournalPersister::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this]() { return (pending.empty() && !writing) || !running || failed.load(); });
+    return !failed.load();
+}
+
+// Drains the queue, stops the worker and closes the connection
+bool JournalPersister::stop()
+{
+    if (!worker.joinable())
+    {
+        return !failed.load();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+    storage.close();
+
+    if (failed.load())
+    {
+        std::cerr << "[ERROR] Journal persister stopped with " << pending.size() << " transactions not written to the database\n";
+        return false;
+    }
+    return true;
+}
+
+// Worker loop
+void JournalPersister::run()
+{
+    std::vector<SQLData::JournalEntry> batch;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorker.wait(lock, [this]() { return !pending.empty() || !running; });
+            if (pending.empty())
+            {
+                break; // Stopped and nothing left to write
+            }
+            batch.swap(pending);
+            writing = true;
+        }
+
+        // The chain link is written inside the batch's transaction, so a batch is never committed without it
+        bool staged = false;
+        auto writeChainLink = [this, &batch, &staged](const std::vector<sqlite3_int64>& txIDs)
+            {
+                staged = true;
+                return audit->stage(storage, batch, txIDs);
+            };
+
+        // Retry with a growing delay (the transactions are already visible in memory, dropping them would lose data);
+        // the log only gets the 1st, 2nd, 4th, 8th... failure
+        bool written = false;
+        int delayMillis = firstDelayMillis;
+        for (int attempt = 1; ; ++attempt)
+        {
+            staged = false;
+            written = storage.persistJournalBatch(batch, audit ? std::function<bool(const std::vector<sqlite3_int64>&)>(writeChainLink) : nullptr);
+            if (written)
+            {
+                break;
+            }
+            if (staged)
+            {
+                audit->rollbackStaged(); // Only this writer's own staging (the chain may be shared with the pipeline)
+            }
+            if (attempt == maxAttempts)
+            {
+                std::cerr << "[ERROR] Journal batch of " << batch.size() << " transactions failed " << attempt
+                    << " times, the journal is no longer written\n";
+                break;
+            }
+            retries.fetch_add(1, std::memory_order_relaxed);
+            if ((attempt & (attempt - 1)) == 0)
+            {
+                std::cerr << "[ERROR] Journal batch of " << batch.size() << " transactions failed (attempt " << attempt
+                    << "), retrying in " << delayMillis << " ms\n";
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMillis));
+            delayMillis = std::min(delayMillis * 2, maxDelayMillis);
+        }
+
+        if (!written)
+        {
+            // Give up for good: the batch goes back in front of the queue so nothing is reordered or silently dropped
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.insert(pending.begin(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+                writing = false;
+                failed.store(true, std::memory_order_release);
+            }
+            batch.clear();
+            break;
+        }
+
+        if (staged)
+        {
+            audit->commitStaged();
+        }
+        persisted.fetch_add(batch.size(), std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        if (batch.size() > maxBatch.load(std::memory_order_relaxed))
+        {
+            maxBatch.store(batch.size(), std::memory_order_relaxed);
+        }
+        batch.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing = false;
+        }
+        drained.notify_all();
+    }
+
+    drained.notify_all();
+}
+
+// Returns a copy of the counters
+PersisterStats JournalPersister::stats() const
+{
+    PersisterStats result;
+    result.enqueued = enqueued.load(std::memory_order_relaxed);
+    result.persisted = persisted.load(std::memory_order_relaxed);
+    result.batches = batches.load(std::memory_order_relaxed);
+    result.retries = retries.load(std::memory_order_relaxed);
+    result.maxBatch = maxBatch.load(std::memory_order_relaxed);
+    result.failed = failed.load(std::memory_order_acquire);
+    return result;
+}
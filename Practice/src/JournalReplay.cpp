@@ -0,0 +1,225 @@
+#include "JournalReplay.h"
+#include "BalanceEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+// One posting of a partition in interned form
+struct ReplayEvent
+{
+    uint32_t account;  // Dense account index
+    uint32_t asset;    // Dense asset index
+    Amount amount;     // Signed change
+};
+
+// Returns the milliseconds since start
+static double millisSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Constructor for JournalReplay
+JournalReplay::JournalReplay(unsigned threads)
+    : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+// Sorts the rows by (account, asset) and hashes them
+Digest JournalReplay::stateHash(std::vector<StateRow>& rows)
+{
+    std::sort(rows.begin(), rows.end(), [](const StateRow& a, const StateRow& b)
+        {
+            return a.account != b.account ? a.account < b.account : a.asset < b.asset;
+        });
+
+    Sha256 sha;
+    for (const auto& row : rows)
+    {
+        sha.updateString(row.account);
+        sha.updateString(row.asset);
+        sha.updateInt64(row.amount);
+    }
+    return sha.finish();
+}
+
+// Reads, partitions, applies in parallel, hashes and compares
+bool JournalReplay::run(SQLData& sqlData, ReplayReport& report)
+{
+    report = ReplayReport();
+    report.threads = threadCount;
+
+    // 1. Read the journal once, in order, and split it by account
+    auto start = std::chrono::steady_clock::now();
+    std::unordered_map<std::string, uint32_t> accountIds, assetIds;
+    std::vector<std::string> accountNames, assetNames;
+    std::vector<std::vector<ReplayEvent>> partitions(threadCount);
+    sqlite3_int64 lastTx = -1;
+
+    auto intern = [](std::unordered_map<std::string, uint32_t>& ids, std::vector<std::string>& names, const char* name)
+        {
+            auto it = ids.find(name);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            uint32_t id = static_cast<uint32_t>(names.size());
+            names.emplace_back(name);
+            ids.emplace(names.back(), id);
+            return id;
+        };
+
+    bool ok = sqlData.forEachPosting([&](sqlite3_int64 txID, const char* userID, const char* asset, SQLData::DataBaseState, Amount amount)
+        {
+            uint32_t account = intern(accountIds, accountNames, userID);
+            partitions[account % threadCount].push_back({ account, intern(assetIds, assetNames, asset), amount });
+            ++report.postings;
+            if (txID != lastTx)
+            {
+                ++report.transactions;
+                lastTx = txID;
+            }
+        });
+    report.readMillis = millisSince(start);
+    if (!ok)
+    {
+        return false;
+    }
+
+    // 2. Apply every partition on its own thread (an account lives in exactly one partition)
+    start = std::chrono::steady_clock::now();
+    std::vector<BalanceTable> tables(threadCount);
+    std::vector<uint64_t> negatives(threadCount, 0);
+    std::vector<std::thread> workers;
+    for (unsigned part = 0; part < threadCount; ++part)
+    {
+        workers.emplace_back([&, part]()
+            {
+                BalanceTable& table = tables[part];
+                table.reserve(partitions[part].size() / 4 + 1);
+                for (const auto& event : partitions[part])
+                {
+                    table.reserve(1);
+                    Amount* balance = table.findOrInsert(BalanceTable::makeKey(event.account, event.asset));
+                    *balance += event.amount;
+                    if (*balance < 0 && accountNames[event.account][0] != '@')
+                    {
+                        ++negatives[part];
+                    }
+                }
+            });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    report.applyMillis = millisSince(start);
+
+    // 3. Canonical state of both sides (user accounts, non-zero balances) and their hashes
+    start = std::chrono::steady_clock::now();
+    std::vector<StateRow> rebuilt;
+    for (unsigned part = 0; part < threadCount; ++part)
+    {
+        report.negativeEvents += negatives[part];
+        tables[part].forEach([&](uint64_t key, Amount amount)
+            {
+                const std::string& account = accountNames[key >> 32];
+                if (amount != 0 && account[0] != '@')
+                {
+                    rebuilt.push_back({ account, assetNames[key & 0xFFFFFFFFu], amount });
+                }
+            });
+    }
+    report.balances = rebuilt.size();
+    report.stateHash = stateHash(rebuilt);
+
+    std::map<std::pair<std::string, std::string>, Amount> liveSums;
+    sqlData.forEachBalance([&](const std::string& userID, const std::string& asset, SQLData::DataBaseState, Amount amount)
+        {
+            if (!userID.empty() && userID[0] != '@')
+            {
+                liveSums[{ userID, asset }] += amount;
+            }
+        });
+    std::vector<StateRow> live;
+    for (const auto& sum : liveSums)
+    {
+        if (sum.second != 0)
+        {
+            live.push_back({ sum.first.first, sum.first.second, sum.second });
+        }
+    }
+    report.liveHash = stateHash(live);
+    report.hashMillis = millisSince(start);
+
+    // 4. List the differences (both vectors are sorted the same way)
+    report.verified = report.stateHash == report.liveHash;
+    size_t i = 0, j = 0;
+    while (!report.verified && (i < rebuilt.size() || j < live.size()))
+    {
+        int order = i == rebuilt.size() ? 1 : j == live.size() ? -1
+            : rebuilt[i].account != live[j].account ? (rebuilt[i].account < live[j].account ? -1 : 1)
+            : rebuilt[i].asset != live[j].asset ? (rebuilt[i].asset < live[j].asset ? -1 : 1) : 0;
+
+        std::string difference;
+        if (order == 0)
+        {
+            if (rebuilt[i].amount != live[j].amount)
+            {
+                difference = rebuilt[i].account + " " + rebuilt[i].asset + ": journal " + std::to_string(FixedPoint::toDouble(rebuilt[i].amount))
+                    + ", table " + std::to_string(FixedPoint::toDouble(live[j].amount));
+            }
+            ++i;
+            ++j;
+        }
+        else if (order < 0)
+        {
+            difference = rebuilt[i].account + " " + rebuilt[i].asset + ": journal only";
+            ++i;
+        }
+        else
+        {
+            difference = live[j].account + " " + live[j].asset + ": table only (older than the journal?)";
+            ++j;
+        }
+
+        if (!difference.empty())
+        {
+            ++report.mismatches;
+            if (report.mismatchSamples.size() < 10)
+            {
+                report.mismatchSamples.push_back(difference);
+            }
+        }
+    }
+    return true;
+}
+
+// Prints the report
+void JournalReplay::print(const ReplayReport& report)
+{
+    double totalMillis = report.readMillis + report.applyMillis;
+    std::cout << "Replayed " << report.postings << " postings of " << report.transactions << " transactions on "
+        << report.threads << " threads\n"
+        << std::fixed << std::setprecision(1)
+        << "  read + partition " << report.readMillis << " ms, apply " << report.applyMillis << " ms ("
+        << std::setprecision(0) << report.postings / (report.applyMillis / 1000.0) << " events/s), hash "
+        << std::setprecision(1) << report.hashMillis << " ms, overall " << std::setprecision(0)
+        << report.postings / (totalMillis / 1000.0) << " events/s\n"
+        << "  " << report.balances << " balances, state " << Sha256::toHex(report.stateHash) << "\n"
+        << "  live  " << Sha256::toHex(report.liveHash) << (report.verified ? "  VERIFIED" : "  MISMATCH") << "\n";
+    if (report.negativeEvents > 0)
+    {
+        std::cout << "  " << report.negativeEvents << " postings left a user balance negative\n";
+    }
+    for (const auto& sample : report.mismatchSamples)
+    {
+        std::cout << "  " << sample << "\n";
+    }
+    if (report.mismatches > report.mismatchSamples.size())
+    {
+        std::cout << "  ... " << report.mismatches - report.mismatchSamples.size() << " more differences\n";
+    }
+}
@@ -0,0 +1,468 @@
+#include "LatencyVFS.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+// Default constructor for LatencyProfile
+LatencyProfile::LatencyProfile()
+    : meanMicros(0.0),   // No delay by default
+    jitterMicros(0.0)    // No jitter by default
+{
+}
+
+// Parameterized constructor for LatencyProfile
+LatencyProfile::LatencyProfile(double mean, double jitter)
+    : meanMicros(mean),  // Mean delay in microseconds
+    jitterMicros(jitter) // Standard deviation in microseconds
+{
+}
+
+// Handle SQLite allocates for every open file (szOsFile bytes), constructed in place by xOpen
+struct MemHandle
+{
+    sqlite3_file base;                       // Must be the first member
+    LatencyVFS* owner;                       // VFS that opened the file
+    std::shared_ptr<LatencyVFS::MemFile> file; // Shared file contents
+    std::string name;                        // File name (empty for anonymous temp files)
+    bool deleteOnClose;                      // Remove the file from the VFS when closed
+    int lockLevel;                           // Current SQLITE_LOCK_* level of this handle
+};
+
+// Static callbacks wired into sqlite3_vfs and sqlite3_io_methods
+struct LatencyVFSCallbacks
+{
+    static MemHandle* handle(sqlite3_file* f) { return reinterpret_cast<MemHandle*>(f); }
+    static LatencyVFS* owner(sqlite3_vfs* v) { return static_cast<LatencyVFS*>(v->pAppData); }
+    static sqlite3_vfs* fallback() { return sqlite3_vfs_find(nullptr); }
+
+    static int xClose(sqlite3_file* f)
+    {
+        MemHandle* h = handle(f);
+        if (h->deleteOnClose && !h->name.empty())
+        {
+            h->owner->removeFile(h->name);
+        }
+        h->~MemHandle(); // Destroy the in-place constructed handle
+        return SQLITE_OK;
+    }
+
+    static int xRead(sqlite3_file* f, void* buffer, int amount, sqlite3_int64 offset)
+    {
+        MemHandle* h = handle(f);
+        LatencyVFS* vfs = h->owner;
+        vfs->reads++;
+        vfs->inject(vfs->readLatency);
+
+        std::lock_guard<std::mutex> lock(h->file->mutex);
+        const std::vector<char>& data = h->file->data;
+
+        size_t available = 0;
+        if (offset < static_cast<sqlite3_int64>(data.size()))
+        {
+            available = std::min(static_cast<size_t>(amount), data.size() - static_cast<size_t>(offset));
+            memcpy(buffer, data.data() + offset, available);
+        }
+        vfs->bytesRead += available;
+
+        if (available < static_cast<size_t>(amount))
+        {
+            // SQLite requires the unread tail to be zero-filled on a short read
+            memset(static_cast<char*>(buffer) + available, 0, amount - available);
+            return SQLITE_IOERR_SHORT_READ;
+        }
+        return SQLITE_OK;
+    }
+
+    static int xWrite(sqlite3_file* f, const void* buffer, int amount, sqlite3_int64 offset)
+    {
+        MemHandle* h = handle(f);
+        LatencyVFS* vfs = h->owner;
+        vfs->writes++;
+        vfs->bytesWritten += amount;
+        vfs->inject(vfs->writeLatency);
+
+        std::lock_guard<std::mutex> lock(h->file->mutex);
+        std::vector<char>& data = h->file->data;
+        size_t end = static_cast<size_t>(offset) + amount;
+        if (data.size() < end)
+        {
+            data.resize(end, 0);
+        }
+        memcpy(data.data() + offset, buffer, amount);
+        return SQLITE_OK;
+    }
+
+    static int xTruncate(sqlite3_file* f, sqlite3_int64 size)
+    {
+        MemHandle* h = handle(f);
+        std::lock_guard<std::mutex> lock(h->file->mutex);
+        if (static_cast<sqlite3_int64>(h->file->data.size()) > size)
+        {
+            h->file->data.resize(static_cast<size_t>(size));
+        }
+        return SQLITE_OK;
+    }
+
+    static int xSync(sqlite3_file* f, int)
+    {
+        MemHandle* h = handle(f);
+        h->owner->syncs++;
+        h->owner->inject(h->owner->syncLatency);
+        return SQLITE_OK;
+    }
+
+    static int xFileSize(sqlite3_file* f, sqlite3_int64* size)
+    {
+        MemHandle* h = handle(f);
+        std::lock_guard<std::mutex> lock(h->file->mutex);
+        *size = static_cast<sqlite3_int64>(h->file->data.size());
+        return SQLITE_OK;
+    }
+
+    // Implements the SQLite lock ladder (SHARED -> RESERVED -> PENDING -> EXCLUSIVE) between in-process connections
+    static int xLock(sqlite3_file* f, int level)
+    {
+        MemHandle* h = handle(f);
+        LatencyVFS::MemFile& file = *h->file;
+        std::lock_guard<std::mutex> lock(file.mutex);
+
+        if (h->lockLevel >= level)
+        {
+            return SQLITE_OK;
+        }
+
+        switch (level)
+        {
+        case SQLITE_LOCK_SHARED:
+            if (file.pending || file.exclusive)
+                return SQLITE_BUSY;
+            file.sharedLocks++;
+            break;
+
+        case SQLITE_LOCK_RESERVED:
+            if (file.reserved)
+                return SQLITE_BUSY;
+            file.reserved = true;
+            break;
+
+        case SQLITE_LOCK_EXCLUSIVE:
+            file.pending = true;     // Keep new readers out while we wait for the others to leave
+            h->lockLevel = SQLITE_LOCK_PENDING;
+            if (file.sharedLocks > 1)
+                return SQLITE_BUSY;
+            file.exclusive = true;
+            break;
+
+        default:
+            return SQLITE_OK;
+        }
+
+        h->lockLevel = level;
+        return SQLITE_OK;
+    }
+
+    static int xUnlock(sqlite3_file* f, int level)
+    {
+        MemHandle* h = handle(f);
+        LatencyVFS::MemFile& file = *h->file;
+        std::lock_guard<std::mutex> lock(file.mutex);
+
+        if (h->lockLevel <= level)
+        {
+            return SQLITE_OK;
+        }
+
+        if (h->lockLevel >= SQLITE_LOCK_RESERVED)
+        {
+            // Everything above SHARED is owned exclusively by this handle
+            file.reserved = false;
+            file.pending = false;
+            file.exclusive = false;
+        }
+        if (level == SQLITE_LOCK_NONE && h->lockLevel >= SQLITE_LOCK_SHARED)
+        {
+            file.sharedLocks--;
+        }
+
+        h->lockLevel = level;
+        return SQLITE_OK;
+    }
+
+    static int xCheckReservedLock(sqlite3_file* f, int* result)
+    {
+        MemHandle* h = handle(f);
+        std::lock_guard<std::mutex> lock(h->file->mutex);
+        *result = h->file->reserved ? 1 : 0;
+        return SQLITE_OK;
+    }
+
+    static int xFileControl(sqlite3_file*, int, void*) { return SQLITE_NOTFOUND; }
+    static int xSectorSize(sqlite3_file*) { return 4096; }
+    static int xDeviceCharacteristics(sqlite3_file*) { return 0; }
+
+    static const sqlite3_io_methods* ioMethods()
+    {
+        static const sqlite3_io_methods methods =
+        {
+            1,                       // iVersion (no shared memory, so no WAL)
+            xClose,
+            xRead,
+            xWrite,
+            xTruncate,
+            xSync,
+            xFileSize,
+            xLock,
+            xUnlock,
+            xCheckReservedLock,
+            xFileControl,
+            xSectorSize,
+            xDeviceCharacteristics,
+            nullptr,                 // xShmMap (version 2 and up, not used at iVersion 1)
+            nullptr,                 // xShmLock
+            nullptr,                 // xShmBarrier
+            nullptr,                 // xShmUnmap
+            nullptr,                 // xFetch (version 3)
+            nullptr                  // xUnfetch
+        };
+        return &methods;
+    }
+
+    static int xOpen(sqlite3_vfs* v, const char* name, sqlite3_file* f, int flags, int* outFlags)
+    {
+        LatencyVFS* vfs = owner(v);
+        MemHandle* h = new (f) MemHandle(); // Construct the handle in the memory SQLite reserved for it
+        h->owner = vfs;
+        h->name = name ? name : "";
+        h->deleteOnClose = (flags & SQLITE_OPEN_DELETEONCLOSE) != 0;
+        h->lockLevel = SQLITE_LOCK_NONE;
+
+        if (h->name.empty())
+        {
+            h->file = std::make_shared<LatencyVFS::MemFile>(); // Anonymous temp file, private to this handle
+        }
+        else
+        {
+            h->file = vfs->getFile(h->name, (flags & SQLITE_OPEN_CREATE) != 0);
+        }
+
+        if (!h->file)
+        {
+            h->~MemHandle();
+            f->pMethods = nullptr;
+            return SQLITE_CANTOPEN;
+        }
+
+        vfs->opens++;
+        f->pMethods = ioMethods();
+        if (outFlags)
+        {
+            *outFlags = flags;
+        }
+        return SQLITE_OK;
+    }
+
+    static int xDelete(sqlite3_vfs* v, const char* name, int)
+    {
+        owner(v)->removeFile(name);
+        return SQLITE_OK;
+    }
+
+    static int xAccess(sqlite3_vfs* v, const char* name, int, int* result)
+    {
+        *result = owner(v)->getFile(name, false) ? 1 : 0;
+        return SQLITE_OK;
+    }
+
+    static int xFullPathname(sqlite3_vfs*, const char* name, int outSize, char* out)
+    {
+        sqlite3_snprintf(outSize, out, "%s", name);
+        return SQLITE_OK;
+    }
+
+    // Everything that is not file I/O is delegated to the platform VFS
+    static void* xDlOpen(sqlite3_vfs*, const char* name) { return fallback()->xDlOpen(fallback(), name); }
+    static void xDlError(sqlite3_vfs*, int n, char* msg) { fallback()->xDlError(fallback(), n, msg); }
+    static void (*xDlSym(sqlite3_vfs*, void* lib, const char* sym))(void) { return fallback()->xDlSym(fallback(), lib, sym); }
+    static void xDlClose(sqlite3_vfs*, void* lib) { fallback()->xDlClose(fallback(), lib); }
+    static int xRandomness(sqlite3_vfs*, int n, char* out) { return fallback()->xRandomness(fallback(), n, out); }
+    static int xSleep(sqlite3_vfs*, int micros) { return fallback()->xSleep(fallback(), micros); }
+    static int xCurrentTime(sqlite3_vfs*, double* now) { return fallback()->xCurrentTime(fallback(), now); }
+    static int xGetLastError(sqlite3_vfs*, int, char*) { return 0; }
+    static int xCurrentTimeInt64(sqlite3_vfs*, sqlite3_int64* now) { return fallback()->xCurrentTimeInt64(fallback(), now); }
+};
+
+// Returns the process-wide VFS instance
+LatencyVFS& LatencyVFS::instance()
+{
+    static LatencyVFS vfsInstance;
+    return vfsInstance;
+}
+
+// Constructor that fills in the sqlite3_vfs structure
+LatencyVFS::LatencyVFS()
+    : vfs{}, registered(false), generator(0)
+    , reads(0), writes(0), syncs(0), bytesRead(0), bytesWritten(0), opens(0), injectedMicros(0)
+{
+    vfs.iVersion = 2;
+    vfs.szOsFile = static_cast<int>(sizeof(MemHandle));
+    vfs.mxPathname = 512;
+    vfs.zName = vfsName;
+    vfs.pAppData = this;
+    vfs.xOpen = LatencyVFSCallbacks::xOpen;
+    vfs.xDelete = LatencyVFSCallbacks::xDelete;
+    vfs.xAccess = LatencyVFSCallbacks::xAccess;
+    vfs.xFullPathname = LatencyVFSCallbacks::xFullPathname;
+    vfs.xDlOpen = LatencyVFSCallbacks::xDlOpen;
+    vfs.xDlError = LatencyVFSCallbacks::xDlError;
+    vfs.xDlSym = LatencyVFSCallbacks::xDlSym;
+    vfs.xDlClose = LatencyVFSCallbacks::xDlClose;
+    vfs.xRandomness = LatencyVFSCallbacks::xRandomness;
+    vfs.xSleep = LatencyVFSCallbacks::xSleep;
+    vfs.xCurrentTime = LatencyVFSCallbacks::xCurrentTime;
+    vfs.xGetLastError = LatencyVFSCallbacks::xGetLastError;
+    vfs.xCurrentTimeInt64 = LatencyVFSCallbacks::xCurrentTimeInt64;
+}
+
+// Registers the VFS with SQLite (not as the default VFS)
+bool LatencyVFS::registerVFS()
+{
+    if (registered)
+    {
+        return true;
+    }
+
+    if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK)
+    {
+        std::cerr << "[ERROR] Failed to register " << vfsName << "\n";
+        return false;
+    }
+
+    registered = true;
+    return true;
+}
+
+void LatencyVFS::setReadLatency(const LatencyProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    readLatency = profile;
+}
+
+void LatencyVFS::setWriteLatency(const LatencyProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    writeLatency = profile;
+}
+
+void LatencyVFS::setSyncLatency(const LatencyProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    syncLatency = profile;
+}
+
+// Reseeds the latency generator
+void LatencyVFS::seed(uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    generator.seed(value);
+}
+
+// Returns a copy of the counters
+VFSStats LatencyVFS::stats() const
+{
+    VFSStats result;
+    result.reads = reads.load();
+    result.writes = writes.load();
+    result.syncs = syncs.load();
+    result.bytesRead = bytesRead.load();
+    result.bytesWritten = bytesWritten.load();
+    result.opens = opens.load();
+    result.injectedMicros = injectedMicros.load();
+    return result;
+}
+
+// Resets all counters to zero
+void LatencyVFS::resetStats()
+{
+    reads = 0;
+    writes = 0;
+    syncs = 0;
+    bytesRead = 0;
+    bytesWritten = 0;
+    opens = 0;
+    injectedMicros = 0;
+}
+
+// Drops every in-memory file
+void LatencyVFS::clearFiles()
+{
+    std::lock_guard<std::mutex> lock(filesMutex);
+    files.clear();
+}
+
+// Waits for a delay drawn from the profile; short delays are spun because OS sleeps are too coarse
+void LatencyVFS::inject(const LatencyProfile& profile)
+{
+    double micros = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        if (profile.meanMicros <= 0.0 && profile.jitterMicros <= 0.0)
+        {
+            return;
+        }
+
+        if (profile.jitterMicros > 0.0)
+        {
+            std::normal_distribution<double> distribution(profile.meanMicros, profile.jitterMicros);
+            micros = std::max(0.0, distribution(generator));
+        }
+        else
+        {
+            micros = profile.meanMicros;
+        }
+    }
+
+    injectedMicros += static_cast<uint64_t>(micros);
+
+    auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(micros));
+    if (micros >= 2000.0)
+    {
+        std::this_thread::sleep_for(delay);
+        return;
+    }
+
+    auto until = std::chrono::steady_clock::now() + delay;
+    while (std::chrono::steady_clock::now() < until)
+    {
+        std::this_thread::yield();
+    }
+}
+
+// Finds a named file, creating it when requested
+std::shared_ptr<LatencyVFS::MemFile> LatencyVFS::getFile(const std::string& name, bool create)
+{
+    std::lock_guard<std::mutex> lock(filesMutex);
+    auto it = files.find(name);
+    if (it != files.end())
+    {
+        return it->second;
+    }
+
+    if (!create)
+    {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<MemFile>();
+    files[name] = file;
+    return file;
+}
+
+// Removes a named file (open handles keep their contents alive until closed)
+bool LatencyVFS::removeFile(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(filesMutex);
+    return files.erase(name) > 0;
+}
@@ -1,16 +1,29 @@
 #include "Ledger.h"
+#include <chrono>
+#include <cstring>
+#include <tuple>
 
 // Constructor for the Ledger class, initializing necessary components and setting up the database
 Ledger::Ledger(User& other, SQLData& sqlD, SeedList& sL, Coin& c)
-    : user(other), sqlData(sqlD), seedList(sL), coin(c), userLoad(false)
+    : user(other), sqlData(sqlD), seedList(sL), coin(c), userLoad(false), batchDepth(0), engineEnabled(false), chainEnabled(false),
+      holds(100, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
 {
-    // Attempt to open the SQLite database
-    if (sqlData.open(dbName))
+    // Attempt to open the SQLite database (unless the caller already opened one, e.g. a benchmark in the memory VFS)
+    if (sqlData.isOpen() || sqlData.open(dbName))
     {
         // Create tables if they don't already exist
         sqlData.createTable(SQLData::DataBaseState::DBS_DATA);
         sqlData.createTable(SQLData::DataBaseState::DBS_COINS);
         sqlData.createTable(SQLData::DataBaseState::DBS_BALANCE);
+        sqlData.createTable(SQLData::DataBaseState::DBS_FX_RATES);
+        sqlData.createTable(SQLData::DataBaseState::DBS_TRANSACTIONS);
+        sqlData.createTable(SQLData::DataBaseState::DBS_POSTINGS);
+        sqlData.createTable(SQLData::DataBaseState::DBS_CHAIN);
+        sqlData.createTable(SQLData::DataBaseState::DBS_COMMANDS);
+
+        // Command IDs still inside the window survive the restart; older ones are deleted
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        sqlData.loadCommands(now - commands.ttl(), [this](uint64_t commandId, sqlite3_int64 recordedAt) { commands.record(commandId, recordedAt); });
     }
     else
     {
@@ -18,6 +31,61 @@ Ledger::Ledger(User& other, SQLData& sqlD, SeedList& sL, Coin& c)
     }
 }
 
+// Destructor: everything the engine accepted must reach the database before the connection goes away
+Ledger::~Ledger()
+{
+    persister.stop();
+}
+
+// Loads all balances into the engine and starts the background writer on a second connection
+bool Ledger::enableBalanceEngine(bool integrityChain)
+{
+    if (engineEnabled)
+    {
+        return true;
+    }
+    if (!sqlData.isOpen() || !engine.load(sqlData))
+    {
+        std::cerr << "[ERROR] Could not load balances into the engine.\n";
+        return false;
+    }
+    if (integrityChain && !integrity.load(sqlData))
+    {
+        std::cerr << "[ERROR] Could not load the integrity chain.\n";
+        return false;
+    }
+    if (!persister.start(sqlData.databaseName(), sqlData.vfsName(), integrityChain ? &integrity : nullptr))
+    {
+        return false;
+    }
+
+    engineEnabled = true;
+    chainEnabled = integrityChain;
+    return true;
+}
+
+// Splits a hot account in the engine and starts folding its sub-balances back
+bool Ledger::markHotAccount(const std::string& userID, int64_t aggregateMillis)
+{
+    if (!engineEnabled)
+    {
+        std::cerr << "[ERROR] Hot accounts need the balance engine.\n";
+        return false;
+    }
+    if (!engine.markHot(userID))
+    {
+        return false;
+    }
+    engine.startAggregation(aggregateMillis);
+    return true;
+}
+
+// Waits for the background writer
+bool Ledger::flush()
+{
+    return !engineEnabled || persister.flush();
+}
+
 // Function to verify if the entered password exists in the database (returns false if the password is found)
 bool Ledger::enterPassword(const char* password)
 {
@@ -93,3 +161,485 @@ std::string Ledger::getSeedPhrase()
 {
     return seedList.getStringSeedPhrase();
 }
+
+// Returns the name stored in TRANSACTIONS.kind
+const char* transactionKindName(TransactionKind kind)
+{
+    switch (kind)
+    {
+    case TransactionKind::TK_Deposit:  return "DEPOSIT";
+    case TransactionKind::TK_Buy:      return "BUY";
+    case TransactionKind::TK_Send:     return "SEND";
+    case TransactionKind::TK_Withdraw: return "WITHDRAW";
+    case TransactionKind::TK_Order:    return "ORDER";
+    case TransactionKind::TK_Trade:    return "TRADE";
+    case TransactionKind::TK_Sell:     return "SELL";
+    case TransactionKind::TK_Credit:   return "CREDIT";
+    case TransactionKind::TK_Hold:     return "HOLD";
+    default:                           return "UNKNOWN";
+    }
+}
+
+// System accounts start with '@' (generated user IDs never do)
+bool Ledger::isSystemAccount(const std::string& userID)
+{
+    return !userID.empty() && userID[0] == '@';
+}
+
+// Transaction without a command ID
+bool Ledger::applyTransaction(TransactionKind kind, const std::vector<Posting>& postings, const std::string& memo)
+{
+    return applyCommand(0, kind, postings, memo) == CommandStatus::CS_Applied;
+}
+
+// Applies the postings to the balance tables and appends them to the journal inside one savepoint.
+// The command window keeps the ID's shard locked until the transaction is applied (or queued), so a concurrent
+// retry of the same command waits and then finds it.
+CommandStatus Ledger::applyCommand(CommandId commandId, TransactionKind kind, const std::vector<Posting>& postings, const std::string& memo,
+    const SQLData::JournalWrite& alsoWrite)
+{
+    if (postings.empty())
+    {
+        return CommandStatus::CS_Rejected;
+    }
+
+    // Double-entry check: every asset must net to zero in its book
+    std::map<std::pair<std::string, SQLData::DataBaseState>, Amount> totals;
+    for (const auto& posting : postings)
+    {
+        if (posting.amount == 0 || posting.userID.empty() ||
+            (posting.book != SQLData::DataBaseState::DBS_COINS && posting.book != SQLData::DataBaseState::DBS_BALANCE))
+        {
+            std::cerr << "[ERROR] Invalid posting for " << posting.asset << "\n";
+            return CommandStatus::CS_Rejected;
+        }
+        Amount& total = totals[{ posting.asset, posting.book }];
+        if (!FixedPoint::add(total, posting.amount, total))
+        {
+            return CommandStatus::CS_Rejected;
+        }
+    }
+    for (const auto& total : totals)
+    {
+        if (total.second != 0)
+        {
+            std::cerr << "[ERROR] Unbalanced transaction for " << total.first.first << "\n";
+            return CommandStatus::CS_Rejected;
+        }
+    }
+
+    auto createdAt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    return commands.run(commandId, createdAt, [&]()
+        {
+            if (engineEnabled)
+            {
+                // Memory is authoritative: apply (or reject) here, the database catches up in the background.
+                // The entry is queued while the accounts are still locked, so the journal keeps each account's order.
+                if (persister.hasFailed())
+                {
+                    std::cerr << "[ERROR] The journal can no longer be written, " << transactionKindName(kind) << " rejected\n";
+                    return false;
+                }
+                if (!engine.apply(postings, [&]() { persister.enqueue({ transactionKindName(kind), memo, createdAt, postings, commandId, alsoWrite }); }))
+                {
+                    std::cerr << "[ERROR] Insufficient funds for " << transactionKindName(kind) << "\n";
+                    return false;
+                }
+                return true;
+            }
+
+            // Half a unit of tolerance for the float history of the REAL balance columns
+            const double tolerance = 0.5 / static_cast<double>(FixedPoint::SCALE);
+
+            // Reject what the balances cannot cover before the savepoint: a rejected transaction then reads a few
+            // pages and writes none, so it costs no sync. The checks in the savepoint stay authoritative.
+            std::map<std::tuple<std::string, std::string, SQLData::DataBaseState>, Amount> nets;
+            for (const auto& posting : postings)
+            {
+                if (isSystemAccount(posting.userID))
+                {
+                    continue;
+                }
+                Amount& net = nets[std::make_tuple(posting.userID, posting.asset, posting.book)];
+                if (!FixedPoint::add(net, posting.amount, net))
+                {
+                    return false;
+                }
+            }
+            for (const auto& net : nets)
+            {
+                double held = 0.0;
+                if (net.second < 0 && (!sqlData.readValuteAmount(std::get<0>(net.first), std::get<1>(net.first), std::get<2>(net.first), held) ||
+                    held + FixedPoint::toDouble(net.second) < -tolerance))
+                {
+                    std::cerr << "[ERROR] Insufficient " << std::get<1>(net.first) << " for " << std::get<0>(net.first) << "\n";
+                    return false;
+                }
+            }
+
+            const std::string savepointName = "ledger_tx";
+            if (!sqlData.savepoint(savepointName))
+            {
+                return false;
+            }
+
+            for (const auto& posting : postings)
+            {
+                if (isSystemAccount(posting.userID))
+                {
+                    continue; // System accounts live in the journal only
+                }
+
+                double newAmount = 0.0;
+                if (!sqlData.applyValuteDelta(posting.userID, posting.asset, posting.amount, posting.book, newAmount) || newAmount < -tolerance)
+                {
+                    std::cerr << "[ERROR] Insufficient " << posting.asset << " for " << posting.userID << "\n";
+                    sqlData.rollbackTo(savepointName);
+                    return false;
+                }
+            }
+
+            sqlite3_int64 txID = sqlData.insertJournalEntry(transactionKindName(kind), memo, createdAt, postings);
+            if (txID == 0 || (commandId != 0 && !sqlData.insertCommand(commandId, txID, createdAt)) || (alsoWrite && !alsoWrite(sqlData, txID)))
+            {
+                sqlData.rollbackTo(savepointName);
+                return false;
+            }
+
+            return sqlData.release(savepointName);
+        });
+}
+
+// Deposit: the user's balance grows, the outside world's shrinks
+bool Ledger::deposit(const std::string& moneyName, Amount amount, CommandId commandId)
+{
+    if (amount <= 0)
+    {
+        return false;
+    }
+
+    return applyCommand(commandId, TransactionKind::TK_Deposit,
+        {
+            { user.userID, moneyName, SQLData::DataBaseState::DBS_BALANCE, amount },
+            { externalAccount, moneyName, SQLData::DataBaseState::DBS_BALANCE, -amount },
+        }) != CommandStatus::CS_Rejected;
+}
+
+// Swap: pay goes from the user to the exchange, receive from the exchange to the user, the fee to '@fees'
+CommandStatus Ledger::swap(TransactionKind kind, const std::string& userID, const SwapLeg& pay, const SwapLeg& receive, const SwapLeg& fee,
+    CommandId commandId)
+{
+    if (pay.amount <= 0 || receive.amount <= 0 || fee.amount < 0 || userID.empty() || isSystemAccount(userID) ||
+        (pay.asset == receive.asset && pay.book == receive.book))
+    {
+        return CommandStatus::CS_Rejected;
+    }
+
+    std::vector<Posting> postings;
+    postings.reserve(6);
+    Amount userPays = pay.amount;
+    bool feeInPayAsset = fee.amount > 0 && fee.asset == pay.asset && fee.book == pay.book;
+    if (feeInPayAsset && !FixedPoint::add(userPays, fee.amount, userPays))
+    {
+        return CommandStatus::CS_Rejected;
+    }
+    postings.push_back({ userID, pay.asset, pay.book, -userPays });
+    postings.push_back({ exchangeAccount, pay.asset, pay.book, pay.amount });
+    postings.push_back({ userID, receive.asset, receive.book, receive.amount });
+    postings.push_back({ exchangeAccount, receive.asset, receive.book, -receive.amount });
+    if (fee.amount > 0)
+    {
+        if (!feeInPayAsset)
+        {
+            // A fee in the received asset comes out of what the user receives, in any other asset it is a leg of its own
+            if (fee.asset == receive.asset && fee.book == receive.book)
+            {
+                postings[2].amount -= fee.amount;
+                if (postings[2].amount <= 0)
+                {
+                    return CommandStatus::CS_Rejected; // The fee eats the whole trade
+                }
+            }
+            else
+            {
+                postings.push_back({ userID, fee.asset, fee.book, -fee.amount });
+            }
+        }
+        postings.push_back({ feeAccount, fee.asset, fee.book, fee.amount });
+    }
+
+    return applyCommand(commandId, kind, postings, receive.asset + " for " + pay.asset);
+}
+
+// Buy: USD (plus the fee) goes from the user to the exchange, coins go from the exchange to the user
+bool Ledger::buyCoin(const std::string& coinName, Amount usdAmount, Amount coinAmount, CommandId commandId, Amount usdFee)
+{
+    return swap(TransactionKind::TK_Buy, user.userID,
+        { "USD", SQLData::DataBaseState::DBS_BALANCE, usdAmount },
+        { coinName, SQLData::DataBaseState::DBS_COINS, coinAmount },
+        { "USD", SQLData::DataBaseState::DBS_BALANCE, usdFee }, commandId) != CommandStatus::CS_Rejected;
+}
+
+// Sell: coins go from the user to the exchange, USD (less the fee) from the exchange to the user
+bool Ledger::sellCoin(const std::string& coinName, Amount coinAmount, Amount usdAmount, CommandId commandId, Amount usdFee)
+{
+    return swap(TransactionKind::TK_Sell, user.userID,
+        { coinName, SQLData::DataBaseState::DBS_COINS, coinAmount },
+        { "USD", SQLData::DataBaseState::DBS_BALANCE, usdAmount },
+        { "USD", SQLData::DataBaseState::DBS_BALANCE, usdFee }, commandId) != CommandStatus::CS_Rejected;
+}
+
+// Send: coins move between two users
+bool Ledger::sendCoins(const std::string& toUserID, const std::string& coinName, Amount amount, CommandId commandId)
+{
+    if (!sqlData.findUserID(toUserID))
+    {
+        return false;
+    }
+
+    return transfer(user.userID, toUserID, coinName, amount, commandId);
+}
+
+// Transfer between two given users (thread-safe once the balance engine is enabled)
+bool Ledger::transfer(const std::string& fromUserID, const std::string& toUserID, const std::string& coinName, Amount amount, CommandId commandId)
+{
+    if (amount <= 0 || toUserID == fromUserID || isSystemAccount(fromUserID) || isSystemAccount(toUserID))
+    {
+        return false;
+    }
+
+    return applyCommand(commandId, TransactionKind::TK_Send,
+        {
+            { fromUserID, coinName, SQLData::DataBaseState::DBS_COINS, -amount },
+            { toUserID, coinName, SQLData::DataBaseState::DBS_COINS, amount },
+        }, "to " + toUserID) != CommandStatus::CS_Rejected;
+}
+
+// Hold: the funds move from the user to the user's hold account, then the hold is tracked until it is settled
+HoldId Ledger::placeHold(const std::string& userID, const std::string& asset, SQLData::DataBaseState book, Amount amount, int64_t ttlMillis)
+{
+    if (amount <= 0 || ttlMillis <= 0 || userID.empty() || isSystemAccount(userID))
+    {
+        return 0;
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    expireHolds(now);
+    if (!applyTransaction(TransactionKind::TK_Hold,
+        {
+            { userID, asset, book, -amount },
+            { holdAccount(userID), asset, book, amount },
+        }, "hold"))
+    {
+        return 0;
+    }
+    return holds.add({ userID, asset, book, amount, now + ttlMillis });
+}
+
+// Capture: the funds move from the hold account to the receiver; a hold past its expiry is released instead
+bool Ledger::captureHold(HoldId id, const std::string& toAccount, TransactionKind kind, CommandId commandId)
+{
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    expireHolds(now);
+
+    Hold hold;
+    if (!holds.claim(id, hold))
+    {
+        return false;
+    }
+    if (hold.expiresAtMillis <= now)
+    {
+        holds.settle(id, returnHold(hold, "expired"));
+        return false;
+    }
+    if (toAccount.empty() || toAccount == hold.userID || toAccount.compare(0, std::strlen(holdAccountPrefix), holdAccountPrefix) == 0)
+    {
+        holds.settle(id, false);
+        return false;
+    }
+
+    // Only CS_Applied wrote this hold's postings: a duplicate command ID belongs to another payment, so the hold stays open
+    bool captured = applyCommand(commandId, kind,
+        {
+            { holdAccount(hold.userID), hold.asset, hold.book, -hold.amount },
+            { toAccount, hold.asset, hold.book, hold.amount },
+        }, "to " + toAccount) == CommandStatus::CS_Applied;
+    holds.settle(id, captured);
+    return captured;
+}
+
+// Send of held coins: the receiver must be a known user
+bool Ledger::sendHold(HoldId id, const std::string& toUserID, CommandId commandId)
+{
+    if (isSystemAccount(toUserID) || !sqlData.findUserID(toUserID))
+    {
+        return false;
+    }
+    return captureHold(id, toUserID, TransactionKind::TK_Send, commandId);
+}
+
+// Release: the hold is claimed first, so it is returned once even if it expires at the same time
+bool Ledger::releaseHold(HoldId id)
+{
+    Hold hold;
+    if (!holds.claim(id, hold))
+    {
+        return false;
+    }
+    bool released = returnHold(hold, "release");
+    holds.settle(id, released);
+    return released;
+}
+
+// Moves the held funds back to the owner
+bool Ledger::returnHold(const Hold& hold, const std::string& memo)
+{
+    return applyTransaction(TransactionKind::TK_Hold,
+        {
+            { holdAccount(hold.userID), hold.asset, hold.book, -hold.amount },
+            { hold.userID, hold.asset, hold.book, hold.amount },
+        }, memo);
+}
+
+// Releases what the wheel reports expired (a failed release is retried by the next call)
+size_t Ledger::expireHolds(int64_t nowMillis)
+{
+    std::vector<std::pair<HoldId, Hold>> expired;
+    holds.claimExpired(nowMillis, expired);
+    size_t released = 0;
+    for (const auto& entry : expired)
+    {
+        bool returned = returnHold(entry.second, "expired");
+        holds.settle(entry.first, returned);
+        released += returned ? 1 : 0;
+    }
+    return released;
+}
+
+// Scans the engine, or the journal when the engine is off (system accounts have no balance row)
+std::vector<Hold> Ledger::findPrefixedBalances(const char* prefix)
+{
+    const size_t prefixLength = std::strlen(prefix);
+    std::vector<Hold> balances;
+    if (engineEnabled)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> found;
+        engine.forEach([&](uint32_t account, uint32_t asset, Amount amount)
+            {
+                if (amount > 0 && (account & BalanceEngine::systemBit))
+                {
+                    found.emplace_back(account, asset);
+                }
+            });
+        for (const auto& balance : found)
+        {
+            std::string account = engine.accountName(balance.first);
+            if (account.compare(0, prefixLength, prefix) == 0)
+            {
+                balances.push_back({ account.substr(prefixLength), engine.assetName(balance.second), engine.bookOf(balance.second),
+                    engine.balance(balance.first, balance.second), 0 });
+            }
+        }
+    }
+    else
+    {
+        // ';' follows ':' in ASCII, so the range is every account starting with the prefix
+        std::string end = prefix;
+        end.back() = ';';
+        sqlData.forEachJournalBalance(prefix, end, [&](const char* account, const char* asset, SQLData::DataBaseState book, Amount amount)
+            {
+                if (amount > 0)
+                {
+                    balances.push_back({ account + prefixLength, asset, book, amount, 0 });
+                }
+            });
+    }
+    return balances;
+}
+
+// Every hold account with funds left belongs to a hold of a previous run, whose payment can no longer be captured
+size_t Ledger::releaseStaleHolds()
+{
+    if (holds.size() != 0)
+    {
+        std::cerr << "[ERROR] Stale holds can only be released before new holds are placed.\n";
+        return 0;
+    }
+
+    size_t released = 0;
+    for (const auto& hold : findPrefixedBalances(holdAccountPrefix))
+    {
+        released += returnHold(hold, "stale hold") ? 1 : 0;
+    }
+    return released;
+}
+
+// Every order escrow account with funds left belongs to orders of a previous run, which are no longer in any book
+size_t Ledger::releaseStaleEscrow()
+{
+    size_t released = 0;
+    for (const auto& escrow : findPrefixedBalances(orderBookAccountPrefix))
+    {
+        bool returned = applyTransaction(TransactionKind::TK_Order,
+            {
+                { orderBookAccount(escrow.userID), escrow.asset, escrow.book, -escrow.amount },
+                { escrow.userID, escrow.asset, escrow.book, escrow.amount },
+            }, "stale order");
+        released += returned ? 1 : 0;
+    }
+    return released;
+}
+
+// Opens a batch: every transaction until commitBatch shares one database transaction
+bool Ledger::beginBatch()
+{
+    // The persister already groups the engine's transactions, holding the write lock here would only block it
+    if (engineEnabled || batchDepth++ > 0)
+    {
+        return true;
+    }
+    return sqlData.execute("BEGIN IMMEDIATE;");
+}
+
+// Commits the batch opened by beginBatch
+bool Ledger::commitBatch()
+{
+    if (engineEnabled)
+    {
+        return true;
+    }
+    if (batchDepth == 0)
+    {
+        return false;
+    }
+    if (--batchDepth > 0)
+    {
+        return true;
+    }
+    return sqlData.execute("COMMIT;");
+}
+
+// Returns a balance in fixed point
+Amount Ledger::getBalance(const std::string& userID, const std::string& asset, SQLData::DataBaseState book)
+{
+    if (engineEnabled)
+    {
+        return engine.balance(userID, asset, book);
+    }
+    return FixedPoint::fromDouble(sqlData.getCurrentValuteAmount(userID, asset, book));
+}
+
+// Proves a balance against the newest link (only chained batches are covered, so wait for the queue)
+bool Ledger::proveBalance(const std::string& userID, const std::string& asset, MerkleProof& proof, SQLData::ChainLink& link)
+{
+    flush();
+    return engineEnabled && integrity.prove(userID, asset, proof, link);
+}
+
+// Returns one page of the current user's postings, newest first
+std::vector<PostingRecord> Ledger::getHistory(sqlite3_int64 beforeID, int limit)
+{
+    flush(); // The newest transactions may still be queued
+    return sqlData.getAccountHistory(user.userID, beforeID, limit);
+}
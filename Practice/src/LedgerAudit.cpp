@@ -0,0 +1,296 @@
+#include "LedgerAudit.h"
+#include <chrono>
+#include <iomanip>
+#include <tuple>
+
+// Constructor for LedgerAudit
+LedgerAudit::LedgerAudit()
+    : head(), stagedLink(), stagedLeafCount(0), hasStaged(false)
+{
+}
+
+// Canonical encoding of a transaction: everything the journal stores about it
+void LedgerAudit::hashEntry(Sha256& sha, sqlite3_int64 txID, const SQLData::JournalEntry& entry)
+{
+    sha.updateInt64(txID);
+    sha.updateString(entry.kind);
+    sha.updateInt64(entry.createdAt);
+    sha.updateString(entry.memo);
+    sha.updateInt64(static_cast<int64_t>(entry.postings.size()));
+    for (const auto& posting : entry.postings)
+    {
+        sha.updateString(posting.userID);
+        sha.updateString(posting.asset);
+        sha.updateInt64(static_cast<int64_t>(posting.book));
+        sha.updateInt64(posting.amount);
+    }
+}
+
+// SHA-256(previous chain hash, seq, batch hash, state root)
+Digest LedgerAudit::linkHash(const Digest& previous, sqlite3_int64 seq, const Digest& batchHash, const Digest& stateRoot)
+{
+    Sha256 sha;
+    sha.update(previous.data(), previous.size());
+    sha.updateInt64(seq);
+    sha.update(batchHash.data(), batchHash.size());
+    sha.update(stateRoot.data(), stateRoot.size());
+    return sha.finish();
+}
+
+// Leaves in their recorded positions first, then balances that have no position yet (sorted, so the order is reproducible)
+bool LedgerAudit::buildTree(SQLData& sqlData, MerkleTree& tree, std::vector<uint32_t>* newLeaves)
+{
+    tree.clear();
+    bool contiguous = true;
+    bool ok = sqlData.forEachMerkleLeaf([&](sqlite3_int64 position, const char* userID, const char* asset)
+        {
+            bool created = false;
+            contiguous = tree.insert(userID, asset, created) == position && contiguous;
+        });
+    if (!ok || !contiguous)
+    {
+        std::cerr << "[ERROR] MERKLE_LEAVES is unreadable or has gaps\n";
+        return false;
+    }
+
+    // System accounts live in the journal only, they are not part of the state
+    std::vector<std::tuple<std::string, std::string, Amount>> balances;
+    ok = sqlData.forEachBalance([&](const std::string& userID, const std::string& asset, SQLData::DataBaseState, Amount amount)
+        {
+            if (!userID.empty() && userID[0] != '@')
+            {
+                balances.emplace_back(userID, asset, amount);
+            }
+        });
+    if (!ok)
+    {
+        return false;
+    }
+
+    std::sort(balances.begin(), balances.end());
+    std::vector<Amount> sums(tree.size(), 0);
+    for (const auto& balance : balances)
+    {
+        bool created = false;
+        uint32_t position = tree.insert(std::get<0>(balance), std::get<1>(balance), created);
+        if (created)
+        {
+            sums.push_back(0);
+            if (newLeaves)
+            {
+                newLeaves->push_back(position);
+            }
+        }
+        sums[position] += std::get<2>(balance); // Duplicate rows of one balance add up
+    }
+
+    for (size_t position = 0; position < sums.size(); ++position)
+    {
+        tree.set(static_cast<uint32_t>(position), sums[position]);
+    }
+    tree.commit();
+    return true;
+}
+
+// Builds the tree, records the positions of new leaves and compares with the newest link
+bool LedgerAudit::load(SQLData& sqlData)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<uint32_t> newLeaves;
+    if (!buildTree(sqlData, tree, &newLeaves) || !sqlData.getChainLink(0, head))
+    {
+        return false;
+    }
+
+    // Balances that appeared outside the chained write path: the chain can no longer vouch for the tables
+    if (head.seq > 0 && (tree.root() != head.stateRoot))
+    {
+        std::cerr << "[WARNING] Balance tables do not match the state root of chain link " << head.seq
+            << " (changed outside the ledger?). Run with --audit for details.\n";
+    }
+
+    if (newLeaves.empty())
+    {
+        return true;
+    }
+    if (!sqlData.execute("BEGIN IMMEDIATE;"))
+    {
+        return false;
+    }
+    for (uint32_t position : newLeaves)
+    {
+        if (!sqlData.insertMerkleLeaf(position, tree.account(position), tree.asset(position)))
+        {
+            sqlData.execute("ROLLBACK;");
+            return false;
+        }
+    }
+    return sqlData.execute("COMMIT;");
+}
+
+// Runs on a journal writer's thread between the journal inserts and COMMIT; the mutex stays locked until the outcome
+// is known, so batches of several writers are chained one at a time in commit order
+bool LedgerAudit::stage(SQLData& storage, const std::vector<SQLData::JournalEntry>& batch, const std::vector<sqlite3_int64>& txIDs)
+{
+    mutex.lock();
+    hasStaged = true;
+    stagedLeafCount = tree.size();
+    staged.clear();
+
+    Sha256 sha;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        hashEntry(sha, txIDs[i], batch[i]);
+        for (const auto& posting : batch[i].postings)
+        {
+            if (posting.userID[0] == '@')
+            {
+                continue;
+            }
+            bool created = false;
+            uint32_t position = tree.insert(posting.userID, posting.asset, created);
+            if (created && !storage.insertMerkleLeaf(position, posting.userID, posting.asset))
+            {
+                return false;
+            }
+            tree.add(position, posting.amount);
+            staged.push_back({ position, posting.amount });
+        }
+    }
+    tree.commit();
+
+    stagedLink.seq = head.seq + 1;
+    stagedLink.firstTxID = txIDs.front();
+    stagedLink.lastTxID = txIDs.back();
+    stagedLink.batchHash = sha.finish();
+    stagedLink.stateRoot = tree.root();
+    stagedLink.chainHash = linkHash(head.chainHash, stagedLink.seq, stagedLink.batchHash, stagedLink.stateRoot);
+    stagedLink.createdAt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return storage.insertChainLink(stagedLink);
+}
+
+// The batch is durable: its link becomes the head
+void LedgerAudit::commitStaged()
+{
+    if (!hasStaged)
+    {
+        return;
+    }
+    head = stagedLink;
+    staged.clear();
+    hasStaged = false;
+    mutex.unlock();
+}
+
+// The batch was rolled back: undo its changes to the tree
+void LedgerAudit::rollbackStaged()
+{
+    if (!hasStaged)
+    {
+        return;
+    }
+    for (auto it = staged.rbegin(); it != staged.rend(); ++it)
+    {
+        tree.add(it->position, -it->delta);
+    }
+    tree.truncate(stagedLeafCount);
+    tree.commit();
+    staged.clear();
+    hasStaged = false;
+    mutex.unlock();
+}
+
+// Proof against the newest committed root
+bool LedgerAudit::prove(const std::string& userID, const std::string& asset, MerkleProof& proof, SQLData::ChainLink& link)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    link = head;
+    return tree.prove(userID, asset, proof);
+}
+
+// Copy of the head
+SQLData::ChainLink LedgerAudit::chainHead()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return head;
+}
+
+// Checks the proof path and the root it leads to
+bool LedgerAudit::verifyProof(SQLData& sqlData, const MerkleProof& proof, sqlite3_int64 seq)
+{
+    SQLData::ChainLink link;
+    return MerkleTree::verify(proof) && sqlData.getChainLink(seq, link) && link.seq == seq && link.stateRoot == proof.root;
+}
+
+// Walks the chain in order, re-hashing each batch from the journal, then compares the tables with the newest root
+bool LedgerAudit::verifyChain(SQLData& sqlData, AuditReport& report)
+{
+    auto start = std::chrono::steady_clock::now();
+    report = AuditReport();
+
+    std::vector<SQLData::ChainLink> links;
+    if (!sqlData.forEachChainLink([&](const SQLData::ChainLink& link) { links.push_back(link); }))
+    {
+        return false;
+    }
+
+    SQLData::ChainLink previous = SQLData::ChainLink();
+    for (const auto& link : links)
+    {
+        Sha256 sha;
+        uint64_t count = 0;
+        if (!sqlData.forEachJournalEntry(link.firstTxID, link.lastTxID, [&](sqlite3_int64 txID, const SQLData::JournalEntry& entry)
+            {
+                hashEntry(sha, txID, entry);
+                ++count;
+            }))
+        {
+            return false;
+        }
+
+        bool valid = link.seq == previous.seq + 1 && link.firstTxID > previous.lastTxID && link.batchHash == sha.finish()
+            && link.chainHash == linkHash(previous.chainHash, link.seq, link.batchHash, link.stateRoot);
+        if (!valid && report.firstBadSeq == 0)
+        {
+            report.firstBadSeq = link.seq;
+        }
+        if (link.firstTxID > previous.lastTxID + 1)
+        {
+            report.unchainedTransactions += link.firstTxID - previous.lastTxID - 1;
+        }
+
+        report.transactions += count;
+        ++report.links;
+        previous = link;
+    }
+    report.chainValid = report.firstBadSeq == 0;
+
+    MerkleTree tables;
+    if (!buildTree(sqlData, tables, nullptr))
+    {
+        return false;
+    }
+    report.balances = tables.size();
+    report.tablesMatch = previous.seq > 0 && tables.root() == previous.stateRoot;
+    report.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// Prints the report
+void LedgerAudit::print(const AuditReport& report)
+{
+    std::cout << "Integrity chain: " << report.links << " links, " << report.transactions << " transactions re-hashed in "
+        << std::fixed << std::setprecision(1) << report.millis << " ms\n"
+        << "  chain   " << (report.chainValid ? "VALID" : "BROKEN");
+    if (!report.chainValid)
+    {
+        std::cout << " (first bad link " << report.firstBadSeq << ")";
+    }
+    std::cout << "\n  tables  " << (report.tablesMatch ? "MATCH" : "DO NOT MATCH") << " the newest state root ("
+        << report.balances << " balances)\n";
+    if (report.unchainedTransactions > 0)
+    {
+        std::cout << "  " << report.unchainedTransactions << " transactions were written outside the chain\n";
+    }
+}
@@ -0,0 +1,452 @@
+#include "LedgerPipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+// Retries of a journal batch: the delay doubles from the first one up to the cap, then the pipeline gives up
+static const int maxJournalAttempts = 10;
+static const int firstRetryMillis = 50;
+static const int maxRetryMillis = 5000;
+
+// Returns the steady clock in nanoseconds
+static int64_t nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Backs off while a stage has nothing to do: spin first (lowest latency), then yield, then sleep
+static void idleWait(int& idle)
+{
+    ++idle;
+    if (idle < 200)
+    {
+        return;
+    }
+    if (idle < 2000)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+// Constructor for LedgerPipeline
+LedgerPipeline::LedgerPipeline(Ledger& ledger, SQLData& sqlData, size_t capacity, bool journal)
+    : ledger(ledger), engine(ledger.balanceEngine()), dbName(sqlData.databaseName()),
+      dbVFS(sqlData.vfsName() ? sqlData.vfsName() : ""), journalEnabled(journal), mask(0)
+{
+    size_t size = 1024;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    mask = size - 1;
+
+    ring.reset(new Slot[size]);
+    for (size_t i = 0; i < size; ++i)
+    {
+        ring[i].published.store(-1, std::memory_order_relaxed);
+    }
+
+    externalId = engine.accountId(Ledger::externalAccount);
+    exchangeId = engine.accountId(Ledger::exchangeAccount);
+    usdId = engine.assetId("USD", SQLData::DataBaseState::DBS_BALANCE);
+}
+
+// Destructor for LedgerPipeline
+LedgerPipeline::~LedgerPipeline()
+{
+    stop();
+}
+
+// Starts one thread per stage
+bool LedgerPipeline::start()
+{
+    if (running.load())
+    {
+        return true;
+    }
+    if (!ledger.isBalanceEngineEnabled())
+    {
+        std::cerr << "[ERROR] The pipeline needs the balance engine (Ledger::enableBalanceEngine).\n";
+        return false;
+    }
+    if (journalEnabled && !storage.open(dbName, dbVFS.empty() ? nullptr : dbVFS.c_str()))
+    {
+        return false;
+    }
+
+    running.store(true);
+    business.thread = std::thread(&LedgerPipeline::runBusiness, this);
+    notifyStage.thread = std::thread(&LedgerPipeline::runNotify, this);
+    if (journalEnabled)
+    {
+        journalStage.thread = std::thread(&LedgerPipeline::runJournal, this);
+    }
+    return true;
+}
+
+// Drains the ring and joins the stage threads
+bool LedgerPipeline::stop()
+{
+    if (!running.load())
+    {
+        return !journalFailed.load();
+    }
+
+    drain();
+    running.store(false);
+    for (Stage* stage : { &business, &journalStage, &notifyStage })
+    {
+        if (stage->thread.joinable())
+        {
+            stage->thread.join();
+        }
+    }
+    storage.close();
+    return !journalFailed.load();
+}
+
+// Claims a slot, copies the command in and publishes it
+uint64_t LedgerPipeline::submit(const LedgerCommand& command)
+{
+    // Nothing applied from now on could be made durable
+    if (journalFailed.load(std::memory_order_acquire))
+    {
+        return rejectedSequence;
+    }
+
+    int64_t sequence = claimed.fetch_add(1) + 1;
+    int64_t capacity = static_cast<int64_t>(mask + 1);
+
+    // Wait until the slowest downstream stage has released the slot used one lap ago. A failed journal stage no longer
+    // reads the ring, and a claimed sequence must still be published (the business stage rejects it)
+    int idle = 0;
+    for (;;)
+    {
+        int64_t released = notifyStage.cursor.load(std::memory_order_acquire);
+        released = std::min(released, journalEnabled && !journalFailed.load(std::memory_order_acquire)
+                                          ? journalStage.cursor.load(std::memory_order_acquire)
+                                          : business.cursor.load(std::memory_order_acquire));
+        if (sequence - capacity <= released)
+        {
+            break;
+        }
+        idleWait(idle);
+    }
+
+    Slot& slot = ring[sequence & mask];
+    slot.command = command;
+    slot.command.sequence = static_cast<uint64_t>(sequence);
+    slot.command.status = CommandStatus::CS_Pending;
+    slot.command.submittedNanos = nowNanos();
+    slot.published.store(sequence, std::memory_order_release);
+    return static_cast<uint64_t>(sequence);
+}
+
+// Waits for every stage to catch up with the last claimed sequence (a failed journal stage never will)
+bool LedgerPipeline::drain()
+{
+    int64_t target = claimed.load();
+    int idle = 0;
+    while (notifyStage.cursor.load() < target || (journalEnabled && !journalFailed.load() && journalStage.cursor.load() < target))
+    {
+        idleWait(idle);
+    }
+    return !journalFailed.load();
+}
+
+// Waits until upstream has published the sequence, returns the highest sequence available (-1 when stopped)
+int64_t LedgerPipeline::waitFor(int64_t sequence, const std::function<int64_t()>& available, const Stage& self)
+{
+    int idle = 0;
+    for (;;)
+    {
+        int64_t upTo = available();
+        if (upTo >= sequence)
+        {
+            return upTo;
+        }
+        if (!running.load(std::memory_order_acquire) && self.cursor.load() >= claimed.load())
+        {
+            return -1;
+        }
+        idleWait(idle);
+    }
+}
+
+// Updates the counters of a stage after one run
+void LedgerPipeline::recordBatch(Stage& stage, uint64_t count, uint64_t depth)
+{
+    stage.processed.fetch_add(count, std::memory_order_relaxed);
+    stage.batches.fetch_add(1, std::memory_order_relaxed);
+    if (depth > stage.maxDepth.load(std::memory_order_relaxed))
+    {
+        stage.maxDepth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+// Copies the counters of a stage
+StageStats LedgerPipeline::readStats(const Stage& stage)
+{
+    StageStats stats;
+    stats.processed = stage.processed.load(std::memory_order_relaxed);
+    stats.batches = stage.batches.load(std::memory_order_relaxed);
+    stats.maxDepth = stage.maxDepth.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Turns a command into balanced postings
+size_t LedgerPipeline::buildPostings(const LedgerCommand& command, EnginePosting* postings) const
+{
+    switch (command.type)
+    {
+    case CommandType::CT_Deposit:
+        postings[0] = { command.account, command.asset, command.amount };
+        postings[1] = { externalId, command.asset, -command.amount };
+        return 2;
+    case CommandType::CT_Withdraw:
+        postings[0] = { command.account, command.asset, -command.amount };
+        postings[1] = { externalId, command.asset, command.amount };
+        return 2;
+    case CommandType::CT_Buy:
+        postings[0] = { command.account, usdId, -command.amount };
+        postings[1] = { exchangeId, usdId, command.amount };
+        postings[2] = { command.account, command.asset, command.amount2 };
+        postings[3] = { exchangeId, command.asset, -command.amount2 };
+        return 4;
+    case CommandType::CT_Send:
+        postings[0] = { command.account, command.asset, -command.amount };
+        postings[1] = { command.counterparty, command.asset, command.amount };
+        return 2;
+    case CommandType::CT_Sell:
+        postings[0] = { command.account, command.asset, -command.amount };
+        postings[1] = { exchangeId, command.asset, command.amount };
+        postings[2] = { command.account, usdId, command.amount2 };
+        postings[3] = { exchangeId, usdId, -command.amount2 };
+        return 4;
+    }
+    return 0;
+}
+
+// Business logic stage: the only thread that mutates balances through the pipeline
+void LedgerPipeline::runBusiness()
+{
+    int64_t next = 0;
+    for (;;)
+    {
+        // Highest run of consecutive published slots (producers may publish out of order)
+        int64_t upTo = waitFor(next, [&]()
+            {
+                int64_t last = next - 1;
+                while (last - next < static_cast<int64_t>(mask) && ring[(last + 1) & mask].published.load(std::memory_order_acquire) == last + 1)
+                {
+                    ++last;
+                }
+                return last;
+            }, business);
+        if (upTo < 0)
+        {
+            return;
+        }
+
+        recordBatch(business, upTo - next + 1, claimed.load(std::memory_order_relaxed) - next + 1);
+        int64_t nowMillis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        bool durable = !journalFailed.load(std::memory_order_acquire); // Nothing is applied once the journal can no longer be written
+        for (; next <= upTo; ++next)
+        {
+            LedgerCommand& command = ring[next & mask].command;
+            EnginePosting postings[4];
+            size_t count = buildPostings(command, postings);
+
+            bool valid = durable && command.amount > 0 && ((command.type != CommandType::CT_Buy && command.type != CommandType::CT_Sell) || command.amount2 > 0) &&
+                (command.type != CommandType::CT_Send || command.account != command.counterparty);
+            command.appliedMillis = nowMillis;
+            command.status = ledger.commandWindow().run(command.commandId, nowMillis, [&]() { return valid && engine.apply(postings, count); });
+        }
+        business.cursor.store(upTo, std::memory_order_release);
+    }
+}
+
+// Journal stage: everything the business stage processed since the last run becomes one database transaction
+void LedgerPipeline::runJournal()
+{
+    static const TransactionKind kinds[] = { TransactionKind::TK_Deposit, TransactionKind::TK_Withdraw, TransactionKind::TK_Buy, TransactionKind::TK_Send, TransactionKind::TK_Sell };
+
+    std::unordered_map<uint32_t, std::string> accountNames; // Cached names (the registry takes a lock)
+    std::unordered_map<uint32_t, std::string> assetNames;
+    auto accountName = [&](uint32_t id) -> const std::string&
+        {
+            auto it = accountNames.find(id);
+            return it != accountNames.end() ? it->second : accountNames.emplace(id, engine.accountName(id)).first->second;
+        };
+    auto assetName = [&](uint32_t id) -> const std::string&
+        {
+            auto it = assetNames.find(id);
+            return it != assetNames.end() ? it->second : assetNames.emplace(id, engine.assetName(id)).first->second;
+        };
+
+    LedgerAudit* audit = ledger.integrityChain();
+    std::vector<SQLData::JournalEntry> batch;
+    int64_t next = 0;
+    for (;;)
+    {
+        int64_t upTo = waitFor(next, [&]() { return business.cursor.load(std::memory_order_acquire); }, journalStage);
+        if (upTo < 0)
+        {
+            return;
+        }
+
+        recordBatch(journalStage, upTo - next + 1, upTo - next + 1);
+        batch.clear();
+        for (int64_t sequence = next; sequence <= upTo; ++sequence)
+        {
+            const LedgerCommand& command = ring[sequence & mask].command;
+            if (command.status != CommandStatus::CS_Applied)
+            {
+                continue;
+            }
+
+            EnginePosting postings[4];
+            size_t count = buildPostings(command, postings);
+
+            SQLData::JournalEntry entry;
+            entry.kind = transactionKindName(kinds[static_cast<int>(command.type)]);
+            entry.createdAt = command.appliedMillis;
+            entry.commandId = command.commandId;
+            if (command.type == CommandType::CT_Send)
+            {
+                entry.memo = "to " + accountName(command.counterparty);
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                entry.postings.push_back({ accountName(postings[i].account), assetName(postings[i].asset), engine.bookOf(postings[i].asset), postings[i].amount });
+            }
+            batch.push_back(std::move(entry));
+        }
+
+        // Retry (the balances already changed in memory) with a doubling delay, logging the 1st, 2nd, 4th, 8th... failure.
+        // The batch extends the ledger's integrity chain in its own transaction, like the persister's batches
+        bool staged = false;
+        auto writeChainLink = [&](const std::vector<sqlite3_int64>& txIDs)
+            {
+                staged = true;
+                return audit->stage(storage, batch, txIDs);
+            };
+        int delayMillis = firstRetryMillis;
+        for (int attempt = 1; !batch.empty() && !storage.persistJournalBatch(batch, audit ? std::function<bool(const std::vector<sqlite3_int64>&)>(writeChainLink) : nullptr); ++attempt)
+        {
+            if (staged)
+            {
+                audit->rollbackStaged();
+                staged = false;
+            }
+            if (attempt == maxJournalAttempts)
+            {
+                // Give up: the business stage rejects everything from now on and drain/stop stop waiting for this stage
+                journalFailed.store(true, std::memory_order_release);
+                std::cerr << "[ERROR] Pipeline journal batch of " << batch.size() << " transactions failed " << attempt
+                    << " times, the pipeline no longer accepts commands\n";
+                return;
+            }
+            if ((attempt & (attempt - 1)) == 0)
+            {
+                std::cerr << "[ERROR] Pipeline journal batch of " << batch.size() << " transactions failed (attempt " << attempt
+                    << "), retrying in " << delayMillis << " ms\n";
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMillis));
+            delayMillis = std::min(delayMillis * 2, maxRetryMillis);
+        }
+        if (staged)
+        {
+            audit->commitStaged();
+        }
+
+        next = upTo + 1;
+        journalStage.cursor.store(upTo, std::memory_order_release);
+    }
+}
+
+// Notification stage: hands every result to the callback
+void LedgerPipeline::runNotify()
+{
+    int64_t next = 0;
+    for (;;)
+    {
+        int64_t upTo = waitFor(next, [&]() { return business.cursor.load(std::memory_order_acquire); }, notifyStage);
+        if (upTo < 0)
+        {
+            return;
+        }
+
+        recordBatch(notifyStage, upTo - next + 1, upTo - next + 1);
+        if (notify)
+        {
+            for (int64_t sequence = next; sequence <= upTo; ++sequence)
+            {
+                notify(ring[sequence & mask].command);
+            }
+        }
+
+        next = upTo + 1;
+        notifyStage.cursor.store(upTo, std::memory_order_release);
+    }
+}
+
+// Builds a deposit command (money into the wallet, like Ledger::deposit)
+LedgerCommand LedgerPipeline::deposit(const std::string& userID, const std::string& moneyName, Amount amount)
+{
+    LedgerCommand command = {};
+    command.type = CommandType::CT_Deposit;
+    command.account = engine.accountId(userID);
+    command.asset = engine.assetId(moneyName, SQLData::DataBaseState::DBS_BALANCE);
+    command.amount = amount;
+    return command;
+}
+
+// Builds a withdraw command (coins leave the ledger)
+LedgerCommand LedgerPipeline::withdraw(const std::string& userID, const std::string& coinName, Amount amount)
+{
+    LedgerCommand command = {};
+    command.type = CommandType::CT_Withdraw;
+    command.account = engine.accountId(userID);
+    command.asset = engine.assetId(coinName, SQLData::DataBaseState::DBS_COINS);
+    command.amount = amount;
+    return command;
+}
+
+// Builds a buy command
+LedgerCommand LedgerPipeline::buy(const std::string& userID, const std::string& coinName, Amount usdAmount, Amount coinAmount)
+{
+    LedgerCommand command = {};
+    command.type = CommandType::CT_Buy;
+    command.account = engine.accountId(userID);
+    command.asset = engine.assetId(coinName, SQLData::DataBaseState::DBS_COINS);
+    command.amount = usdAmount;
+    command.amount2 = coinAmount;
+    return command;
+}
+
+// Builds a send command
+LedgerCommand LedgerPipeline::send(const std::string& fromUserID, const std::string& toUserID, const std::string& coinName, Amount amount)
+{
+    LedgerCommand command = {};
+    command.type = CommandType::CT_Send;
+    command.account = engine.accountId(fromUserID);
+    command.counterparty = engine.accountId(toUserID);
+    command.asset = engine.assetId(coinName, SQLData::DataBaseState::DBS_COINS);
+    command.amount = amount;
+    return command;
+}
+
+// Builds a sell command
+LedgerCommand LedgerPipeline::sell(const std::string& userID, const std::string& coinName, Amount coinAmount, Amount usdAmount)
+{
+    LedgerCommand command = {};
+    command.type = CommandType::CT_Sell;
+    command.account = engine.accountId(userID);
+    command.asset = engine.assetId(coinName, SQLData::DataBaseState::DBS_COINS);
+    command.amount = coinAmount;
+    command.amount2 = usdAmount;
+    return command;
+}
@@ -0,0 +1,495 @@
+#include "LedgerReconciler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+// Table side of one balance
+struct TableSum
+{
+    Amount amount = 0;           // Sum of its rows
+    sqlite3_int64 cut = 0;       // Newest transaction the rows include
+};
+
+// Journal side of one balance
+struct JournalSum
+{
+    Amount amount = 0;           // Sum of its postings up to the reconciled transaction
+    uint64_t postings = 0;       // Number of those postings
+    sqlite3_int64 lastTxID = 0;  // Newest of their transactions
+};
+
+// Posting committed while the tables were read (it may be missing from the balance's rows)
+struct TailPosting
+{
+    std::string key;             // Balance key
+    sqlite3_int64 txID;          // Transaction
+    Amount amount;               // Signed change
+};
+
+// Per-asset totals of the journal
+struct JournalAssetSum
+{
+    Amount net = 0;              // Every posting
+    Amount system = 0;           // Postings of system accounts
+};
+
+// Returns the milliseconds since start
+static double millisSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Balance key: the book byte, then "account\x1fasset"
+static std::string keyOf(SQLData::DataBaseState book, const char* account, const char* asset)
+{
+    std::string key(1, static_cast<char>(book));
+    key += account;
+    key += '\x1f';
+    key += asset;
+    return key;
+}
+
+// Splits a balance key back into its parts
+static void splitKey(const std::string& key, SQLData::DataBaseState& book, std::string& account, std::string& asset)
+{
+    size_t separator = key.find('\x1f', 1);
+    book = static_cast<SQLData::DataBaseState>(key[0]);
+    account = key.substr(1, separator - 1);
+    asset = key.substr(separator + 1);
+}
+
+// Constructor for LedgerReconciler
+LedgerReconciler::LedgerReconciler(unsigned threads)
+    : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+// Reads the tables in chunks, then the journal up to the newest cut, then merges shard by shard
+bool LedgerReconciler::run(SQLData& sqlData, ReconcileReport& report)
+{
+    report = ReconcileReport();
+    report.threads = threadCount;
+    const unsigned shards = threadCount;
+    const std::string dbName = sqlData.databaseName();
+    const char* vfsName = sqlData.vfsName();
+    std::hash<std::string> hasher;
+    std::atomic<bool> failed(false);
+
+    // Opens a worker's connection, runs body on it and closes it
+    auto runWorkers = [&](const std::function<void(unsigned worker, SQLData& connection)>& body)
+        {
+            std::vector<std::thread> workers;
+            for (unsigned worker = 0; worker < threadCount; ++worker)
+            {
+                workers.emplace_back([&, worker]()
+                    {
+                        SQLData connection;
+                        if (!connection.open(dbName, vfsName))
+                        {
+                            failed = true;
+                            return;
+                        }
+                        body(worker, connection);
+                        connection.close();
+                    });
+            }
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+        };
+
+    // 1. Tables: every table is split into one rowid range per worker; the last range is open-ended, so it
+    // also picks up the rows inserted during the scan
+    auto start = std::chrono::steady_clock::now();
+    const SQLData::DataBaseState books[] = { SQLData::DataBaseState::DBS_COINS, SQLData::DataBaseState::DBS_BALANCE };
+    sqlite3_int64 maxRowIDs[] = { sqlData.maxID("COINS"), sqlData.maxID("BALANCE") };
+    sqlite3_int64 lastCuts[] = { 0, 0 };                      // Cut of the final chunk of each table
+    std::vector<std::vector<std::unordered_map<std::string, TableSum>>> tableShards(threadCount,
+        std::vector<std::unordered_map<std::string, TableSum>>(shards));
+    std::vector<sqlite3_int64> minCuts(threadCount, LLONG_MAX), maxCuts(threadCount, 0);
+    std::vector<uint64_t> rowCounts(threadCount, 0), chunkCounts(threadCount, 0);
+
+    runWorkers([&](unsigned worker, SQLData& connection)
+        {
+            for (int table = 0; table < 2 && !failed; ++table)
+            {
+                sqlite3_int64 from = 1 + maxRowIDs[table] * worker / threadCount;
+                sqlite3_int64 to = worker + 1 == threadCount ? LLONG_MAX : 1 + maxRowIDs[table] * (worker + 1) / threadCount;
+                for (;;)
+                {
+                    sqlite3_int64 cut = 0, lastID = 0;
+                    int rows = 0;
+                    if (!connection.readBalanceChunk(books[table], from, to, chunkRows, cut, lastID,
+                        [&](const char* userID, const char* asset, Amount amount)
+                        {
+                            std::string key = keyOf(books[table], userID, asset);
+                            TableSum& sum = tableShards[worker][hasher(key) % shards][key];
+                            sum.amount += amount;
+                            sum.cut = std::max(sum.cut, cut); // A balance in several rows is compared at its newest cut
+                            ++rows;
+                        }))
+                    {
+                        failed = true;
+                        return;
+                    }
+                    ++chunkCounts[worker];
+                    rowCounts[worker] += rows;
+                    minCuts[worker] = std::min(minCuts[worker], cut);
+                    maxCuts[worker] = std::max(maxCuts[worker], cut);
+                    if (rows < chunkRows)
+                    {
+                        if (to == LLONG_MAX)
+                        {
+                            lastCuts[table] = cut;
+                        }
+                        break;
+                    }
+                    from = lastID + 1;
+                }
+            }
+        });
+    report.tableMillis = millisSince(start);
+    if (failed)
+    {
+        std::cerr << "[ERROR] Reconciliation could not read the balance tables\n";
+        return false;
+    }
+
+    sqlite3_int64 minCut = LLONG_MAX;
+    for (unsigned worker = 0; worker < threadCount; ++worker)
+    {
+        report.rows += rowCounts[worker];
+        report.chunks += chunkCounts[worker];
+        minCut = std::min(minCut, minCuts[worker]);
+        report.throughTxID = std::max(report.throughTxID, maxCuts[worker]);
+    }
+    const sqlite3_int64 throughTxID = report.throughTxID;
+
+    // 2. Journal: posting ranges start at transaction starts, so every transaction is checked by one worker.
+    // Every posting up to the newest cut counts; the ones after the oldest cut are also kept as the tail.
+    start = std::chrono::steady_clock::now();
+    sqlite3_int64 maxPostingID = sqlData.maxID("POSTINGS");
+    std::vector<sqlite3_int64> bounds(threadCount + 1, maxPostingID + 1);
+    bounds[0] = 1;
+    for (unsigned worker = 1; worker < threadCount; ++worker)
+    {
+        sqlite3_int64 first = sqlData.transactionStart(1 + maxPostingID * worker / threadCount);
+        bounds[worker] = std::max(bounds[worker - 1], first ? first : maxPostingID + 1);
+    }
+
+    std::vector<std::vector<std::unordered_map<std::string, JournalSum>>> journalShards(threadCount,
+        std::vector<std::unordered_map<std::string, JournalSum>>(shards));
+    std::vector<std::vector<std::vector<TailPosting>>> tails(threadCount, std::vector<std::vector<TailPosting>>(shards));
+    std::vector<std::map<std::string, JournalAssetSum>> assetSums(threadCount);
+    std::vector<uint64_t> postingCounts(threadCount, 0), transactionCounts(threadCount, 0), unbalancedCounts(threadCount, 0);
+    std::vector<std::vector<std::string>> unbalancedSamples(threadCount);
+
+    runWorkers([&](unsigned worker, SQLData& connection)
+        {
+            sqlite3_int64 openTxID = 0;                              // Transaction being checked
+            std::vector<std::pair<std::string, Amount>> openTotals;  // Its per-asset totals
+            auto closeTransaction = [&]()
+                {
+                    for (const auto& total : openTotals)
+                    {
+                        if (total.second != 0)
+                        {
+                            ++unbalancedCounts[worker];
+                            if (unbalancedSamples[worker].size() < maxSamples)
+                            {
+                                std::ostringstream sample;
+                                sample << "transaction " << openTxID << ": " << total.first << " nets to " << std::fixed
+                                    << std::setprecision(8) << FixedPoint::toDouble(total.second);
+                                unbalancedSamples[worker].push_back(sample.str());
+                            }
+                            break;
+                        }
+                    }
+                    openTotals.clear();
+                };
+
+            sqlite3_int64 from = bounds[worker];
+            while (from < bounds[worker + 1])
+            {
+                sqlite3_int64 lastID = 0;
+                if (!connection.readPostingChunk(from, bounds[worker + 1], chunkRows, lastID,
+                    [&](sqlite3_int64 txID, const char* userID, const char* asset, SQLData::DataBaseState book, Amount amount)
+                    {
+                        if (txID > throughTxID)
+                        {
+                            return;
+                        }
+                        ++postingCounts[worker];
+                        if (txID != openTxID)
+                        {
+                            closeTransaction();
+                            openTxID = txID;
+                            ++transactionCounts[worker];
+                        }
+                        auto total = std::find_if(openTotals.begin(), openTotals.end(),
+                            [asset](const std::pair<std::string, Amount>& entry) { return entry.first == asset; });
+                        if (total == openTotals.end())
+                        {
+                            openTotals.emplace_back(asset, amount);
+                        }
+                        else
+                        {
+                            total->second += amount;
+                        }
+
+                        JournalAssetSum& assetSum = assetSums[worker][asset];
+                        assetSum.net += amount;
+                        if (userID[0] == '@')
+                        {
+                            assetSum.system += amount; // System accounts live in the journal only
+                            return;
+                        }
+
+                        std::string key = keyOf(book, userID, asset);
+                        unsigned shard = static_cast<unsigned>(hasher(key) % shards);
+                        JournalSum& sum = journalShards[worker][shard][key];
+                        sum.amount += amount;
+                        ++sum.postings;
+                        sum.lastTxID = txID;
+                        if (txID > minCut)
+                        {
+                            tails[worker][shard].push_back({ std::move(key), txID, amount });
+                        }
+                    }))
+                {
+                    failed = true;
+                    return;
+                }
+                if (lastID == 0)
+                {
+                    break;
+                }
+                from = lastID + 1;
+            }
+            closeTransaction();
+        });
+    report.journalMillis = millisSince(start);
+    if (failed)
+    {
+        std::cerr << "[ERROR] Reconciliation could not read the journal\n";
+        return false;
+    }
+
+    // 3. Merge: thread s owns shard s of every worker. A balance is expected to hold its postings minus the
+    // tail postings committed after its rows were read; a balance without rows is compared at its table's final cut.
+    start = std::chrono::steady_clock::now();
+    std::vector<std::map<std::string, AssetSupply>> shardSupply(shards);
+    std::vector<std::vector<Discrepancy>> shardDiscrepancies(shards);
+    std::vector<size_t> shardBalances(shards, 0);
+    std::vector<std::thread> mergers;
+    for (unsigned shard = 0; shard < shards; ++shard)
+    {
+        mergers.emplace_back([&, shard]()
+            {
+                struct Merged
+                {
+                    TableSum table;
+                    JournalSum journal;
+                    bool inTable = false;
+                    Amount tail = 0;
+                    uint64_t tailPostings = 0;
+                };
+                std::unordered_map<std::string, Merged> merged;
+                for (unsigned worker = 0; worker < threadCount; ++worker)
+                {
+                    for (auto& entry : tableShards[worker][shard])
+                    {
+                        Merged& balance = merged[entry.first];
+                        balance.table.amount += entry.second.amount;
+                        balance.table.cut = std::max(balance.table.cut, entry.second.cut);
+                        balance.inTable = true;
+                    }
+                    std::unordered_map<std::string, TableSum>().swap(tableShards[worker][shard]);
+                }
+                for (unsigned worker = 0; worker < threadCount; ++worker)
+                {
+                    for (auto& entry : journalShards[worker][shard])
+                    {
+                        JournalSum& sum = merged[entry.first].journal;
+                        sum.amount += entry.second.amount;
+                        sum.postings += entry.second.postings;
+                        sum.lastTxID = std::max(sum.lastTxID, entry.second.lastTxID);
+                    }
+                    std::unordered_map<std::string, JournalSum>().swap(journalShards[worker][shard]);
+                }
+                for (unsigned worker = 0; worker < threadCount; ++worker)
+                {
+                    for (const auto& posting : tails[worker][shard])
+                    {
+                        Merged& balance = merged[posting.key];
+                        sqlite3_int64 cut = balance.inTable ? balance.table.cut
+                            : lastCuts[static_cast<SQLData::DataBaseState>(posting.key[0]) == SQLData::DataBaseState::DBS_COINS ? 0 : 1];
+                        if (posting.txID > cut)
+                        {
+                            balance.tail += posting.amount;
+                            ++balance.tailPostings;
+                        }
+                    }
+                }
+
+                shardBalances[shard] = merged.size();
+                SQLData::DataBaseState book;
+                std::string account, asset;
+                for (const auto& entry : merged)
+                {
+                    const Merged& balance = entry.second;
+                    splitKey(entry.first, book, account, asset);
+                    AssetSupply& supply = shardSupply[shard][asset];
+                    supply.table += balance.table.amount;
+                    supply.journal += balance.journal.amount;
+                    supply.inFlight += balance.tail;
+
+                    Amount expected = balance.journal.amount - balance.tail;
+                    if (balance.table.amount != expected)
+                    {
+                        shardDiscrepancies[shard].push_back({ account, asset, book, balance.table.amount, expected,
+                            balance.journal.postings - balance.tailPostings, balance.journal.lastTxID });
+                    }
+                }
+            });
+    }
+    for (auto& merger : mergers)
+    {
+        merger.join();
+    }
+
+    // 4. Totals
+    std::map<std::string, AssetSupply> supply;
+    for (unsigned shard = 0; shard < shards; ++shard)
+    {
+        report.balances += shardBalances[shard];
+        for (const auto& entry : shardSupply[shard])
+        {
+            AssetSupply& total = supply[entry.first];
+            total.table += entry.second.table;
+            total.journal += entry.second.journal;
+            total.inFlight += entry.second.inFlight;
+        }
+        report.discrepancies += shardDiscrepancies[shard].size();
+        report.discrepancySamples.insert(report.discrepancySamples.end(), shardDiscrepancies[shard].begin(), shardDiscrepancies[shard].end());
+    }
+    for (unsigned worker = 0; worker < threadCount; ++worker)
+    {
+        report.postings += postingCounts[worker];
+        report.transactions += transactionCounts[worker];
+        report.unbalanced += unbalancedCounts[worker];
+        for (const auto& sample : unbalancedSamples[worker])
+        {
+            if (report.unbalancedSamples.size() < maxSamples)
+            {
+                report.unbalancedSamples.push_back(sample);
+            }
+        }
+        for (const auto& entry : assetSums[worker])
+        {
+            AssetSupply& total = supply[entry.first];
+            total.net += entry.second.net;
+            total.issued -= entry.second.system;
+        }
+    }
+
+    std::sort(report.discrepancySamples.begin(), report.discrepancySamples.end(), [](const Discrepancy& a, const Discrepancy& b)
+        {
+            return a.account != b.account ? a.account < b.account : a.asset != b.asset ? a.asset < b.asset : a.book < b.book;
+        });
+    if (report.discrepancySamples.size() > maxSamples)
+    {
+        report.discrepancySamples.resize(maxSamples);
+    }
+
+    report.reconciled = report.discrepancies == 0 && report.unbalanced == 0;
+    for (auto& entry : supply)
+    {
+        entry.second.asset = entry.first;
+        entry.second.conserved = entry.second.net == 0 && entry.second.table == entry.second.journal - entry.second.inFlight;
+        report.reconciled = report.reconciled && entry.second.conserved;
+        report.supply.push_back(entry.second);
+    }
+    report.mergeMillis = millisSince(start);
+    return true;
+}
+
+// Postings of the balance's book only, with the running sum
+bool LedgerReconciler::drillDown(SQLData& sqlData, const Discrepancy& discrepancy, std::vector<DrillDownRow>& rows)
+{
+    rows.clear();
+    Amount balance = 0;
+    return sqlData.forEachAccountPosting(discrepancy.account, discrepancy.asset, [&](const SQLData::PostingRecord& record)
+        {
+            if (record.book == discrepancy.book)
+            {
+                balance += record.amount;
+                rows.push_back({ record.txID, record.kind, record.amount, balance, record.createdAt });
+            }
+        });
+}
+
+// Prints the report
+void LedgerReconciler::print(const ReconcileReport& report)
+{
+    std::cout << "Reconciled " << report.rows << " balance rows (" << report.chunks << " read chunks) against "
+        << report.postings << " postings of " << report.transactions << " transactions on " << report.threads << " threads\n"
+        << std::fixed << std::setprecision(1)
+        << "  tables " << report.tableMillis << " ms, journal " << report.journalMillis << " ms, merge " << report.mergeMillis
+        << " ms; " << report.balances << " balances through transaction " << report.throughTxID
+        << (report.reconciled ? "  RECONCILED" : "  DIFFERENCES") << "\n"
+        << std::setprecision(8);
+    for (const auto& supply : report.supply)
+    {
+        std::cout << "  " << std::left << std::setw(8) << supply.asset << std::right << " table " << FixedPoint::toDouble(supply.table)
+            << ", journal " << FixedPoint::toDouble(supply.journal) << ", issued " << FixedPoint::toDouble(supply.issued);
+        if (supply.inFlight != 0)
+        {
+            std::cout << ", in flight " << FixedPoint::toDouble(supply.inFlight);
+        }
+        if (supply.net != 0)
+        {
+            std::cout << ", net " << FixedPoint::toDouble(supply.net);
+        }
+        std::cout << (supply.conserved ? "" : "  NOT CONSERVED") << "\n";
+    }
+    for (const auto& discrepancy : report.discrepancySamples)
+    {
+        std::cout << "  " << discrepancy.account << " " << discrepancy.asset << ": table " << FixedPoint::toDouble(discrepancy.table)
+            << ", journal " << FixedPoint::toDouble(discrepancy.journal) << " (" << discrepancy.postings << " postings, last transaction "
+            << discrepancy.lastTxID << ")\n";
+    }
+    if (report.discrepancies > report.discrepancySamples.size())
+    {
+        std::cout << "  ... " << report.discrepancies - report.discrepancySamples.size() << " more discrepancies\n";
+    }
+    for (const auto& sample : report.unbalancedSamples)
+    {
+        std::cout << "  " << sample << "\n";
+    }
+    if (report.unbalanced > report.unbalancedSamples.size())
+    {
+        std::cout << "  ... " << report.unbalanced - report.unbalancedSamples.size() << " more unbalanced transactions\n";
+    }
+    std::cout << std::defaultfloat;
+}
+
+// Prints the postings of one discrepancy and where the running balance ends
+void LedgerReconciler::print(const Discrepancy& discrepancy, const std::vector<DrillDownRow>& rows)
+{
+    std::cout << discrepancy.account << " " << discrepancy.asset << ": " << rows.size() << " postings\n" << std::fixed << std::setprecision(8);
+    for (const auto& row : rows)
+    {
+        std::cout << "  tx " << std::setw(10) << row.txID << "  " << std::left << std::setw(8) << row.kind << std::right
+            << std::setw(20) << FixedPoint::toDouble(row.amount) << std::setw(20) << FixedPoint::toDouble(row.balance) << "\n";
+    }
+    std::cout << "  journal " << FixedPoint::toDouble(rows.empty() ? 0 : rows.back().balance) << ", table " << FixedPoint::toDouble(discrepancy.table)
+        << ", difference " << FixedPoint::toDouble(discrepancy.table - (rows.empty() ? 0 : rows.back().balance)) << "\n" << std::defaultfloat;
+}
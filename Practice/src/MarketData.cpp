@@ -0,0 +1,176 @@
+#include "MarketData.h"
+#include <iostream>
+#include <thread>
+
+// Finds the position of a coin in the layout
+int64_t PriceLayout::find(const std::string& coinName) const
+{
+    auto it = index.find(coinName);
+    return it != index.end() ? static_cast<int64_t>(it->second) : -1;
+}
+
+// Finds a coin's price in the snapshot by name
+bool PriceSnapshot::find(const std::string& coinName, double& price) const
+{
+    int64_t position = layout ? layout->find(coinName) : -1;
+    if (position < 0)
+    {
+        return false;
+    }
+    price = prices[position];
+    return true;
+}
+
+// Constructor for MarketData
+MarketData::MarketData()
+    : sequence(0), version(0), layout(nullptr)
+{
+    layouts.push_back(std::make_unique<PriceLayout>()); // Empty layout until the first publish
+    layout.store(layouts.back().get(), std::memory_order_release);
+    for (auto& price : prices)
+    {
+        price.store(0.0, std::memory_order_relaxed);
+    }
+}
+
+// Seqlock write: odd sequence, data, even sequence
+void MarketData::publishLocked(const PriceLayout* newLayout, const double* newPrices, size_t count)
+{
+    uint64_t start = sequence.load(std::memory_order_relaxed);
+    sequence.store(start + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // The odd sequence is visible before any price changes
+
+    if (newLayout)
+    {
+        layout.store(newLayout, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        prices[i].store(newPrices[i], std::memory_order_relaxed);
+    }
+    version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    sequence.store(start + 2, std::memory_order_release);
+}
+
+// Publishes a full set of coins; a new layout only when the names changed
+bool MarketData::publishPrices(const std::list<Coin>& coins)
+{
+    if (coins.size() > maxCoins)
+    {
+        std::cerr << "[ERROR] At most " << maxCoins << " coins can be published\n";
+        return false;
+    }
+
+    std::vector<double> newPrices;
+    auto candidate = std::make_unique<PriceLayout>();
+    for (const auto& coin : coins)
+    {
+        candidate->index[coin.coinName] = candidate->names.size();
+        candidate->names.push_back(coin.coinName);
+        newPrices.push_back(coin.prise);
+    }
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    const PriceLayout* current = layout.load(std::memory_order_relaxed);
+    const PriceLayout* newLayout = nullptr;
+    if (current->names != candidate->names)
+    {
+        layouts.push_back(std::move(candidate));
+        newLayout = layouts.back().get();
+    }
+    publishLocked(newLayout, newPrices.data(), newPrices.size());
+    return true;
+}
+
+// Starts from the published prices and changes the given coins
+size_t MarketData::updatePrices(const std::vector<std::pair<std::string, double>>& updates)
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    const PriceLayout* current = layout.load(std::memory_order_relaxed);
+
+    double newPrices[maxCoins];
+    for (size_t i = 0; i < current->names.size(); ++i)
+    {
+        newPrices[i] = prices[i].load(std::memory_order_relaxed); // Only writers change them, and we are the writer
+    }
+
+    size_t applied = 0;
+    for (const auto& update : updates)
+    {
+        int64_t position = current->find(update.first);
+        if (position >= 0)
+        {
+            newPrices[position] = update.second;
+            ++applied;
+        }
+    }
+
+    if (applied > 0)
+    {
+        publishLocked(nullptr, newPrices, current->names.size());
+    }
+    return applied;
+}
+
+// Seqlock read: copy, then check that no publish overlapped the copy
+void MarketData::readPrices(PriceSnapshot& snapshot) const
+{
+    for (;;)
+    {
+        uint64_t start = sequence.load(std::memory_order_acquire);
+        if (start & 1)
+        {
+            std::this_thread::yield(); // A publish is in progress (a few stores long)
+            continue;
+        }
+
+        const PriceLayout* current = layout.load(std::memory_order_relaxed);
+        size_t count = current->names.size();
+        snapshot.prices.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            snapshot.prices[i] = prices[i].load(std::memory_order_relaxed);
+        }
+        snapshot.version = version.load(std::memory_order_relaxed);
+        snapshot.layout = current;
+
+        std::atomic_thread_fence(std::memory_order_acquire); // The copy is complete before the sequence is read again
+        if (sequence.load(std::memory_order_relaxed) == start)
+        {
+            return;
+        }
+    }
+}
+
+// Returns a fresh copy of the prices
+PriceSnapshot MarketData::priceSnapshot() const
+{
+    PriceSnapshot snapshot;
+    readPrices(snapshot);
+    return snapshot;
+}
+
+// Reads a single price under the seqlock
+bool MarketData::coinPrice(const std::string& coinName, double& price) const
+{
+    for (;;)
+    {
+        uint64_t start = sequence.load(std::memory_order_acquire);
+        if (start & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        int64_t position = layout.load(std::memory_order_relaxed)->find(coinName);
+        double value = position >= 0 ? prices[position].load(std::memory_order_relaxed) : 0.0;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == start)
+        {
+            price = value;
+            return position >= 0;
+        }
+    }
+}
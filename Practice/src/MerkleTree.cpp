@@ -0,0 +1,215 @@
+#include "MerkleTree.h"
+#include <algorithm>
+
+// Constructor for MerkleTree
+MerkleTree::MerkleTree()
+    : rebuildAll(false)
+{
+    clear();
+}
+
+// Domain-separated leaf hash
+Digest MerkleTree::leafHash(const std::string& account, const std::string& asset, Amount amount)
+{
+    const uint8_t tag = 0;
+    Sha256 sha;
+    sha.update(&tag, 1);
+    sha.updateString(account);
+    sha.updateString(asset);
+    sha.updateInt64(amount);
+    return sha.finish();
+}
+
+// Domain-separated node hash
+Digest MerkleTree::nodeHash(const Digest& left, const Digest& right)
+{
+    uint8_t block[65];
+    block[0] = 1;
+    std::copy(left.begin(), left.end(), block + 1);
+    std::copy(right.begin(), right.end(), block + 33);
+    return Sha256::hash(block, sizeof(block));
+}
+
+// Back to a single unused leaf
+void MerkleTree::clear()
+{
+    leaves.clear();
+    positions.clear();
+    dirty.clear();
+    emptyHashes.assign(1, Digest());
+    levels.assign(1, std::vector<Digest>(1, Digest()));
+    rebuildAll = false;
+}
+
+// Grows every level to the next power of two; the hashes are recomputed by commit
+void MerkleTree::reserveLeaves(size_t leafCount)
+{
+    size_t capacity = levels[0].size();
+    if (leafCount <= capacity)
+    {
+        return;
+    }
+    while (capacity < leafCount)
+    {
+        capacity *= 2;
+    }
+
+    size_t depth = 0;
+    while ((size_t(1) << depth) < capacity)
+    {
+        ++depth;
+    }
+    while (emptyHashes.size() <= depth)
+    {
+        emptyHashes.push_back(nodeHash(emptyHashes.back(), emptyHashes.back()));
+    }
+
+    levels.resize(depth + 1);
+    for (size_t level = 0; level <= depth; ++level)
+    {
+        levels[level].assign(capacity >> level, emptyHashes[level]);
+    }
+    rebuildAll = true;
+}
+
+// Appends a leaf for a new balance
+uint32_t MerkleTree::insert(const std::string& account, const std::string& asset, bool& created)
+{
+    auto it = positions.find(keyOf(account, asset));
+    created = it == positions.end();
+    if (!created)
+    {
+        return it->second;
+    }
+
+    uint32_t position = static_cast<uint32_t>(leaves.size());
+    positions.emplace(scratchKey, position);
+    reserveLeaves(leaves.size() + 1);
+    leaves.push_back({ account, asset, 0 });
+    dirty.push_back(position);
+    return position;
+}
+
+// Looks up the position of a balance
+int64_t MerkleTree::find(const std::string& account, const std::string& asset) const
+{
+    auto it = positions.find(keyOf(account, asset));
+    return it == positions.end() ? -1 : it->second;
+}
+
+// Overwrites a balance
+void MerkleTree::set(uint32_t position, Amount amount)
+{
+    leaves[position].amount = amount;
+    dirty.push_back(position);
+}
+
+// Adds to a balance
+void MerkleTree::add(uint32_t position, Amount delta)
+{
+    leaves[position].amount += delta;
+    dirty.push_back(position);
+}
+
+// Removes the newest leaves (the capacity stays)
+void MerkleTree::truncate(size_t leafCount)
+{
+    while (leaves.size() > leafCount)
+    {
+        positions.erase(keyOf(leaves.back().account, leaves.back().asset));
+        leaves.pop_back();
+    }
+    dirty.erase(std::remove_if(dirty.begin(), dirty.end(), [leafCount](uint32_t position) { return position >= leafCount; }), dirty.end());
+    rebuildAll = true; // Rare (only after a failed batch), a full rebuild keeps it simple
+}
+
+// Rehashes the dirty leaves and their ancestors, level by level
+void MerkleTree::commit()
+{
+    if (rebuildAll)
+    {
+        for (size_t position = 0; position < levels[0].size(); ++position)
+        {
+            levels[0][position] = position < leaves.size()
+                ? leafHash(leaves[position].account, leaves[position].asset, leaves[position].amount) : emptyHashes[0];
+        }
+        for (size_t level = 1; level < levels.size(); ++level)
+        {
+            // Only the part of the level above used leaves differs from the empty hash
+            size_t used = (leaves.size() + (size_t(1) << level) - 1) >> level;
+            for (size_t index = 0; index < levels[level].size(); ++index)
+            {
+                levels[level][index] = index < used
+                    ? nodeHash(levels[level - 1][index * 2], levels[level - 1][index * 2 + 1]) : emptyHashes[level];
+            }
+        }
+        dirty.clear();
+        rebuildAll = false;
+        return;
+    }
+
+    if (dirty.empty())
+    {
+        return;
+    }
+
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    for (uint32_t position : dirty)
+    {
+        levels[0][position] = leafHash(leaves[position].account, leaves[position].asset, leaves[position].amount);
+    }
+
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        // Parents of sorted indices stay sorted, so unique only has to drop neighbours
+        for (auto& index : dirty)
+        {
+            index >>= 1;
+        }
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        for (uint32_t index : dirty)
+        {
+            levels[level][index] = nodeHash(levels[level - 1][index * 2], levels[level - 1][index * 2 + 1]);
+        }
+    }
+    dirty.clear();
+}
+
+// Collects the sibling on every level
+bool MerkleTree::prove(const std::string& account, const std::string& asset, MerkleProof& proof) const
+{
+    int64_t position = find(account, asset);
+    if (position < 0)
+    {
+        return false;
+    }
+
+    proof.account = account;
+    proof.asset = asset;
+    proof.amount = leaves[position].amount;
+    proof.leafIndex = static_cast<uint64_t>(position);
+    proof.siblings.clear();
+    for (size_t level = 0; level + 1 < levels.size(); ++level)
+    {
+        proof.siblings.push_back(levels[level][(position >> level) ^ 1]);
+    }
+    proof.root = root();
+    return true;
+}
+
+// Recomputes the root from the leaf
+bool MerkleTree::verify(const MerkleProof& proof)
+{
+    if (proof.siblings.size() < 64 && (proof.leafIndex >> proof.siblings.size()) != 0)
+    {
+        return false; // The index does not fit a tree of that depth
+    }
+
+    Digest hash = leafHash(proof.account, proof.asset, proof.amount);
+    for (size_t level = 0; level < proof.siblings.size(); ++level)
+    {
+        hash = ((proof.leafIndex >> level) & 1) ? nodeHash(proof.siblings[level], hash) : nodeHash(hash, proof.siblings[level]);
+    }
+    return hash == proof.root;
+}
@@ -0,0 +1,278 @@
+#include "OrderBook.h"
+#include <algorithm>
+
+// Constructor for OrderBook
+OrderBook::OrderBook(Amount tickSize, Amount minPrice, uint32_t levelCount, size_t expectedOrders)
+    : tick(tickSize > 0 ? tickSize : 1), minPrice(minPrice), levels(levelCount, Level{ nil, nil, 0 }),
+      bestBidLevel(-1), bestAskLevel(levelCount), liveOrders(0)
+{
+    pool.reserve(expectedOrders);
+    freeSlots.reserve(expectedOrders);
+}
+
+// Checks that the price is inside the grid and a multiple of the tick
+bool OrderBook::validPrice(Amount price) const
+{
+    return price >= minPrice && (price - minPrice) % tick == 0 && levelOf(price) < static_cast<int64_t>(levels.size());
+}
+
+// USD value of a quantity at a price, rounded down
+Amount OrderBook::notional(Amount quantity, Amount price)
+{
+    Amount value = 0;
+    FixedPoint::mulDivFloor(quantity, price, FixedPoint::SCALE, value);
+    return value;
+}
+
+// Takes a slot from the free list (or grows the slab)
+uint32_t OrderBook::allocate()
+{
+    uint32_t slot;
+    if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(pool.size());
+        pool.push_back(Order{ nil, nil, 0, 0, 0, OrderSide::OS_Buy, false, 0 });
+    }
+
+    ++pool[slot].generation;
+    return slot;
+}
+
+// Unlinks the order (if it rests) and returns the slot to the pool
+void OrderBook::release(uint32_t slot)
+{
+    Order& order = pool[slot];
+    if (order.live)
+    {
+        Level& level = levels[order.level];
+        if (order.prev != nil)
+            pool[order.prev].next = order.next;
+        else
+            level.head = order.next;
+        if (order.next != nil)
+            pool[order.next].prev = order.prev;
+        else
+            level.tail = order.prev;
+
+        order.live = false;
+        --liveOrders;
+    }
+    freeSlots.push_back(slot);
+}
+
+// Moves the best levels past empty levels
+void OrderBook::refreshBest()
+{
+    while (bestBidLevel >= 0 && levels[bestBidLevel].head == nil)
+    {
+        --bestBidLevel;
+    }
+    while (bestAskLevel < static_cast<int64_t>(levels.size()) && levels[bestAskLevel].head == nil)
+    {
+        ++bestAskLevel;
+    }
+}
+
+// Matches against the opposite side in price-time priority, at the makers' prices
+Amount OrderBook::match(uint32_t owner, uint64_t takerId, OrderSide side, int64_t limitLevel, Amount quantity, std::vector<Fill>& fills)
+{
+    Amount filled = 0;
+    for (;;)
+    {
+        int64_t levelIndex = side == OrderSide::OS_Buy ? bestAskLevel : bestBidLevel;
+        bool crosses = side == OrderSide::OS_Buy
+            ? (levelIndex < static_cast<int64_t>(levels.size()) && levelIndex <= limitLevel)
+            : (levelIndex >= 0 && levelIndex >= limitLevel);
+        if (quantity == 0 || !crosses)
+        {
+            break;
+        }
+
+        Level& level = levels[levelIndex];
+        Amount price = priceOf(levelIndex);
+        while (quantity > 0 && level.head != nil)
+        {
+            uint32_t makerSlot = level.head;
+            Order& maker = pool[makerSlot];
+            Amount traded = std::min(quantity, maker.remaining);
+
+            maker.remaining -= traded;
+            level.quantity -= traded;
+            quantity -= traded;
+            filled += traded;
+
+            bool done = maker.remaining == 0;
+            fills.push_back(Fill{ idOf(makerSlot), takerId, maker.owner, owner, side, done, price, traded });
+            if (done)
+            {
+                release(makerSlot);
+            }
+        }
+
+        if (level.head == nil)
+        {
+            refreshBest();
+        }
+    }
+    return filled;
+}
+
+// Matches a limit order and rests the remainder
+OrderResult OrderBook::submitLimit(uint32_t owner, OrderSide side, Amount price, Amount quantity, std::vector<Fill>& fills)
+{
+    OrderResult result;
+    if (quantity <= 0 || !validPrice(price))
+    {
+        return result;
+    }
+
+    uint32_t slot = allocate();
+    result.accepted = true;
+    result.orderId = idOf(slot);
+
+    int64_t levelIndex = levelOf(price);
+    result.filled = match(owner, result.orderId, side, levelIndex, quantity, fills);
+    Amount remaining = quantity - result.filled;
+    if (remaining == 0)
+    {
+        release(slot);
+        return result;
+    }
+
+    // Rest at the tail of the level (time priority)
+    Order& order = pool[slot];
+    Level& level = levels[levelIndex];
+    order.prev = level.tail;
+    order.next = nil;
+    order.owner = owner;
+    order.level = static_cast<uint32_t>(levelIndex);
+    order.side = side;
+    order.live = true;
+    order.remaining = remaining;
+    if (level.tail != nil)
+        pool[level.tail].next = slot;
+    else
+        level.head = slot;
+    level.tail = slot;
+    level.quantity += remaining;
+    ++liveOrders;
+
+    if (side == OrderSide::OS_Buy)
+        bestBidLevel = std::max(bestBidLevel, levelIndex);
+    else
+        bestAskLevel = std::min(bestAskLevel, levelIndex);
+
+    result.resting = remaining;
+    return result;
+}
+
+// Matches a market order, the unmatched rest is dropped
+OrderResult OrderBook::submitMarket(uint32_t owner, OrderSide side, Amount quantity, std::vector<Fill>& fills)
+{
+    OrderResult result;
+    if (quantity <= 0)
+    {
+        return result;
+    }
+
+    uint32_t slot = allocate();
+    result.accepted = true;
+    result.orderId = idOf(slot);
+    int64_t limitLevel = side == OrderSide::OS_Buy ? static_cast<int64_t>(levels.size()) - 1 : 0;
+    result.filled = match(owner, result.orderId, side, limitLevel, quantity, fills);
+    release(slot);
+    return result;
+}
+
+// Removes a resting order
+bool OrderBook::cancel(uint64_t orderId, uint32_t owner, CanceledOrder& canceled)
+{
+    uint32_t slot = static_cast<uint32_t>(orderId & 0xFFFFFFFFu);
+    uint32_t generation = static_cast<uint32_t>(orderId >> 32);
+    if (slot >= pool.size() || !pool[slot].live || pool[slot].generation != generation || pool[slot].owner != owner)
+    {
+        return false;
+    }
+
+    Order& order = pool[slot];
+    canceled = CanceledOrder{ order.owner, order.side, priceOf(order.level), order.remaining };
+    levels[order.level].quantity -= order.remaining;
+    release(slot);
+    refreshBest();
+    return true;
+}
+
+// Empties the book
+void OrderBook::cancelAll(std::vector<std::pair<uint64_t, CanceledOrder>>& canceled)
+{
+    for (uint32_t slot = 0; slot < pool.size(); ++slot)
+    {
+        Order& order = pool[slot];
+        if (order.live)
+        {
+            canceled.emplace_back(idOf(slot), CanceledOrder{ order.owner, order.side, priceOf(order.level), order.remaining });
+            levels[order.level].quantity -= order.remaining;
+            release(slot);
+        }
+    }
+    refreshBest();
+}
+
+// Walks the opposite side without changing it
+Amount OrderBook::quote(OrderSide side, Amount quantity, Amount& usd) const
+{
+    Amount fillable = 0;
+    usd = 0;
+    int64_t levelIndex = side == OrderSide::OS_Buy ? bestAskLevel : bestBidLevel;
+    int64_t step = side == OrderSide::OS_Buy ? 1 : -1;
+
+    for (; quantity > 0 && levelIndex >= 0 && levelIndex < static_cast<int64_t>(levels.size()); levelIndex += step)
+    {
+        const Level& level = levels[levelIndex];
+        if (level.head == nil)
+        {
+            continue;
+        }
+
+        // Rounded down per level, which is never less than the sum of the per-fill amounts
+        Amount traded = std::min(quantity, level.quantity);
+        usd += notional(traded, priceOf(levelIndex));
+        fillable += traded;
+        quantity -= traded;
+    }
+    return fillable;
+}
+
+// Highest bid price
+Amount OrderBook::bestBid() const
+{
+    return bestBidLevel >= 0 ? priceOf(bestBidLevel) : 0;
+}
+
+// Lowest ask price
+Amount OrderBook::bestAsk() const
+{
+    return bestAskLevel < static_cast<int64_t>(levels.size()) ? priceOf(bestAskLevel) : 0;
+}
+
+// Aggregated levels of one side, best first
+std::vector<std::pair<Amount, Amount>> OrderBook::depth(OrderSide side, size_t maxLevels) const
+{
+    std::vector<std::pair<Amount, Amount>> result;
+    int64_t levelIndex = side == OrderSide::OS_Buy ? bestBidLevel : bestAskLevel;
+    int64_t step = side == OrderSide::OS_Buy ? -1 : 1;
+
+    for (; result.size() < maxLevels && levelIndex >= 0 && levelIndex < static_cast<int64_t>(levels.size()); levelIndex += step)
+    {
+        if (levels[levelIndex].head != nil)
+        {
+            result.emplace_back(priceOf(levelIndex), levels[levelIndex].quantity);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,198 @@
+#include "PortfolioValuation.h"
+#include "GatherKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <tuple>
+
+// Accounts per unit of work handed to a thread
+static const size_t rowsPerChunk = 4096;
+
+// Constructor for PortfolioValuation
+PortfolioValuation::PortfolioValuation(unsigned threads)
+    : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), simdEnabled(true)
+{
+    clear();
+}
+
+// Sets the worker count
+void PortfolioValuation::setThreadCount(unsigned threads)
+{
+    threadCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Empties the accounts and assets
+void PortfolioValuation::clear()
+{
+    accountNames.clear();
+    accountIds.clear();
+    offsets.assign(1, 0);
+    assetIndex.clear();
+    amounts.clear();
+    assetNames.clear();
+    assetIds.clear();
+    prices.clear();
+    values.clear();
+}
+
+// Interns an asset
+uint32_t PortfolioValuation::assetId(const std::string& assetName)
+{
+    auto inserted = assetIds.emplace(assetName, static_cast<uint32_t>(assetNames.size()));
+    if (inserted.second)
+    {
+        assetNames.push_back(assetName);
+        prices.push_back(0.0);
+    }
+    return inserted.first->second;
+}
+
+// Starts a new row
+void PortfolioValuation::beginAccount(const std::string& userID)
+{
+    accountIds[userID] = static_cast<uint32_t>(accountNames.size());
+    accountNames.push_back(userID);
+    offsets.push_back(offsets.back());
+}
+
+// Appends a holding to the newest row
+void PortfolioValuation::addHolding(uint32_t asset, double units)
+{
+    assetIndex.push_back(static_cast<int32_t>(asset));
+    amounts.push_back(units);
+    ++offsets.back();
+}
+
+// Groups the balance rows by account
+bool PortfolioValuation::load(SQLData& sqlData)
+{
+    std::vector<std::tuple<std::string, std::string, Amount>> balances;
+    bool ok = sqlData.forEachBalance([&](const std::string& userID, const std::string& asset, SQLData::DataBaseState, Amount amount)
+        {
+            if (!userID.empty() && userID[0] != '@' && amount != 0)
+            {
+                balances.emplace_back(userID, asset, amount);
+            }
+        });
+    if (!ok)
+    {
+        return false;
+    }
+
+    clear();
+    std::sort(balances.begin(), balances.end());
+    for (const auto& balance : balances)
+    {
+        if (accountNames.empty() || accountNames.back() != std::get<0>(balance))
+        {
+            beginAccount(std::get<0>(balance));
+        }
+        addHolding(assetId(std::get<1>(balance)), FixedPoint::toDouble(std::get<2>(balance)));
+    }
+    return true;
+}
+
+// Sets one price
+void PortfolioValuation::setPrice(uint32_t asset, double usdPrice)
+{
+    prices[asset] = usdPrice;
+}
+
+// Coins take their price from the snapshot, currencies their USD rate
+size_t PortfolioValuation::updatePrices(const PriceSnapshot& snapshot, const MarketData& market)
+{
+    std::shared_ptr<const FxTable> published = market.fx().table(); // One version of the rates for every asset
+    const FxTable& rates = *published;
+    size_t missing = 0;
+    for (size_t asset = 0; asset < assetNames.size(); ++asset)
+    {
+        double price = 0.0;
+        CurrencyId currencyId = rates.find(assetNames[asset]);
+        if (snapshot.find(assetNames[asset], price))
+        {
+            prices[asset] = price;
+        }
+        else if (currencyId >= 0 && rates.usdRates[currencyId] > 0.0)
+        {
+            prices[asset] = rates.usdRates[currencyId];
+        }
+        else
+        {
+            prices[asset] = 0.0;
+            ++missing;
+        }
+    }
+    return missing;
+}
+
+// Multiplies the holdings of the rows, then sums them per row.
+// The per-row sums come from a running total over the chunk (value of row = total at its end - total at its start):
+// rows hold a few holdings each, a loop per row would mispredict its exit on almost every row.
+void PortfolioValuation::valueRows(size_t firstRow, size_t lastRow, std::vector<double>& scratch)
+{
+    size_t first = offsets[firstRow];
+    size_t count = offsets[lastRow] - first;
+    scratch.resize(count + 1);
+    scratch[0] = 0.0;
+    double* holdingValues = scratch.data() + 1;
+
+    gatherMultiply(assetIndex.data() + first, amounts.data() + first, prices.data(), holdingValues, count, simdEnabled);
+
+    for (size_t i = 1; i <= count; ++i)
+    {
+        scratch[i] += scratch[i - 1];
+    }
+    for (size_t row = firstRow; row < lastRow; ++row)
+    {
+        values[row] = scratch[offsets[row + 1] - first] - scratch[offsets[row] - first];
+    }
+}
+
+// Hands out chunks of rows to the workers
+void PortfolioValuation::valueAll()
+{
+    size_t rowCount = accountNames.size();
+    values.resize(rowCount);
+    size_t chunkCount = (rowCount + rowsPerChunk - 1) / rowsPerChunk;
+    std::atomic<size_t> nextChunk(0);
+
+    auto work = [&]()
+        {
+            std::vector<double> scratch;
+            for (size_t chunk = nextChunk.fetch_add(1); chunk < chunkCount; chunk = nextChunk.fetch_add(1))
+            {
+                valueRows(chunk * rowsPerChunk, std::min(rowCount, (chunk + 1) * rowsPerChunk), scratch);
+            }
+        };
+
+    size_t workerCount = std::min<size_t>(threadCount, chunkCount);
+    if (workerCount <= 1)
+    {
+        work();
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < workerCount; ++i)
+    {
+        workers.emplace_back(work);
+    }
+    work(); // The calling thread takes chunks too
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Looks up an account's value
+double PortfolioValuation::value(const std::string& userID) const
+{
+    auto it = accountIds.find(userID);
+    return it != accountIds.end() && it->second < values.size() ? values[it->second] : 0.0;
+}
+
+// Name of the kernel in use
+const char* PortfolioValuation::kernelName() const
+{
+    return gatherMultiplyKernel(simdEnabled);
+}
@@ -0,0 +1,228 @@
+#include "PriceChart.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Pixels per candlestick
+static const float candlePixels = 6.0f;
+
+// Shortest and longest visible range
+static const int64_t minSpanMillis = 10 * 1000LL;
+static const int64_t maxSpanMillis = 365 * 24 * 60 * 60 * 1000LL;
+
+// Merges one price range into a bucket
+static void fold(ChartBucket& bucket, double open, double high, double low, double close)
+{
+    if (!bucket.filled)
+    {
+        bucket = { open, high, low, close, true };
+        return;
+    }
+    bucket.high = std::max(bucket.high, high);
+    bucket.low = std::min(bucket.low, low);
+    bucket.close = close;
+}
+
+// Constructor for PriceChart
+PriceChart::PriceChart()
+    : cachedFrom(0), cachedBucketMillis(0), cachedRevision(0), lowest(0.0), highest(0.0), sourceName(""), sourcePoints(0),
+      style(ChartStyle::CS_Line), spanMillis(60 * 60 * 1000LL), panMillis(0), pointsPerBucket(8), rebuildCount(0)
+{
+}
+
+// Zooms, within a minimum and a maximum range
+void PriceChart::setSpan(int64_t millis)
+{
+    spanMillis = std::clamp(millis, minSpanMillis, maxSpanMillis);
+}
+
+// One pass over the ticks, they are sorted so the pass stops at the end of the range
+void PriceChart::decimate(const PriceTick* ticks, size_t tickCount, int64_t from, int64_t bucketMillis, std::vector<ChartBucket>& out)
+{
+    std::fill(out.begin(), out.end(), ChartBucket{ 0.0, 0.0, 0.0, 0.0, false });
+    int64_t to = from + static_cast<int64_t>(out.size()) * bucketMillis;
+    for (size_t i = 0; i < tickCount && ticks[i].time < to; ++i)
+    {
+        if (ticks[i].time >= from)
+        {
+            double price = ticks[i].price;
+            fold(out[static_cast<size_t>((ticks[i].time - from) / bucketMillis)], price, price, price, price);
+        }
+    }
+}
+
+// Same for candles; a candle starting before the range still overlaps it and goes to the first bucket
+void PriceChart::decimate(const Candle* candles, size_t candleCount, int64_t from, int64_t bucketMillis, std::vector<ChartBucket>& out)
+{
+    std::fill(out.begin(), out.end(), ChartBucket{ 0.0, 0.0, 0.0, 0.0, false });
+    int64_t to = from + static_cast<int64_t>(out.size()) * bucketMillis;
+    for (size_t i = 0; i < candleCount && candles[i].start < to; ++i)
+    {
+        const Candle& candle = candles[i];
+        size_t index = candle.start < from ? 0 : static_cast<size_t>((candle.start - from) / bucketMillis);
+        fold(out[index], candle.open, candle.high, candle.low, candle.close);
+    }
+}
+
+// Picks the source: raw ticks when the ring covers the range with few enough of them, else the finest tier that fits
+void PriceChart::rebuild(const PriceHistory& history, const std::string& coinName, int64_t from, int64_t bucketMillis, size_t count)
+{
+    int64_t to = from + static_cast<int64_t>(count) * bucketMillis - 1;
+    size_t budget = pointsPerBucket * count;
+    buckets.resize(count);
+
+    bool complete = false;
+    size_t rawCount = history.tickCount(coinName, from, to, complete);
+    if (complete && rawCount <= budget)
+    {
+        history.ticks(coinName, from, to, tickScratch);
+        decimate(tickScratch.data(), tickScratch.size(), from, bucketMillis, buckets);
+        sourceName = "ticks";
+        sourcePoints = tickScratch.size();
+    }
+    else
+    {
+        HistoryTier tier = PriceHistory::tierFor(from, to, budget);
+        history.candles(coinName, tier, from, to, candleScratch);
+        decimate(candleScratch.data(), candleScratch.size(), from, bucketMillis, buckets);
+        sourceName = PriceHistory::tierName(tier);
+        sourcePoints = candleScratch.size();
+    }
+
+    lowest = INFINITY;
+    highest = -INFINITY;
+    for (const auto& bucket : buckets)
+    {
+        if (bucket.filled)
+        {
+            lowest = std::min(lowest, bucket.low);
+            highest = std::max(highest, bucket.high);
+        }
+    }
+
+    cachedCoin = coinName;
+    cachedFrom = from;
+    cachedBucketMillis = bucketMillis;
+    ++rebuildCount;
+}
+
+// Handles zoom and pan, rebuilds the buckets if needed and draws one primitive per bucket
+void PriceChart::draw(const char* id, const PriceHistory& history, const std::string& coinName, ImVec2 size)
+{
+    ImVec2 available = ImGui::GetContentRegionAvail();
+    size.x = std::max(size.x > 0.0f ? size.x : available.x, 50.0f);
+    size.y = std::max(size.y > 0.0f ? size.y : available.y, 50.0f);
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton(id, size);
+
+    // Wheel zooms around the right edge, dragging right goes back in time
+    ImGuiIO& io = ImGui::GetIO();
+    bool hovered = ImGui::IsItemHovered();
+    if (hovered && io.MouseWheel != 0.0f)
+    {
+        setSpan(static_cast<int64_t>(spanMillis * std::pow(0.8, io.MouseWheel)));
+    }
+    if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left))
+    {
+        panMillis = std::max<int64_t>(0, panMillis + static_cast<int64_t>(io.MouseDelta.x / size.x * spanMillis));
+    }
+    if (hovered && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+    {
+        panMillis = 0;
+    }
+
+    // Bucket boundaries are aligned to the bucket width, so following the latest prices moves them only once per bucket
+    size_t count = static_cast<size_t>(style == ChartStyle::CS_Line ? size.x : std::max(1.0f, size.x / candlePixels));
+    int64_t bucketMillis = std::max<int64_t>(1, spanMillis / static_cast<int64_t>(count));
+    int64_t end = PriceHistory::nowMillis() - panMillis;
+    int64_t from = (end / bucketMillis + 1) * bucketMillis - static_cast<int64_t>(count) * bucketMillis;
+
+    uint64_t revision = history.revision();
+    if (coinName != cachedCoin || from != cachedFrom || bucketMillis != cachedBucketMillis || count != buckets.size() || revision != cachedRevision)
+    {
+        rebuild(history, coinName, from, bucketMillis, count);
+        cachedRevision = revision;
+    }
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 corner(origin.x + size.x, origin.y + size.y);
+    drawList->AddRectFilled(origin, corner, IM_COL32(20, 22, 28, 255));
+    if (!(lowest <= highest))
+    {
+        drawList->AddText(ImVec2(origin.x + 6.0f, origin.y + 6.0f), IM_COL32(160, 160, 160, 255), "No prices in this range");
+        return;
+    }
+
+    // Flat series get a small range so they draw in the middle
+    double range = highest - lowest;
+    double padding = range > 0.0 ? range * 0.05 : std::max(std::fabs(highest) * 0.001, 1e-9);
+    double bottom = lowest - padding;
+    double scale = (size.y - 2.0f) / (range + 2.0 * padding);
+    auto yOf = [&](double price) { return corner.y - 1.0f - static_cast<float>((price - bottom) * scale); };
+    float bucketWidth = size.x / static_cast<float>(count);
+
+    if (style == ChartStyle::CS_Line)
+    {
+        // Min-max bar of every pixel column keeps the spikes that a plain line through the closes would hide
+        // (AddLine builds its own path, so the closes are collected and drawn as one polyline afterwards)
+        linePoints.clear();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const ChartBucket& bucket = buckets[i];
+            if (bucket.filled)
+            {
+                float x = origin.x + (i + 0.5f) * bucketWidth;
+                if (bucket.high > bucket.low)
+                {
+                    drawList->AddLine(ImVec2(x, yOf(bucket.high)), ImVec2(x, yOf(bucket.low)), IM_COL32(70, 110, 170, 255));
+                }
+                linePoints.push_back(ImVec2(x, yOf(bucket.close)));
+            }
+        }
+        drawList->AddPolyline(linePoints.data(), static_cast<int>(linePoints.size()), IM_COL32(120, 180, 255, 255), ImDrawFlags_None, 1.5f);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const ChartBucket& bucket = buckets[i];
+            if (!bucket.filled)
+            {
+                continue;
+            }
+
+            float left = origin.x + i * bucketWidth + 1.0f;
+            float right = std::max(left + 1.0f, origin.x + (i + 1) * bucketWidth - 1.0f);
+            float middle = (left + right) * 0.5f;
+            ImU32 color = bucket.close >= bucket.open ? IM_COL32(80, 200, 120, 255) : IM_COL32(220, 80, 80, 255);
+            float top = yOf(std::max(bucket.open, bucket.close));
+            float base = std::max(top + 1.0f, yOf(std::min(bucket.open, bucket.close)));
+            drawList->AddLine(ImVec2(middle, yOf(bucket.high)), ImVec2(middle, yOf(bucket.low)), color);
+            drawList->AddRectFilled(ImVec2(left, top), ImVec2(right, base), color);
+        }
+    }
+
+    // Price scale and where the data came from
+    char label[96];
+    snprintf(label, sizeof(label), "%.2f", highest);
+    drawList->AddText(ImVec2(origin.x + 4.0f, origin.y + 2.0f), IM_COL32(200, 200, 200, 255), label);
+    snprintf(label, sizeof(label), "%.2f", lowest);
+    drawList->AddText(ImVec2(origin.x + 4.0f, corner.y - ImGui::GetTextLineHeight() - 2.0f), IM_COL32(200, 200, 200, 255), label);
+    snprintf(label, sizeof(label), "%zu %s -> %zu buckets", sourcePoints, sourceName, count);
+    drawList->AddText(ImVec2(corner.x - ImGui::CalcTextSize(label).x - 4.0f, origin.y + 2.0f), IM_COL32(140, 140, 140, 255), label);
+
+    // Crosshair and prices of the bucket under the mouse
+    if (hovered)
+    {
+        size_t index = static_cast<size_t>(std::clamp((io.MousePos.x - origin.x) / bucketWidth, 0.0f, count - 1.0f));
+        float x = origin.x + (index + 0.5f) * bucketWidth;
+        drawList->AddLine(ImVec2(x, origin.y), ImVec2(x, corner.y), IM_COL32(255, 255, 255, 60));
+        const ChartBucket& bucket = buckets[index];
+        if (bucket.filled)
+        {
+            int64_t secondsAgo = (PriceHistory::nowMillis() - (from + static_cast<int64_t>(index) * bucketMillis)) / 1000;
+            ImGui::SetTooltip("%llds ago\nO %.4f\nH %.4f\nL %.4f\nC %.4f", static_cast<long long>(secondsAgo),
+                bucket.open, bucket.high, bucket.low, bucket.close);
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#include "PriceFeed.h"
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+// Constructor for PriceFeed
+PriceFeed::PriceFeed(MarketData& marketData, PriceHistory* priceHistory)
+    : market(marketData), history(priceHistory), running(false), updates(0), publishes(0), rejected(0)
+{
+}
+
+// Destructor for PriceFeed
+PriceFeed::~PriceFeed()
+{
+    stop();
+}
+
+// Records under one timestamp (unknown coins were not published, so they get no history)
+void PriceFeed::record(const std::vector<std::pair<std::string, double>>& batch)
+{
+    if (!history)
+    {
+        return;
+    }
+
+    market.readPrices(recorded);
+    int64_t now = PriceHistory::nowMillis();
+    for (const auto& update : batch)
+    {
+        if (recorded.layout->find(update.first) >= 0)
+        {
+            history->addTick(update.first, now, update.second);
+        }
+    }
+}
+
+// Sleeps until the next poll or until stop is called
+bool PriceFeed::waitFor(int millis)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    wakeWorker.wait_for(lock, std::chrono::milliseconds(millis), [this]() { return !running; });
+    return running;
+}
+
+// Starts following a file
+bool PriceFeed::startFile(const std::string& path, int pollMillis)
+{
+    if (worker.joinable())
+    {
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&PriceFeed::runFile, this, path, pollMillis);
+    return true;
+}
+
+// Starts the random walk
+bool PriceFeed::startSimulated(int ticksPerSecond, double volatility, unsigned seed)
+{
+    if (worker.joinable() || ticksPerSecond <= 0)
+    {
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&PriceFeed::runSimulated, this, ticksPerSecond, volatility, seed);
+    return true;
+}
+
+// Stops and joins the worker
+void PriceFeed::stop()
+{
+    if (!worker.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+}
+
+// Reads the complete lines appended since the last poll and publishes them together
+void PriceFeed::runFile(std::string path, int pollMillis)
+{
+    std::streamoff offset = 0;
+    std::vector<std::pair<std::string, double>> batch;
+
+    do
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            continue; // The producer has not created it yet
+        }
+
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        if (size < offset)
+        {
+            offset = 0; // Truncated or replaced: start over
+        }
+        if (size == offset)
+        {
+            continue;
+        }
+
+        std::string appended(static_cast<size_t>(size - offset), '\0');
+        file.seekg(offset);
+        file.read(&appended[0], appended.size());
+
+        // A line without its newline is still being written, it is read on the next poll
+        size_t complete = appended.rfind('\n');
+        if (complete == std::string::npos)
+        {
+            continue;
+        }
+        offset += static_cast<std::streamoff>(complete + 1);
+
+        batch.clear();
+        std::istringstream lines(appended.substr(0, complete));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            if (line.empty() || line[0] == '#' || line == "\r")
+            {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            std::string coinName;
+            double price = 0.0;
+            if (fields >> coinName >> price && std::isfinite(price) && price > 0.0)
+            {
+                batch.emplace_back(coinName, price);
+            }
+            else
+            {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (!batch.empty())
+        {
+            size_t applied = market.updatePrices(batch);
+            updates.fetch_add(batch.size(), std::memory_order_relaxed);
+            rejected.fetch_add(batch.size() - applied, std::memory_order_relaxed);
+            if (applied > 0)
+            {
+                publishes.fetch_add(1, std::memory_order_relaxed);
+                record(batch);
+            }
+        }
+    } while (waitFor(pollMillis));
+}
+
+// Geometric random walk of every listed coin
+void PriceFeed::runSimulated(int ticksPerSecond, double volatility, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<double> step(0.0, volatility);
+    PriceSnapshot snapshot;
+    std::vector<std::pair<std::string, double>> batch;
+    int tickMillis = std::max(1, 1000 / ticksPerSecond);
+
+    while (waitFor(tickMillis))
+    {
+        market.readPrices(snapshot);
+        batch.clear();
+        for (size_t i = 0; i < snapshot.size(); ++i)
+        {
+            batch.emplace_back(snapshot.name(i), snapshot.prices[i] * std::exp(step(random)));
+        }
+
+        if (!batch.empty() && market.updatePrices(batch) > 0)
+        {
+            updates.fetch_add(batch.size(), std::memory_order_relaxed);
+            publishes.fetch_add(1, std::memory_order_relaxed);
+            record(batch);
+        }
+    }
+}
+
+// Returns a copy of the counters
+PriceFeedStats PriceFeed::stats() const
+{
+    PriceFeedStats result;
+    result.updates = updates.load(std::memory_order_relaxed);
+    result.publishes = publishes.load(std::memory_order_relaxed);
+    result.rejected = rejected.load(std::memory_order_relaxed);
+    return result;
+}
@@ -0,0 +1,430 @@
+#include "PriceHistory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+
+// Size of one persisted candle: start, open, high, low, close, ticks
+static const size_t recordSize = 8 + 4 * 8 + 4;
+
+// Serializes a candle into a file record
+static void writeRecord(std::ofstream& file, const Candle& candle)
+{
+    char record[recordSize];
+    std::memcpy(record, &candle.start, 8);
+    std::memcpy(record + 8, &candle.open, 8);
+    std::memcpy(record + 16, &candle.high, 8);
+    std::memcpy(record + 24, &candle.low, 8);
+    std::memcpy(record + 32, &candle.close, 8);
+    std::memcpy(record + 40, &candle.ticks, 4);
+    file.write(record, recordSize);
+}
+
+// Deserializes a file record
+static Candle readRecord(const char* record)
+{
+    Candle candle;
+    std::memcpy(&candle.start, record, 8);
+    std::memcpy(&candle.open, record + 8, 8);
+    std::memcpy(&candle.high, record + 16, 8);
+    std::memcpy(&candle.low, record + 24, 8);
+    std::memcpy(&candle.close, record + 32, 8);
+    std::memcpy(&candle.ticks, record + 40, 4);
+    return candle;
+}
+
+// Bucket width of a tier
+int64_t PriceHistory::tierMillis(HistoryTier tier)
+{
+    switch (tier)
+    {
+    case HistoryTier::HT_Second: return 1000;
+    case HistoryTier::HT_Minute: return 60 * 1000;
+    default: return 60 * 60 * 1000;
+    }
+}
+
+// Short name of a tier (also the file extension)
+const char* PriceHistory::tierName(HistoryTier tier)
+{
+    switch (tier)
+    {
+    case HistoryTier::HT_Second: return "1s";
+    case HistoryTier::HT_Minute: return "1m";
+    default: return "1h";
+    }
+}
+
+// Constructor for PriceHistory
+PriceHistory::PriceHistory(size_t ticksPerCoin)
+    : ringCapacity(std::max<size_t>(1, ticksPerCoin)), revisionCounter(0)
+{
+    closedLimits[static_cast<size_t>(HistoryTier::HT_Second)] = 24 * 60 * 60; // One day of seconds
+    closedLimits[static_cast<size_t>(HistoryTier::HT_Minute)] = 0;
+    closedLimits[static_cast<size_t>(HistoryTier::HT_Hour)] = 0;
+}
+
+// Destructor for PriceHistory
+PriceHistory::~PriceHistory()
+{
+    // Unfinished candles are written too; if their bucket gets more ticks after a restart, the candle is
+    // written again when it closes and the later record replaces this one on load
+    for (auto& coin : series)
+    {
+        for (auto& tier : coin.second->tiers)
+        {
+            if (tier.file.is_open())
+            {
+                if (tier.hasCurrent)
+                {
+                    writeRecord(tier.file, tier.current);
+                }
+                tier.file.close();
+            }
+        }
+    }
+}
+
+// Loads <coin>.<tier> files and keeps them open for appending
+bool PriceHistory::open(const std::string& directoryPath)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (!series.empty())
+    {
+        std::cerr << "[ERROR] Price history must be opened before any tick is added\n";
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directoryPath, error);
+    if (!std::filesystem::is_directory(directoryPath, error))
+    {
+        std::cerr << "[ERROR] Cannot create the price history directory " << directoryPath << "\n";
+        return false;
+    }
+    directory = directoryPath;
+
+    for (const auto& entry : std::filesystem::directory_iterator(directoryPath, error))
+    {
+        std::string extension = entry.path().extension().string();
+        size_t level = 0;
+        while (level < tierCount && extension != std::string(".") + tierName(static_cast<HistoryTier>(level)))
+        {
+            ++level;
+        }
+        if (level == tierCount || !entry.is_regular_file())
+        {
+            continue;
+        }
+
+        // A record cut short by a crash is dropped, appends must start on a record boundary
+        uintmax_t size = entry.file_size(error);
+        if (size % recordSize != 0)
+        {
+            std::filesystem::resize_file(entry.path(), size - size % recordSize, error);
+            size -= size % recordSize;
+        }
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<char> data(static_cast<size_t>(size));
+        if (!data.empty() && !file.read(data.data(), data.size()))
+        {
+            std::cerr << "[ERROR] Cannot read " << entry.path().string() << "\n";
+            continue;
+        }
+
+        std::string coinName = entry.path().stem().string();
+        auto inserted = series.emplace(coinName, nullptr);
+        if (inserted.second)
+        {
+            inserted.first->second = std::make_unique<CoinSeries>();
+        }
+        CandleSeries& tier = inserted.first->second->tiers[level];
+        size_t limit = closedLimits[level];
+        size_t count = data.size() / recordSize;
+        size_t first = (limit && count > limit) ? count - limit : 0;
+        for (size_t i = first; i < count; ++i)
+        {
+            Candle candle = readRecord(data.data() + i * recordSize);
+            if (!tier.closed.empty() && tier.closed.back().start == candle.start)
+            {
+                tier.closed.back() = candle; // Rewritten after a restart, the later record has every tick
+            }
+            else
+            {
+                tier.closed.push_back(candle);
+            }
+        }
+
+        // The newest candle may have been written at shutdown before its bucket ended: it keeps filling
+        if (!tier.closed.empty())
+        {
+            tier.current = tier.closed.back();
+            tier.closed.pop_back();
+            tier.hasCurrent = true;
+            tier.closedUntil = tier.current.start;
+        }
+    }
+
+    // Every coin found appends to its files from now on
+    for (auto& coin : series)
+    {
+        for (size_t level = 0; level < tierCount; ++level)
+        {
+            std::string path = directory + "/" + coin.first + "." + tierName(static_cast<HistoryTier>(level));
+            coin.second->tiers[level].file.open(path, std::ios::binary | std::ios::app);
+        }
+    }
+    revisionCounter.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+// Sets the in-memory limit of a tier
+void PriceHistory::setMemoryLimit(HistoryTier tier, size_t candles)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    closedLimits[static_cast<size_t>(tier)] = candles;
+}
+
+// Finds or creates a coin's history (called with the lock held exclusively)
+PriceHistory::CoinSeries& PriceHistory::coinSeries(const std::string& coinName)
+{
+    auto it = series.find(coinName);
+    if (it != series.end())
+    {
+        return *it->second;
+    }
+
+    auto coin = std::make_unique<CoinSeries>();
+    if (!directory.empty())
+    {
+        for (size_t level = 0; level < tierCount; ++level)
+        {
+            std::string path = directory + "/" + coinName + "." + tierName(static_cast<HistoryTier>(level));
+            coin->tiers[level].file.open(path, std::ios::binary | std::ios::app);
+        }
+    }
+    return *series.emplace(coinName, std::move(coin)).first->second;
+}
+
+// Folds a tick into the candle of its bucket
+void PriceHistory::aggregate(CandleSeries& tier, HistoryTier level, int64_t time, double price)
+{
+    int64_t width = tierMillis(level);
+    int64_t bucket = time - ((time % width) + width) % width;
+    if (bucket < tier.closedUntil || (tier.hasCurrent && bucket < tier.current.start))
+    {
+        return; // The bucket is already closed (persisted before a restart, or the clock went back)
+    }
+
+    if (tier.hasCurrent && bucket == tier.current.start)
+    {
+        tier.current.high = std::max(tier.current.high, price);
+        tier.current.low = std::min(tier.current.low, price);
+        tier.current.close = price;
+        ++tier.current.ticks;
+        return;
+    }
+
+    if (tier.hasCurrent)
+    {
+        tier.closed.push_back(tier.current);
+        tier.closedUntil = tier.current.start + width;
+        if (tier.file.is_open())
+        {
+            writeRecord(tier.file, tier.current);
+            if (level != HistoryTier::HT_Second)
+            {
+                tier.file.flush(); // Seconds are flushed in batches by the OS buffer, coarser tiers right away
+            }
+        }
+
+        // Dropping the oldest half at once keeps trimming amortized O(1)
+        size_t limit = closedLimits[static_cast<size_t>(level)];
+        if (limit && tier.closed.size() >= 2 * limit)
+        {
+            tier.closed.erase(tier.closed.begin(), tier.closed.end() - limit);
+        }
+    }
+
+    tier.current = { bucket, price, price, price, price, 1 };
+    tier.hasCurrent = true;
+}
+
+// Appends a tick to the ring and every tier
+bool PriceHistory::addTick(const std::string& coinName, int64_t time, double price)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    CoinSeries& coin = coinSeries(coinName);
+
+    if (coin.ringCount > 0 && time < tickAt(coin, coin.ringCount - 1).time)
+    {
+        return false;
+    }
+
+    if (coin.ring.size() < ringCapacity)
+    {
+        coin.ring.push_back({ time, price });
+        ++coin.ringCount;
+    }
+    else
+    {
+        coin.ring[coin.ringStart] = { time, price }; // Overwrites the oldest tick
+        coin.ringStart = (coin.ringStart + 1) % coin.ring.size();
+    }
+
+    for (size_t level = 0; level < tierCount; ++level)
+    {
+        aggregate(coin.tiers[level], static_cast<HistoryTier>(level), time, price);
+    }
+    revisionCounter.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+// Binary search over the ring in time order
+size_t PriceHistory::firstTickAt(const CoinSeries& coin, int64_t time)
+{
+    size_t low = 0;
+    size_t high = coin.ringCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (tickAt(coin, middle).time < time)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Copies the ticks from the first one at or after from
+size_t PriceHistory::ticks(const std::string& coinName, int64_t from, int64_t to, std::vector<PriceTick>& out) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    out.clear();
+    auto it = series.find(coinName);
+    if (it == series.end())
+    {
+        return 0;
+    }
+    const CoinSeries& coin = *it->second;
+
+    for (size_t i = firstTickAt(coin, from); i < coin.ringCount && tickAt(coin, i).time <= to; ++i)
+    {
+        out.push_back(tickAt(coin, i));
+    }
+    return out.size();
+}
+
+// Two binary searches; the ring is complete from its oldest tick on (only the oldest ticks are overwritten)
+size_t PriceHistory::tickCount(const std::string& coinName, int64_t from, int64_t to, bool& complete) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    complete = false;
+    auto it = series.find(coinName);
+    if (it == series.end() || it->second->ringCount == 0)
+    {
+        return 0;
+    }
+    const CoinSeries& coin = *it->second;
+
+    complete = tickAt(coin, 0).time <= from;
+    return to < from ? 0 : firstTickAt(coin, to + 1) - firstTickAt(coin, from);
+}
+
+// Binary search for the first closed candle ending after from
+size_t PriceHistory::candles(const std::string& coinName, HistoryTier tier, int64_t from, int64_t to, std::vector<Candle>& out) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    out.clear();
+    auto it = series.find(coinName);
+    if (it == series.end())
+    {
+        return 0;
+    }
+
+    const CandleSeries& candleSeries = it->second->tiers[static_cast<size_t>(tier)];
+    int64_t width = tierMillis(tier);
+    auto first = std::lower_bound(candleSeries.closed.begin(), candleSeries.closed.end(), from,
+        [width](const Candle& candle, int64_t time) { return candle.start + width <= time; });
+    auto last = std::upper_bound(first, candleSeries.closed.end(), to,
+        [](int64_t time, const Candle& candle) { return time < candle.start; });
+    out.assign(first, last);
+
+    const Candle& current = candleSeries.current;
+    if (candleSeries.hasCurrent && current.start <= to && current.start + width > from)
+    {
+        out.push_back(current);
+    }
+    return out.size();
+}
+
+// Finest tier whose candle count over the range fits
+HistoryTier PriceHistory::tierFor(int64_t from, int64_t to, size_t maxCandles)
+{
+    for (size_t level = 0; level + 1 < tierCount; ++level)
+    {
+        HistoryTier tier = static_cast<HistoryTier>(level);
+        if (static_cast<uint64_t>(std::max<int64_t>(0, to - from)) / tierMillis(tier) + 1 <= maxCandles)
+        {
+            return tier;
+        }
+    }
+    return HistoryTier::HT_Hour;
+}
+
+// Oldest candle or tick to the newest
+bool PriceHistory::timeRange(const std::string& coinName, int64_t& first, int64_t& last) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = series.find(coinName);
+    if (it == series.end())
+    {
+        return false;
+    }
+    const CoinSeries& coin = *it->second;
+
+    bool found = false;
+    first = INT64_MAX;
+    last = INT64_MIN;
+    if (coin.ringCount > 0)
+    {
+        first = tickAt(coin, 0).time;
+        last = tickAt(coin, coin.ringCount - 1).time;
+        found = true;
+    }
+    for (const auto& tier : coin.tiers)
+    {
+        if (!tier.closed.empty())
+        {
+            first = std::min(first, tier.closed.front().start);
+            last = std::max(last, tier.closed.back().start);
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Coins in name order
+std::vector<std::string> PriceHistory::coinNames() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::string> names;
+    for (const auto& coin : series)
+    {
+        names.push_back(coin.first);
+    }
+    return names;
+}
+
+// Wall-clock time (persisted with the candles, so not the steady clock)
+int64_t PriceHistory::nowMillis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,227 @@
+#include "PricesVTab.h"
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// Column positions in the declared schema
+enum PricesColumn
+{
+    PC_CoinName = 0,
+    PC_Price = 1,
+    PC_SnapshotVersion = 2
+};
+
+// Plans chosen by xBestIndex
+enum PricesPlan
+{
+    PP_FullScan = 0,   // Walk every coin in the snapshot
+    PP_CoinLookup = 1  // coin_name = ? (single hash lookup)
+};
+
+// Copies the prices once for every statement run until the matching unpin
+void PinnedPrices::pin()
+{
+    if (depth++ == 0)
+    {
+        market->readPrices(snapshot);
+    }
+}
+
+// Virtual table instance
+struct PricesTable
+{
+    sqlite3_vtab base;      // Must be the first member
+    PinnedPrices* prices;   // Pinned snapshot and source of the unpinned ones
+};
+
+// Cursor over one snapshot for the whole statement (xFilter runs again for every outer row of a join)
+struct PricesCursor
+{
+    sqlite3_vtab_cursor base;                    // Must be the first member
+    PriceSnapshot own;                           // Prices copied when the cursor was opened (no pin held)
+    const PriceSnapshot* snapshot;               // Prices the statement reads: the pinned ones or own
+    size_t position;                             // Current row
+    size_t end;                                  // One past the last row to return
+};
+
+static int pricesConnect(sqlite3* db, void* aux, int, const char* const*, sqlite3_vtab** out, char**)
+{
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(coin_name TEXT, price REAL, snapshot_version INTEGER)");
+    if (rc != SQLITE_OK)
+    {
+        return rc;
+    }
+
+    auto* table = static_cast<PricesTable*>(sqlite3_malloc(sizeof(PricesTable)));
+    if (!table)
+    {
+        return SQLITE_NOMEM;
+    }
+
+    memset(table, 0, sizeof(PricesTable));
+    table->prices = static_cast<PinnedPrices*>(aux);
+    *out = &table->base;
+
+    sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+    return SQLITE_OK;
+}
+
+static int pricesDisconnect(sqlite3_vtab* vtab)
+{
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+// Uses the coin_name equality constraint when the planner offers one
+static int pricesBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info)
+{
+    auto* table = reinterpret_cast<PricesTable*>(vtab);
+
+    for (int i = 0; i < info->nConstraint; ++i)
+    {
+        const auto& constraint = info->aConstraint[i];
+        if (constraint.usable && constraint.iColumn == PC_CoinName && constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+        {
+            info->aConstraintUsage[i].argvIndex = 1;
+            info->aConstraintUsage[i].omit = 1;
+            info->idxNum = PP_CoinLookup;
+            info->estimatedCost = 1.0;
+            info->estimatedRows = 1;
+            info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+            return SQLITE_OK;
+        }
+    }
+
+    double rows = static_cast<double>(table->prices->market->priceSnapshot().size());
+    info->idxNum = PP_FullScan;
+    info->estimatedCost = rows + 1.0;
+    info->estimatedRows = static_cast<sqlite3_int64>(rows);
+    return SQLITE_OK;
+}
+
+// Opened once per statement: this is where the statement's prices are chosen
+static int pricesOpen(sqlite3_vtab* vtab, sqlite3_vtab_cursor** out)
+{
+    auto* table = reinterpret_cast<PricesTable*>(vtab);
+    auto* cursor = new (std::nothrow) PricesCursor();
+    if (!cursor)
+    {
+        return SQLITE_NOMEM;
+    }
+
+    if (table->prices->depth > 0)
+    {
+        cursor->snapshot = &table->prices->snapshot;
+    }
+    else
+    {
+        table->prices->market->readPrices(cursor->own);
+        cursor->snapshot = &cursor->own;
+    }
+    cursor->position = 0;
+    cursor->end = 0;
+    *out = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int pricesClose(sqlite3_vtab_cursor* cur)
+{
+    delete reinterpret_cast<PricesCursor*>(cur);
+    return SQLITE_OK;
+}
+
+// Positions the cursor according to the plan (the prices stay those chosen when the cursor was opened)
+static int pricesFilter(sqlite3_vtab_cursor* cur, int idxNum, const char*, int argc, sqlite3_value** argv)
+{
+    auto* cursor = reinterpret_cast<PricesCursor*>(cur);
+
+    cursor->position = 0;
+    cursor->end = cursor->snapshot->size();
+
+    if (idxNum == PP_CoinLookup && argc == 1)
+    {
+        cursor->end = 0;
+        const unsigned char* name = sqlite3_value_text(argv[0]);
+        if (name)
+        {
+            int64_t position = cursor->snapshot->layout->find(reinterpret_cast<const char*>(name));
+            if (position >= 0)
+            {
+                cursor->position = static_cast<size_t>(position);
+                cursor->end = cursor->position + 1;
+            }
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+static int pricesNext(sqlite3_vtab_cursor* cur)
+{
+    reinterpret_cast<PricesCursor*>(cur)->position++;
+    return SQLITE_OK;
+}
+
+static int pricesEof(sqlite3_vtab_cursor* cur)
+{
+    auto* cursor = reinterpret_cast<PricesCursor*>(cur);
+    return cursor->position >= cursor->end;
+}
+
+// Returns column values out of the copied snapshot (names point into the layout, which lives as long as the MarketData)
+static int pricesColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int column)
+{
+    auto* cursor = reinterpret_cast<PricesCursor*>(cur);
+    const std::string& coinName = cursor->snapshot->name(cursor->position);
+
+    switch (column)
+    {
+    case PC_CoinName:
+        sqlite3_result_text(ctx, coinName.c_str(), static_cast<int>(coinName.size()), SQLITE_STATIC);
+        break;
+    case PC_Price:
+        sqlite3_result_double(ctx, cursor->snapshot->prices[cursor->position]);
+        break;
+    case PC_SnapshotVersion:
+        sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(cursor->snapshot->version));
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int pricesRowid(sqlite3_vtab_cursor* cur, sqlite3_int64* rowid)
+{
+    *rowid = static_cast<sqlite3_int64>(reinterpret_cast<PricesCursor*>(cur)->position);
+    return SQLITE_OK;
+}
+
+// Registers PRICES as an eponymous-only module (no CREATE VIRTUAL TABLE needed)
+bool registerPricesModule(sqlite3* db, PinnedPrices* prices)
+{
+    static sqlite3_module module = []()
+        {
+            sqlite3_module m;
+            memset(&m, 0, sizeof(m));
+            m.iVersion = 1;
+            m.xCreate = nullptr;   // nullptr makes the module eponymous-only
+            m.xConnect = pricesConnect;
+            m.xBestIndex = pricesBestIndex;
+            m.xDisconnect = pricesDisconnect;
+            m.xDestroy = pricesDisconnect;
+            m.xOpen = pricesOpen;
+            m.xClose = pricesClose;
+            m.xFilter = pricesFilter;
+            m.xNext = pricesNext;
+            m.xEof = pricesEof;
+            m.xColumn = pricesColumn;
+            m.xRowid = pricesRowid;
+            return m;
+        }();
+
+    if (sqlite3_create_module(db, "PRICES", &module, prices) != SQLITE_OK)
+    {
+        std::cerr << "[ERROR] Failed to register PRICES module: " << sqlite3_errmsg(db) << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+#include "SQLFunctions.h"
+#include "FixedPoint.h"
+#include <iostream>
+#include <string>
+
+// Reads a text argument (empty string for NULL)
+static std::string textArg(sqlite3_value* value)
+{
+    const unsigned char* text = sqlite3_value_text(value);
+    return text ? reinterpret_cast<const char*>(text) : "";
+}
+
+// fp(x): REAL -> fixed-point INTEGER
+static void fpFunc(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    sqlite3_result_int64(ctx, FixedPoint::fromDouble(sqlite3_value_double(argv[0])));
+}
+
+// fp_real(i): fixed-point INTEGER -> REAL
+static void fpRealFunc(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    sqlite3_result_double(ctx, FixedPoint::toDouble(sqlite3_value_int64(argv[0])));
+}
+
+// fp_mul(a, b): product of two fixed-point INTEGERs
+static void fpMulFunc(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    Amount product = 0;
+    if (!FixedPoint::mul(sqlite3_value_int64(argv[0]), sqlite3_value_int64(argv[1]), product))
+    {
+        sqlite3_result_error(ctx, "fp_mul: fixed-point overflow", -1);
+        return;
+    }
+    sqlite3_result_int64(ctx, product);
+}
+
+// Per-group state of fp_sum
+struct FpSumState
+{
+    Amount sum;      // Exact running sum
+    bool overflow;   // Set once the sum no longer fits
+    bool any;        // At least one non-NULL value was seen
+};
+
+// fp_sum step: adds one value
+static void fpSumStep(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    auto* state = static_cast<FpSumState*>(sqlite3_aggregate_context(ctx, sizeof(FpSumState)));
+    if (!state || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    {
+        return;
+    }
+
+    state->any = true;
+    if (!FixedPoint::add(state->sum, FixedPoint::fromDouble(sqlite3_value_double(argv[0])), state->sum))
+    {
+        state->overflow = true;
+    }
+}
+
+// fp_sum final: returns the sum as REAL (NULL for an empty group)
+static void fpSumFinal(sqlite3_context* ctx)
+{
+    auto* state = static_cast<FpSumState*>(sqlite3_aggregate_context(ctx, 0));
+    if (!state || !state->any)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    if (state->overflow)
+    {
+        sqlite3_result_error(ctx, "fp_sum: fixed-point overflow", -1);
+        return;
+    }
+    sqlite3_result_double(ctx, FixedPoint::toDouble(state->sum));
+}
+
+// fx_convert(amount, from, to)
+static void fxConvertFunc(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    auto* market = static_cast<PinnedPrices*>(sqlite3_user_data(ctx))->market;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    double result = 0.0;
+    if (!market->convert(sqlite3_value_double(argv[0]), textArg(argv[1]), textArg(argv[2]), result))
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    sqlite3_result_double(ctx, result);
+}
+
+// coin_value(coin, amount): USD value at the pinned price, so every row of a pinned statement uses the same version
+static void coinValueFunc(sqlite3_context* ctx, int, sqlite3_value** argv)
+{
+    auto* prices = static_cast<PinnedPrices*>(sqlite3_user_data(ctx));
+    double price = 0.0;
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    bool known = prices->depth > 0 ? prices->snapshot.find(textArg(argv[0]), price) : prices->market->coinPrice(textArg(argv[0]), price);
+    if (!known)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    Amount value = 0;
+    if (!FixedPoint::mul(FixedPoint::fromDouble(sqlite3_value_double(argv[1])), FixedPoint::fromDouble(price), value))
+    {
+        sqlite3_result_error(ctx, "coin_value: fixed-point overflow", -1);
+        return;
+    }
+    sqlite3_result_double(ctx, FixedPoint::toDouble(value));
+}
+
+// Registers every function, stops at the first failure
+bool registerLedgerFunctions(sqlite3* db, PinnedPrices* prices)
+{
+    const int pure = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    const int marketDependent = SQLITE_UTF8 | SQLITE_INNOCUOUS; // Results change when prices or rates change
+
+    bool ok =
+        sqlite3_create_function(db, "fp", 1, pure, nullptr, fpFunc, nullptr, nullptr) == SQLITE_OK &&
+        sqlite3_create_function(db, "fp_real", 1, pure, nullptr, fpRealFunc, nullptr, nullptr) == SQLITE_OK &&
+        sqlite3_create_function(db, "fp_mul", 2, pure, nullptr, fpMulFunc, nullptr, nullptr) == SQLITE_OK &&
+        sqlite3_create_function(db, "fp_sum", 1, pure, nullptr, nullptr, fpSumStep, fpSumFinal) == SQLITE_OK &&
+        sqlite3_create_function(db, "fx_convert", 3, marketDependent, prices, fxConvertFunc, nullptr, nullptr) == SQLITE_OK &&
+        sqlite3_create_function(db, "coin_value", 2, marketDependent, prices, coinValueFunc, nullptr, nullptr) == SQLITE_OK;
+
+    if (!ok)
+    {
+        std::cerr << "[ERROR] Failed to register ledger SQL functions: " << sqlite3_errmsg(db) << "\n";
+    }
+    return ok;
+}
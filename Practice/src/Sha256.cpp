@@ -0,0 +1,270 @@
+#include "Sha256.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SHA256_HAS_SHANI 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define SHA256_TARGET
+#else
+#define SHA256_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+// Round constants (first 32 bits of the fractional parts of the cube roots of the first 64 primes)
+static const uint32_t roundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Rotates right
+static inline uint32_t rotr(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+// Constructor for Sha256
+Sha256::Sha256()
+{
+    reset();
+}
+
+// Loads the initial hash values
+void Sha256::reset()
+{
+    static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    std::memcpy(state, initial, sizeof(state));
+    bufferLength = 0;
+    totalLength = 0;
+}
+
+// Portable block function
+void Sha256::compressPortable(uint32_t state[8], const uint8_t* blocks, size_t blockCount)
+{
+    for (size_t block = 0; block < blockCount; ++block, blocks += 64)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (uint32_t(blocks[i * 4]) << 24) | (uint32_t(blocks[i * 4 + 1]) << 16) | (uint32_t(blocks[i * 4 + 2]) << 8) | uint32_t(blocks[i * 4 + 3]);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t choose = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choose + roundConstants[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef SHA256_HAS_SHANI
+// Block function on the SHA extensions: two rounds per sha256rnds2, four message words per msg1/msg2.
+// The state is kept as ABEF/CDGH pairs the way the instructions expect it.
+SHA256_TARGET static void compressShaNi(uint32_t state[8], const uint8_t* blocks, size_t blockCount)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+
+    __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (size_t block = 0; block < blockCount; ++block, blocks += 64)
+    {
+        __m128i abefSaved = abef;
+        __m128i cdghSaved = cdgh;
+        __m128i words[4]; // Message words w[4g .. 4g+3] of the last four groups
+
+        for (int group = 0; group < 16; ++group)
+        {
+            __m128i& current = words[group & 3];
+            if (group < 4)
+            {
+                current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + group * 16)), byteSwap);
+            }
+            else
+            {
+                // current still holds w[i-16..], the other slots hold w[i-12..], w[i-8..] and w[i-4..]
+                __m128i next = _mm_sha256msg1_epu32(current, words[(group + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(words[(group + 3) & 3], words[(group + 2) & 3], 4));
+                current = _mm_sha256msg2_epu32(next, words[(group + 3) & 3]);
+            }
+
+            __m128i scheduled = _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&roundConstants[group * 4])));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, scheduled);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(scheduled, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+// SHA-NI needs the SHA extensions and SSE4.1
+bool Sha256::hardwareSupported()
+{
+#ifdef SHA256_HAS_SHANI
+    return CpuFeatures::get().sha;
+#else
+    return false;
+#endif
+}
+
+// Set by setHardwareEnabled, read on every compress
+static std::atomic<bool> hardwareAllowed(true);
+
+// Turns the hardware path on or off
+void Sha256::setHardwareEnabled(bool enabled)
+{
+    hardwareAllowed.store(enabled, std::memory_order_relaxed);
+}
+
+// Picks the fastest available implementation
+void Sha256::compress(uint32_t state[8], const uint8_t* blocks, size_t blockCount)
+{
+#ifdef SHA256_HAS_SHANI
+    if (hardwareAllowed.load(std::memory_order_relaxed) && hardwareSupported())
+    {
+        compressShaNi(state, blocks, blockCount);
+        return;
+    }
+#endif
+    compressPortable(state, blocks, blockCount);
+}
+
+// Name of the implementation in use
+const char* Sha256::implementationName()
+{
+    return hardwareAllowed.load(std::memory_order_relaxed) && hardwareSupported() ? "SHA-NI" : "portable";
+}
+
+// Buffers partial blocks and compresses whole ones
+void Sha256::update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    totalLength += length;
+
+    if (bufferLength > 0)
+    {
+        size_t take = std::min(length, sizeof(buffer) - bufferLength);
+        std::memcpy(buffer + bufferLength, bytes, take);
+        bufferLength += take;
+        bytes += take;
+        length -= take;
+        if (bufferLength < sizeof(buffer))
+        {
+            return;
+        }
+        compress(state, buffer, 1);
+        bufferLength = 0;
+    }
+
+    size_t blocks = length / 64;
+    if (blocks > 0)
+    {
+        compress(state, bytes, blocks);
+        bytes += blocks * 64;
+        length -= blocks * 64;
+    }
+
+    std::memcpy(buffer, bytes, length);
+    bufferLength = length;
+}
+
+// Hashes an integer as 8 little-endian bytes
+void Sha256::updateInt64(int64_t value)
+{
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8));
+    }
+    update(bytes, sizeof(bytes));
+}
+
+// Hashes a string with its length in front
+void Sha256::updateString(const std::string& value)
+{
+    updateInt64(static_cast<int64_t>(value.size()));
+    update(value.data(), value.size());
+}
+
+// Pads, appends the bit length and returns the digest
+Digest Sha256::finish()
+{
+    uint64_t bitLength = totalLength * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t padLength = (bufferLength < 56) ? (56 - bufferLength) : (120 - bufferLength);
+    for (int i = 0; i < 8; ++i)
+    {
+        padding[padLength + i] = static_cast<uint8_t>(bitLength >> (56 - i * 8));
+    }
+    update(padding, padLength + 8);
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i)
+    {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+    return digest;
+}
+
+// One-shot hash
+Digest Sha256::hash(const void* data, size_t length)
+{
+    Sha256 sha;
+    sha.update(data, length);
+    return sha.finish();
+}
+
+// Hex formatting
+std::string Sha256::toHex(const Digest& digest)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string text;
+    text.reserve(64);
+    for (uint8_t byte : digest)
+    {
+        text += hexDigits[byte >> 4];
+        text += hexDigits[byte & 15];
+    }
+    return text;
+}
@@ -0,0 +1,544 @@
+#include "StatementGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+// One balance row of a range
+struct StatementBalance
+{
+    std::string userID;
+    std::string asset;
+    SQLData::DataBaseState book;
+    Amount amount;
+};
+
+// One posting of a range
+struct StatementPosting
+{
+    std::string userID;
+    SQLData::PostingRecord record;
+};
+
+// Returns the milliseconds since start
+static double millisSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Appends a fixed-point amount with all 8 decimals ("-12.50000000"; withSign adds '+' to positive amounts)
+static void appendAmount(std::string& out, Amount amount, bool withSign = false)
+{
+    uint64_t magnitude = amount < 0 ? 0 - static_cast<uint64_t>(amount) : static_cast<uint64_t>(amount);
+    if (amount < 0)
+    {
+        out += '-';
+    }
+    else if (withSign && amount > 0)
+    {
+        out += '+';
+    }
+
+    char digits[32];
+    int length = 0;
+    uint64_t units = magnitude / FixedPoint::SCALE;
+    uint64_t fraction = magnitude % FixedPoint::SCALE;
+    for (int i = 0; i < 8; ++i, fraction /= 10)
+    {
+        digits[length++] = static_cast<char>('0' + fraction % 10);
+    }
+    digits[length++] = '.';
+    do
+    {
+        digits[length++] = static_cast<char>('0' + units % 10);
+        units /= 10;
+    } while (units != 0);
+    while (length > 0)
+    {
+        out += digits[--length];
+    }
+}
+
+// Appends "YYYY-MM-DD hh:mm:ss" in UTC (days to civil date without the C library, which is slow and not thread-safe)
+static void appendTime(std::string& out, int64_t millis)
+{
+    int64_t seconds = millis >= 0 ? millis / 1000 : (millis - 999) / 1000;
+    int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    int64_t secondOfDay = seconds - days * 86400;
+
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t dayOfEra = days - era * 146097;
+    int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+    int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    int64_t year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+
+    char text[24];
+    auto two = [&text](int at, int64_t value)
+        {
+            text[at] = static_cast<char>('0' + value / 10);
+            text[at + 1] = static_cast<char>('0' + value % 10);
+        };
+    two(0, year / 100 % 100);
+    two(2, year % 100);
+    text[4] = '-';
+    two(5, month);
+    text[7] = '-';
+    two(8, day);
+    text[10] = ' ';
+    two(11, secondOfDay / 3600);
+    text[13] = ':';
+    two(14, secondOfDay / 60 % 60);
+    text[16] = ':';
+    two(17, secondOfDay % 60);
+    out.append(text, 19);
+}
+
+// Appends a CSV field, quoted when it holds a separator, a quote or a line break
+static void appendCsvField(std::string& out, const std::string& field)
+{
+    if (field.find_first_of(",\"\r\n") == std::string::npos)
+    {
+        out += field;
+        return;
+    }
+    out += '"';
+    for (char c : field)
+    {
+        if (c == '"')
+        {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+// Appends text padded with spaces to width (on the left when rightAlign)
+static void appendPadded(std::string& out, const std::string& text, size_t width, bool rightAlign = false)
+{
+    size_t padding = text.size() < width ? width - text.size() : 0;
+    if (rightAlign)
+    {
+        out.append(padding, ' ');
+    }
+    out += text;
+    if (!rightAlign)
+    {
+        out.append(padding, ' ');
+    }
+}
+
+// Name of a balance table in a statement
+static const char* bookName(SQLData::DataBaseState book)
+{
+    return book == SQLData::DataBaseState::DBS_BALANCE ? "BALANCE" : "COINS";
+}
+
+// Constructor for StatementGenerator
+StatementGenerator::StatementGenerator(SQLData& sqlData, unsigned threads)
+    : sqlData(sqlData), threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+// Plans the ranges, then runs the workers and the writer
+bool StatementGenerator::run(const StatementJob& job, StatementReport& report)
+{
+    report = StatementReport();
+    report.threads = threadCount;
+    auto start = std::chrono::steady_clock::now();
+    if (job.toMillis <= job.fromMillis)
+    {
+        std::cerr << "[ERROR] Empty statement period\n";
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(job.directory, error);
+    if (error)
+    {
+        std::cerr << "[ERROR] Could not create " << job.directory << ": " << error.message() << "\n";
+        return false;
+    }
+
+    // The period in journal terms: postings after startPosting happened since the start, the ones after endPosting after the end
+    sqlite3_int64 maxTx = sqlData.maxID("TRANSACTIONS");
+    sqlite3_int64 startTx = sqlData.lastTransactionAt(job.fromMillis - 1, 0, maxTx);
+    sqlite3_int64 endTx = sqlData.lastTransactionAt(job.toMillis - 1, startTx, maxTx);
+    const sqlite3_int64 startPosting = startTx != 0 ? sqlData.lastPostingOf(startTx) : 0;
+    const sqlite3_int64 endPosting = endTx != startTx ? sqlData.lastPostingOf(endTx) : startPosting;
+
+    // Range bounds: every accountsPerRange-th account key; the first range starts below every key and the last one
+    // ends above every key (0xFF never occurs in UTF-8)
+    std::vector<std::string> bounds(1, std::string());
+    size_t accounts = 0;
+    if (!sqlData.forEachAccountKey([&](const char* userID)
+        {
+            if (accounts++ % accountsPerRange == 0 && accounts > 1)
+            {
+                bounds.emplace_back(userID);
+            }
+        }))
+    {
+        return false;
+    }
+    bounds.emplace_back(1, '\xFF');
+
+    // System accounts ('@' prefix) are one block of keys with no balance rows but long journals: it gets a range of its
+    // own, which is skipped
+    for (const char* bound : { "@", "A" })
+    {
+        auto at = std::lower_bound(bounds.begin(), bounds.end(), std::string(bound));
+        if (*at != bound)
+        {
+            bounds.insert(at, bound);
+        }
+    }
+    const size_t rangeCount = bounds.size() - 1;
+
+    // Buffer pool: two per worker, so a worker renders the next range while the writer writes the last one
+    std::vector<std::string> buffers(static_cast<size_t>(threadCount) * 2);
+    std::vector<size_t> freeBuffers;
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        freeBuffers.push_back(i);
+    }
+    std::deque<std::pair<size_t, size_t>> ready; // (range, buffer) waiting for the writer
+    std::mutex poolMutex;
+    std::condition_variable bufferFreed, bufferReady;
+    bool rendering = true;
+    std::atomic<bool> failed(false);
+    std::atomic<size_t> nextRange(0);
+    const char* extension = job.format == StatementFormat::SF_Csv ? ".csv" : ".txt";
+
+    std::thread writer([&]()
+        {
+            for (;;)
+            {
+                std::pair<size_t, size_t> item;
+                {
+                    std::unique_lock<std::mutex> lock(poolMutex);
+                    bufferReady.wait(lock, [&]() { return !ready.empty() || !rendering; });
+                    if (ready.empty())
+                    {
+                        return;
+                    }
+                    item = ready.front();
+                    ready.pop_front();
+                }
+
+                auto writeStart = std::chrono::steady_clock::now();
+                std::string& buffer = buffers[item.second];
+                char name[32];
+                std::snprintf(name, sizeof(name), "statements-%05zu", item.first);
+                std::ofstream file(std::filesystem::path(job.directory) / (std::string(name) + extension), std::ios::binary | std::ios::trunc);
+                file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                if (!file)
+                {
+                    std::cerr << "[ERROR] Could not write " << name << extension << "\n";
+                    failed = true;
+                }
+                report.bytes += buffer.size();
+                ++report.files;
+                buffer.clear(); // Keeps its capacity for the next range
+                report.writeMillis += millisSince(writeStart);
+
+                std::lock_guard<std::mutex> lock(poolMutex);
+                freeBuffers.push_back(item.second);
+                bufferFreed.notify_one();
+            }
+        });
+
+    std::vector<uint64_t> statementCounts(threadCount, 0), movementCounts(threadCount, 0);
+    std::vector<double> readTimes(threadCount, 0.0), renderTimes(threadCount, 0.0), waitTimes(threadCount, 0.0);
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < threadCount; ++worker)
+    {
+        workers.emplace_back([&, worker]()
+            {
+                SQLData connection;
+                if (!connection.open(sqlData.databaseName(), sqlData.vfsName()))
+                {
+                    failed = true;
+                    return;
+                }
+
+                std::vector<StatementBalance> balances;   // Reused for every range
+                std::vector<StatementPosting> postings;
+                std::vector<size_t> order;                 // The current account's postings by (asset, book, id)
+                size_t range;
+                while (!failed && (range = nextRange++) < rangeCount)
+                {
+                    if (bounds[range] == "@")
+                    {
+                        continue;
+                    }
+
+                    // 1. Both streams of the range in one short read transaction
+                    auto phase = std::chrono::steady_clock::now();
+                    balances.clear();
+                    postings.clear();
+                    bool read = connection.execute("BEGIN;") &&
+                        connection.forEachBalanceInRange(bounds[range], bounds[range + 1],
+                            [&](const char* userID, const char* asset, SQLData::DataBaseState book, Amount amount)
+                            {
+                                balances.push_back({ userID, asset, book, amount });
+                            }) &&
+                        connection.forEachPostingInRange(bounds[range], bounds[range + 1], startPosting,
+                            [&](const char* userID, const SQLData::PostingRecord& record)
+                            {
+                                postings.push_back({ userID, record });
+                            });
+                    connection.execute("COMMIT;");
+                    readTimes[worker] += millisSince(phase);
+                    if (!read)
+                    {
+                        failed = true;
+                        break;
+                    }
+
+                    // 2. A free buffer
+                    phase = std::chrono::steady_clock::now();
+                    size_t bufferIndex;
+                    {
+                        std::unique_lock<std::mutex> lock(poolMutex);
+                        bufferFreed.wait(lock, [&]() { return !freeBuffers.empty(); });
+                        bufferIndex = freeBuffers.back();
+                        freeBuffers.pop_back();
+                    }
+                    waitTimes[worker] += millisSince(phase);
+
+                    // 3. Merge the streams account by account and render
+                    phase = std::chrono::steady_clock::now();
+                    std::string& out = buffers[bufferIndex];
+                    if (job.format == StatementFormat::SF_Csv)
+                    {
+                        out += "account,asset,book,time,transaction,kind,amount,balance\n";
+                    }
+                    size_t b = 0, p = 0;
+                    while (b < balances.size() || p < postings.size())
+                    {
+                        const std::string& account = p == postings.size() || (b < balances.size() && balances[b].userID <= postings[p].userID)
+                            ? balances[b].userID : postings[p].userID;
+                        size_t balanceEnd = b, postingEnd = p;
+                        while (balanceEnd < balances.size() && balances[balanceEnd].userID == account)
+                        {
+                            ++balanceEnd;
+                        }
+                        while (postingEnd < postings.size() && postings[postingEnd].userID == account)
+                        {
+                            ++postingEnd;
+                        }
+                        order.clear();
+                        for (size_t i = p; i < postingEnd; ++i)
+                        {
+                            order.push_back(i);
+                        }
+                        std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y)
+                            {
+                                const SQLData::PostingRecord& a = postings[x].record;
+                                const SQLData::PostingRecord& c = postings[y].record;
+                                return a.asset != c.asset ? a.asset < c.asset : a.book < c.book;
+                            });
+
+                        size_t accountStart = out.size();
+                        bool printed = false;
+                        if (job.format == StatementFormat::SF_Text)
+                        {
+                            out += "Statement of ";
+                            out += account;
+                            out += "\nPeriod ";
+                            appendTime(out, job.fromMillis);
+                            out += " - ";
+                            appendTime(out, job.toMillis);
+                            out += " UTC\n";
+                        }
+
+                        // Assets in key order: the balance rows and the posting groups are both sorted by (asset, book)
+                        size_t o = 0;
+                        while (b < balanceEnd || o < order.size())
+                        {
+                            const SQLData::PostingRecord* first = o < order.size() ? &postings[order[o]].record : nullptr;
+                            bool fromBalance = b < balanceEnd && (!first || balances[b].asset < first->asset ||
+                                (balances[b].asset == first->asset && balances[b].book <= first->book));
+                            std::string asset = fromBalance ? balances[b].asset : first->asset;
+                            SQLData::DataBaseState book = fromBalance ? balances[b].book : first->book;
+
+                            Amount current = 0, sinceStart = 0, afterEnd = 0;
+                            while (b < balanceEnd && balances[b].asset == asset && balances[b].book == book)
+                            {
+                                current += balances[b++].amount;
+                            }
+                            size_t groupStart = o;
+                            while (o < order.size() && postings[order[o]].record.asset == asset && postings[order[o]].record.book == book)
+                            {
+                                const SQLData::PostingRecord& record = postings[order[o++]].record;
+                                sinceStart += record.amount;
+                                if (record.id > endPosting)
+                                {
+                                    afterEnd += record.amount;
+                                }
+                            }
+                            Amount opening = current - sinceStart;
+                            Amount closing = current - afterEnd;
+                            size_t movementEnd = groupStart;
+                            while (movementEnd < o && postings[order[movementEnd]].record.id <= endPosting)
+                            {
+                                ++movementEnd;
+                            }
+                            if (opening == 0 && closing == 0 && movementEnd == groupStart)
+                            {
+                                continue;
+                            }
+                            printed = true;
+
+                            Amount running = opening;
+                            if (job.format == StatementFormat::SF_Csv)
+                            {
+                                auto row = [&](int64_t time, sqlite3_int64 txID, const std::string& kind, const Amount* amount, Amount balance)
+                                    {
+                                        appendCsvField(out, account);
+                                        out += ',';
+                                        appendCsvField(out, asset);
+                                        out += ',';
+                                        out += bookName(book);
+                                        out += ',';
+                                        appendTime(out, time);
+                                        out += ',';
+                                        if (txID != 0)
+                                        {
+                                            out += std::to_string(txID);
+                                        }
+                                        out += ',';
+                                        appendCsvField(out, kind);
+                                        out += ',';
+                                        if (amount)
+                                        {
+                                            appendAmount(out, *amount);
+                                        }
+                                        out += ',';
+                                        appendAmount(out, balance);
+                                        out += '\n';
+                                    };
+                                row(job.fromMillis, 0, "OPENING", nullptr, opening);
+                                for (size_t i = groupStart; i < movementEnd; ++i)
+                                {
+                                    const SQLData::PostingRecord& record = postings[order[i]].record;
+                                    running += record.amount;
+                                    row(record.createdAt, record.txID, record.kind, &record.amount, running);
+                                }
+                                row(job.toMillis, 0, "CLOSING", nullptr, closing);
+                            }
+                            else
+                            {
+                                std::string number;
+                                out += "\n  ";
+                                out += asset;
+                                out += book == SQLData::DataBaseState::DBS_BALANCE ? " (balance)\n" : " (coins)\n";
+                                out += "    ";
+                                appendTime(out, job.fromMillis);
+                                out += "  Opening balance";
+                                number.clear();
+                                appendAmount(number, opening);
+                                appendPadded(out, number, 49, true);
+                                out += '\n';
+                                for (size_t i = groupStart; i < movementEnd; ++i)
+                                {
+                                    const SQLData::PostingRecord& record = postings[order[i]].record;
+                                    running += record.amount;
+                                    out += "    ";
+                                    appendTime(out, record.createdAt);
+                                    out += "  ";
+                                    appendPadded(out, record.kind, 10);
+                                    appendPadded(out, "#" + std::to_string(record.txID), 12);
+                                    number.clear();
+                                    appendAmount(number, record.amount, true);
+                                    appendPadded(out, number, 22, true);
+                                    number.clear();
+                                    appendAmount(number, running);
+                                    appendPadded(out, number, 20, true);
+                                    out += '\n';
+                                }
+                                out += "    ";
+                                appendTime(out, job.toMillis);
+                                out += "  Closing balance";
+                                number.clear();
+                                appendAmount(number, closing);
+                                appendPadded(out, number, 49, true);
+                                out += '\n';
+                            }
+                            movementCounts[worker] += movementEnd - groupStart;
+                        }
+
+                        if (printed)
+                        {
+                            ++statementCounts[worker];
+                            if (job.format == StatementFormat::SF_Text)
+                            {
+                                out += '\n';
+                            }
+                        }
+                        else
+                        {
+                            out.resize(accountStart); // Nothing held and nothing moved
+                        }
+                        p = postingEnd;
+                    }
+                    renderTimes[worker] += millisSince(phase);
+
+                    // 4. Hand the buffer to the writer
+                    std::lock_guard<std::mutex> lock(poolMutex);
+                    ready.emplace_back(range, bufferIndex);
+                    bufferReady.notify_one();
+                }
+                connection.close();
+            });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        rendering = false;
+    }
+    bufferReady.notify_one();
+    writer.join();
+
+    for (unsigned worker = 0; worker < threadCount; ++worker)
+    {
+        report.statements += statementCounts[worker];
+        report.movements += movementCounts[worker];
+        report.readMillis += readTimes[worker];
+        report.renderMillis += renderTimes[worker];
+        report.waitMillis += waitTimes[worker];
+    }
+    report.millis = millisSince(start);
+    if (failed)
+    {
+        std::cerr << "[ERROR] Statement run failed\n";
+        return false;
+    }
+    return true;
+}
+
+// Prints the report
+void StatementGenerator::print(const StatementReport& report)
+{
+    double seconds = report.millis / 1000.0;
+    std::cout << "Wrote " << report.statements << " statements (" << report.movements << " movements) to " << report.files
+        << " files on " << report.threads << " threads\n" << std::fixed << std::setprecision(0)
+        << "  " << report.millis << " ms, " << report.statements / seconds << " statements/s (" << report.statements / seconds * 3600.0
+        << " per hour), " << std::setprecision(1) << report.bytes / (1024.0 * 1024.0) << " MiB\n"
+        << "  workers: read " << report.readMillis << " ms, render " << report.renderMillis << " ms, waited for buffers "
+        << report.waitMillis << " ms; writer: " << report.writeMillis << " ms\n" << std::defaultfloat;
+}
@@ -0,0 +1,161 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+// Constructor for TimerWheel
+TimerWheel::TimerWheel(int64_t tick, int64_t nowMillis)
+    : heads(static_cast<size_t>(levels) * slotsPerLevel, none), freeList(none), active(0), tickMillis(std::max<int64_t>(1, tick)),
+      nextTick(nowMillis / std::max<int64_t>(1, tick))
+{
+}
+
+// The level is the first one whose range covers the distance; the slot comes from the due tick's bits of that level
+void TimerWheel::link(uint32_t handle)
+{
+    Node& node = nodes[handle];
+    int64_t due = std::max(node.dueTick, nextTick);
+    uint64_t delta = static_cast<uint64_t>(due - nextTick);
+    const uint64_t range = 1ULL << (slotBits * levels);
+    if (delta >= range)
+    {
+        due = nextTick + static_cast<int64_t>(range - 1); // Parked on the top level, re-filed when it is cascaded
+        delta = range - 1;
+    }
+
+    int level = 0;
+    while (level < levels - 1 && delta >= (1ULL << (slotBits * (level + 1))))
+    {
+        ++level;
+    }
+    uint32_t slot = static_cast<uint32_t>(level) * slotsPerLevel + static_cast<uint32_t>((due >> (slotBits * level)) & (slotsPerLevel - 1));
+
+    node.slot = slot;
+    node.prev = none;
+    node.next = heads[slot];
+    if (node.next != none)
+    {
+        nodes[node.next].prev = handle;
+    }
+    heads[slot] = handle;
+}
+
+// Removes a node from its slot's list
+void TimerWheel::unlink(uint32_t handle)
+{
+    Node& node = nodes[handle];
+    if (node.prev != none)
+    {
+        nodes[node.prev].next = node.next;
+    }
+    else
+    {
+        heads[node.slot] = node.next;
+    }
+    if (node.next != none)
+    {
+        nodes[node.next].prev = node.prev;
+    }
+    node.slot = none;
+}
+
+// Every timer of the slot is due within the level's range from now, so it lands on a lower level
+void TimerWheel::cascade(int level, uint32_t index)
+{
+    uint32_t slot = static_cast<uint32_t>(level) * slotsPerLevel + index;
+    uint32_t handle = heads[slot];
+    heads[slot] = none;
+    while (handle != none)
+    {
+        uint32_t next = nodes[handle].next;
+        link(handle);
+        handle = next;
+    }
+}
+
+// Takes a node from the free list (or a new one) and files it
+uint32_t TimerWheel::add(int64_t dueMillis, uint64_t payload)
+{
+    uint32_t handle = freeList;
+    if (handle != none)
+    {
+        freeList = nodes[handle].next;
+    }
+    else
+    {
+        handle = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node());
+    }
+
+    Node& node = nodes[handle];
+    node.dueTick = dueMillis / tickMillis + (dueMillis % tickMillis > 0 ? 1 : 0);
+    node.payload = payload;
+    link(handle);
+    ++active;
+    return handle;
+}
+
+// Unlinks the node and returns it to the free list
+bool TimerWheel::cancel(uint32_t handle)
+{
+    if (handle >= nodes.size() || nodes[handle].slot == none)
+    {
+        return false;
+    }
+    unlink(handle);
+    nodes[handle].next = freeList;
+    freeList = handle;
+    --active;
+    return true;
+}
+
+// Processes tick by tick: cascade when the lower levels wrap, then fire the lowest level's slot
+size_t TimerWheel::advance(int64_t nowMillis, std::vector<uint64_t>& due)
+{
+    size_t fired = 0;
+    int64_t target = nowMillis / tickMillis;
+    while (nextTick <= target)
+    {
+        if (active == 0)
+        {
+            nextTick = target + 1; // Nothing to fire or cascade on the way
+            break;
+        }
+
+        uint32_t index = static_cast<uint32_t>(nextTick & (slotsPerLevel - 1));
+        if (index == 0)
+        {
+            for (int level = 1; level < levels; ++level)
+            {
+                uint32_t upper = static_cast<uint32_t>((nextTick >> (slotBits * level)) & (slotsPerLevel - 1));
+                cascade(level, upper);
+                if (upper != 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        uint32_t handle = heads[index];
+        heads[index] = none;
+        while (handle != none)
+        {
+            Node& node = nodes[handle];
+            uint32_t next = node.next;
+            if (node.dueTick > nextTick)
+            {
+                link(handle); // Was parked beyond the wheel's range
+            }
+            else
+            {
+                due.push_back(node.payload);
+                node.slot = none;
+                node.next = freeList;
+                freeList = handle;
+                --active;
+                ++fired;
+            }
+            handle = next;
+        }
+        ++nextTick;
+    }
+    return fired;
+}
@@ -0,0 +1,377 @@
+#include "TransferScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+// Command ID of one run of a schedule: the same run always gets the same ID (splitmix64 of the pair, never 0)
+static CommandId commandIdOf(sqlite3_int64 scheduleId, uint64_t occurrence)
+{
+    uint64_t x = static_cast<uint64_t>(scheduleId) * 0x9e3779b97f4a7c15ULL ^ (occurrence + 0x632be59bd9b4e019ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+// Constructor for TransferScheduler
+TransferScheduler::TransferScheduler(Ledger& ledger, SQLData& sqlData, int64_t tickMillis)
+    : ledger(ledger), dbName(sqlData.databaseName()), vfsName(sqlData.vfsName()), wheel(tickMillis, nowMillis()), running(false)
+{
+}
+
+// Destructor for TransferScheduler
+TransferScheduler::~TransferScheduler()
+{
+    stop();
+    storage.close();
+}
+
+// Opens the connection and files every persisted schedule
+bool TransferScheduler::load()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!storage.isOpen() && !storage.open(dbName, vfsName))
+    {
+        std::cerr << "[ERROR] Scheduler could not open " << dbName << "\n";
+        return false;
+    }
+    if (!storage.createTable(SQLData::DataBaseState::DBS_SCHEDULES))
+    {
+        return false;
+    }
+    return storage.forEachSchedule([this](const SQLData::ScheduleRow& row)
+        {
+            if (byId.find(row.id) == byId.end())
+            {
+                insertLocked(row);
+            }
+        });
+}
+
+// Sets the price callback
+void TransferScheduler::setPriceSource(PriceSource source)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    priceSource = std::move(source);
+}
+
+// Interns the names and files the next run
+void TransferScheduler::insertLocked(const SQLData::ScheduleRow& row)
+{
+    uint32_t index;
+    if (!freeEntries.empty())
+    {
+        index = freeEntries.back();
+        freeEntries.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(entries.size());
+        entries.emplace_back();
+    }
+
+    Entry& entry = entries[index];
+    entry.id = row.id;
+    entry.dueMillis = row.nextDue;
+    entry.intervalMillis = row.intervalMillis;
+    entry.occurrence = static_cast<uint64_t>(row.occurrence);
+    entry.amount = row.amount;
+    entry.runsLeft = static_cast<uint32_t>(row.runsLeft);
+    entry.user = names.intern(row.userID);
+    entry.counterparty = names.intern(row.counterparty);
+    entry.asset = names.intern(row.asset);
+    entry.kind = static_cast<ScheduleKind>(row.kind);
+    entry.book = row.book;
+    entry.timer = wheel.add(entry.dueMillis, index);
+    byId[entry.id] = index;
+}
+
+// Checks a schedule and turns it into a row
+static bool toRow(const ScheduledTransfer& transfer, SQLData::ScheduleRow& row)
+{
+    bool valid = transfer.amount > 0 && !transfer.userID.empty() && !transfer.asset.empty() && transfer.intervalMillis >= 0 &&
+        (transfer.runs == 1 || transfer.intervalMillis > 0);
+    if (transfer.kind == ScheduleKind::SK_Send)
+    {
+        valid = valid && !transfer.counterparty.empty() && transfer.counterparty != transfer.userID &&
+            (transfer.book == SQLData::DataBaseState::DBS_COINS || transfer.book == SQLData::DataBaseState::DBS_BALANCE);
+    }
+    else
+    {
+        valid = valid && transfer.asset != "USD";
+    }
+    if (!valid)
+    {
+        std::cerr << "[ERROR] Invalid schedule for " << transfer.userID << "\n";
+        return false;
+    }
+
+    row.id = 0;
+    row.kind = static_cast<int>(transfer.kind);
+    row.userID = transfer.userID;
+    row.counterparty = transfer.kind == ScheduleKind::SK_Send ? transfer.counterparty : "";
+    row.asset = transfer.asset;
+    row.book = transfer.kind == ScheduleKind::SK_Send ? transfer.book : SQLData::DataBaseState::DBS_COINS;
+    row.amount = transfer.amount;
+    row.nextDue = transfer.firstDueMillis;
+    row.intervalMillis = transfer.intervalMillis;
+    row.runsLeft = transfer.runs;
+    row.occurrence = 0;
+    return true;
+}
+
+// Stores the schedule, then files it
+sqlite3_int64 TransferScheduler::schedule(const ScheduledTransfer& transfer)
+{
+    SQLData::ScheduleRow row;
+    if (!toRow(transfer, row))
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!storage.isOpen())
+    {
+        std::cerr << "[ERROR] Scheduler is not loaded\n";
+        return 0;
+    }
+    row.id = storage.insertSchedule(row);
+    if (row.id != 0)
+    {
+        insertLocked(row);
+    }
+    return row.id;
+}
+
+// One transaction for all the rows; nothing is filed unless it commits
+size_t TransferScheduler::scheduleMany(const std::vector<ScheduledTransfer>& transfers, std::vector<sqlite3_int64>* ids)
+{
+    std::vector<SQLData::ScheduleRow> rows;
+    rows.reserve(transfers.size());
+    for (const auto& transfer : transfers)
+    {
+        SQLData::ScheduleRow row;
+        if (toRow(transfer, row))
+        {
+            rows.push_back(std::move(row));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!storage.isOpen() || !storage.execute("BEGIN IMMEDIATE;"))
+    {
+        return 0;
+    }
+    for (auto& row : rows)
+    {
+        row.id = storage.insertSchedule(row);
+        if (row.id == 0)
+        {
+            storage.execute("ROLLBACK;");
+            return 0;
+        }
+    }
+    if (!storage.execute("COMMIT;"))
+    {
+        storage.execute("ROLLBACK;");
+        return 0;
+    }
+
+    entries.reserve(entries.size() + rows.size());
+    wheel.reserve(wheel.size() + rows.size());
+    for (const auto& row : rows)
+    {
+        insertLocked(row);
+        if (ids)
+        {
+            ids->push_back(row.id);
+        }
+    }
+    return rows.size();
+}
+
+// Unfiles the timer and deletes the row
+bool TransferScheduler::cancel(sqlite3_int64 id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byId.find(id);
+    if (it == byId.end() || !storage.deleteSchedule(id))
+    {
+        return false;
+    }
+
+    wheel.cancel(entries[it->second].timer);
+    freeEntries.push_back(it->second);
+    byId.erase(it);
+    return true;
+}
+
+// A send moves the asset; a buy is a swap at the current price
+CommandStatus TransferScheduler::execute(const Entry& entry)
+{
+    CommandId commandId = commandIdOf(entry.id, entry.occurrence);
+    const std::string userID = names.name(entry.user);
+    const std::string asset = names.name(entry.asset);
+
+    if (entry.kind == ScheduleKind::SK_Send)
+    {
+        const std::string counterparty = names.name(entry.counterparty);
+        return ledger.applyCommand(commandId, TransactionKind::TK_Send,
+            {
+                { userID, asset, entry.book, -entry.amount },
+                { counterparty, asset, entry.book, entry.amount },
+            }, "scheduled to " + counterparty);
+    }
+
+    double price = 0.0;
+    if (!priceSource || !priceSource(asset, price) || !(price > 0.0))
+    {
+        std::cerr << "[ERROR] No price for the scheduled buy of " << asset << "\n";
+        return CommandStatus::CS_Rejected;
+    }
+    Amount coins = FixedPoint::fromDouble(FixedPoint::toDouble(entry.amount) / price);
+    return ledger.swap(TransactionKind::TK_Buy, userID,
+        { "USD", SQLData::DataBaseState::DBS_BALANCE, entry.amount },
+        { asset, SQLData::DataBaseState::DBS_COINS, coins }, { "", SQLData::DataBaseState::DBS_NONE, 0 }, commandId);
+}
+
+// Runs the batch, makes the journal durable, then moves the schedules on in one transaction
+size_t TransferScheduler::runDue(int64_t now)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    dueScratch.clear();
+    wheel.advance(now, dueScratch);
+    if (dueScratch.empty())
+    {
+        return 0;
+    }
+
+    ledger.beginBatch();
+    for (uint64_t index : dueScratch)
+    {
+        Entry& entry = entries[index];
+        entry.timer = TimerWheel::none;
+        switch (execute(entry))
+        {
+        case CommandStatus::CS_Applied:   ++counters.executed; break;
+        case CommandStatus::CS_Duplicate: ++counters.duplicates; break;
+        default:                          ++counters.rejected; break;
+        }
+    }
+    ledger.commitBatch();
+    bool journaled = ledger.flush();
+
+    // A run that was missed (the application was down) is not repeated: the next run is the next one after now
+    bool stored = journaled && storage.execute("BEGIN IMMEDIATE;");
+    for (uint64_t index : dueScratch)
+    {
+        Entry& entry = entries[index];
+        ++entry.occurrence;
+        bool finished = entry.intervalMillis == 0 || (entry.runsLeft > 0 && --entry.runsLeft == 0);
+        if (finished)
+        {
+            stored = stored && storage.deleteSchedule(entry.id);
+            byId.erase(entry.id);
+            freeEntries.push_back(static_cast<uint32_t>(index));
+            continue;
+        }
+
+        entry.dueMillis += entry.intervalMillis;
+        if (entry.dueMillis <= now)
+        {
+            entry.dueMillis += ((now - entry.dueMillis) / entry.intervalMillis + 1) * entry.intervalMillis;
+        }
+        stored = stored && storage.updateSchedule(entry.id, entry.dueMillis, entry.runsLeft, static_cast<sqlite3_int64>(entry.occurrence));
+        entry.timer = wheel.add(entry.dueMillis, index);
+    }
+    if (!journaled)
+    {
+        // The runs never reached the database, so the rows keep them due and they run again after a restart
+        std::cerr << "[ERROR] The runs of " << dueScratch.size() << " schedules were not written, their next runs are not stored\n";
+    }
+    else if (!stored || !storage.execute("COMMIT;"))
+    {
+        // The rows keep the runs just made; after a restart they are found as duplicates and skipped
+        storage.execute("ROLLBACK;");
+        std::cerr << "[ERROR] Could not store the next runs of " << dueScratch.size() << " schedules\n";
+    }
+
+    ++counters.batches;
+    counters.maxBatch = std::max(counters.maxBatch, dueScratch.size());
+    return dueScratch.size();
+}
+
+// Starts the worker
+bool TransferScheduler::start(int64_t pollMillis)
+{
+    if (worker.joinable())
+    {
+        return true;
+    }
+    if (!storage.isOpen() && !load())
+    {
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&TransferScheduler::run, this, std::max<int64_t>(1, pollMillis));
+    return true;
+}
+
+// Stops the worker
+void TransferScheduler::stop()
+{
+    if (!worker.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+}
+
+// Runs what is due, then sleeps until the next poll or a stop
+void TransferScheduler::run(int64_t pollMillis)
+{
+    for (;;)
+    {
+        runDue(nowMillis());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wakeWorker.wait_for(lock, std::chrono::milliseconds(pollMillis), [this]() { return !running; }))
+        {
+            return;
+        }
+    }
+}
+
+// Number of schedules in the wheel
+size_t TransferScheduler::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return byId.size();
+}
+
+// Wheel nodes, entries and the ID index (an unordered_map node is the pair plus a next pointer)
+size_t TransferScheduler::memoryBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return wheel.memoryBytes() + entries.capacity() * sizeof(Entry) + freeEntries.capacity() * sizeof(uint32_t) +
+        byId.bucket_count() * sizeof(void*) + byId.size() * (sizeof(std::pair<const sqlite3_int64, uint32_t>) + sizeof(void*));
+}
+
+// Returns a copy of the counters
+SchedulerStats TransferScheduler::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+// Wall clock time (schedules are persisted as Unix times)
+int64_t TransferScheduler::nowMillis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -17,6 +17,17 @@
 #include <thread>
 
 #include "Ledger.h"
+#include "CoinExchange.h"
+#include "InterestAccrual.h"
+#include "Benchmark.h"
+#include "BalanceHistory.h"
+#include "JournalReplay.h"
+#include "LedgerReconciler.h"
+#include "PriceFeed.h"
+#include "PriceChart.h"
+#include "PriceHistory.h"
+#include "StatementGenerator.h"
+#include "TransferScheduler.h"
 
 #pragma region DX9_GLOBAL_DATA
 // Global variables for managing Direct3D 9 and ImGui state
@@ -74,12 +85,20 @@ private:
     SeedList seedList;        // SeedList object for managing the seed phrase
     Coin coin;                // Coin object to represent the coin in use
     Ledger ledger;            // Ledger object for managing user wallet and coins
+    CoinExchange exchange;    // Order books where coins are bought (settled through the ledger)
 
     std::list<Coin> coins;    // A list to store coins available in the wallet
+    MarketData marketData;    // Current coin prices and FX rates (shared with the SQL functions)
+    PriceHistory priceHistory; // Ticks and 1s/1m/1h candles of every coin (persisted in history/)
+    PriceChart priceChart;    // Price chart of the dashboard (keeps its zoom and cached buckets between frames)
+    PriceFeed priceFeed;      // Keeps marketData's prices live (stopped before marketData and priceHistory are destroyed)
+    TransferScheduler scheduler; // Recurring buys and scheduled payouts (stopped before the ledger is destroyed)
+    BalanceHistory balanceHistory; // Balance checkpoints for point-in-time queries (written in the background)
     Currency currency;        // Currency object containing supported currencies
     float SEND_AMOUNT = 0.0f; // Amount to send (in cryptocurrency)
     std::string SEND_COIN_NAME = ""; // Name of the coin to be sent
-    float newGlobalAmount = 0.0f; // New global amount for cryptocurrency
+    HoldId SEND_HOLD = 0;     // Hold on the coins being sent (captured by Send, released by Cancel or on expiry)
+    static constexpr int64_t sendHoldMillis = 10 * 60 * 1000; // Time the user has to enter the account
 
     enum class MenuState
     {
@@ -101,6 +120,7 @@ private:
 
         MS_UserCoins,         // User's coins screen
         MS_UserWallet,        // User's wallet screen
+        MS_History,           // User's transaction history screen
     };
     MenuState CurrentState;  // Current menu state
 
@@ -386,12 +406,11 @@ public:
     // User View function: shows the user dashboard with options to manage the wallet, buy coins, etc.
     void UserView(char* password)
     {
-        static bool openGraph = false;
-        static float values[60] = {}; // Placeholder for graph values
-        static float base[] = { 1.0f, 3.0f, 2.5f, 5.0f, 4.0f, 6.0f };
-        static int index = 0;
-        static double lastUpdate = 0.0;
-        static float currentValue = 1.0f;
+        static int chartCoin = 0;               // Coin shown in the price chart
+        static int chartRange = 1;              // Index into rangeMillis
+        static int chartStyle = 0;              // 0 = line, 1 = candles
+        static const int64_t rangeMillis[] = { 5 * 60 * 1000LL, 60 * 60 * 1000LL, 24 * 60 * 60 * 1000LL, 30 * 24 * 60 * 60 * 1000LL };
+        static const char* rangeNames[] = { "5 minutes", "1 hour", "1 day", "30 days" };
 
         ImGui::Begin("User Dashboard");
 
@@ -422,6 +441,10 @@ public:
         {
             CurrentState = MenuState::MS_WidthdrawCoin;
         }
+        else if (ImGui::Button("History"))
+        {
+            CurrentState = MenuState::MS_History;
+        }
         else if (ImGui::Button("ShowUserID"))
         {
             CurrentState = MenuState::MS_ShowUserID;
@@ -432,6 +455,41 @@ public:
             memset(password, 0, 128); // Clear password
         }
 
+        // Price chart: decimated to the chart's width, redrawn from its cache until prices arrive or the view changes
+        if (!coins.empty())
+        {
+            ImGui::Separator();
+            chartCoin = std::min(chartCoin, static_cast<int>(coins.size()) - 1);
+            auto selected = std::next(coins.begin(), chartCoin);
+            ImGui::SetNextItemWidth(150.0f);
+            if (ImGui::BeginCombo("Coin", selected->coinName.c_str()))
+            {
+                int i = 0;
+                for (const auto& listed : coins)
+                {
+                    if (ImGui::Selectable(listed.coinName.c_str(), i == chartCoin))
+                    {
+                        chartCoin = i;
+                    }
+                    ++i;
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120.0f);
+            if (ImGui::Combo("Range", &chartRange, rangeNames, IM_ARRAYSIZE(rangeNames)))
+            {
+                priceChart.setSpan(rangeMillis[chartRange]); // The mouse wheel zooms from there
+            }
+            ImGui::SameLine();
+            ImGui::RadioButton("Line", &chartStyle, 0);
+            ImGui::SameLine();
+            ImGui::RadioButton("Candles", &chartStyle, 1);
+            priceChart.setStyle(chartStyle == 0 ? ChartStyle::CS_Line : ChartStyle::CS_Candles);
+
+            priceChart.draw("##PriceChart", priceHistory, std::next(coins.begin(), chartCoin)->coinName, ImVec2(0.0f, 260.0f));
+        }
+
         ImGui::EndChild();
         ImGui::End();
     }
@@ -452,6 +510,7 @@ public:
         // Static variables to store the amount to add and the selected currency
         static float amountToAdd = 0.0f;
         static std::string selectedCurrency;
+        static CommandId depositCommand = 0; // ID of the deposit being entered (a second click is not a second deposit)
 
         // Loop through all available currencies and create a button for each
         for (auto& it : currency.currentCurrency)
@@ -471,25 +530,24 @@ public:
             ImGui::Text("Select amount to add in %s:", selectedCurrency.c_str());
             ImGui::SliderFloat(sliderLabel.c_str(), &amountToAdd, 0.0f, 1000.0f);
 
+            if (depositCommand == 0)
+            {
+                depositCommand = CommandWindow::newId();
+            }
+
             // If the "Confirm" button is clicked, add the amount to the wallet
             if (ImGui::Button("Confirm"))
             {
-                // Check if the currency exists in the user's balance
-                if (sqlData.valuteExists(user.userID, selectedCurrency, SQLData::DataBaseState::DBS_BALANCE))
+                // Record the deposit in the balance table and the journal in one step
+                if (ledger.deposit(selectedCurrency, FixedPoint::fromDouble(amountToAdd), depositCommand))
                 {
-                    // If exists, update the user's balance with the new amount
-                    float currentAmount = sqlData.getCurrentValuteAmount(user.userID, selectedCurrency, SQLData::DataBaseState::DBS_BALANCE);
-                    float updatedAmount = currentAmount + amountToAdd;
-                    sqlData.updateValuteAmount(user.userID, selectedCurrency, updatedAmount, SQLData::DataBaseState::DBS_BALANCE);
-                }
-                else
-                {
-                    // If currency doesn't exist, insert it with the added amount
-                    sqlData.insertValute(user.userID, selectedCurrency, amountToAdd, SQLData::DataBaseState::DBS_BALANCE);
+                    depositCommand = 0;
+
+                    // Log the amount added
+                    std::cout << "Added " << amountToAdd << " " << selectedCurrency << " to wallet" << std::endl;
                 }
 
-                // Log the amount added and reset the values
-                std::cout << "Added " << amountToAdd << " " << selectedCurrency << " to wallet" << std::endl;
+                // Reset the values
                 amountToAdd = 0.0f;
                 selectedCurrency.clear();
             }
@@ -524,6 +582,11 @@ public:
 
         // Variable to show error messages if needed
         static bool showErrorMsg = false;
+        static CommandId purchaseCommand = 0; // ID of the order on screen (kept until it goes through, so a retry is not a second order)
+
+        // One consistent copy of the live prices for the whole frame (never waits for the feed)
+        static PriceSnapshot snapshot;
+        marketData.readPrices(snapshot);
 
         // Loop through all available coins and create a button for each
         for (const auto& coin : coins)
@@ -551,61 +614,72 @@ public:
                 float& amountInDollars = coinQuantities[coin.coinName];
                 ImGui::SliderFloat(sliderLabel.c_str(), &amountInDollars, 1.0f, 100.0f);
 
-                // Calculate the amount of coins the user will receive based on the price
-                float coinsToReceive = amountInDollars / coin.prise;
+                // Calculate the amount of coins the user will receive at the best ask of the order book
+                double marketPrice = coin.prise;
+                snapshot.find(coin.coinName, marketPrice);
+                const OrderBook* book = exchange.book(coin.coinName);
+                float price = (book && book->bestAsk() > 0) ? static_cast<float>(FixedPoint::toDouble(book->bestAsk())) : static_cast<float>(marketPrice);
+                float coinsToReceive = amountInDollars / price;
 
                 // Show the price and the calculated amount of coins
-                ImGui::Text("Price: $%.2f for 1 %s", coin.prise, coin.coinName.c_str());
+                ImGui::Text("Market price: $%.2f (update %llu)", marketPrice, static_cast<unsigned long long>(snapshot.version));
+                ImGui::Text("Best ask: $%.2f for 1 %s", price, coin.coinName.c_str());
                 ImGui::Text("You will receive: %.6f %s", coinsToReceive, coin.coinName.c_str());
 
+                if (purchaseCommand == 0)
+                {
+                    purchaseCommand = CommandWindow::newId();
+                }
+
                 // If the "Confirm Purchase" button is clicked
                 if (ImGui::Button("Confirm Purchase"))
                 {
-                    // Check if the user has enough balance in USD
-                    if (sqlData.getCurrentValuteAmount(user.userID, "USD", SQLData::DataBaseState::DBS_BALANCE) > 0.0f)
+                    // Market order: USD is reserved, matched against the asks and settled through the journal
+                    OrderResult result = exchange.placeMarket(user.userID, coin.coinName, OrderSide::OS_Buy, FixedPoint::fromDouble(coinsToReceive), purchaseCommand);
+                    if (result.duplicate)
+                    {
+                        // The same order was already placed (e.g. a retry after a timeout)
+                        showErrorMsg = false;
+                        selectedCoinName.clear();
+                        purchaseCommand = 0;
+                    }
+                    else if (result.accepted && result.filled > 0)
+                    {
+                        // Clear the selected coin and log the purchase
+                        showErrorMsg = false;
+                        selectedCoinName.clear();
+                        purchaseCommand = 0;
+                        std::cout << "Purchased " << FixedPoint::toDouble(result.filled) << " of " << coin.coinName << std::endl;
+                    }
+                    else
+                    {
+                        // If not enough funds (or no sellers), show an error message
+                        showErrorMsg = true;
+                    }
+                }
+
+                // Recurring buy of the same dollar amount every day, starting now (at the market price of each run)
+                ImGui::SameLine();
+                if (ImGui::Button("Buy daily"))
+                {
+                    ScheduledTransfer dca;
+                    dca.kind = ScheduleKind::SK_Buy;
+                    dca.userID = user.userID;
+                    dca.asset = coin.coinName;
+                    dca.amount = FixedPoint::fromDouble(amountInDollars);
+                    dca.firstDueMillis = TransferScheduler::nowMillis();
+                    dca.intervalMillis = 24 * 60 * 60 * 1000LL;
+                    dca.runs = 0;
+                    if (scheduler.schedule(dca) != 0)
                     {
-                        // If enough balance, check if the user has sufficient funds
-                        if (sqlData.getCurrentValuteAmount(user.userID, "USD", SQLData::DataBaseState::DBS_BALANCE) >= amountInDollars)
-                        {
-                            // Check if the coin already exists in the user's wallet
-                            if (sqlData.valuteExists(user.userID, coin.coinName, SQLData::DataBaseState::DBS_COINS))
-                            {
-                                // If the coin exists, update the amount
-                                float currentAmount = sqlData.getCurrentValuteAmount(user.userID, coin.coinName, SQLData::DataBaseState::DBS_COINS);
-                                float newAmount = currentAmount + coinsToReceive;
-                                sqlData.updateValuteAmount(user.userID, coin.coinName, newAmount, SQLData::DataBaseState::DBS_COINS);
-
-                                // Deduct the amount from the user's USD balance
-                                float currenMoneyAmount = sqlData.getCurrentValuteAmount(user.userID, "USD", SQLData::DataBaseState::DBS_BALANCE);
-                                float newMoneyAmount = currenMoneyAmount - amountInDollars;
-                                sqlData.updateValuteAmount(user.userID, "USD", newMoneyAmount, SQLData::DataBaseState::DBS_BALANCE);
-                            }
-                            else
-                            {
-                                // If the coin doesn't exist, insert it into the user's wallet
-                                sqlData.insertValute(user.userID, selectedCoinName, coinsToReceive, SQLData::DataBaseState::DBS_COINS);
-
-                                // Deduct the amount from the user's USD balance
-                                float currenMoneyAmount = sqlData.getCurrentValuteAmount(user.userID, "USD", SQLData::DataBaseState::DBS_BALANCE);
-                                float newMoneyAmount = currenMoneyAmount - amountInDollars;
-                                sqlData.updateValuteAmount(user.userID, "USD", newMoneyAmount, SQLData::DataBaseState::DBS_BALANCE);
-                            }
-
-                            // Clear the selected coin and log the purchase
-                            selectedCoinName.clear();
-                            std::cout << "Purchased " << coinsToReceive << " of " << coin.coinName << std::endl;
-                        }
-                        else
-                        {
-                            // If not enough funds, show an error message
-                            showErrorMsg = true;
-                            if (showErrorMsg)
-                            {
-                                ImGui::TextColored(ImVec4(1, 0, 0, 1), "Not enough funds to complete the purchase.");
-                            }
-                        }
+                        std::cout << "Scheduled a daily buy of $" << amountInDollars << " of " << coin.coinName << std::endl;
                     }
                 }
+
+                if (showErrorMsg)
+                {
+                    ImGui::TextColored(ImVec4(1, 0, 0, 1), "Not enough funds to complete the purchase.");
+                }
             }
 
             ImGui::Separator();
@@ -687,15 +761,13 @@ public:
             // Withdraw button logic
             if (ImGui::Button("Withdraw"))
             {
-                // Check if the withdrawal amount is less than or equal to the available balance
-                if (amountToWithdraw <= selectedCoin.second)
+                // Reserve the coins now, so they are still there once the crypto account is entered
+                HoldId hold = ledger.placeHold(user.userID, selectedCoin.first, SQLData::DataBaseState::DBS_COINS,
+                    FixedPoint::fromDouble(amountToWithdraw), sendHoldMillis);
+                if (hold != 0)
                 {
-                    // Update the global amount after withdrawal
-                    float currentCount = selectedCoin.second;
-                    float newAmount = currentCount - amountToWithdraw;
-                    newGlobalAmount = newAmount;
-
                     // Set up the coin and amount for the transaction
+                    SEND_HOLD = hold;
                     SEND_AMOUNT = amountToWithdraw;
                     SEND_COIN_NAME = selectedCoin.first;
 
@@ -750,33 +822,39 @@ public:
         ImGui::Text("Sending: %.4f of %s", SEND_AMOUNT, SEND_COIN_NAME.c_str());
 
         // Send button logic
+        static CommandId sendCommand = 0; // ID of the transfer on screen (kept if it fails so a retry is the same command)
+        if (sendCommand == 0)
+        {
+            sendCommand = CommandWindow::newId();
+        }
         if (ImGui::Button("Send"))
         {
-            // Check if the entered crypto account exists in the database
-            if (sqlData.findUserID(cryptoAccount))
+            // Pay the held coins to the entered account in one journaled transaction
+            // (fails if the account does not exist or the hold expired and the coins went back to the user)
+            if (ledger.sendHold(SEND_HOLD, cryptoAccount, sendCommand))
             {
-                // Perform the transaction: send the coins to the specified account
-                sqlData.sendCoinsToUser(cryptoAccount, SEND_COIN_NAME, SEND_AMOUNT);
-
-                // Update the user's coin balance after sending the amount
-                sqlData.updateValuteAmount(user.userID, SEND_COIN_NAME, newGlobalAmount, SQLData::DataBaseState::DBS_COINS);
-
+                sendCommand = 0;
+                SEND_HOLD = 0;
                 // Log the transaction
                 std::cout << "Sent " << SEND_AMOUNT << " " << SEND_COIN_NAME << " to " << cryptoAccount << std::endl;
             }
             else
             {
-                // Inform the user if the crypto account is not found
-                std::cout << "User not found!" << std::endl;
+                // Inform the user if the transfer was rejected, and give the coins back
+                std::cout << "Transfer failed: user not found or the reservation expired!" << std::endl;
+                ledger.releaseHold(SEND_HOLD);
+                SEND_HOLD = 0;
             }
 
             // Return to the user view after the transaction
             CurrentState = MenuState::MS_UserView;
         }
 
-        // Cancel button to return to the user view without sending
+        // Cancel button to return to the user view without sending (the held coins go back)
         if (ImGui::Button("Cancel"))
         {
+            ledger.releaseHold(SEND_HOLD);
+            SEND_HOLD = 0;
             CurrentState = MenuState::MS_UserView; // Return to the user view
         }
 
@@ -800,13 +878,13 @@ public:
             CurrentState = MenuState::MS_UserView; // Transition to the user view state
         }
 
-        // Fetch the user's coins from the database
-        std::vector<std::pair<std::string, float>> userCoins = sqlData.getUserCoins(user.userID);
+        // Fetch the user's coins joined with their current prices
+        std::vector<CoinHolding> userCoins = sqlData.getUserCoinValues(user.userID);
 
-        // Loop through each coin and display it along with the amount
+        // Loop through each coin and display it along with the amount and its value
         for (const auto& coin : userCoins)
         {
-            ImGui::Text("%s - %.8f", coin.first.c_str(), coin.second); // Display coin name and its amount
+            ImGui::Text("%s - %.8f (%.2f USD)", coin.coinName.c_str(), coin.amount, coin.value); // Display coin name, amount and value
         }
 
         // End the child window and the main window
@@ -828,13 +906,121 @@ public:
             CurrentState = MenuState::MS_UserView; // Transition to the user view state
         }
 
+        // Currency the totals are shown in
+        static std::string totalCurrency = "USD";
+        ImGui::SetNextItemWidth(120.0f);
+        if (ImGui::BeginCombo("Show in", totalCurrency.c_str()))
+        {
+            for (const auto& moneyName : currency.currentCurrency)
+            {
+                if (ImGui::Selectable(moneyName.c_str(), moneyName == totalCurrency))
+                {
+                    totalCurrency = moneyName;
+                }
+            }
+            ImGui::EndCombo();
+        }
+
         // Fetch the user's balance from the database (wallet money)
         std::vector<std::pair<std::string, float>> walletMoney = sqlData.getUserBalance(user.userID);
 
-        // Loop through each item in the wallet and display it (e.g., balance and coin name)
+        // Convert every balance with one version of the rates
+        std::shared_ptr<const FxTable> published = marketData.fx().table();
+        const FxTable& rates = *published;
+        CurrencyId target = rates.find(totalCurrency);
+        std::vector<CurrencyId> moneyIds;
+        std::vector<double> moneyAmounts;
         for (const auto& money : walletMoney)
         {
-            ImGui::Text("%s - %.2f", money.first.c_str(), money.second); // Display balance and its value
+            CurrencyId id = rates.find(money.first);
+            moneyIds.push_back(id >= 0 ? id : 0);
+            moneyAmounts.push_back(id >= 0 ? money.second : 0.0); // Unknown currencies count as 0
+        }
+        std::vector<double> converted(walletMoney.size());
+        if (target >= 0)
+        {
+            FxRates::convertBatch(rates, moneyIds.data(), moneyAmounts.data(), moneyAmounts.size(), target, converted.data());
+        }
+
+        // Loop through each item in the wallet and display it (e.g., balance and coin name)
+        for (size_t i = 0; i < walletMoney.size(); ++i)
+        {
+            ImGui::Text("%s - %.2f  (%.2f %s)", walletMoney[i].first.c_str(), walletMoney[i].second, converted[i], totalCurrency.c_str());
+        }
+
+        // Total of the money, and of all coins and money computed inside SQLite
+        ImGui::Separator();
+        double moneyTotal = 0.0;
+        for (double value : converted)
+        {
+            moneyTotal += value;
+        }
+        ImGui::Text("Money: %.2f %s", moneyTotal, totalCurrency.c_str());
+        ImGui::Text("Total value: %.2f %s", sqlData.getWalletValuation(user.userID, totalCurrency), totalCurrency.c_str());
+
+        // End the child window and the main window
+        ImGui::EndChild();
+        ImGui::End();
+    }
+    void History()
+    {
+        // Keyset pagination state: the id of the last posting shown on each visited page
+        static std::vector<sqlite3_int64> pageStarts = { 0 };
+        const int pageSize = 20;
+
+        // Begin the ImGui window titled "History"
+        ImGui::Begin("History");
+        ImGui::SetWindowSize(ImVec2(windowWidth, windowHeight)); // Set the window size
+
+        // Begin a child window inside the main window
+        ImGui::BeginChild("ChildWindow", ImVec2(0, 0), true);
+
+        // Return button to go back to the user view
+        if (ImGui::Button("Return"))
+        {
+            pageStarts = { 0 };
+            CurrentState = MenuState::MS_UserView; // Transition to the user view state
+        }
+
+        // Fetch the current page of the user's postings, newest first
+        std::vector<PostingRecord> page = ledger.getHistory(pageStarts.back(), pageSize);
+
+        if (ImGui::BeginTable("HistoryTable", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("#");
+            ImGui::TableSetupColumn("Kind");
+            ImGui::TableSetupColumn("Asset");
+            ImGui::TableSetupColumn("Amount");
+            ImGui::TableHeadersRow();
+
+            for (const auto& record : page)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%lld", static_cast<long long>(record.txID));
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%s", record.kind.c_str());
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%s", record.asset.c_str());
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%+.8f", FixedPoint::toDouble(record.amount));
+            }
+
+            ImGui::EndTable();
+        }
+
+        // Page navigation
+        if (pageStarts.size() > 1 && ImGui::Button("Newer"))
+        {
+            pageStarts.pop_back();
+        }
+        if (static_cast<int>(page.size()) == pageSize)
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Older"))
+            {
+                pageStarts.push_back(page.back().id);
+            }
         }
 
         // End the child window and the main window
@@ -843,6 +1029,9 @@ public:
     }
     void SwitchFunc(char* password)
     {
+        // Holds whose time ran out give their coins back
+        ledger.expireHolds(TransferScheduler::nowMillis());
+
         // Switch statement to handle different menu states
         switch (CurrentState)
         {
@@ -887,6 +1076,9 @@ public:
         case MenuState::MS_UserWallet:
             UserWallet(); // Call UserWallet function if the state is MS_UserWallet
             break;
+        case MenuState::MS_History:
+            History(); // Call History function if the state is MS_History
+            break;
 
         case MenuState::MS_EnterCryptoAccount:
             EnterCryptoAccount(); // Call EnterCryptoAccount function if the state is MS_EnterCryptoAccount
@@ -900,7 +1092,7 @@ public:
 public:
     UI_Render()
         // Constructor for the UI_Render class
-        : ledger(user, sqlData, seedList, coin), seedList(12), CurrentState(MenuState::MS_Login)  // Initialize member variables and set the initial state
+        : ledger(user, sqlData, seedList, coin), exchange(ledger), priceFeed(marketData, &priceHistory), scheduler(ledger, sqlData), balanceHistory(sqlData), seedList(12), CurrentState(MenuState::MS_Login)  // Initialize member variables and set the initial state
     {
         // Adding some predefined coins with their respective values (this could be dynamic in a full implementation)
         coins.push_back(Coin("Bitcoin", 63250.0f));     // Bitcoin with a value of 63250.0
@@ -908,6 +1100,71 @@ public:
         coins.push_back(Coin("Dogecoin", 0.14f));       // Dogecoin with a value of 0.14
         coins.push_back(Coin("Litecoin", 85.0f));       // Litecoin with a value of 85.0
         coins.push_back(Coin("Cardano", 0.45f));        // Cardano with a value of 0.45
+
+        // Publish the prices and register the SQL valuation functions on the open database
+        marketData.publishPrices(coins);
+        sqlData.attachMarketData(marketData);
+
+        // Every supported currency gets its id up front (rates come from FX_RATES)
+        for (const auto& moneyName : currency.currentCurrency)
+        {
+            marketData.fx().intern(moneyName);
+        }
+
+        // Keep every balance in memory, the database is written in the background
+        ledger.enableBalanceEngine();
+
+        // Coins still held by a send that was open when the application stopped go back to their owners
+        ledger.releaseStaleHolds();
+
+        // So do the funds of orders that were resting in the (in-memory) books, the exchange's asks included
+        ledger.releaseStaleEscrow();
+
+        // Price history survives restarts in the history directory
+        priceHistory.open("history");
+
+        // Follow prices.feed when a feed process writes one, otherwise simulate the market
+        if (std::filesystem::exists("prices.feed"))
+        {
+            priceFeed.startFile("prices.feed");
+        }
+        else
+        {
+            priceFeed.startSimulated();
+        }
+
+        // One order book per coin (tick = 1/10000 of the price's order of magnitude, prices from half the
+        // list price up), seeded with a ladder of asks from the exchange account around the live price
+        PriceSnapshot livePrices;
+        marketData.readPrices(livePrices);
+        for (const auto& listed : coins)
+        {
+            Amount listPrice = FixedPoint::fromDouble(listed.prise);
+            Amount tick = std::max<Amount>(1, FixedPoint::fromDouble(std::pow(10.0, std::floor(std::log10(listed.prise))) / 10000.0));
+            Amount minPrice = listPrice / 2 / tick * tick;
+            exchange.addMarket(listed.coinName, tick, minPrice, 65536);
+
+            double livePrice = listed.prise;
+            livePrices.find(listed.coinName, livePrice);
+            Amount price = FixedPoint::fromDouble(livePrice);
+            for (int step = 0; step < 20; ++step)
+            {
+                Amount askPrice = (price + price * step / 1000) / tick * tick; // +0.1% per step (off the grid: not placed)
+                Amount quantity = 0;
+                FixedPoint::div(FixedPoint::fromDouble(1000.0), askPrice, quantity); // $1000 per level
+                exchange.placeLimit(Ledger::exchangeAccount, listed.coinName, OrderSide::OS_Sell, askPrice, quantity);
+            }
+        }
+
+        // Scheduled buys run at the live market price
+        scheduler.setPriceSource([this](const std::string& coinName, double& usdPerCoin)
+            {
+                thread_local PriceSnapshot prices;
+                marketData.readPrices(prices);
+                return prices.find(coinName, usdPerCoin);
+            });
+        scheduler.start();
+        balanceHistory.start();
     }
 
     void Update()
@@ -1053,8 +1310,162 @@ public:
     }
 };
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // Run a benchmark instead of the UI when started with: --bench <name>
+    if (argc > 2 && std::string(argv[1]) == "--bench")
+    {
+        return runBenchmark(argv[2]);
+    }
+
+    // Rebuild the balances from the journal and verify them with: --replay [database] [threads]
+    if (argc > 1 && std::string(argv[1]) == "--replay")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 2 ? argv[2] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        JournalReplay replay(argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 0);
+        ReplayReport report;
+        if (!replay.run(sqlData, report))
+        {
+            return 1;
+        }
+        JournalReplay::print(report);
+        return report.verified ? 0 : 2;
+    }
+
+    // Prove the balance tables against the journal and the supply of every asset with: --reconcile [database] [threads]
+    if (argc > 1 && std::string(argv[1]) == "--reconcile")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 2 ? argv[2] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        LedgerReconciler reconciler(argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 0);
+        ReconcileReport report;
+        if (!reconciler.run(sqlData, report))
+        {
+            return 1;
+        }
+        LedgerReconciler::print(report);
+        std::vector<DrillDownRow> rows;
+        for (size_t i = 0; i < report.discrepancySamples.size() && i < 3; ++i)
+        {
+            if (LedgerReconciler::drillDown(sqlData, report.discrepancySamples[i], rows))
+            {
+                LedgerReconciler::print(report.discrepancySamples[i], rows);
+            }
+        }
+        return report.reconciled ? 0 : 2;
+    }
+
+    // Balances of an account at a Unix time in milliseconds with: --balance-at user time [database]
+    if (argc > 3 && std::string(argv[1]) == "--balance-at")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 4 ? argv[4] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        BalanceHistory history(sqlData);
+        history.checkpoint(); // Catch the checkpoints up first, so the query reads at most one interval of postings
+        std::vector<AsOfBalance> balances;
+        AsOfInfo info;
+        if (!history.balancesAt(argv[2], std::atoll(argv[3]), balances, &info))
+        {
+            return 1;
+        }
+        std::cout << argv[2] << " at " << argv[3] << " (through transaction " << info.throughTxID << ", checkpoint "
+            << info.checkpointTxID << " + " << info.deltaPostings << " postings)\n" << std::fixed << std::setprecision(8);
+        for (const auto& balance : balances)
+        {
+            std::cout << "  " << balance.asset << " " << FixedPoint::toDouble(balance.amount) << "\n";
+        }
+        return 0;
+    }
+
+    // Statements of every account for [from, to) in Unix milliseconds with: --statements from to [csv|text] [directory] [database]
+    if (argc > 3 && std::string(argv[1]) == "--statements")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 6 ? argv[6] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        StatementJob job;
+        job.fromMillis = std::atoll(argv[2]);
+        job.toMillis = std::atoll(argv[3]);
+        job.format = argc > 4 && std::string(argv[4]) == "text" ? StatementFormat::SF_Text : StatementFormat::SF_Csv;
+        if (argc > 5)
+        {
+            job.directory = argv[5];
+        }
+        StatementGenerator generator(sqlData);
+        StatementReport report;
+        if (!generator.run(job, report))
+        {
+            return 1;
+        }
+        StatementGenerator::print(report);
+        return 0;
+    }
+
+    // Pay one period of interest or staking yield on a coin with: --accrue name coin annualRate [periodsPerYear] [database]
+    // (annualRate 0.05 = 5%; running a name again resumes it and never pays twice). The credits go through a ledger with
+    // its balance engine and integrity chain, like every other transaction; run it while the application is closed.
+    if (argc > 4 && std::string(argv[1]) == "--accrue")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 6 ? argv[6] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        AccrualJob job;
+        job.name = argv[2];
+        job.asset = argv[3];
+        job.annualRate = FixedPoint::fromDouble(std::atof(argv[4]));
+        if (argc > 5)
+        {
+            job.periodsPerYear = static_cast<uint32_t>(std::atoi(argv[5]));
+        }
+        User user;
+        SeedList seedList(12);
+        Coin coin;
+        Ledger ledger(user, sqlData, seedList, coin);
+        if (!ledger.enableBalanceEngine())
+        {
+            return 1;
+        }
+        InterestAccrual accrual(ledger, sqlData);
+        AccrualReport report;
+        if (!accrual.run(job, report))
+        {
+            return 1;
+        }
+        InterestAccrual::print(report);
+        return 0;
+    }
+
+    // Re-hash the journal against the integrity chain and the balances against its newest root with: --audit [database]
+    if (argc > 1 && std::string(argv[1]) == "--audit")
+    {
+        SQLData sqlData;
+        if (!sqlData.open(argc > 2 ? argv[2] : "MyLedgerData.db"))
+        {
+            return 1;
+        }
+        AuditReport report;
+        if (!LedgerAudit::verifyChain(sqlData, report))
+        {
+            return 1;
+        }
+        LedgerAudit::print(report);
+        return report.chainValid && report.tablesMatch ? 0 : 2;
+    }
+
     UI_Render ui;  // Create an instance of the UI_Render class
     ui.Update();   // Update the UI
 